@@ -1,4 +1,5 @@
 #include <Arduino.h>
+#include "esp32-hal-tinyusb.h"
 #include "motor_control.h"
 #include "movement_modes.h"
 #include "test_mode.h"
@@ -10,7 +11,10 @@ MovementMode currentMode = WANDER_MODE;
 
 void setup() {
   Serial.begin(115200);
-  delay(5000);
+  // Wait up to 5 s for a serial monitor, but only if a USB host enumerated us
+  while (!Serial && millis() < 5000 && (tud_mounted() || millis() < 1000)) {
+    delay(10);
+  }
   
   Serial.println("\n\n");
   Serial.println("************************");
@@ -147,7 +151,7 @@ void runWanderMode() {
       break;
       
     case 3: // Sharp left curve
-      leftSpeed = baseSpeed - speedDiff*1.5;
+      leftSpeed = baseSpeed - speedDiff * 3 / 2;
       rightSpeed = baseSpeed;
       Serial.print("Wander: Sharp left curve (L:");
       Serial.print(leftSpeed);
@@ -159,7 +163,7 @@ void runWanderMode() {
       
     case 4: // Sharp right curve
       leftSpeed = baseSpeed;
-      rightSpeed = baseSpeed - speedDiff*1.5;
+      rightSpeed = baseSpeed - speedDiff * 3 / 2;
       Serial.print("Wander: Sharp right curve (L:");
       Serial.print(leftSpeed);
       Serial.print(", R:");
@@ -199,7 +203,7 @@ void runWanderMode() {
 // Rotate mode - slow rotation around its own axis
 void runRotateMode() {
   // Slow rotation speed (30% of max speed)
-  int rotationSpeed = MAX_SPEED * 0.3;
+  int rotationSpeed = MAX_SPEED * 3 / 10;
   
   // Choose a random rotation direction, but change it less frequently
   static int rotationDirection = 0;
@@ -1,3 +1,5 @@
+#include <Arduino.h>
+#include <driver/ledc.h>
 #include "motor_control.h"
 
 // DRV8833 Motor Driver Pins for ESP32-CAM
@@ -21,6 +23,82 @@ const int PWM_CHANNEL_AIN1 = 0; // PWM channel for AIN1
 const int PWM_CHANNEL_AIN2 = 1; // PWM channel for AIN2
 const int PWM_CHANNEL_BIN1 = 2; // PWM channel for BIN1
 const int PWM_CHANNEL_BIN2 = 3; // PWM channel for BIN2
+const int PWM_FULL_ON = 1 << RESOLUTION; // Duty that holds an input high
+
+// Decay mode per motor. Fast decay drives one input with PWM and holds the
+// other low, so the bridge coasts between pulses. Slow decay holds one
+// input high and drives the other with inverted PWM, so it brakes between
+// pulses instead: steadier current and better low-speed control.
+const bool SLOW_DECAY_A = false;
+const bool SLOW_DECAY_B = false;
+
+// Output frame: the motor functions stage all four channel duties here,
+// then commitFrame() loads the changed ones and latches them together, so
+// both bridges change on the same PWM period boundary and a channel that
+// is already right is not written again
+#define NUM_CHANNELS 4
+static uint32_t stagedDuty[NUM_CHANNELS] = {0, 0, 0, 0};
+static uint32_t committedDuty[NUM_CHANNELS] = {0, 0, 0, 0};
+
+static void commitFrame() {
+  static portMUX_TYPE latchMux = portMUX_INITIALIZER_UNLOCKED;
+  uint8_t changedMask = 0;
+  for (int channel = 0; channel < NUM_CHANNELS; channel++) {
+    if (stagedDuty[channel] != committedDuty[channel]) {
+      ledc_set_duty(LEDC_LOW_SPEED_MODE, (ledc_channel_t)channel, stagedDuty[channel]);
+      committedDuty[channel] = stagedDuty[channel];
+      changedMask |= 1 << channel;
+    }
+  }
+
+  // Set every update bit inside one critical section so they all land
+  // before the same timer overflow
+  portENTER_CRITICAL(&latchMux);
+  for (int channel = 0; channel < NUM_CHANNELS; channel++) {
+    if (changedMask & (1 << channel)) {
+      ledc_update_duty(LEDC_LOW_SPEED_MODE, (ledc_channel_t)channel);
+    }
+  }
+  portEXIT_CRITICAL(&latchMux);
+}
+
+// Stages one H-bridge. DRV8833 truth table: IN1/IN2 = 1/0 forward,
+// 0/1 backward, 0/0 coast, 1/1 brake. A speed gives the same drive time
+// per period in either decay mode.
+static void stageBridge(int channelIn1, int channelIn2, int speed, bool forward, bool slowDecay) {
+  int pwmInput = forward ? channelIn1 : channelIn2;
+  int otherInput = forward ? channelIn2 : channelIn1;
+  
+  if (speed == 0) {
+    // Stopped: coast, as stopMotors() does
+    stagedDuty[channelIn1] = 0;
+    stagedDuty[channelIn2] = 0;
+  } else if (slowDecay) {
+    // Direction input high, the other low for the drive part of the period
+    stagedDuty[pwmInput] = PWM_FULL_ON;
+    stagedDuty[otherInput] = PWM_FULL_ON - speed;
+  } else {
+    stagedDuty[pwmInput] = speed;
+    stagedDuty[otherInput] = 0;
+  }
+}
+
+static void stageMotorA(int speed, bool forward) {
+  // Forward: PWM on AIN1; backward: PWM on AIN2
+  stageBridge(PWM_CHANNEL_AIN1, PWM_CHANNEL_AIN2, constrain(speed, MIN_SPEED, MAX_SPEED), forward, SLOW_DECAY_A);
+}
+
+static void stageMotorB(int speed, bool forward) {
+  // Forward: PWM on BIN1; backward: PWM on BIN2
+  stageBridge(PWM_CHANNEL_BIN1, PWM_CHANNEL_BIN2, constrain(speed, MIN_SPEED, MAX_SPEED), forward, SLOW_DECAY_B);
+}
+
+// Sets all four channels, for stopping and braking
+static void stageAll(uint32_t duty) {
+  for (int channel = 0; channel < NUM_CHANNELS; channel++) {
+    stagedDuty[channel] = duty;
+  }
+}
 
 void setupMotors() {
   // Configure PWM for all motor control pins
@@ -35,7 +113,15 @@ void setupMotors() {
   ledcAttachPin(BIN1, PWM_CHANNEL_BIN1);
   ledcAttachPin(BIN2, PWM_CHANNEL_BIN2);
   
-  // Initially stop the motors
+  // The core puts channels 2/3 on their own timer. Run all four from
+  // timer 0 so a committed frame takes effect on one period boundary.
+  ledc_bind_channel_timer(LEDC_LOW_SPEED_MODE, (ledc_channel_t)PWM_CHANNEL_BIN1, (ledc_timer_t)0);
+  ledc_bind_channel_timer(LEDC_LOW_SPEED_MODE, (ledc_channel_t)PWM_CHANNEL_BIN2, (ledc_timer_t)0);
+  
+  // Initially stop the motors, writing every channel whatever it held
+  for (int channel = 0; channel < NUM_CHANNELS; channel++) {
+    committedDuty[channel] = PWM_FULL_ON + 1;
+  }
   stopMotors();
   
   Serial.println("Motor control initialized with DRV8833 driver (v2)");
@@ -43,86 +129,76 @@ void setupMotors() {
 
 // Function to set motor A (left) speed and direction
 void setMotorA(int speed, bool forward) {
-  // Constrain speed to valid range
-  speed = constrain(speed, MIN_SPEED, MAX_SPEED);
-  
-  if (forward) {
-    // Forward: PWM on AIN1, 0 on AIN2
-    ledcWrite(PWM_CHANNEL_AIN1, speed);
-    ledcWrite(PWM_CHANNEL_AIN2, 0);
-  } else {
-    // Backward: 0 on AIN1, PWM on AIN2
-    ledcWrite(PWM_CHANNEL_AIN1, 0);
-    ledcWrite(PWM_CHANNEL_AIN2, speed);
-  }
+  stageMotorA(speed, forward);
+  commitFrame();
 }
 
 // Function to set motor B (right) speed and direction
 void setMotorB(int speed, bool forward) {
-  // Constrain speed to valid range
-  speed = constrain(speed, MIN_SPEED, MAX_SPEED);
-  
-  if (forward) {
-    // Forward: PWM on BIN1, 0 on BIN2
-    ledcWrite(PWM_CHANNEL_BIN1, speed);
-    ledcWrite(PWM_CHANNEL_BIN2, 0);
-  } else {
-    // Backward: 0 on BIN1, PWM on BIN2
-    ledcWrite(PWM_CHANNEL_BIN1, 0);
-    ledcWrite(PWM_CHANNEL_BIN2, speed);
-  }
+  stageMotorB(speed, forward);
+  commitFrame();
 }
 
 // Function to move the robot forward
 void moveForward(int speed) {
   // Set both motors to forward direction with the same speed
-  setMotorA(speed, true);
-  setMotorB(speed, true);
+  stageMotorA(speed, true);
+  stageMotorB(speed, true);
+  commitFrame();
 }
 
 // Function to move the robot backward
 void moveBackward(int speed) {
   // Set both motors to backward direction with the same speed
-  setMotorA(speed, false);
-  setMotorB(speed, false);
+  stageMotorA(speed, false);
+  stageMotorB(speed, false);
+  commitFrame();
 }
 
 // Function to turn the robot left
 void turnLeft(int speed) {
   // Rotate left by moving right motor forward and left motor backward
-  setMotorA(speed, false);
-  setMotorB(speed, true);
+  stageMotorA(speed, false);
+  stageMotorB(speed, true);
+  commitFrame();
 }
 
 // Function to turn the robot right
 void turnRight(int speed) {
   // Rotate right by moving left motor forward and right motor backward
-  setMotorA(speed, true);
-  setMotorB(speed, false);
+  stageMotorA(speed, true);
+  stageMotorB(speed, false);
+  commitFrame();
 }
 
 // Function to stop the motors
 void stopMotors() {
   // Using brake mode (both pins LOW for coast or both HIGH for brake)
   // We'll use coast mode (both LOW) for smoother stops
-  ledcWrite(PWM_CHANNEL_AIN1, 0);
-  ledcWrite(PWM_CHANNEL_AIN2, 0);
-  ledcWrite(PWM_CHANNEL_BIN1, 0);
-  ledcWrite(PWM_CHANNEL_BIN2, 0);
+  stageAll(0);
+  commitFrame();
+}
+
+// Function to stop the motors and hold them (both inputs HIGH)
+void brakeMotors() {
+  stageAll(PWM_FULL_ON);
+  commitFrame();
 }
 
 // NEW FUNCTIONS FOR DIFFERENTIAL STEERING
 
 // Function to curve left (both motors forward, but right faster than left)
 void curveLeft(int leftSpeed, int rightSpeed) {
-  setMotorA(leftSpeed, true);   // Left motor
-  setMotorB(rightSpeed, true);  // Right motor
+  stageMotorA(leftSpeed, true);   // Left motor
+  stageMotorB(rightSpeed, true);  // Right motor
+  commitFrame();
 }
 
 // Function to curve right (both motors forward, but left faster than right)
 void curveRight(int leftSpeed, int rightSpeed) {
-  setMotorA(leftSpeed, true);   // Left motor
-  setMotorB(rightSpeed, true);  // Right motor
+  stageMotorA(leftSpeed, true);   // Left motor
+  stageMotorB(rightSpeed, true);  // Right motor
+  commitFrame();
 }
 
 // Function to move with different speeds for each wheel
@@ -137,6 +213,7 @@ void moveDifferential(int leftSpeed, int rightSpeed) {
   int absRightSpeed = abs(rightSpeed);
   
   // Set motors
-  setMotorA(absLeftSpeed, leftForward);
-  setMotorB(absRightSpeed, rightForward);
+  stageMotorA(absLeftSpeed, leftForward);
+  stageMotorB(absRightSpeed, rightForward);
+  commitFrame();
 } 
\ No newline at end of file
@@ -4,7 +4,7 @@
 // Rotate mode - slow rotation around its own axis
 void runRotateMode() {
   // Slow rotation speed (30% of max speed)
-  int rotationSpeed = MAX_SPEED * 0.3;
+  int rotationSpeed = MAX_SPEED * 3 / 10;
   
   // Choose a random rotation direction, but change it less frequently
   static int rotationDirection = 0;
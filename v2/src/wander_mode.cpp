@@ -45,7 +45,7 @@ void runWanderMode() {
       break;
       
     case 3: // Sharp left curve
-      leftSpeed = baseSpeed - speedDiff*1.5;
+      leftSpeed = baseSpeed - speedDiff * 3 / 2;
       rightSpeed = baseSpeed;
       Serial.print("Wander: Sharp left curve (L:");
       Serial.print(leftSpeed);
@@ -57,7 +57,7 @@ void runWanderMode() {
       
     case 4: // Sharp right curve
       leftSpeed = baseSpeed;
-      rightSpeed = baseSpeed - speedDiff*1.5;
+      rightSpeed = baseSpeed - speedDiff * 3 / 2;
       Serial.print("Wander: Sharp right curve (L:");
       Serial.print(leftSpeed);
       Serial.print(", R:");
@@ -1,4 +1,5 @@
 #include <Arduino.h>
+#include "esp32-hal-tinyusb.h"
 #include "motor_control.h"
 
 #define LED_PIN 15  // Onboard LED pin
@@ -17,7 +18,10 @@ void setup() {
   pinMode(LED_PIN, OUTPUT);
   
   Serial.begin(115200);
-  delay(5000);  // Give time to open serial monitor
+  // Wait for the serial monitor only when plugged into a USB host, not a powerbank
+  while (!Serial && millis() < 5000 && (tud_mounted() || millis() < 1000)) {
+    delay(10);
+  }
   
   Serial.println("\n\n");
   Serial.println("************************");
@@ -0,0 +1,82 @@
+#include "fault_monitor.h"
+
+static FaultState state = FAULT_STATE_OK;
+static FaultStats stats = {0, 0, 0, 0};
+static unsigned long faultStartUs = 0;
+static unsigned long lastRecoveryUs = 0;
+static unsigned long retryAtUs = 0;
+static unsigned long backoffMs = FAULT_BACKOFF_BASE_MS;
+static bool recoveredOnce = false;
+
+void faultInit(bool asserted, unsigned long nowUs) {
+  stats = {0, 0, 0, 0};
+  backoffMs = FAULT_BACKOFF_BASE_MS;
+  recoveredOnce = false;
+  state = FAULT_STATE_OK;
+  if (asserted) {
+    faultOnEvent({nowUs, true});
+  }
+}
+
+// Applies one edge of the fault line. Repeated edges in the same direction
+// (a glitch shorter than the ISR latency) are ignored.
+void faultOnEvent(const FaultEvent& event) {
+  if (event.asserted) {
+    if (state == FAULT_STATE_ACTIVE) {
+      return;
+    }
+
+    // A fault during the backoff, or soon after the last recovery, means
+    // the cause is still there - wait longer next time
+    if (state == FAULT_STATE_BACKOFF ||
+        (recoveredOnce && event.timeUs - lastRecoveryUs < FAULT_STABLE_MS * 1000UL)) {
+      backoffMs = backoffMs * 2 > FAULT_BACKOFF_MAX_MS ? FAULT_BACKOFF_MAX_MS : backoffMs * 2;
+    } else {
+      backoffMs = FAULT_BACKOFF_BASE_MS;
+    }
+
+    stats.count++;
+    faultStartUs = event.timeUs;
+    state = FAULT_STATE_ACTIVE;
+  } else {
+    if (state != FAULT_STATE_ACTIVE) {
+      return;
+    }
+
+    unsigned long durationUs = event.timeUs - faultStartUs;
+    stats.totalUs += durationUs;
+    if (durationUs > stats.longestUs) {
+      stats.longestUs = durationUs;
+    }
+
+    retryAtUs = event.timeUs + backoffMs * 1000UL;
+    state = FAULT_STATE_BACKOFF;
+  }
+}
+
+// Returns true once, when the backoff has passed and the outputs may be
+// re-enabled
+bool faultUpdate(unsigned long nowUs) {
+  if (state != FAULT_STATE_BACKOFF || (long)(nowUs - retryAtUs) < 0) {
+    return false;
+  }
+
+  stats.recoveries++;
+  lastRecoveryUs = nowUs;
+  recoveredOnce = true;
+  state = FAULT_STATE_OK;
+  return true;
+}
+
+FaultState faultGetState() {
+  return state;
+}
+
+// Backoff for the current (or next) fault
+unsigned long faultGetBackoffMs() {
+  return backoffMs;
+}
+
+const FaultStats& faultGetStats() {
+  return stats;
+}
@@ -0,0 +1,42 @@
+#ifndef FAULT_MONITOR_H
+#define FAULT_MONITOR_H
+
+// DRV8833 nFAULT recovery state machine and fault statistics.
+//
+// Fed with timestamped edges of the fault line (queued by the GPIO ISR in
+// motor_control.cpp). After the line releases, the outputs stay off for a
+// backoff that doubles with each fault that follows the last recovery
+// within FAULT_STABLE_MS. Like the ramp engine it has no hardware
+// dependencies: the caller passes the current time to faultUpdate().
+
+#define FAULT_BACKOFF_BASE_MS 100    // Wait after the first fault clears (ms)
+#define FAULT_BACKOFF_MAX_MS 10000   // Longest backoff (ms)
+#define FAULT_STABLE_MS 10000        // Fault-free running that resets the backoff (ms)
+
+enum FaultState {
+  FAULT_STATE_OK,        // Outputs enabled
+  FAULT_STATE_ACTIVE,    // nFAULT asserted, outputs off
+  FAULT_STATE_BACKOFF    // nFAULT released, waiting before re-enabling
+};
+
+// One edge of the fault line
+struct FaultEvent {
+  unsigned long timeUs;
+  bool asserted;
+};
+
+struct FaultStats {
+  unsigned long count;       // Faults seen
+  unsigned long totalUs;     // Time nFAULT was asserted, finished faults only
+  unsigned long longestUs;   // Longest single fault
+  unsigned long recoveries;  // Times the outputs were re-enabled
+};
+
+void faultInit(bool asserted, unsigned long nowUs);
+void faultOnEvent(const FaultEvent& event);
+bool faultUpdate(unsigned long nowUs);
+FaultState faultGetState();
+unsigned long faultGetBackoffMs();
+const FaultStats& faultGetStats();
+
+#endif // FAULT_MONITOR_H
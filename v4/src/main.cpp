@@ -1,4 +1,5 @@
 #include <Arduino.h>
+#include "esp32-hal-tinyusb.h"
 #include "motor_control.h"
 
 #define LED_PIN 15  // Onboard LED pin
@@ -17,7 +18,10 @@ void setup() {
   pinMode(LED_PIN, OUTPUT);
   
   Serial.begin(115200);
-  delay(5000);  // Give time to open serial monitor
+  // Wait up to 5 s for a serial monitor, skipped within 1 s on a powerbank
+  while (!Serial && millis() < 5000 && (tud_mounted() || millis() < 1000)) {
+    delay(10);
+  }
   
   Serial.println("\n\n");
   Serial.println("************************");
@@ -33,7 +37,59 @@ void setup() {
   Serial.println("Starting organic movement sequence...");
 }
 
-void loop() {
+// Movement sequence state
+enum SequenceState {
+  STATE_START_MOVEMENT,  // Pick and start the next movement
+  STATE_MOVING,          // Holding the movement until moveEndTime
+  STATE_STOPPING,        // Ramping down to a stop
+  STATE_GAP              // Short random delay between movements
+};
+
+SequenceState sequenceState = STATE_START_MOVEMENT;
+unsigned long stateEndTime = 0;
+
+#ifdef LOOP_BENCHMARK
+// Loop period: the time from one loop() entry to the next, which takes in
+// anything that blocks, such as a Serial.print waiting on USB. Build the
+// loop_benchmark env, and loop_benchmark_logged for the per-write motor
+// prints, to compare the two.
+#define LOOP_BENCHMARK_REPORT_MS 10000
+static unsigned long loopLastStart = 0;
+static unsigned long loopPeriods = 0;
+static unsigned long loopTotalUs = 0;
+static unsigned long loopLongestUs = 0;
+static unsigned long loopReportTime = 0;
+
+static void recordLoopPeriod() {
+  unsigned long now = micros();
+  if (loopLastStart != 0) {
+    unsigned long period = now - loopLastStart;
+    loopPeriods++;
+    loopTotalUs += period;
+    if (period > loopLongestUs) {
+      loopLongestUs = period;
+    }
+  }
+  loopLastStart = now;
+
+  if ((long)(millis() - loopReportTime) >= LOOP_BENCHMARK_REPORT_MS && loopPeriods != 0) {
+    Serial.print("Loop period: mean ");
+    Serial.print(loopTotalUs / loopPeriods);
+    Serial.print(" us, longest ");
+    Serial.print(loopLongestUs);
+    Serial.print(" us over ");
+    Serial.print(loopPeriods);
+    Serial.println(" loops");
+    loopPeriods = 0;
+    loopTotalUs = 0;
+    loopLongestUs = 0;
+    loopReportTime = millis();
+    loopLastStart = 0;    // The report's own prints don't count
+  }
+}
+#endif
+
+void startRandomMovement() {
   // Get a random movement type
   MovementType movement = getRandomMovement();
   int speed = getRandomSpeed();
@@ -45,37 +101,69 @@ void loop() {
     case FORWARD:
       Serial.println("Moving forward");
       moveForward(speed);
-      delay(moveTime);
       break;
       
     case BACKWARD:
       Serial.println("Moving backward");
       moveBackward(speed);
-      delay(moveTime);
       break;
       
     case CURVE_LEFT:
       Serial.println("Curving left");
       curveLeft(speed);
-      delay(moveTime);
       break;
       
     case CURVE_RIGHT:
       Serial.println("Curving right");
       curveRight(speed);
-      delay(moveTime);
       break;
       
     case PAUSE:
       Serial.println("Pausing");
       stopMotors();
-      delay(pauseTime);
+      moveTime = pauseTime;
       break;
   }
   
-  // Always stop between movements
-  stopMotors();
+  stateEndTime = millis() + moveTime;
+}
+
+void loop() {
+#ifdef LOOP_BENCHMARK
+  recordLoopPeriod();
+#endif
+
+  // Keep the speed ramp running - never blocks
+  updateMotors();
+  
+  unsigned long currentTime = millis();
   
-  // Add a small random delay between movements
-  delay(random(500, 1500));
-} 
\ No newline at end of file
+  switch (sequenceState) {
+    case STATE_START_MOVEMENT:
+      startRandomMovement();
+      sequenceState = STATE_MOVING;
+      break;
+      
+    case STATE_MOVING:
+      if ((long)(currentTime - stateEndTime) >= 0) {
+        // Always stop between movements
+        stopMotors();
+        sequenceState = STATE_STOPPING;
+      }
+      break;
+      
+    case STATE_STOPPING:
+      if (motorsAtTarget()) {
+        // Add a small random delay between movements
+        stateEndTime = currentTime + random(500, 1500);
+        sequenceState = STATE_GAP;
+      }
+      break;
+      
+    case STATE_GAP:
+      if ((long)(currentTime - stateEndTime) >= 0) {
+        sequenceState = STATE_START_MOVEMENT;
+      }
+      break;
+  }
+}
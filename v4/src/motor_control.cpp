@@ -1,9 +1,76 @@
 #include <Arduino.h>
+#include "freertos/queue.h"
+#include "esp_rom_gpio.h"
+#include "soc/gpio_sig_map.h"
+#include "soc/gpio_struct.h"
 #include "motor_control.h"
+#include "motor_ramp.h"
+#include "fault_monitor.h"
 
 // PWM configuration
 const int PWM_FREQ = 1000;  // 1kHz
 const int PWM_RESOLUTION = 8;  // 8-bit resolution (0-255)
+const int PWM_FULL_ON = 1 << PWM_RESOLUTION;  // LEDC duty that holds the output high
+
+// Decay mode per motor, and what a stopped motor does
+static DecayMode motorDecay[2] = {DECAY_FAST, DECAY_FAST};
+static StopMode stopMode = STOP_COAST;
+
+// Last duty written to each LEDC channel
+static int appliedDuty[RAMP_NUM_CHANNELS] = {0, 0, 0, 0};
+
+// Motor pins in LEDC channel order, and as a mask for the GPIO registers
+static const int motorPins[RAMP_NUM_CHANNELS] = {MOTOR_A_IN1, MOTOR_A_IN2, MOTOR_B_IN1, MOTOR_B_IN2};
+#define MOTOR_PIN_MASK ((1UL << MOTOR_A_IN1) | (1UL << MOTOR_A_IN2) | (1UL << MOTOR_B_IN1) | (1UL << MOTOR_B_IN2))
+
+// Fault line edges, from the ISR to updateMotors()
+#define FAULT_QUEUE_LENGTH 16
+static QueueHandle_t faultQueue = NULL;
+static volatile unsigned long faultEventsDropped = 0;
+static unsigned long faultEventsDroppedSeen = 0;
+
+// Takes the motor pins away from LEDC and drives them low, so both
+// H-bridges coast. Runs from IRAM and touches only registers and ROM code;
+// the pins are spelt out rather than read from motorPins[], which is in
+// flash. The ISR is attached without ESP_INTR_FLAG_IRAM, though, so while
+// the flash cache is off for a flash write, a fault waits until it is back.
+static void IRAM_ATTR disconnectMotorPins() {
+  GPIO.out_w1tc = MOTOR_PIN_MASK;
+  esp_rom_gpio_connect_out_signal(MOTOR_A_IN1, SIG_GPIO_OUT_IDX, false, false);
+  esp_rom_gpio_connect_out_signal(MOTOR_A_IN2, SIG_GPIO_OUT_IDX, false, false);
+  esp_rom_gpio_connect_out_signal(MOTOR_B_IN1, SIG_GPIO_OUT_IDX, false, false);
+  esp_rom_gpio_connect_out_signal(MOTOR_B_IN2, SIG_GPIO_OUT_IDX, false, false);
+}
+
+// A fault that asserts part way through has already run the ISR, so check
+// the line again afterwards rather than leave some pins reconnected
+static void reconnectMotorPins() {
+  for (int channel = 0; channel < RAMP_NUM_CHANNELS; channel++) {
+    ledcAttachPin(motorPins[channel], channel);
+  }
+  if (!digitalRead(FAULT_PIN)) {
+    disconnectMotorPins();
+  }
+}
+
+// nFAULT edge: the outputs go off here, within microseconds of the driver
+// asserting the fault, and the recovery runs later from updateMotors()
+static void IRAM_ATTR onFaultEdge() {
+  FaultEvent event;
+  event.timeUs = micros();
+  event.asserted = !((GPIO.in >> FAULT_PIN) & 1);
+  if (event.asserted) {
+    disconnectMotorPins();
+  }
+
+  BaseType_t woken = pdFALSE;
+  if (xQueueSendFromISR(faultQueue, &event, &woken) != pdTRUE) {
+    faultEventsDropped++;
+  }
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
 
 void setupMotors() {
   Serial.println("Setting up motors...");
@@ -14,17 +81,26 @@ void setupMotors() {
   ledcSetup(2, PWM_FREQ, PWM_RESOLUTION);  // Channel 2 for Motor B IN1
   ledcSetup(3, PWM_FREQ, PWM_RESOLUTION);  // Channel 3 for Motor B IN2
   
-  // Attach PWM channels to pins
-  ledcAttachPin(MOTOR_A_IN1, 0);
-  ledcAttachPin(MOTOR_A_IN2, 1);
-  ledcAttachPin(MOTOR_B_IN1, 2);
-  ledcAttachPin(MOTOR_B_IN2, 3);
-  
-  // Set fault pin as input with pullup
+  // Set fault pin as input with pullup (nFAULT is open-drain, active low)
   pinMode(FAULT_PIN, INPUT_PULLUP);
   
+  // Attach PWM channels to pins
+  reconnectMotorPins();
+  
   // Initialize motors in stopped state
-  stopMotors();
+  for (int channel = 0; channel < RAMP_NUM_CHANNELS; channel++) {
+    ledcWrite(channel, 0);
+  }
+  rampInit(millis());
+  
+  // Watch both edges of the fault pin. A fault that is already asserted
+  // has no edge, so start the monitor from the pin.
+  faultQueue = xQueueCreate(FAULT_QUEUE_LENGTH, sizeof(FaultEvent));
+  faultInit(!digitalRead(FAULT_PIN), micros());
+  if (faultGetState() != FAULT_STATE_OK) {
+    disconnectMotorPins();
+  }
+  attachInterrupt(FAULT_PIN, onFaultEdge, CHANGE);
   
   // Seed random number generator
   randomSeed(analogRead(0));
@@ -33,117 +109,155 @@ void setupMotors() {
   printFaultStatus();
 }
 
+// True while the outputs are off for a fault (asserted or backing off)
 bool checkFault() {
-  return !digitalRead(FAULT_PIN);
+  return faultGetState() != FAULT_STATE_OK;
 }
 
 void printFaultStatus() {
-  if (checkFault()) {
+  if (faultGetState() == FAULT_STATE_ACTIVE) {
     Serial.println("WARNING: DRV8833 is in fault condition!");
     Serial.println("Possible causes:");
     Serial.println("1. Overcurrent protection triggered");
     Serial.println("2. Overtemperature protection triggered");
     Serial.println("3. Undervoltage lockout");
     Serial.println("4. Short circuit detected");
+  } else if (faultGetState() == FAULT_STATE_BACKOFF) {
+    Serial.print("DRV8833 fault cleared - motors off for ");
+    Serial.print(faultGetBackoffMs());
+    Serial.println(" ms backoff");
   } else {
     Serial.println("DRV8833 status: Normal");
   }
+  
+  const FaultStats& stats = faultGetStats();
+  Serial.print("Faults: ");
+  Serial.print(stats.count);
+  Serial.print(", total ");
+  Serial.print(stats.totalUs);
+  Serial.print(" us, longest ");
+  Serial.print(stats.longestUs);
+  Serial.print(" us, recoveries ");
+  Serial.println(stats.recoveries);
 }
 
+// Called from updateMotors() on every ramp tick, so it doesn't print:
+// under USB-CDC back-pressure four prints per tick stall the loop. Build
+// with -DMOTOR_LOG_WRITES to trace the writes anyway.
 void setMotorSpeed(int channel, int speed) {
   ledcWrite(channel, speed);
+#ifdef MOTOR_LOG_WRITES
   Serial.print("Channel ");
   Serial.print(channel);
   Serial.print(" speed: ");
   Serial.println(speed);
+#endif
+}
+
+// LEDC duty for one channel at the current ramp speed, in the motor's
+// decay and stop modes (see rampGetDriveDuty())
+static int channelDuty(int channel) {
+  return rampGetDriveDuty(channel, motorDecay[channel / 2], stopMode, PWM_FULL_ON);
 }
 
-void rampSpeed(int startSpeed, int endSpeed, int duration) {
-  int stepDelay = duration / RAMP_STEPS;
-  int speedStep = (endSpeed - startSpeed) / RAMP_STEPS;
-  
-  for (int i = 0; i < RAMP_STEPS; i++) {
-    int currentSpeed = startSpeed + (speedStep * i);
-    setMotorSpeed(0, currentSpeed);
-    setMotorSpeed(2, currentSpeed);
-    delay(stepDelay);
-    
-    if (checkFault()) {
-      Serial.println("Fault detected during speed ramping!");
-      printFaultStatus();
-      stopMotors();
-      delay(1000);
-      return;
+// Writes the current ramp output to any LEDC channel whose duty changed
+static void applyRampOutput() {
+  for (int channel = 0; channel < RAMP_NUM_CHANNELS; channel++) {
+    int duty = channelDuty(channel);
+    if (duty != appliedDuty[channel]) {
+      setMotorSpeed(channel, duty);
+      appliedDuty[channel] = duty;
     }
   }
 }
 
-void moveForward(int speed) {
-  Serial.print("Moving forward at speed: ");
-  Serial.println(speed);
-  
-  if (checkFault()) {
-    Serial.println("Cannot move forward - fault detected!");
-    printFaultStatus();
+// Applies one queued edge of the fault line
+static void handleFaultEvent(const FaultEvent& event) {
+  FaultState previous = faultGetState();
+  faultOnEvent(event);
+  FaultState state = faultGetState();
+  if (state == previous) {
     return;
   }
+
+  if (state == FAULT_STATE_ACTIVE) {
+    // The ISR already cut the outputs; drop the ramp so they come back at
+    // zero, coasting
+    rampHalt();
+    stopMode = STOP_COAST;
+    applyRampOutput();
+  }
+  printFaultStatus();
+}
+
+// Handles fault events and advances the speed ramp; call from loop() as
+// often as possible
+void updateMotors() {
+  FaultEvent event;
+  while (xQueueReceive(faultQueue, &event, 0) == pdTRUE) {
+    handleFaultEvent(event);
+  }
   
-  // Ramp up to speed
-  rampSpeed(0, speed, RAMP_DELAY * RAMP_STEPS);
-  
-  // Motor A forward
-  setMotorSpeed(0, speed);  // IN1
-  setMotorSpeed(1, 0);      // IN2
+  // If the queue overflowed an edge may be missing - resync from the pin
+  if (faultEventsDropped != faultEventsDroppedSeen) {
+    faultEventsDroppedSeen = faultEventsDropped;
+    Serial.println("Fault events dropped - resyncing from nFAULT");
+    handleFaultEvent({micros(), !digitalRead(FAULT_PIN)});
+  }
   
-  // Motor B forward
-  setMotorSpeed(2, speed);  // IN1
-  setMotorSpeed(3, 0);      // IN2
+  if (faultUpdate(micros())) {
+    Serial.println("Backoff over - re-enabling motors");
+    reconnectMotorPins();
+  }
   
-  if (checkFault()) {
-    Serial.println("Fault detected after setting forward speed!");
-    printFaultStatus();
-    stopMotors();
+  if (!rampUpdate(millis())) {
+    return;
   }
+
+  applyRampOutput();
 }
 
-void moveBackward(int speed) {
-  Serial.print("Moving backward at speed: ");
-  Serial.println(speed);
-  
+bool motorsAtTarget() {
+  return rampIsComplete();
+}
+
+void setMotorsCompleteCallback(RampCompleteCallback callback) {
+  rampSetCompleteCallback(callback);
+}
+
+// Starts a ramp towards the given signed speeds (positive = forward)
+static void driveMotors(int speedA, int speedB, const char* action) {
   if (checkFault()) {
-    Serial.println("Cannot move backward - fault detected!");
+    Serial.print("Cannot ");
+    Serial.print(action);
+    Serial.println(" - fault detected!");
     printFaultStatus();
     return;
   }
+
+  // Don't brake at the zero crossing of a reversal
+  stopMode = STOP_COAST;
+  rampSetTarget(speedA, speedB);
+}
+
+void moveForward(int speed) {
+  Serial.print("Moving forward at speed: ");
+  Serial.println(speed);
   
-  // Ramp up to speed
-  rampSpeed(0, speed, RAMP_DELAY * RAMP_STEPS);
-  
-  // Motor A backward
-  setMotorSpeed(0, 0);      // IN1
-  setMotorSpeed(1, speed);  // IN2
-  
-  // Motor B backward
-  setMotorSpeed(2, 0);      // IN1
-  setMotorSpeed(3, speed);  // IN2
+  driveMotors(speed, speed, "move forward");
+}
+
+void moveBackward(int speed) {
+  Serial.print("Moving backward at speed: ");
+  Serial.println(speed);
   
-  if (checkFault()) {
-    Serial.println("Fault detected after setting backward speed!");
-    printFaultStatus();
-    stopMotors();
-  }
+  driveMotors(-speed, -speed, "move backward");
 }
 
 void curveLeft(int baseSpeed) {
   Serial.print("Curving left at base speed: ");
   Serial.println(baseSpeed);
   
-  if (checkFault()) {
-    Serial.println("Cannot curve left - fault detected!");
-    printFaultStatus();
-    return;
-  }
-  
   int leftSpeed = max(baseSpeed - CURVE_SPEED_DIFF, MIN_SPEED);
   int rightSpeed = min(baseSpeed + CURVE_SPEED_DIFF, MAX_SPEED);
   
@@ -152,34 +266,14 @@ void curveLeft(int baseSpeed) {
   Serial.print(", Right motor speed: ");
   Serial.println(rightSpeed);
   
-  // Ramp up to speed
-  rampSpeed(0, baseSpeed, RAMP_DELAY * RAMP_STEPS);
-  
-  // Motor A forward (left)
-  setMotorSpeed(0, leftSpeed);  // IN1
-  setMotorSpeed(1, 0);          // IN2
-  
-  // Motor B forward (right)
-  setMotorSpeed(2, rightSpeed); // IN1
-  setMotorSpeed(3, 0);          // IN2
-  
-  if (checkFault()) {
-    Serial.println("Fault detected after setting curve left speed!");
-    printFaultStatus();
-    stopMotors();
-  }
+  // Motor A is left, Motor B is right
+  driveMotors(leftSpeed, rightSpeed, "curve left");
 }
 
 void curveRight(int baseSpeed) {
   Serial.print("Curving right at base speed: ");
   Serial.println(baseSpeed);
   
-  if (checkFault()) {
-    Serial.println("Cannot curve right - fault detected!");
-    printFaultStatus();
-    return;
-  }
-  
   int leftSpeed = min(baseSpeed + CURVE_SPEED_DIFF, MAX_SPEED);
   int rightSpeed = max(baseSpeed - CURVE_SPEED_DIFF, MIN_SPEED);
   
@@ -188,40 +282,26 @@ void curveRight(int baseSpeed) {
   Serial.print(", Right motor speed: ");
   Serial.println(rightSpeed);
   
-  // Ramp up to speed
-  rampSpeed(0, baseSpeed, RAMP_DELAY * RAMP_STEPS);
-  
-  // Motor A forward (left)
-  setMotorSpeed(0, leftSpeed);  // IN1
-  setMotorSpeed(1, 0);          // IN2
-  
-  // Motor B forward (right)
-  setMotorSpeed(2, rightSpeed); // IN1
-  setMotorSpeed(3, 0);          // IN2
-  
-  if (checkFault()) {
-    Serial.println("Fault detected after setting curve right speed!");
-    printFaultStatus();
-    stopMotors();
-  }
+  // Motor A is left, Motor B is right
+  driveMotors(leftSpeed, rightSpeed, "curve right");
 }
 
-void stopMotors() {
-  Serial.println("Stopping motors");
-  
-  // Ramp down to stop
-  rampSpeed(ledcRead(0), 0, RAMP_DELAY * RAMP_STEPS);
-  
-  // Stop both motors
-  setMotorSpeed(0, 0);
-  setMotorSpeed(1, 0);
-  setMotorSpeed(2, 0);
-  setMotorSpeed(3, 0);
-  
-  if (checkFault()) {
-    Serial.println("Fault detected after stopping motors!");
-    printFaultStatus();
-  }
+void stopMotors(StopMode mode) {
+  Serial.print("Stopping motors (");
+  Serial.print(mode == STOP_BRAKE ? "brake" : "coast");
+  Serial.println(")");
+  
+  // Ramp down to stop (the ramp continues from the current speed). Apply
+  // now too, in case the motors are already at zero.
+  stopMode = mode;
+  rampSetTarget(0, 0);
+  applyRampOutput();
+}
+
+// Takes effect at once; with the outputs at zero it changes nothing
+void setMotorDecay(int motor, DecayMode mode) {
+  motorDecay[motor] = mode;
+  applyRampOutput();
 }
 
 int getRandomSpeed() {
@@ -21,6 +21,18 @@
 #define MIN_PAUSE_TIME 3000  // Minimum pause time between movements (ms)
 #define MAX_PAUSE_TIME 8000  // Maximum pause time between movements (ms)
 
+// H-bridge decay mode, per motor (DRV8833: IN1/IN2 = 1/1 brakes, 0/0 coasts)
+enum DecayMode {
+  DECAY_FAST,   // PWM on one input, other input low - coast between pulses
+  DECAY_SLOW    // One input high, inverted PWM on the other - brake between pulses
+};
+
+// What a motor does once stopMotors() has ramped it to zero
+enum StopMode {
+  STOP_COAST,   // Both inputs low
+  STOP_BRAKE    // Both inputs high - the wheel is held
+};
+
 // Movement types
 enum MovementType {
   FORWARD,
@@ -36,8 +48,11 @@ void moveForward(int speed);
 void moveBackward(int speed);
 void curveLeft(int baseSpeed);
 void curveRight(int baseSpeed);
-void stopMotors();
-void rampSpeed(int startSpeed, int endSpeed, int duration);
+void stopMotors(StopMode mode = STOP_COAST);
+void setMotorDecay(int motor, DecayMode mode);
+void updateMotors();
+bool motorsAtTarget();
+void setMotorsCompleteCallback(void (*callback)());
 int getRandomSpeed();
 int getRandomTime(int minTime, int maxTime);
 MovementType getRandomMovement();
@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include "motor_ramp.h"
+
+// No Arduino.h (constrain, max), so the engine builds on the host too
+static int clampSpeed(int speed) {
+  return speed < -255 ? -255 : (speed > 255 ? 255 : speed);
+}
+
+// Ramp state per motor (signed speeds)
+static int currentSpeed[2] = {0, 0};
+static int targetSpeed[2] = {0, 0};
+static int stepSize[2] = {1, 1};
+static unsigned long lastTick = 0;
+static bool complete = true;
+static RampCompleteCallback completeCallback = nullptr;
+
+void rampInit(unsigned long now) {
+  for (int m = 0; m < 2; m++) {
+    currentSpeed[m] = 0;
+    targetSpeed[m] = 0;
+    stepSize[m] = 1;
+  }
+  lastTick = now;
+  complete = true;
+}
+
+void rampSetTarget(int speedA, int speedB) {
+  int speeds[2] = {speedA, speedB};
+
+  for (int m = 0; m < 2; m++) {
+    targetSpeed[m] = clampSpeed(speeds[m]);
+
+    // Continue from wherever the motor is now, so a new target mid-ramp
+    // does not restart from zero. Both motors arrive after RAMP_TICKS.
+    int distance = abs(targetSpeed[m] - currentSpeed[m]);
+    stepSize[m] = distance > RAMP_TICKS ? (distance + RAMP_TICKS - 1) / RAMP_TICKS : 1;
+  }
+
+  complete = (currentSpeed[0] == targetSpeed[0] && currentSpeed[1] == targetSpeed[1]);
+}
+
+// Advances the ramp by however many ticks have elapsed since the last call.
+// Returns true if any motor speed changed.
+bool rampUpdate(unsigned long now) {
+  unsigned long elapsed = now - lastTick;
+  if (elapsed < RAMP_TICK_MS) {
+    return false;
+  }
+
+  unsigned long ticks = elapsed / RAMP_TICK_MS;
+  lastTick += ticks * RAMP_TICK_MS;
+
+  if (complete) {
+    return false;
+  }
+
+  bool changed = false;
+  for (int m = 0; m < 2; m++) {
+    int diff = targetSpeed[m] - currentSpeed[m];
+    if (diff == 0) {
+      continue;
+    }
+
+    long maxMove = (long)stepSize[m] * ticks;
+    if (abs(diff) <= maxMove) {
+      currentSpeed[m] = targetSpeed[m];
+    } else {
+      currentSpeed[m] += (diff > 0) ? maxMove : -maxMove;
+    }
+    changed = true;
+  }
+
+  if (currentSpeed[0] == targetSpeed[0] && currentSpeed[1] == targetSpeed[1]) {
+    complete = true;
+    if (completeCallback != nullptr) {
+      completeCallback();
+    }
+  }
+
+  return changed;
+}
+
+// Drops both motors to zero immediately (used on faults)
+void rampHalt() {
+  for (int m = 0; m < 2; m++) {
+    currentSpeed[m] = 0;
+    targetSpeed[m] = 0;
+  }
+  complete = true;
+}
+
+bool rampIsComplete() {
+  return complete;
+}
+
+int rampGetSpeed(int motor) {
+  return currentSpeed[motor];
+}
+
+int rampGetTarget(int motor) {
+  return targetSpeed[motor];
+}
+
+// Maps the signed motor speeds onto the four LEDC channels
+// (0: A IN1, 1: A IN2, 2: B IN1, 3: B IN2)
+int rampGetChannelDuty(int channel) {
+  int speed = currentSpeed[channel / 2];
+  if (channel % 2 == 0) {
+    return speed > 0 ? speed : 0;
+  }
+  return speed < 0 ? -speed : 0;
+}
+
+// LEDC duty for one channel at the current speed, in a decay mode. In slow
+// decay the direction's input is held high and the other is low for the
+// drive part of each period, so a speed gives the same drive time in both
+// modes. A stopped motor gets the stop mode. fullOn is the duty that holds
+// an output high for the whole period.
+int rampGetDriveDuty(int channel, DecayMode decay, StopMode stop, int fullOn) {
+  int speed = currentSpeed[channel / 2];
+  if (speed == 0) {
+    return stop == STOP_BRAKE ? fullOn : 0;
+  }
+  if (decay == DECAY_FAST) {
+    return rampGetChannelDuty(channel);
+  }
+  bool directionInput = (channel % 2 == 0) == (speed > 0);
+  return directionInput ? fullOn : fullOn - abs(speed);
+}
+
+void rampSetCompleteCallback(RampCompleteCallback callback) {
+  completeCallback = callback;
+}
@@ -0,0 +1,34 @@
+#ifndef MOTOR_RAMP_H
+#define MOTOR_RAMP_H
+
+#include "motor_control.h"
+
+// Non-blocking speed ramp for both motors.
+//
+// Speeds are signed per motor (positive = forward, negative = backward) so a
+// reversal always passes through zero instead of driving IN1 and IN2 at the
+// same time. The engine has no hardware dependencies: the caller passes the
+// current time to rampUpdate() and applies rampGetDriveDuty() to LEDC.
+
+#define RAMP_TICK_MS 10                                    // Ramp tick period (ms)
+#define RAMP_TICKS ((RAMP_STEPS * RAMP_DELAY) / RAMP_TICK_MS)  // Ticks for a full ramp
+
+#define RAMP_MOTOR_A 0
+#define RAMP_MOTOR_B 1
+#define RAMP_NUM_CHANNELS 4
+
+// Called once when both motors reach their targets
+typedef void (*RampCompleteCallback)();
+
+void rampInit(unsigned long now);
+void rampSetTarget(int speedA, int speedB);
+bool rampUpdate(unsigned long now);
+void rampHalt();
+bool rampIsComplete();
+int rampGetSpeed(int motor);
+int rampGetTarget(int motor);
+int rampGetChannelDuty(int channel);
+int rampGetDriveDuty(int channel, DecayMode decay, StopMode stop, int fullOn);
+void rampSetCompleteCallback(RampCompleteCallback callback);
+
+#endif // MOTOR_RAMP_H
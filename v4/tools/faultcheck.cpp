@@ -0,0 +1,209 @@
+// Host check for the v4 nFAULT recovery state machine (src/fault_monitor.cpp).
+//
+// Feeds faultOnEvent() and faultUpdate() timed sequences of fault line
+// edges, as the ISR would queue them. It checks that the outputs come
+// back exactly one backoff after the line releases, and only once. The
+// backoff must double for each fault that follows a recovery within
+// FAULT_STABLE_MS or arrives during the backoff, up to
+// FAULT_BACKOFF_MAX_MS, and drop back to FAULT_BACKOFF_BASE_MS after
+// FAULT_STABLE_MS of clean running. Repeated edges must be ignored.
+// Throughout, count, totalUs, longestUs and recoveries must match a tally
+// kept here. Each sequence runs from boot and again across a wrap of the
+// microsecond clock.
+//
+//   g++ -std=gnu++17 -O2 -Isrc -o faultcheck tools/faultcheck.cpp src/fault_monitor.cpp
+//   ./faultcheck
+//
+// Exits non-zero if any check fails.
+
+#include <stdio.h>
+#include <stdint.h>
+#include "fault_monitor.h"
+
+static unsigned long failures = 0;
+
+static void check(bool ok, const char* what, unsigned long step) {
+  if (!ok && failures++ < 20) {
+    printf("FAIL %s (step %lu)\n", what, step);
+  }
+}
+
+static uint32_t randomState = 1;
+
+// xorshift32: fast, and the same sequence everywhere for a given seed
+static uint32_t nextRandom() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+// What the stats should say, tallied from the sequence fed in
+struct Tally {
+  unsigned long count;
+  unsigned long totalUs;
+  unsigned long longestUs;
+  unsigned long recoveries;
+};
+
+static Tally tally;
+static unsigned long nowUs;
+static unsigned long step;
+
+static void checkStats() {
+  const FaultStats& stats = faultGetStats();
+  check(stats.count == tally.count, "count", step);
+  check(stats.totalUs == tally.totalUs, "totalUs", step);
+  check(stats.longestUs == tally.longestUs, "longestUs", step);
+  check(stats.recoveries == tally.recoveries, "recoveries", step);
+}
+
+static void start(unsigned long startUs) {
+  nowUs = startUs;
+  step = 0;
+  tally = {0, 0, 0, 0};
+  faultInit(false, nowUs);
+}
+
+// One fault: asserted for durationUs, then the backoff waited out. Checks
+// the backoff it was given, that nothing recovers early, and that the
+// recovery is reported once.
+static void fault(unsigned long durationUs, unsigned long expectedBackoffMs) {
+  step++;
+  faultOnEvent({nowUs, true});
+  tally.count++;
+  check(faultGetState() == FAULT_STATE_ACTIVE, "asserted edge sets ACTIVE", step);
+  check(faultGetBackoffMs() == expectedBackoffMs, "backoff", step);
+  if (faultGetBackoffMs() != expectedBackoffMs && failures <= 20) {
+    printf("     backoff %lu ms, expected %lu ms\n", faultGetBackoffMs(), expectedBackoffMs);
+  }
+
+  // A glitch the ISR saw twice changes nothing
+  faultOnEvent({nowUs + durationUs / 2, true});
+  check(!faultUpdate(nowUs + durationUs / 2), "recovered while asserted", step);
+
+  nowUs += durationUs;
+  faultOnEvent({nowUs, false});
+  tally.totalUs += durationUs;
+  if (durationUs > tally.longestUs) {
+    tally.longestUs = durationUs;
+  }
+  check(faultGetState() == FAULT_STATE_BACKOFF, "released edge sets BACKOFF", step);
+  faultOnEvent({nowUs + 1, false});
+  checkStats();
+
+  unsigned long backoffUs = faultGetBackoffMs() * 1000UL;
+  check(!faultUpdate(nowUs + backoffUs - 1), "recovered before the backoff ended", step);
+  nowUs += backoffUs;
+  check(faultUpdate(nowUs), "no recovery at the end of the backoff", step);
+  tally.recoveries++;
+  check(!faultUpdate(nowUs + 1), "recovery reported twice", step);
+  check(faultGetState() == FAULT_STATE_OK, "recovered state", step);
+  checkStats();
+}
+
+// Back-to-back faults, each within FAULT_STABLE_MS of the last recovery:
+// the backoff doubles up to its cap, then stays there
+static void checkDoubling(unsigned long startUs) {
+  start(startUs);
+  unsigned long expected = FAULT_BACKOFF_BASE_MS;
+  int capped = 0;
+  while (capped < 3) {
+    fault(500 + nextRandom() % 20000, expected);
+    nowUs += (nextRandom() % FAULT_STABLE_MS) * 1000UL;       // Under FAULT_STABLE_MS
+    capped += expected == FAULT_BACKOFF_MAX_MS;
+    expected = expected * 2 > FAULT_BACKOFF_MAX_MS ? FAULT_BACKOFF_MAX_MS : expected * 2;
+  }
+  printf("Doubling: %lu faults, backoff capped at %lu ms\n", tally.count, faultGetBackoffMs());
+}
+
+// FAULT_STABLE_MS after the last recovery the next fault starts over; a
+// microsecond short of it, the backoff still doubles
+static void checkReset(unsigned long startUs) {
+  start(startUs);
+  fault(1000, FAULT_BACKOFF_BASE_MS);
+  nowUs += 5000;
+  fault(1000, FAULT_BACKOFF_BASE_MS * 2);
+  nowUs += FAULT_STABLE_MS * 1000UL - 1;
+  fault(1000, FAULT_BACKOFF_BASE_MS * 4);
+  nowUs += FAULT_STABLE_MS * 1000UL;
+  fault(1000, FAULT_BACKOFF_BASE_MS);
+  nowUs += 3 * FAULT_STABLE_MS * 1000UL;
+  fault(1000, FAULT_BACKOFF_BASE_MS);
+  printf("Reset: backoff back to %d ms after %d ms stable\n", FAULT_BACKOFF_BASE_MS, FAULT_STABLE_MS);
+}
+
+// A fault during the backoff doubles it and holds the outputs off
+static void checkFaultInBackoff(unsigned long startUs) {
+  start(startUs);
+  step++;
+  faultOnEvent({nowUs, true});
+  tally.count++;
+  nowUs += 2000;
+  faultOnEvent({nowUs, false});
+  tally.totalUs += 2000;
+  tally.longestUs = 2000;
+
+  nowUs += FAULT_BACKOFF_BASE_MS * 1000UL / 2;
+  faultOnEvent({nowUs, true});
+  tally.count++;
+  check(faultGetState() == FAULT_STATE_ACTIVE, "fault in the backoff sets ACTIVE", step);
+  check(faultGetBackoffMs() == FAULT_BACKOFF_BASE_MS * 2, "fault in the backoff doubles it", step);
+  check(!faultUpdate(nowUs + FAULT_BACKOFF_BASE_MS * 1000UL), "old backoff recovered the outputs", step);
+  checkStats();
+
+  nowUs += 7000;
+  faultOnEvent({nowUs, false});
+  tally.totalUs += 7000;
+  tally.longestUs = 7000;
+  checkStats();
+  check(!faultUpdate(nowUs + FAULT_BACKOFF_BASE_MS * 2000UL - 1), "recovered early after a backoff fault", step);
+  nowUs += FAULT_BACKOFF_BASE_MS * 2000UL;
+  check(faultUpdate(nowUs), "no recovery after a backoff fault", step);
+  tally.recoveries++;
+  checkStats();
+
+  // A release with nothing asserted, and faultInit() with the line held
+  faultOnEvent({nowUs + 10, false});
+  checkStats();
+  faultInit(true, nowUs);
+  check(faultGetState() == FAULT_STATE_ACTIVE && faultGetStats().count == 1 &&
+            faultGetBackoffMs() == FAULT_BACKOFF_BASE_MS,
+        "init with the line asserted", step);
+  printf("Backoff fault: doubles the backoff and holds the outputs off\n");
+}
+
+// Random runs of faults and gaps, long and short, against the tally
+static void checkRandom(unsigned long startUs) {
+  start(startUs);
+  unsigned long expected = FAULT_BACKOFF_BASE_MS;
+  for (int i = 0; i < 10000; i++) {
+    fault(1 + nextRandom() % 300000, expected);
+    unsigned long gapMs = nextRandom() % 2 ? nextRandom() % FAULT_STABLE_MS
+                                           : FAULT_STABLE_MS + nextRandom() % 60000;
+    nowUs += gapMs * 1000UL + nextRandom() % 1000;
+    bool stable = gapMs >= FAULT_STABLE_MS;
+    expected = stable ? FAULT_BACKOFF_BASE_MS
+                      : (expected * 2 > FAULT_BACKOFF_MAX_MS ? FAULT_BACKOFF_MAX_MS : expected * 2);
+  }
+  printf("Random: %lu faults, %lu recoveries, longest %lu us\n", tally.count, tally.recoveries,
+         tally.longestUs);
+}
+
+int main() {
+  // From boot, and from just before the microsecond clock wraps
+  static const unsigned long starts[] = {0, 0UL - 30000000UL};
+  for (unsigned long startUs : starts) {
+    checkDoubling(startUs);
+    checkReset(startUs);
+    checkFaultInBackoff(startUs);
+    checkRandom(startUs);
+  }
+
+  if (failures != 0) {
+    printf("FAILED: %lu checks\n", failures);
+    return 1;
+  }
+  printf("ALL PASSED\n");
+  return 0;
+}
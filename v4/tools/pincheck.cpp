@@ -0,0 +1,119 @@
+// Host check of the v4 H-bridge input duties (rampGetDriveDuty() in
+// src/motor_ramp.cpp, which motor_control.cpp writes to LEDC).
+//
+// For every speed from -255 to 255 in fast and slow decay, and for a
+// stopped motor set to coast or to brake, it plays one PWM period of the
+// two input duties through the DRV8833 truth table (IN1/IN2: 10 forward,
+// 01 reverse, 11 brake, 00 coast). The motor must drive the right way for
+// |speed| counts and never the wrong way. For the rest of the period it
+// must coast in fast decay and brake in slow decay. A stopped motor must
+// spend the whole period in its stop mode.
+//
+//   g++ -std=gnu++17 -O2 -Isrc -o pincheck tools/pincheck.cpp src/motor_ramp.cpp
+//   ./pincheck
+//
+// Exits non-zero if any check fails.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "motor_ramp.h"
+
+#define CHECK_FULL_ON 256          // PWM_FULL_ON in motor_control.cpp: 8-bit LEDC
+
+enum BridgeState { BRIDGE_COAST, BRIDGE_FORWARD, BRIDGE_REVERSE, BRIDGE_BRAKE, BRIDGE_STATES };
+
+static const char* const DECAY_NAMES[] = {"fast", "slow"};
+static const char* const STOP_NAMES[] = {"coast", "brake"};
+
+static unsigned long failures = 0;
+
+// Counts per PWM period spent in each bridge state: an LEDC output is high
+// for the first duty counts of the period
+static void playPeriod(int in1Duty, int in2Duty, int* counts) {
+  for (int state = 0; state < BRIDGE_STATES; state++) {
+    counts[state] = 0;
+  }
+  for (int count = 0; count < CHECK_FULL_ON; count++) {
+    bool in1 = count < in1Duty;
+    bool in2 = count < in2Duty;
+    counts[in1 ? (in2 ? BRIDGE_BRAKE : BRIDGE_FORWARD) : (in2 ? BRIDGE_REVERSE : BRIDGE_COAST)]++;
+  }
+}
+
+// Ramps motor A to the speed at once (the ramp catches up in one update)
+static void setSpeed(int speed) {
+  rampInit(0);
+  rampSetTarget(speed, 0);
+  rampUpdate(1000000);
+}
+
+static void checkMotor(int speed, DecayMode decay, StopMode stop) {
+  setSpeed(speed);
+  int in1 = rampGetDriveDuty(0, decay, stop, CHECK_FULL_ON);
+  int in2 = rampGetDriveDuty(1, decay, stop, CHECK_FULL_ON);
+  int counts[BRIDGE_STATES];
+  playPeriod(in1, in2, counts);
+
+  int expected[BRIDGE_STATES] = {0, 0, 0, 0};
+  int magnitude = abs(speed);
+  if (speed == 0) {
+    expected[stop == STOP_BRAKE ? BRIDGE_BRAKE : BRIDGE_COAST] = CHECK_FULL_ON;
+  } else {
+    expected[speed > 0 ? BRIDGE_FORWARD : BRIDGE_REVERSE] = magnitude;
+    expected[decay == DECAY_SLOW ? BRIDGE_BRAKE : BRIDGE_COAST] = CHECK_FULL_ON - magnitude;
+  }
+
+  bool ok = in1 >= 0 && in1 <= CHECK_FULL_ON && in2 >= 0 && in2 <= CHECK_FULL_ON;
+  for (int state = 0; state < BRIDGE_STATES; state++) {
+    ok = ok && counts[state] == expected[state];
+  }
+  if (!ok && failures++ < 20) {
+    printf("FAIL speed %d, %s decay, stop %s: IN1 %d IN2 %d -> coast %d fwd %d rev %d brake %d\n", speed,
+           DECAY_NAMES[decay], STOP_NAMES[stop], in1, in2, counts[BRIDGE_COAST], counts[BRIDGE_FORWARD],
+           counts[BRIDGE_REVERSE], counts[BRIDGE_BRAKE]);
+  }
+}
+
+int main() {
+  unsigned long cases = 0;
+  for (int decay = DECAY_FAST; decay <= DECAY_SLOW; decay++) {
+    for (int stop = STOP_COAST; stop <= STOP_BRAKE; stop++) {
+      for (int speed = -255; speed <= 255; speed++) {
+        checkMotor(speed, (DecayMode)decay, (StopMode)stop);
+        cases++;
+      }
+    }
+  }
+  printf("Truth table: %lu speed x decay x stop cases\n", cases);
+
+  // A few rows written out, as the DRV8833 datasheet gives them
+  struct Row { int speed; DecayMode decay; StopMode stop; int in1; int in2; };
+  static const Row rows[] = {
+    {100, DECAY_FAST, STOP_COAST, 100, 0},
+    {-100, DECAY_FAST, STOP_COAST, 0, 100},
+    {100, DECAY_SLOW, STOP_COAST, CHECK_FULL_ON, CHECK_FULL_ON - 100},
+    {-100, DECAY_SLOW, STOP_COAST, CHECK_FULL_ON - 100, CHECK_FULL_ON},
+    {0, DECAY_FAST, STOP_COAST, 0, 0},
+    {0, DECAY_SLOW, STOP_BRAKE, CHECK_FULL_ON, CHECK_FULL_ON},
+  };
+  for (const Row& row : rows) {
+    setSpeed(row.speed);
+    int in1 = rampGetDriveDuty(0, row.decay, row.stop, CHECK_FULL_ON);
+    int in2 = rampGetDriveDuty(1, row.decay, row.stop, CHECK_FULL_ON);
+    // Motor B is stopped throughout, so it is in its stop mode
+    int stopDuty = row.stop == STOP_BRAKE ? CHECK_FULL_ON : 0;
+    if (in1 != row.in1 || in2 != row.in2 || rampGetDriveDuty(2, row.decay, row.stop, CHECK_FULL_ON) != stopDuty ||
+        rampGetDriveDuty(3, row.decay, row.stop, CHECK_FULL_ON) != stopDuty) {
+      printf("FAIL row speed %d, %s decay, stop %s: IN1 %d IN2 %d, expected %d %d\n", row.speed,
+             DECAY_NAMES[row.decay], STOP_NAMES[row.stop], in1, in2, row.in1, row.in2);
+      failures++;
+    }
+  }
+
+  if (failures != 0) {
+    printf("FAILED: %lu checks\n", failures);
+    return 1;
+  }
+  printf("ALL PASSED\n");
+  return 0;
+}
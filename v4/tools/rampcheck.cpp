@@ -0,0 +1,221 @@
+// Host check for the v4 speed ramp (src/motor_ramp.cpp).
+//
+// Drives the ramp engine from a simulated clock. It checks a plain
+// ramp, a new target mid-ramp (the ramp carries on from the current
+// speed and still takes RAMP_TICKS), and a reversal (it passes through
+// zero and never drives both inputs of a motor). It checks catch-up: one
+// rampUpdate() after several ticks, or at times off the tick grid, lands
+// where the tick-by-tick ramp does. It also checks that the completion
+// callback fires once per ramp, never on a halt, and that all of this
+// holds across a wrap of the millisecond clock.
+//
+//   g++ -std=gnu++17 -O2 -Isrc -o rampcheck tools/rampcheck.cpp src/motor_ramp.cpp
+//   ./rampcheck
+//
+// Exits non-zero if any check fails.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "motor_ramp.h"
+
+static unsigned long failures = 0;
+static int callbacks = 0;
+
+static void check(bool ok, const char* what, unsigned long tick) {
+  if (!ok && failures++ < 20) {
+    printf("FAIL %s (tick %lu)\n", what, tick);
+  }
+}
+
+static void onComplete() {
+  callbacks++;
+}
+
+// Both inputs of a motor driven at once would short the H-bridge leg
+static void checkChannels(unsigned long tick) {
+  for (int motor = 0; motor < 2; motor++) {
+    int in1 = rampGetChannelDuty(motor * 2);
+    int in2 = rampGetChannelDuty(motor * 2 + 1);
+    check(in1 == 0 || in2 == 0, "both inputs driven", tick);
+    check(in1 - in2 == rampGetSpeed(motor), "channel duties don't match the speed", tick);
+  }
+}
+
+// Ticks one at a time until the ramp completes; returns the ticks taken
+static unsigned long runToTarget(unsigned long& now, unsigned long limit) {
+  for (unsigned long tick = 1; tick <= limit; tick++) {
+    int before[2] = {rampGetSpeed(RAMP_MOTOR_A), rampGetSpeed(RAMP_MOTOR_B)};
+    now += RAMP_TICK_MS;
+    rampUpdate(now);
+    checkChannels(tick);
+    for (int motor = 0; motor < 2; motor++) {
+      // Never overshoots: each step moves towards the target, or stays there
+      int target = rampGetTarget(motor);
+      int speed = rampGetSpeed(motor);
+      check(abs(target - speed) <= abs(target - before[motor]), "moved away from the target", tick);
+    }
+    if (rampIsComplete()) {
+      return tick;
+    }
+  }
+  return limit + 1;
+}
+
+static void checkPlainRamp(unsigned long start) {
+  unsigned long now = start;
+  rampInit(now);
+  callbacks = 0;
+  rampSetTarget(200, -120);
+  check(!rampIsComplete(), "complete before the ramp ran", 0);
+  unsigned long ticks = runToTarget(now, 2 * RAMP_TICKS);
+  check(ticks <= RAMP_TICKS, "plain ramp took longer than RAMP_TICKS", ticks);
+  check(rampGetSpeed(RAMP_MOTOR_A) == 200 && rampGetSpeed(RAMP_MOTOR_B) == -120, "plain ramp target", ticks);
+  check(callbacks == 1, "callback count after a ramp", ticks);
+
+  // Nothing more once there, however long it waits
+  for (int i = 0; i < 3; i++) {
+    now += 10 * RAMP_TICK_MS;
+    check(!rampUpdate(now), "update reported a change at the target", ticks);
+  }
+  check(callbacks == 1, "callback fired again at the target", ticks);
+
+  // Out-of-range targets are clamped
+  rampSetTarget(400, -400);
+  check(rampGetTarget(RAMP_MOTOR_A) == 255 && rampGetTarget(RAMP_MOTOR_B) == -255, "target clamp", 0);
+  runToTarget(now, 2 * RAMP_TICKS);
+  check(callbacks == 2, "callback count after a second ramp", 0);
+  printf("Plain ramp from %lu: %lu ticks of %d ms\n", start, ticks, RAMP_TICK_MS);
+}
+
+static void checkRetarget(unsigned long start) {
+  unsigned long now = start;
+  rampInit(now);
+  callbacks = 0;
+  rampSetTarget(250, 250);
+  for (int tick = 0; tick < RAMP_TICKS / 2; tick++) {
+    now += RAMP_TICK_MS;
+    rampUpdate(now);
+  }
+  int midway = rampGetSpeed(RAMP_MOTOR_A);
+  check(midway > 0 && midway < 250, "midway speed", RAMP_TICKS / 2);
+
+  // A new target carries on from where the motor is, with no jump
+  rampSetTarget(60, 250);
+  check(rampGetSpeed(RAMP_MOTOR_A) == midway, "retarget moved the speed", RAMP_TICKS / 2);
+  now += RAMP_TICK_MS;
+  rampUpdate(now);
+  check(rampGetSpeed(RAMP_MOTOR_A) < midway, "retarget didn't turn the ramp round", RAMP_TICKS / 2 + 1);
+  unsigned long ticks = 1 + runToTarget(now, 2 * RAMP_TICKS);
+  check(ticks <= RAMP_TICKS, "retarget took longer than RAMP_TICKS", ticks);
+  check(rampGetSpeed(RAMP_MOTOR_A) == 60 && rampGetSpeed(RAMP_MOTOR_B) == 250, "retarget target", ticks);
+  check(callbacks == 1, "callback count after a retarget", ticks);
+  printf("Retarget at %d: %d -> 60 in %lu ticks\n", RAMP_TICKS / 2, midway, ticks);
+}
+
+static void checkReversal(unsigned long start) {
+  unsigned long now = start;
+  rampInit(now);
+  callbacks = 0;
+  rampSetTarget(150, -150);
+  runToTarget(now, 2 * RAMP_TICKS);
+  rampSetTarget(-150, 150);
+
+  // runToTarget checks the inputs on every tick; here, that it crosses zero
+  bool crossedA = false;
+  for (unsigned long tick = 1; tick <= 2 * RAMP_TICKS && !rampIsComplete(); tick++) {
+    int before = rampGetSpeed(RAMP_MOTOR_A);
+    now += RAMP_TICK_MS;
+    rampUpdate(now);
+    checkChannels(tick);
+    crossedA |= before > 0 && rampGetSpeed(RAMP_MOTOR_A) <= 0;
+  }
+  check(crossedA, "reversal never crossed zero", 0);
+  check(rampGetSpeed(RAMP_MOTOR_A) == -150 && rampGetSpeed(RAMP_MOTOR_B) == 150, "reversal target", 0);
+  check(callbacks == 2, "callback count after a reversal", 0);
+  printf("Reversal: 150 -> -150 with one input driven at a time\n");
+}
+
+// Speeds after each whole tick of a reference ramp, updated every tick
+static void referenceRamp(unsigned long start, int* speedA, int* speedB, int ticks) {
+  unsigned long now = start;
+  rampInit(now);
+  rampSetTarget(230, -90);
+  for (int tick = 0; tick <= ticks; tick++) {
+    speedA[tick] = rampGetSpeed(RAMP_MOTOR_A);
+    speedB[tick] = rampGetSpeed(RAMP_MOTOR_B);
+    now += RAMP_TICK_MS;
+    rampUpdate(now);
+  }
+}
+
+static void checkCatchUp(unsigned long start) {
+  int speedA[RAMP_TICKS + 1];
+  int speedB[RAMP_TICKS + 1];
+  referenceRamp(start, speedA, speedB, RAMP_TICKS);
+
+  // Calls at uneven times, several ticks apart or between ticks: at each
+  // one the ramp must be where the reference was at that many whole ticks
+  static const int gapsMs[] = {3, 7, 25, 1, 70, 4, 9, 130, 11, 2, 45, 0, 60, 200};
+  unsigned long now = start;
+  rampInit(now);
+  callbacks = 0;
+  rampSetTarget(230, -90);
+  unsigned long elapsed = 0;
+  for (int gap : gapsMs) {
+    now += gap;
+    elapsed += gap;
+    bool changed = rampUpdate(now);
+    unsigned long tick = elapsed / RAMP_TICK_MS;
+    if (tick > RAMP_TICKS) {
+      tick = RAMP_TICKS;
+    }
+    check(rampGetSpeed(RAMP_MOTOR_A) == speedA[tick] && rampGetSpeed(RAMP_MOTOR_B) == speedB[tick],
+          "catch-up off the tick-by-tick ramp", tick);
+    check(!changed || gap != 0, "update with no time passed changed the speed", tick);
+    checkChannels(tick);
+  }
+  check(rampIsComplete() && callbacks == 1, "catch-up completes once", elapsed / RAMP_TICK_MS);
+  printf("Catch-up: %zu uneven updates over %lu ms match the tick-by-tick ramp\n",
+         sizeof(gapsMs) / sizeof(gapsMs[0]), elapsed);
+}
+
+static void checkHalt(unsigned long start) {
+  unsigned long now = start;
+  rampInit(now);
+  callbacks = 0;
+  rampSetTarget(-200, 200);
+  for (int tick = 0; tick < 5; tick++) {
+    now += RAMP_TICK_MS;
+    rampUpdate(now);
+  }
+  rampHalt();
+  check(rampGetSpeed(RAMP_MOTOR_A) == 0 && rampGetSpeed(RAMP_MOTOR_B) == 0 && rampIsComplete(), "halt", 5);
+  now += RAMP_TICK_MS;
+  check(!rampUpdate(now), "update after a halt changed the speed", 6);
+  check(callbacks == 0, "halt fired the callback", 6);
+
+  // A target the motors already have is complete at once, with no callback
+  rampSetTarget(0, 0);
+  check(rampIsComplete() && callbacks == 0, "target already reached", 6);
+  printf("Halt: outputs dropped at once, no callback\n");
+}
+
+int main() {
+  rampSetCompleteCallback(onComplete);
+  // From boot, and from just before the millisecond clock wraps
+  static const unsigned long starts[] = {0, 0UL - 15 * RAMP_TICK_MS};
+  for (unsigned long start : starts) {
+    checkPlainRamp(start);
+    checkRetarget(start);
+    checkReversal(start);
+    checkCatchUp(start);
+    checkHalt(start);
+  }
+
+  if (failures != 0) {
+    printf("FAILED: %lu checks\n", failures);
+    return 1;
+  }
+  printf("ALL PASSED\n");
+  return 0;
+}
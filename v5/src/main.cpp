@@ -1,9 +1,13 @@
 #include <Arduino.h>
+#include <esp_sleep.h>
 #include "motor_control.h"
 
 // Define the onboard LED pin for ESP32-S2
 #define LED_PIN 15
 
+// How long each loop() pass light-sleeps (us)
+#define LOOP_SLEEP_US 1000000
+
 void blinkLED(int times, int onTime = 200, int offTime = 200) {
   for (int i = 0; i < times; i++) {
     digitalWrite(LED_PIN, HIGH);
@@ -29,9 +33,13 @@ void setup() {
   setupMotors();
   Serial.println("Starting continuous forward movement...");
   moveForward();  // Start motors and keep them running
+  Serial.flush();  // Get the output out before loop() starts sleeping
 }
 
 void loop() {
-  // Empty loop - motors will continue running
-  delay(1000);  // Small delay to prevent watchdog timer issues
+  // Nothing to do - light-sleep instead of idling awake. PWM runs from the
+  // RTC8M clock (see setupMotors()), so the motors keep running.
+  // Note that USB serial disconnects while the chip sleeps.
+  esp_sleep_enable_timer_wakeup(LOOP_SLEEP_US);
+  esp_light_sleep_start();
 } 
\ No newline at end of file
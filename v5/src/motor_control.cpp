@@ -1,4 +1,7 @@
 #include <Arduino.h>
+#include <driver/ledc.h>
+#include <driver/gpio.h>
+#include <esp_sleep.h>
 #include "motor_control.h"
 
 // PWM configuration
@@ -20,6 +23,25 @@ void setupMotors() {
   ledcAttachPin(MOTOR_B_IN1, 2);
   ledcAttachPin(MOTOR_B_IN2, 3);
   
+  // Clock both LEDC timers (channels 0/1 and 2/3) from RTC8M, which keeps
+  // running in light sleep, so the motors keep turning while loop() sleeps
+  for (int timer = 0; timer < 2; timer++) {
+    ledc_timer_config_t config = {};
+    config.speed_mode = LEDC_LOW_SPEED_MODE;
+    config.timer_num = (ledc_timer_t)timer;
+    config.duty_resolution = (ledc_timer_bit_t)PWM_RESOLUTION;
+    config.freq_hz = PWM_FREQ;
+    config.clk_cfg = LEDC_USE_RTC8M_CLK;
+    ledc_timer_config(&config);
+  }
+  esp_sleep_pd_config(ESP_PD_DOMAIN_RTC8M, ESP_PD_OPTION_ON);
+  
+  // Keep the normal pin configuration during sleep
+  gpio_sleep_sel_dis((gpio_num_t)MOTOR_A_IN1);
+  gpio_sleep_sel_dis((gpio_num_t)MOTOR_A_IN2);
+  gpio_sleep_sel_dis((gpio_num_t)MOTOR_B_IN1);
+  gpio_sleep_sel_dis((gpio_num_t)MOTOR_B_IN2);
+  
   // Initialize motors in stopped state
   stopMotors();
   
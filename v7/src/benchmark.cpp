@@ -0,0 +1,164 @@
+#include "hal.h"
+#include "benchmark.h"
+#include "motor_control.h"
+#include "movement_modes.h"
+#include "pattern.h"
+#include "log.h"
+#include "fixed_point.h"
+
+#ifdef ENABLE_BENCHMARK
+
+#include <algorithm>
+#include <math.h>
+
+#ifdef HAL_NATIVE
+#define BENCHMARK_TARGET "native"
+#define BENCHMARK_CLOCK_MHZ 1000
+static inline uint32_t benchmarkClock() {
+  return halSimHostNanos();
+}
+#else
+#define BENCHMARK_TARGET "esp32s2"
+#define BENCHMARK_CLOCK_MHZ getCpuFrequencyMhz()
+static inline uint32_t benchmarkClock() {
+  return halCycleCount();
+}
+#endif
+
+static uint32_t samples[BENCHMARK_ITERATIONS];
+static uint32_t clockOverhead = 0;
+static int benchmarksRun = 0;
+
+// A typical log line and a short reply, for the Serial.print benchmarks
+static const char* const PRINT_LINE = "Pattern step 3: drive L=100% R=-100%\r\n";
+static const char* const PRINT_SHORT = "OK\r\n";
+
+// Operands for the fixed-vs-float pairs, the same values in both forms.
+// Filled once up front so the timed calls convert nothing.
+#define MATH_OPERANDS 16
+static Fixed fixedOperands[MATH_OPERANDS];
+static float floatOperands[MATH_OPERANDS];
+static uint16_t angleOperands[MATH_OPERANDS];
+static float radianOperands[MATH_OPERANDS];
+
+// Results land here so the compiler can't drop the math
+static volatile int32_t fixedSink;
+static volatile float floatSink;
+
+// Times body(i) for i = 0 .. BENCHMARK_ITERATIONS - 1 and logs min,
+// median and p99
+template <typename Body>
+static void runBenchmark(const char* name, Body body) {
+  // Let the log drain first so its task isn't competing for the CPU or
+  // the serial port
+  logFlush();
+
+  for (int i = 0; i < BENCHMARK_WARMUP; i++) {
+    body(i);
+  }
+  for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+    uint32_t start = benchmarkClock();
+    body(i);
+    uint32_t elapsed = benchmarkClock() - start;
+    samples[i] = elapsed > clockOverhead ? elapsed - clockOverhead : 0;
+  }
+
+  std::sort(samples, samples + BENCHMARK_ITERATIONS);
+  // The rank-th smallest sample, counting from 1 (as LatencyHistogram)
+  int p99Rank = (BENCHMARK_ITERATIONS * 99 + 99) / 100;
+  logWrite(LOG_LEVEL_NONE, "bench,%s,%d,%lu,%lu,%lu", name, BENCHMARK_ITERATIONS,
+           (unsigned long)samples[0], (unsigned long)samples[(BENCHMARK_ITERATIONS - 1) / 2],
+           (unsigned long)samples[p99Rank - 1]);
+  benchmarksRun++;
+}
+
+// Cheapest back-to-back pair of counter reads
+static void measureClockOverhead() {
+  uint32_t cheapest = UINT32_MAX;
+  for (int i = 0; i < BENCHMARK_OVERHEAD_RUNS; i++) {
+    uint32_t start = benchmarkClock();
+    uint32_t elapsed = benchmarkClock() - start;
+    cheapest = min(cheapest, elapsed);
+  }
+  clockOverhead = cheapest;
+}
+
+// Runs the suite. Leaves the outputs stopped and the aux pin low.
+void benchmarkRun() {
+  LOG_INFO("Benchmark: %d iterations per primitive", BENCHMARK_ITERATIONS);
+  measureClockOverhead();
+  logWrite(LOG_LEVEL_NONE, "bench-target,%s,%lu,%lu", BENCHMARK_TARGET,
+           (unsigned long)BENCHMARK_CLOCK_MHZ, (unsigned long)clockOverhead);
+
+  // Raw output writes, alternating values so nothing can skip them
+  uint32_t halfDuty = getPwmMaxDuty() / 2;
+  runBenchmark("ledcWrite", [=](int i) { halPwmWrite(PWM_CHANNEL_A_IN1, (i & 1) ? halfDuty : 0); });
+  halPwmWrite(PWM_CHANNEL_A_IN1, getCommittedFrame().duty[PWM_CHANNEL_A_IN1]);
+  runBenchmark("digitalWrite", [](int i) { halGpioWrite(AUX_PIN, (i & 1) ? HIGH : LOW); });
+
+  // Motor calls: staged and committed outputs, then the setpoint post
+  // that the modes use
+  runBenchmark("setMotorA", [](int i) { setMotorA((i & 1) ? 200 : 100, true); });
+  runBenchmark("moveDifferential", [](int i) { moveDifferential((i & 1) ? 200 : -100, (i & 1) ? -100 : 200); });
+  runBenchmark("setDirection", [](int i) { setDirection((i & 1) ? TURN_LEFT : FORWARD); });
+
+  runBenchmark("Serial.print(line)", [](int i) { Serial.print(PRINT_LINE); });
+  runBenchmark("Serial.print(short)", [](int i) { Serial.print(PRINT_SHORT); });
+  runBenchmark("Serial.print(int)", [](int i) { Serial.print(1000 + i); });
+  Serial.print("\r\n");    // End the run of numbers before the next result line
+
+  runBenchmark("random", [](int i) { random(100); });
+
+  // The same math in Q16.16 (fixed_point.h) and in float, which the S2
+  // does in software: the case for keeping the control loop in fixed point
+  for (int i = 0; i < MATH_OPERANDS; i++) {
+    floatOperands[i] = 0.75f + i * 13.375f;
+    fixedOperands[i] = Fixed::fromFloat(floatOperands[i]);
+    angleOperands[i] = i * 4099;
+    radianOperands[i] = angleOperands[i] * (2 * (float)M_PI / 65536);
+  }
+  runBenchmark("fixed:mul", [](int i) {
+    fixedSink = (fixedOperands[i % MATH_OPERANDS] * fixedOperands[(i + 5) % MATH_OPERANDS]).raw;
+  });
+  runBenchmark("float:mul", [](int i) {
+    floatSink = floatOperands[i % MATH_OPERANDS] * floatOperands[(i + 5) % MATH_OPERANDS];
+  });
+  runBenchmark("fixed:div", [](int i) {
+    fixedSink = (fixedOperands[i % MATH_OPERANDS] / fixedOperands[(i + 5) % MATH_OPERANDS]).raw;
+  });
+  runBenchmark("float:div", [](int i) {
+    floatSink = floatOperands[i % MATH_OPERANDS] / floatOperands[(i + 5) % MATH_OPERANDS];
+  });
+  runBenchmark("fixed:sin", [](int i) { fixedSink = fixedSin(angleOperands[i % MATH_OPERANDS]).raw; });
+  runBenchmark("float:sin", [](int i) { floatSink = sinf(radianOperands[i % MATH_OPERANDS]); });
+  runBenchmark("fixed:sqrt", [](int i) { fixedSink = fixedSqrt(fixedOperands[i % MATH_OPERANDS]).raw; });
+  runBenchmark("float:sqrt", [](int i) { floatSink = sqrtf(floatOperands[i % MATH_OPERANDS]); });
+
+  // One movement update per mode, as the mode's callback runs it: a step
+  // of its pattern (late enough that every call runs one) or its function
+  for (int modeId = 0; modeId < NUM_MODES; modeId++) {
+    const MovementMode* mode = getMovementMode(modeId);
+    char name[24];
+    snprintf(name, sizeof(name), "mode:%s", mode->name);
+    if (mode->pattern != nullptr) {
+      static PatternRunner runner;
+      static unsigned long now;
+      now = 0;
+      patternStart(runner, mode->pattern, now);
+      runBenchmark(name, [](int i) {
+        now += BENCHMARK_PATTERN_STEP_MS;
+        patternUpdate(runner, now);
+      });
+    } else {
+      runBenchmark(name, [mode](int i) { mode->movementFunction(); });
+    }
+  }
+
+  setDirection(STOP);
+  moveDifferential(0, 0);
+  halGpioWrite(AUX_PIN, LOW);
+  logWrite(LOG_LEVEL_NONE, "bench-end,%d", benchmarksRun);
+  logFlush();
+}
+
+#endif // ENABLE_BENCHMARK
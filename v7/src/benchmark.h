@@ -0,0 +1,39 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// Microbenchmarks for the motor, mode and math primitives.
+//
+// Build with -DENABLE_BENCHMARK (pio run -e benchmark, or -e
+// native_benchmark for host baselines). setupMotors() then runs the suite
+// once, after the PWM channels are set up and before the control task
+// takes them over, so nothing else touches the outputs while it runs.
+// The motor rail is still charging at that point, but keep the wheels off
+// the ground anyway.
+//
+// Each primitive runs BENCHMARK_WARMUP times untimed, then
+// BENCHMARK_ITERATIONS times, each call timed on its own with the CPU
+// cycle counter (CCOUNT). The cost of reading the counter is measured
+// first and taken off every sample. The native build has no cycle counter
+// that moves while code runs, so it times with the host's clock in
+// nanoseconds instead.
+//
+// Results go out through the log as CSV lines that tools/benchcheck.cpp
+// reads and checks against tools/benchmark_thresholds.csv:
+//
+//   bench-target,TARGET,CLOCK_MHZ,OVERHEAD   target, clock ticks per us, ticks taken off
+//   bench,NAME,ITERATIONS,MIN,MEDIAN,P99      one per primitive, in clock ticks
+//   bench-end,COUNT                           number of bench lines sent
+//
+// The Serial.print benchmarks write their strings straight to the serial
+// port, so those lines are mixed in with the results.
+
+#ifndef BENCHMARK_ITERATIONS
+#define BENCHMARK_ITERATIONS 1000
+#endif
+#define BENCHMARK_WARMUP 16         // Untimed calls first, to load the flash cache
+#define BENCHMARK_OVERHEAD_RUNS 64  // Empty timings; the cheapest is the counter overhead
+#define BENCHMARK_PATTERN_STEP_MS 3000  // Pattern clock advance per call - longer than any step
+
+void benchmarkRun();
+
+#endif // BENCHMARK_H
@@ -0,0 +1,377 @@
+#include <atomic>
+#include "hal.h"
+#include "calibration.h"
+#include "motor_control.h"
+#include "encoder.h"
+#include "control.h"
+#include "power.h"
+#include "log.h"
+
+#define MS_TO_PERIODS(ms) ((ms) * 1000L / CONTROL_PERIOD_US)
+#define PERCENT_TO_DUTY(percent) ((percent) * CALIBRATION_DUTY_SCALE / 100)
+#define RAMP_PPM_PER_PERIOD (CALIBRATION_RAMP_PERCENT_PER_S * 10000L * CONTROL_PERIOD_US / 1000000)
+
+enum CalibrationState {
+  CAL_IDLE,
+  CAL_RAMP,          // Raising the duty until both wheels turn
+  CAL_SETTLE,        // Waiting for the wheels to reach speed at a point
+  CAL_MEASURE,       // Counting encoder edges at a point
+  CAL_COAST,         // Outputs off between directions
+  CAL_CHECK_SETTLE,  // New table in use, both wheels at the check speed
+  CAL_CHECK_MEASURE,
+  CAL_DONE
+};
+
+enum CalibrationOutcome {
+  CAL_OUTCOME_RUNNING,
+  CAL_OUTCOME_OK,
+  CAL_OUTCOME_NO_BREAKAWAY,    // A wheel didn't turn below the ramp limit
+  CAL_OUTCOME_NO_SPEED,        // The measured curves gave no usable table
+  CAL_OUTCOME_FAULT
+};
+
+// Table in use (control task, and setupMotors() before it starts)
+static CalibrationTable table = {};
+static bool tableLoaded = false;
+
+// Behaviour -> control
+static std::atomic<bool> calibrationRequested(false);
+
+// Control -> behaviour: valid once outcome leaves CAL_OUTCOME_RUNNING
+static std::atomic<uint8_t> outcome(CAL_OUTCOME_RUNNING);
+static CalibrationCurve curves[2][2];      // [motor][direction]
+static CalibrationTable newTable;
+static uint16_t checkSpeedCps[2];
+
+// Control task state
+static CalibrationState state = CAL_IDLE;
+static int direction = CALIBRATION_FORWARD;
+static int point = 0;
+static uint32_t rampPpm = 0;
+static int32_t counts[2] = {0, 0};
+static uint32_t periodsLeft = 0;
+
+// Behaviour side
+static bool resultReported = false;
+
+// Loads the tables from NVS. Call before the control task starts.
+bool calibrationLoad() {
+  CalibrationTable stored;
+  size_t length = halNvsRead(CALIBRATION_NVS_NAMESPACE, CALIBRATION_NVS_KEY, &stored, sizeof(stored));
+  if (length == 0) {
+    LOG_INFO("No motor calibration stored - speeds map straight to duty");
+    return false;
+  }
+  if (length != sizeof(stored) || stored.version != CALIBRATION_VERSION) {
+    LOG_WARN("Motor calibration in NVS is from another version - recalibrate");
+    return false;
+  }
+  table = stored;
+  tableLoaded = true;
+  LOG_INFO("Motor calibration loaded: top speed %u fwd, %u rev counts/s",
+           table.topSpeedCps[CALIBRATION_FORWARD], table.topSpeedCps[CALIBRATION_REVERSE]);
+  return true;
+}
+
+bool calibrationActive() {
+  return tableLoaded;
+}
+
+// Inverts the measured duty-to-speed curves into the tables. Speeds are
+// forced monotonic first, so noise or a sticky gearbox can't make the table
+// step backwards. Fails if a wheel never moved.
+bool calibrationBuild(const CalibrationCurve measured[2][2], CalibrationTable& out) {
+  out = {};
+  out.version = CALIBRATION_VERSION;
+
+  for (int dir = 0; dir < 2; dir++) {
+    uint16_t speeds[2][CALIBRATION_POINTS];
+    for (int motor = 0; motor < 2; motor++) {
+      uint16_t fastest = 0;
+      for (int k = 0; k < CALIBRATION_POINTS; k++) {
+        fastest = max(fastest, measured[motor][dir].speedCps[k]);
+        speeds[motor][k] = fastest;
+      }
+    }
+
+    // Full scale is what the slower wheel manages, so both can reach it
+    uint32_t top = min(speeds[MOTOR_A][CALIBRATION_POINTS - 1], speeds[MOTOR_B][CALIBRATION_POINTS - 1]);
+    if (top == 0) {
+      return false;
+    }
+    out.topSpeedCps[dir] = (uint16_t)top;
+
+    for (int motor = 0; motor < 2; motor++) {
+      const uint16_t* duty = measured[motor][dir].duty;
+      const uint16_t* speed = speeds[motor];
+      uint16_t* steps = out.duty[motor][dir];
+      steps[0] = duty[0];
+
+      int k = 0;
+      for (int step = 1; step <= CALIBRATION_SEGMENTS; step++) {
+        int32_t target = (int32_t)(top * step / CALIBRATION_SEGMENTS);
+        while (speed[k + 1] < target) {
+          k++;
+        }
+        int32_t value = duty[k + 1];
+        if (target <= speed[k]) {
+          value = duty[k];
+        } else if (speed[k + 1] != speed[k]) {
+          value = duty[k] + (int32_t)(duty[k + 1] - duty[k]) * (target - speed[k]) / (speed[k + 1] - speed[k]);
+        }
+        steps[step] = (uint16_t)max(value, (int32_t)steps[step - 1]);
+      }
+    }
+  }
+  return true;
+}
+
+// Table duty (CALIBRATION_DUTY_SCALE units, signed) for a -255..255 speed:
+// one index and one interpolation, whatever the speed
+int32_t calibrationMapSpeed(int motor, int speed) {
+  if (speed == 0) {
+    return 0;
+  }
+  const uint16_t* steps = table.duty[motor][speed > 0 ? CALIBRATION_FORWARD : CALIBRATION_REVERSE];
+  uint32_t position = (uint32_t)abs(speed) * (CALIBRATION_SEGMENTS << 8) / 255;   // 8.8 fixed point
+  uint32_t index = position >> 8;
+  uint32_t fraction = position & 0xFF;
+
+  int32_t duty = steps[index];
+  if (fraction != 0) {
+    duty += ((int32_t)(steps[index + 1] - steps[index]) * (int32_t)fraction) >> 8;
+  }
+  return speed > 0 ? duty : -duty;
+}
+
+// Drives each motor at its own duty (CALIBRATION_DUTY_SCALE units) in the
+// current direction, bypassing the table
+static void driveRaw(const uint32_t duty[2]) {
+  MotorFrame& frame = stageMotorFrame();
+  for (int motor = 0; motor < 2; motor++) {
+    int32_t raw = (int32_t)((duty[motor] * getPwmMaxDuty() + CALIBRATION_DUTY_SCALE / 2) / CALIBRATION_DUTY_SCALE);
+    stageMotorDuty(frame, motor, direction == CALIBRATION_FORWARD ? raw : -raw);
+  }
+  commitMotorFrame();
+}
+
+// Duty of each motor at the current point, evenly spaced from its
+// breakaway duty to full
+static void pointDuty(uint32_t duty[2]) {
+  for (int motor = 0; motor < 2; motor++) {
+    uint32_t breakaway = curves[motor][direction].duty[0];
+    duty[motor] = breakaway + (CALIBRATION_DUTY_SCALE - breakaway) * point / (CALIBRATION_POINTS - 1);
+  }
+}
+
+static void startCounting(uint32_t periods) {
+  encoderReadDelta(MOTOR_A);
+  encoderReadDelta(MOTOR_B);
+  counts[MOTOR_A] = counts[MOTOR_B] = 0;
+  periodsLeft = periods;
+}
+
+static void startDirection(int dir) {
+  direction = dir;
+  for (int motor = 0; motor < 2; motor++) {
+    curves[motor][dir] = {};
+  }
+  startCounting(0);
+  rampPpm = CALIBRATION_START_PERCENT * 10000L;
+  state = CAL_RAMP;
+}
+
+static void finish(CalibrationOutcome result) {
+  moveDifferential(0, 0);
+  state = CAL_DONE;
+  outcome.store(result, std::memory_order_release);
+}
+
+// Behaviour side: hands the motors to the calibration
+void calibrationStart() {
+#ifndef ENABLE_SPEED_CONTROL
+  // Only the speed loop starts the encoders otherwise
+  encoderBegin();
+#endif
+  // The control task times the measurements, and it stops in light sleep
+  powerSetSleepInhibit(POWER_INHIBIT_CALIBRATION, true);
+  LOG_INFO("Motor calibration: %d points per direction - wheels must be off the ground",
+           CALIBRATION_POINTS);
+  calibrationRequested.store(true, std::memory_order_release);
+}
+
+// Control task: one period of the calibration. Returns true while it owns
+// the outputs.
+bool calibrationStep(bool fault) {
+  if (state == CAL_IDLE) {
+    if (!calibrationRequested.load(std::memory_order_acquire)) {
+      return false;
+    }
+    // Measure raw duties, not whatever an old table makes of them
+    tableLoaded = false;
+    startDirection(CALIBRATION_FORWARD);
+  }
+  if (state == CAL_DONE) {
+    return false;
+  }
+
+  if (fault) {
+    finish(CAL_OUTCOME_FAULT);
+    return false;
+  }
+
+  for (int motor = 0; motor < 2; motor++) {
+    counts[motor] += encoderReadDelta(motor);
+  }
+
+  switch (state) {
+    case CAL_RAMP: {
+      uint32_t duty = (uint32_t)((uint64_t)rampPpm * CALIBRATION_DUTY_SCALE / 1000000);
+      for (int motor = 0; motor < 2; motor++) {
+        CalibrationCurve& curve = curves[motor][direction];
+        if (curve.duty[0] == 0 && abs(counts[motor]) >= CALIBRATION_MOTION_COUNTS) {
+          curve.duty[0] = (uint16_t)duty;
+        }
+      }
+      if (curves[MOTOR_A][direction].duty[0] != 0 && curves[MOTOR_B][direction].duty[0] != 0) {
+        point = 0;
+        uint32_t duties[2];
+        pointDuty(duties);
+        driveRaw(duties);
+        startCounting(MS_TO_PERIODS(CALIBRATION_SETTLE_MS));
+        state = CAL_SETTLE;
+        break;
+      }
+      if (duty >= PERCENT_TO_DUTY(CALIBRATION_MAX_BREAKAWAY_PERCENT)) {
+        finish(CAL_OUTCOME_NO_BREAKAWAY);
+        break;
+      }
+      rampPpm += RAMP_PPM_PER_PERIOD;
+      uint32_t duties[2] = {duty, duty};
+      driveRaw(duties);
+      break;
+    }
+
+    case CAL_SETTLE:
+      if (--periodsLeft == 0) {
+        startCounting(MS_TO_PERIODS(CALIBRATION_MEASURE_MS));
+        state = CAL_MEASURE;
+      }
+      break;
+
+    case CAL_MEASURE:
+      if (--periodsLeft != 0) {
+        break;
+      }
+      for (int motor = 0; motor < 2; motor++) {
+        uint32_t duties[2];
+        pointDuty(duties);
+        CalibrationCurve& curve = curves[motor][direction];
+        curve.duty[point] = (uint16_t)duties[motor];
+        curve.speedCps[point] = (uint16_t)min((uint32_t)abs(counts[motor]) * 1000 / CALIBRATION_MEASURE_MS,
+                                              (uint32_t)UINT16_MAX);
+      }
+      if (++point < CALIBRATION_POINTS) {
+        uint32_t duties[2];
+        pointDuty(duties);
+        driveRaw(duties);
+        startCounting(MS_TO_PERIODS(CALIBRATION_SETTLE_MS));
+        state = CAL_SETTLE;
+      } else {
+        moveDifferential(0, 0);
+        startCounting(MS_TO_PERIODS(CALIBRATION_COAST_MS));
+        state = CAL_COAST;
+      }
+      break;
+
+    case CAL_COAST:
+      if (--periodsLeft != 0) {
+        break;
+      }
+      if (direction == CALIBRATION_FORWARD) {
+        startDirection(CALIBRATION_REVERSE);
+        break;
+      }
+      if (!calibrationBuild(curves, newTable)) {
+        finish(CAL_OUTCOME_NO_SPEED);
+        break;
+      }
+      // Put the new table to use and check that the wheels now match
+      table = newTable;
+      tableLoaded = true;
+      moveDifferential(CALIBRATION_CHECK_SPEED, CALIBRATION_CHECK_SPEED);
+      startCounting(MS_TO_PERIODS(CALIBRATION_SETTLE_MS));
+      state = CAL_CHECK_SETTLE;
+      break;
+
+    case CAL_CHECK_SETTLE:
+      if (--periodsLeft == 0) {
+        startCounting(MS_TO_PERIODS(CALIBRATION_MEASURE_MS));
+        state = CAL_CHECK_MEASURE;
+      }
+      break;
+
+    case CAL_CHECK_MEASURE:
+      if (--periodsLeft == 0) {
+        for (int motor = 0; motor < 2; motor++) {
+          checkSpeedCps[motor] = (uint16_t)min((uint32_t)abs(counts[motor]) * 1000 / CALIBRATION_MEASURE_MS,
+                                               (uint32_t)UINT16_MAX);
+        }
+        finish(CAL_OUTCOME_OK);
+      }
+      break;
+
+    default:
+      break;
+  }
+  return true;
+}
+
+// Duty in tenths of a percent
+static unsigned long dutyTenths(uint16_t duty) {
+  return ((unsigned long)duty * 1000 + CALIBRATION_DUTY_SCALE / 2) / CALIBRATION_DUTY_SCALE;
+}
+
+// Behaviour side: once the calibration is over, logs it and saves the
+// tables to NVS
+void calibrationReport() {
+  uint8_t result = outcome.load(std::memory_order_acquire);
+  if (resultReported || result == CAL_OUTCOME_RUNNING) {
+    return;
+  }
+  resultReported = true;
+  powerSetSleepInhibit(POWER_INHIBIT_CALIBRATION, false);
+
+  if (result == CAL_OUTCOME_FAULT) {
+    LOG_WARN("Motor calibration aborted by a driver fault");
+    return;
+  }
+  if (result == CAL_OUTCOME_NO_BREAKAWAY) {
+    LOG_WARN("Motor calibration failed: a wheel didn't turn below %d%% duty",
+             CALIBRATION_MAX_BREAKAWAY_PERCENT);
+    return;
+  }
+
+  for (int dir = 0; dir < 2; dir++) {
+    for (int motor = 0; motor < 2; motor++) {
+      const CalibrationCurve& curve = curves[motor][dir];
+      unsigned long breakaway = dutyTenths(curve.duty[0]);
+      LOG_INFO("Calibration %c %s: breakaway %lu.%lu%%, full duty %u counts/s",
+               motor == MOTOR_A ? 'A' : 'B', dir == CALIBRATION_FORWARD ? "fwd" : "rev",
+               breakaway / 10, breakaway % 10, curve.speedCps[CALIBRATION_POINTS - 1]);
+    }
+  }
+  if (result == CAL_OUTCOME_NO_SPEED) {
+    LOG_WARN("Motor calibration failed: a wheel never reached a measurable speed");
+    return;
+  }
+
+  LOG_INFO("Calibration check at speed %d: A %u B %u counts/s (target %lu)", CALIBRATION_CHECK_SPEED,
+           checkSpeedCps[MOTOR_A], checkSpeedCps[MOTOR_B],
+           (unsigned long)newTable.topSpeedCps[CALIBRATION_FORWARD] * CALIBRATION_CHECK_SPEED / 255);
+  if (halNvsWrite(CALIBRATION_NVS_NAMESPACE, CALIBRATION_NVS_KEY, &newTable, sizeof(newTable))) {
+    LOG_INFO("Motor calibration saved");
+  } else {
+    LOG_ERROR("Motor calibration could not be saved");
+  }
+}
@@ -0,0 +1,71 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <stdint.h>
+
+// Per-motor feedforward calibration.
+//
+// Each motor has a PWM-to-speed lookup table per direction, stored in NVS.
+// When a table is loaded, stageMotorSpeed() (and so setMotorA/setMotorB,
+// moveDifferential and the speed loop) maps the -255..255 speed through
+// it instead of using it as a duty. That makes requested speeds linear
+// from just above the breakaway duty, with no deadband, and gives both
+// wheels the same speed for the same request: full scale is the top speed
+// of the slower wheel.
+//
+// Build with -DENABLE_CALIBRATION, with the wheels off the ground, to
+// measure the tables instead of running the movement modes. For each
+// direction the control task ramps both motors up to find their breakaway
+// duty. It then measures encoder speed at CALIBRATION_POINTS duties from
+// there to full and inverts the (forced monotonic) curve into the table.
+// main.cpp saves the result to NVS and logs a check of both wheels at
+// half speed.
+
+#define CALIBRATION_SEGMENTS 16               // Table steps over 0..255 (power of two)
+#define CALIBRATION_POINTS 8                  // Duties measured per motor and direction
+#define CALIBRATION_DUTY_SCALE 4095           // Table duty units: 4095 = full
+#define CALIBRATION_START_PERCENT 5           // Breakaway ramp start
+#define CALIBRATION_RAMP_PERCENT_PER_S 10
+#define CALIBRATION_MOTION_COUNTS 4           // Encoder counts that mean the wheel turned
+#define CALIBRATION_MAX_BREAKAWAY_PERCENT 60  // Give up above this duty
+#define CALIBRATION_SETTLE_MS 300             // Wait at each duty before measuring
+#define CALIBRATION_MEASURE_MS 200
+#define CALIBRATION_COAST_MS 1000             // Between directions, so the wheels stop
+#define CALIBRATION_CHECK_SPEED 128           // Speed used for the check after calibrating
+#define CALIBRATION_REPORT_INTERVAL_MS 100    // How often main.cpp checks for the result
+
+#define CALIBRATION_NVS_NAMESPACE "motor_cal"
+#define CALIBRATION_NVS_KEY "lut"
+#define CALIBRATION_VERSION 1                 // Bump when CalibrationTable changes
+
+#define CALIBRATION_FORWARD 0
+#define CALIBRATION_REVERSE 1
+
+// What the calibration measured for one motor in one direction
+struct CalibrationCurve {
+  uint16_t duty[CALIBRATION_POINTS];       // CALIBRATION_DUTY_SCALE units; [0] is breakaway
+  uint16_t speedCps[CALIBRATION_POINTS];   // Encoder counts/s at each duty
+};
+
+// Duty for speeds 0, 16, 32 .. 256 (255) per motor and direction. Entry 0
+// is the breakaway duty, so the smallest non-zero speed already turns the
+// wheel.
+struct CalibrationTable {
+  uint16_t version;
+  uint16_t topSpeedCps[2];                                     // Per direction, both wheels
+  uint16_t duty[2][2][CALIBRATION_SEGMENTS + 1];               // [motor][direction][step]
+};
+
+bool calibrationLoad();
+bool calibrationActive();
+bool calibrationBuild(const CalibrationCurve curves[2][2], CalibrationTable& table);
+
+// Control task only
+int32_t calibrationMapSpeed(int motor, int speed);
+bool calibrationStep(bool fault);
+
+// Behaviour side (ENABLE_CALIBRATION)
+void calibrationStart();
+void calibrationReport();
+
+#endif // CALIBRATION_H
@@ -0,0 +1,172 @@
+#include <stddef.h>
+#include "hal.h"
+#include "config.h"
+#include "crc.h"
+#include "motor_control.h"
+#include "movement_modes.h"
+#include "teleop.h"
+#include "log.h"
+
+// Stored payload: up to the end of the last field. Not sizeof(), whose
+// tail padding would be written out and read back as the next field
+// appended.
+#define CONFIG_PAYLOAD_LENGTH (offsetof(RobotConfig, teleopPort) + sizeof(uint16_t))
+
+// Largest blob read back - room for layouts newer than this firmware
+#define CONFIG_MAX_BLOB_LENGTH 256
+
+static_assert(CONFIG_PAYLOAD_LENGTH == 50, "RobotConfig layout changed - bump CONFIG_LAYOUT_VERSION");
+static_assert(offsetof(RobotConfig, pwmResolution) == 34, "RobotConfig fields moved");
+static_assert(offsetof(RobotConfig, teleopDeadmanMs) == 46, "RobotConfig fields moved");
+static_assert(CONFIG_NUM_MODES == NUM_MODES, "CONFIG_NUM_MODES out of step with ModeID");
+static_assert(CONFIG_NUM_DURATIONS == NUM_DURATION_OPTIONS, "CONFIG_NUM_DURATIONS out of step");
+static_assert(sizeof(ConfigHeader) + CONFIG_PAYLOAD_LENGTH <= CONFIG_MAX_BLOB_LENGTH, "Config blob too big");
+
+RobotConfig robotConfig;
+
+// The compile-time constants the configuration replaced
+void configDefaults(RobotConfig& config) {
+  memset(&config, 0, sizeof(config));
+  config.pwmFreqHz = PWM_DEFAULT_FREQ;
+  config.pwmResolution = PWM_DEFAULT_RESOLUTION;
+  config.motorSpeed = MOTOR_SPEED_ACTUAL;
+#ifdef ENABLE_SLOW_DECAY
+  config.decay[MOTOR_A] = config.decay[MOTOR_B] = DECAY_SLOW;
+#else
+  config.decay[MOTOR_A] = config.decay[MOTOR_B] = DECAY_FAST;
+#endif
+  for (int i = 0; i < CONFIG_NUM_DURATIONS; i++) {
+    config.durationOptions[i] = DURATION_OPTIONS[i];
+  }
+  config.minRestDuration = MIN_REST_DURATION;
+  config.maxRestDuration = MAX_REST_DURATION;
+  config.teleopDeadmanMs = TELEOP_DEADMAN_MS;
+  config.teleopPort = TELEOP_PORT;
+  for (int mode = 0; mode < CONFIG_NUM_MODES; mode++) {
+    config.movementIntervalMs[mode] = getMovementMode(mode)->movementInterval;
+    config.auxPinIntervalMs[mode] = getMovementMode(mode)->auxPinInterval;
+  }
+}
+
+bool configValidate(const RobotConfig& config) {
+  if (config.pwmFreqHz < PWM_MIN_FREQ || config.pwmResolution == 0 ||
+      config.pwmResolution > pwmMaxResolution(config.pwmFreqHz)) {
+    return false;
+  }
+  if (config.motorSpeed == 0 || config.motorSpeed > 255) {
+    return false;
+  }
+  for (int motor = 0; motor < 2; motor++) {
+    if (config.decay[motor] != DECAY_FAST && config.decay[motor] != DECAY_SLOW) {
+      return false;
+    }
+  }
+  for (int i = 0; i < CONFIG_NUM_DURATIONS; i++) {
+    if (config.durationOptions[i] == 0) {
+      return false;
+    }
+  }
+  if (config.minRestDuration == 0 || config.minRestDuration > config.maxRestDuration) {
+    return false;
+  }
+  for (int mode = 0; mode < CONFIG_NUM_MODES; mode++) {
+    if (config.movementIntervalMs[mode] == 0 || config.auxPinIntervalMs[mode] == 0) {
+      return false;
+    }
+  }
+  if (config.teleopDeadmanMs < TELEOP_MIN_DEADMAN_MS || config.teleopDeadmanMs > TELEOP_MAX_DEADMAN_MS ||
+      config.teleopPort == 0) {
+    return false;
+  }
+  return true;
+}
+
+// Header plus payload; returns the blob length (0 if maxLength is too small)
+size_t configEncode(const RobotConfig& config, uint8_t* blob, size_t maxLength) {
+  size_t length = sizeof(ConfigHeader) + CONFIG_PAYLOAD_LENGTH;
+  if (maxLength < length) {
+    return 0;
+  }
+  ConfigHeader header;
+  header.magic = CONFIG_MAGIC;
+  header.version = CONFIG_LAYOUT_VERSION;
+  header.length = CONFIG_PAYLOAD_LENGTH;
+  header.crc = crc32(&config, CONFIG_PAYLOAD_LENGTH);
+  memcpy(blob, &header, sizeof(header));
+  memcpy(blob + sizeof(header), &config, CONFIG_PAYLOAD_LENGTH);
+  return length;
+}
+
+// Checks a blob and unpacks it over the defaults: an older layout keeps
+// the defaults for the fields appended since, a newer one's extra fields
+// are dropped. Every layout so far has only appended, so that is all the
+// migration there is; a change appending can't express (a field rescaled,
+// or its default changed) would be fixed up here by version.
+bool configDecode(const uint8_t* blob, size_t length, RobotConfig& config, uint16_t& version) {
+  ConfigHeader header;
+  if (length < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, blob, sizeof(header));
+  const uint8_t* payload = blob + sizeof(header);
+  if (header.magic != CONFIG_MAGIC || header.length != length - sizeof(header) ||
+      crc32(payload, header.length) != header.crc) {
+    return false;
+  }
+
+  configDefaults(config);
+  memcpy(&config, payload, min((size_t)header.length, (size_t)CONFIG_PAYLOAD_LENGTH));
+  version = header.version;
+  return true;
+}
+
+// Boot: one NVS read into robotConfig, or the defaults if there is nothing
+// usable stored
+bool configLoad() {
+  configDefaults(robotConfig);
+
+  uint8_t blob[CONFIG_MAX_BLOB_LENGTH];
+  size_t length = halNvsRead(CONFIG_NVS_NAMESPACE, CONFIG_NVS_KEY, blob, sizeof(blob));
+  if (length == 0) {
+    LOG_INFO("No stored config - using defaults");
+    return false;
+  }
+
+  RobotConfig loaded;
+  uint16_t version;
+  if (length > sizeof(blob) || !configDecode(blob, length, loaded, version)) {
+    LOG_WARN("Stored config failed its checks - using defaults");
+    return false;
+  }
+  if (!configValidate(loaded)) {
+    LOG_WARN("Stored config out of range - using defaults");
+    return false;
+  }
+
+  robotConfig = loaded;
+  if (version < CONFIG_LAYOUT_VERSION) {
+    LOG_INFO("Config migrated from layout %u to %d", version, CONFIG_LAYOUT_VERSION);
+    configStore(robotConfig);
+  } else if (version > CONFIG_LAYOUT_VERSION) {
+    LOG_WARN("Config from newer layout %u - its new fields are ignored", version);
+  } else {
+    LOG_INFO("Config loaded (layout %u)", version);
+  }
+  return true;
+}
+
+// Behaviour side: validates, saves and puts a new configuration in use.
+// Fields read at boot (PWM, decay) take effect on the next one.
+bool configStore(const RobotConfig& config) {
+  if (!configValidate(config)) {
+    return false;
+  }
+  uint8_t blob[sizeof(ConfigHeader) + CONFIG_PAYLOAD_LENGTH];
+  size_t length = configEncode(config, blob, sizeof(blob));
+  if (!halNvsWrite(CONFIG_NVS_NAMESPACE, CONFIG_NVS_KEY, blob, length)) {
+    LOG_ERROR("Config could not be saved");
+    return false;
+  }
+  robotConfig = config;
+  return true;
+}
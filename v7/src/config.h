@@ -0,0 +1,69 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Tunables kept in NVS, so they change without a reflash.
+//
+// configLoad() reads one blob at boot into robotConfig, a plain struct in
+// RAM; everything else reads its fields directly. The defaults come from
+// the compile-time constants they replace (MOTOR_SPEED_ACTUAL,
+// DURATION_OPTIONS, the movement mode table...), so a robot with nothing
+// stored runs exactly as before. With ENABLE_CONSOLE the "config" commands
+// (console.h) edit the settings and store them through configStore().
+//
+// The blob is a ConfigHeader followed by the RobotConfig bytes. The header
+// carries the layout version and a CRC-32 of the payload; a blob that fails
+// either check is ignored and the defaults are used. RobotConfig only ever
+// grows at the end: loading an older, shorter blob keeps the defaults for
+// the fields it lacks, and configLoad() stores it back in the current
+// layout. Bump CONFIG_LAYOUT_VERSION with every change.
+
+#define CONFIG_NVS_NAMESPACE "robot"
+#define CONFIG_NVS_KEY "config"
+#define CONFIG_MAGIC 0x47464352             // "RCFG"
+#define CONFIG_LAYOUT_VERSION 2
+
+#define CONFIG_NUM_DURATIONS 6              // Mode durations cycled through
+#define CONFIG_NUM_MODES 7                  // NUM_MODES in movement_modes.h
+
+struct ConfigHeader {
+  uint32_t magic;
+  uint16_t version;                         // Layout the payload was written with
+  uint16_t length;                          // Payload bytes
+  uint32_t crc;                             // CRC-32 of the payload
+};
+
+// Layout 2. Layout 1 ended at maxRestDuration and its fields are ordered
+// by size; reserved keeps the fields appended after it aligned, so there
+// is no padding anywhere. The static_asserts in config.cpp pin the layout.
+struct RobotConfig {
+  uint32_t pwmFreqHz;
+  uint16_t motorSpeed;                              // Cruise speed, -255..255 scale
+  uint16_t movementIntervalMs[CONFIG_NUM_MODES];    // Per ModeID
+  uint16_t auxPinIntervalMs[CONFIG_NUM_MODES];
+  uint8_t pwmResolution;
+  uint8_t decay[2];                                 // DecayMode per motor
+  uint8_t durationOptions[CONFIG_NUM_DURATIONS];    // Mode durations (s)
+  uint8_t minRestDuration;                          // Rest between modes (s)
+  uint8_t maxRestDuration;
+  // Layout 2
+  uint8_t reserved;
+  uint16_t teleopDeadmanMs;                         // Stop this long after the last teleop command
+  uint16_t teleopPort;                              // UDP port for teleop commands
+};
+
+// The running configuration. Read it directly; only config.cpp writes it.
+extern RobotConfig robotConfig;
+
+void configDefaults(RobotConfig& config);
+bool configValidate(const RobotConfig& config);
+bool configLoad();
+bool configStore(const RobotConfig& config);
+
+// Blob encoding, separate from NVS so it can be checked on its own
+size_t configEncode(const RobotConfig& config, uint8_t* blob, size_t maxLength);
+bool configDecode(const uint8_t* blob, size_t length, RobotConfig& config, uint16_t& version);
+
+#endif // CONFIG_H
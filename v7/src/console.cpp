@@ -0,0 +1,367 @@
+#include <limits.h>
+#include <stddef.h>
+#include <strings.h>
+#include "hal.h"
+#include "console.h"
+#include "console_parse.h"
+#include "config.h"
+#include "movement_modes.h"
+#include "motor_control.h"
+#include "control.h"
+#include "power.h"
+#include "latency.h"
+#include "log.h"
+
+// Replies ignore the log level
+#define CONSOLE_REPLY(...) logWrite(LOG_LEVEL_NONE, __VA_ARGS__)
+
+typedef void (*ConsoleHandler)(int argc, char* const* argv);
+
+struct ConsoleCommand {
+  ConsoleHandler handler;
+  uint8_t minArgs;           // Including the command name
+  uint8_t maxArgs;
+  const char* usage;
+};
+
+static ConsoleLineReader reader;
+static uint32_t commandsRun = 0;
+static uint32_t commandErrors = 0;
+
+// The movement modes are only there once the motors have been released
+// (and never with the PWM sweep or the calibration)
+static bool modesRunning() {
+  if (getCurrentMode() == nullptr) {
+    CONSOLE_REPLY("Movement modes not running");
+    return false;
+  }
+  return true;
+}
+
+static void commandHelp(int argc, char* const* argv);
+
+static void commandMode(int argc, char* const* argv) {
+  if (!modesRunning()) {
+    return;
+  }
+  if (strcasecmp(argv[1], "next") == 0) {
+    selectNextMode();
+    return;
+  }
+  long modeId;
+  if (!consoleParseInt(argv[1], 0, NUM_MODES - 1, modeId)) {
+    for (modeId = 0; modeId < NUM_MODES; modeId++) {
+      if (strcasecmp(argv[1], getModeName(modeId)) == 0) {
+        break;
+      }
+    }
+  }
+  if (modeId == NUM_MODES) {
+    CONSOLE_REPLY("No mode '%s'", argv[1]);
+    commandErrors++;
+    return;
+  }
+  selectMode(modeId);
+}
+
+static void commandDrive(int argc, char* const* argv) {
+  long left;
+  long right;
+  if (!consoleParseInt(argv[1], -255, 255, left) || !consoleParseInt(argv[2], -255, 255, right)) {
+    CONSOLE_REPLY("Speeds are -255..255");
+    commandErrors++;
+    return;
+  }
+  if (!modesRunning()) {
+    return;
+  }
+  pauseMovementModes();
+  driveWheels(left, right);
+  CONSOLE_REPLY("Driving %ld %ld - 'mode next' resumes the modes", left, right);
+}
+
+static void commandStop(int argc, char* const* argv) {
+  if (!modesRunning()) {
+    return;
+  }
+  pauseMovementModes();
+  stopMotors(argc > 1 && strcasecmp(argv[1], "brake") == 0 ? STOP_BRAKE : STOP_COAST);
+  CONSOLE_REPLY("Stopped - 'mode next' resumes the modes");
+}
+
+static void commandStats(int argc, char* const* argv) {
+  ControlStats stats;
+  if (controlGetStats(stats)) {
+    CONSOLE_REPLY("Control: %lu periods, %lu overruns, %lu faults, exec max %lu us, jitter %ld..%ld us",
+                  (unsigned long)stats.periods, (unsigned long)stats.overruns, (unsigned long)stats.faults,
+                  (unsigned long)stats.execMaxUs, (long)stats.jitterMinUs, (long)stats.jitterMaxUs);
+    CONSOLE_REPLY("Current: peak est. %lu mA, %lu budget holds",
+                  (unsigned long)stats.peakCurrentMa, (unsigned long)stats.budgetHolds);
+  }
+  CONSOLE_REPLY("PWM: %lu writes, %lu avoided", getPwmWritesIssued(), getPwmWritesAvoided());
+  const MovementMode* mode = getCurrentMode();
+  CONSOLE_REPLY("Mode: %s%s for %lu s", mode != nullptr ? mode->name : "-",
+                movementModesPaused() ? " (paused)" : "", (halMillis() - getModeStartTime()) / 1000);
+  CONSOLE_REPLY("Log: level %d, %lu dropped; console: %lu commands, %lu errors, %lu overlong lines",
+                logGetLevel(), logGetDroppedCount(), (unsigned long)commandsRun,
+                (unsigned long)commandErrors, (unsigned long)reader.overflows());
+}
+
+static void commandLog(int argc, char* const* argv) {
+  long level;
+  if (argc > 1) {
+    if (!consoleParseInt(argv[1], LOG_LEVEL_NONE, LOG_LEVEL_DEBUG, level)) {
+      CONSOLE_REPLY("Log levels are 0 (none) .. 4 (debug)");
+      commandErrors++;
+      return;
+    }
+    logSetLevel(level);
+  }
+  CONSOLE_REPLY("Log level %d (built with %d)", logGetLevel(), LOG_LEVEL);
+}
+
+static void commandLatency(int argc, char* const* argv) {
+#ifdef ENABLE_LATENCY
+  if (argc == 1) {
+    latencyPrintSummary(LOG_LEVEL_NONE);
+    return;
+  }
+  long id;
+  long budgetUs = 0;
+  if (!consoleParseInt(argv[1], 0, LATENCY_NUM_HISTOGRAMS - 1, id) ||
+      (argc > 2 && !consoleParseInt(argv[2], 0, 1000000, budgetUs))) {
+    CONSOLE_REPLY("Histograms are 0..%d, budgets 0..1000000 us", LATENCY_NUM_HISTOGRAMS - 1);
+    commandErrors++;
+    return;
+  }
+  if (argc > 2) {
+    latencySetBudgetUs(id, budgetUs);
+    CONSOLE_REPLY("Latency %ld budget %ld us", id, budgetUs);
+  } else {
+    latencyPrintBuckets(id, LOG_LEVEL_NONE);
+  }
+#else
+  CONSOLE_REPLY("Built without ENABLE_LATENCY");
+#endif
+}
+
+// The RobotConfig fields "config" can reach, in struct order
+struct ConfigField {
+  const char* name;
+  uint8_t offset;
+  uint8_t size;              // Bytes per element: 1, 2 or 4
+  uint8_t count;             // Elements (1 unless an array)
+};
+
+#define CONFIG_FIELD(field, count) \
+  {#field, offsetof(RobotConfig, field), sizeof(RobotConfig::field) / (count), count}
+
+static const ConfigField configFields[] = {
+  CONFIG_FIELD(pwmFreqHz, 1),
+  CONFIG_FIELD(motorSpeed, 1),
+  CONFIG_FIELD(movementIntervalMs, CONFIG_NUM_MODES),
+  CONFIG_FIELD(auxPinIntervalMs, CONFIG_NUM_MODES),
+  CONFIG_FIELD(pwmResolution, 1),
+  CONFIG_FIELD(decay, 2),
+  CONFIG_FIELD(durationOptions, CONFIG_NUM_DURATIONS),
+  CONFIG_FIELD(minRestDuration, 1),
+  CONFIG_FIELD(maxRestDuration, 1),
+  CONFIG_FIELD(teleopDeadmanMs, 1),
+  CONFIG_FIELD(teleopPort, 1),
+};
+
+// "config set" edits this copy; "config save" stores it
+static RobotConfig editedConfig;
+static bool configEdited = false;
+
+static unsigned long readConfigField(const RobotConfig& config, const ConfigField& field, int index) {
+  const uint8_t* at = (const uint8_t*)&config + field.offset + index * field.size;
+  switch (field.size) {
+    case 1:
+      return *at;
+    case 2: {
+      uint16_t value;
+      memcpy(&value, at, sizeof(value));
+      return value;
+    }
+    default: {
+      uint32_t value;
+      memcpy(&value, at, sizeof(value));
+      return value;
+    }
+  }
+}
+
+static void writeConfigField(RobotConfig& config, const ConfigField& field, int index, unsigned long value) {
+  uint8_t* at = (uint8_t*)&config + field.offset + index * field.size;
+  switch (field.size) {
+    case 1:
+      *at = value;
+      break;
+    case 2: {
+      uint16_t half = value;
+      memcpy(at, &half, sizeof(half));
+      break;
+    }
+    default: {
+      uint32_t word = value;
+      memcpy(at, &word, sizeof(word));
+      break;
+    }
+  }
+}
+
+// FIELD or FIELD.N (an array element); index is -1 for a whole array
+static const ConfigField* findConfigField(char* word, long& index) {
+  index = -1;
+  char* dot = strchr(word, '.');
+  if (dot != nullptr) {
+    *dot = '\0';
+  }
+  for (const ConfigField& field : configFields) {
+    if (strcasecmp(word, field.name) != 0) {
+      continue;
+    }
+    if (dot != nullptr && !consoleParseInt(dot + 1, 0, field.count - 1, index)) {
+      CONSOLE_REPLY("%s has elements 0..%d", field.name, field.count - 1);
+      return nullptr;
+    }
+    return &field;
+  }
+  CONSOLE_REPLY("No setting '%s' - 'config get' lists them", word);
+  return nullptr;
+}
+
+static void printConfigField(const RobotConfig& config, const ConfigField& field) {
+  char line[CONSOLE_LINE_LENGTH];
+  int length = snprintf(line, sizeof(line), "  %s", field.name);
+  for (int i = 0; i < field.count && length < (int)sizeof(line); i++) {
+    length += snprintf(line + length, sizeof(line) - length, " %lu", readConfigField(config, field, i));
+  }
+  CONSOLE_REPLY("%s", line);
+}
+
+static void commandConfig(int argc, char* const* argv) {
+  if (!configEdited) {
+    editedConfig = robotConfig;
+  }
+  const char* action = argc > 1 ? argv[1] : "get";
+
+  if (strcasecmp(action, "get") == 0 && argc <= 3) {
+    long index = -1;
+    const ConfigField* only = nullptr;
+    if (argc == 3 && (only = findConfigField(argv[2], index)) == nullptr) {
+      commandErrors++;
+      return;
+    }
+    CONSOLE_REPLY("Config (layout %d)%s:", CONFIG_LAYOUT_VERSION, configEdited ? ", unsaved changes" : "");
+    for (const ConfigField& field : configFields) {
+      if (only == nullptr || only == &field) {
+        printConfigField(editedConfig, field);
+      }
+    }
+    return;
+  }
+
+  if (strcasecmp(action, "set") == 0 && argc == 4) {
+    long index;
+    const ConfigField* field = findConfigField(argv[2], index);
+    if (field == nullptr) {
+      commandErrors++;
+      return;
+    }
+    if (index < 0 && field->count > 1) {
+      CONSOLE_REPLY("%s is an array - set %s.N", field->name, field->name);
+      commandErrors++;
+      return;
+    }
+    long value;
+    long highest = field->size == 1 ? UINT8_MAX : field->size == 2 ? UINT16_MAX : LONG_MAX;
+    if (!consoleParseInt(argv[3], 0, highest, value)) {
+      CONSOLE_REPLY("%s takes 0..%ld", field->name, highest);
+      commandErrors++;
+      return;
+    }
+    writeConfigField(editedConfig, *field, index < 0 ? 0 : index, value);
+    configEdited = true;
+    CONSOLE_REPLY("%s set - 'config save' to keep it", field->name);
+    return;
+  }
+
+  if (strcasecmp(action, "save") == 0 && argc == 2) {
+    if (!configValidate(editedConfig)) {
+      CONSOLE_REPLY("Settings out of range - not saved");
+      commandErrors++;
+      return;
+    }
+    if (!configStore(editedConfig)) {
+      commandErrors++;
+      return;
+    }
+    configEdited = false;
+    CONSOLE_REPLY("Config saved - mode timings apply from the next mode, PWM and decay after a reset");
+    return;
+  }
+
+  CONSOLE_REPLY("Usage: config get [FIELD] | set FIELD VALUE | save");
+  commandErrors++;
+}
+
+// Indexed by ConsoleCommandId
+static const ConsoleCommand commands[CONSOLE_NUM_COMMANDS] = {
+  {commandHelp, 1, 1, ""},
+  {commandMode, 2, 2, "NAME|N|next"},
+  {commandDrive, 3, 3, "LEFT RIGHT"},
+  {commandStop, 1, 2, "[brake]"},
+  {commandStats, 1, 1, ""},
+  {commandLog, 1, 2, "[LEVEL]"},
+  {commandLatency, 1, 3, "[N [BUDGET_US]]"},
+  {commandConfig, 1, 4, "get [FIELD] | set FIELD VALUE | save"},
+};
+
+static void commandHelp(int argc, char* const* argv) {
+  for (int command = 0; command < CONSOLE_NUM_COMMANDS; command++) {
+    CONSOLE_REPLY("  %s %s", CONSOLE_COMMAND_NAMES[command], commands[command].usage);
+  }
+}
+
+static void runCommand(int argc, char* const* argv) {
+  int command = consoleLookup(argv[0]);
+  if (command < 0) {
+    CONSOLE_REPLY("Unknown command '%s' - try help", argv[0]);
+    commandErrors++;
+    return;
+  }
+  const ConsoleCommand& entry = commands[command];
+  if (argc < entry.minArgs || argc > entry.maxArgs) {
+    CONSOLE_REPLY("Usage: %s %s", CONSOLE_COMMAND_NAMES[command], entry.usage);
+    commandErrors++;
+    return;
+  }
+  commandsRun++;
+  entry.handler(argc, argv);
+}
+
+void consoleBegin() {
+  // USB serial stops while the CPU is in light sleep
+  powerSetSleepInhibit(POWER_INHIBIT_CONSOLE, true);
+  CONSOLE_REPLY("Console ready - type help");
+}
+
+// Never waits: parses what has arrived, up to CONSOLE_POLL_BUDGET bytes
+void consolePoll() {
+  uint8_t received[32];
+  size_t budget = CONSOLE_POLL_BUDGET;
+  while (budget != 0) {
+    size_t count = halSerialRead(received, min(sizeof(received), budget));
+    if (count == 0) {
+      break;
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (reader.feed((char)received[i])) {
+        runCommand(reader.argc(), reader.argv());
+      }
+    }
+    budget -= count;
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+// Interactive command console on the serial port.
+//
+// Build with -DENABLE_CONSOLE and type commands into a serial terminal:
+//
+//   mode NAME|N|next   jump to a movement mode (Spin, Wander ... Rest)
+//   drive LEFT RIGHT   pause the modes and drive the wheels (-255..255)
+//   stop [brake]       pause the modes and stop the wheels
+//   stats              control, PWM, log and console counters
+//   log [LEVEL]        show or set the log level (0 none .. 4 debug)
+//   latency [N [US]]   latency summary, histogram N's buckets, or set its
+//                      budget (ENABLE_LATENCY, see latency.h)
+//   config get [FIELD] show the settings (config.h), or one of them
+//   config set FIELD V change a setting; an array element is FIELD.N
+//   config save        validate the changes and store them in NVS
+//   help
+//
+// main.cpp polls it from a scheduler timer: each poll takes what the USB
+// serial port has received without waiting, parses it in a fixed buffer
+// (console_parse.h) and runs any complete commands. Replies go through
+// the log ring at LOG_LEVEL_NONE, so they show whatever the log level.
+// "mode" hands the wheels back to the movement modes after drive/stop.
+// "config set" edits a copy of the running configuration; nothing changes
+// until "config save". Mode timings apply from the next mode started, PWM
+// and decay settings only on the next boot.
+
+#define CONSOLE_POLL_INTERVAL_MS 20      // How often main.cpp polls for input
+#define CONSOLE_POLL_BUDGET 256          // Most bytes parsed per poll
+
+void consoleBegin();
+void consolePoll();
+
+#endif // CONSOLE_H
@@ -0,0 +1,80 @@
+#include <stdlib.h>
+#include <string.h>
+#include "console_parse.h"
+
+int consoleLookup(const char* word) {
+  int command = CONSOLE_HASH_TABLE.command[consoleSlot(word, CONSOLE_HASH_SEED)];
+  if (command < 0 || strcmp(word, CONSOLE_COMMAND_NAMES[command]) != 0) {
+    return -1;
+  }
+  return command;
+}
+
+bool consoleParseInt(const char* word, long low, long high, long& value) {
+  char* end;
+  long parsed = strtol(word, &end, 10);
+  if (end == word || *end != '\0' || parsed < low || parsed > high) {
+    return false;
+  }
+  value = parsed;
+  return true;
+}
+
+// Splits the line into words at spaces and tabs, terminating each in place
+void ConsoleLineReader::split() {
+  argCount = 0;
+  char* p = line;
+  while (argCount <= CONSOLE_MAX_ARGS) {
+    while (*p == ' ' || *p == '\t') {
+      p++;
+    }
+    if (*p == '\0') {
+      break;
+    }
+    args[argCount++] = p;
+    while (*p != '\0' && *p != ' ' && *p != '\t') {
+      p++;
+    }
+    if (*p != '\0') {
+      *p++ = '\0';
+    }
+  }
+}
+
+bool ConsoleLineReader::feed(char c) {
+  if (c == '\r' || c == '\n') {
+    bool complete = !discarding && length != 0;
+    if (complete) {
+      line[length] = '\0';
+      split();
+      complete = argCount != 0;
+    }
+    length = 0;
+    discarding = false;
+    return complete;
+  }
+
+  // Backspace or delete, for a person typing in a terminal
+  if (c == '\b' || c == 0x7F) {
+    if (length != 0 && !discarding) {
+      length--;
+    }
+    return false;
+  }
+
+  // Other control bytes (and a stray 0x00 that would cut the line short)
+  // are ignored
+  if ((uint8_t)c < ' ' && c != '\t') {
+    return false;
+  }
+  if (discarding) {
+    return false;
+  }
+  if (length == CONSOLE_LINE_LENGTH - 1) {
+    discarding = true;
+    overflowCount++;
+    return false;
+  }
+  line[length++] = c;
+  return false;
+}
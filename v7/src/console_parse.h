@@ -0,0 +1,126 @@
+#ifndef CONSOLE_PARSE_H
+#define CONSOLE_PARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Line parsing and command lookup for the serial console (console.h).
+//
+// ConsoleLineReader collects bytes into a fixed line buffer and, at the end
+// of a line, splits it into words in place - no allocation, no copies. A
+// line too long for the buffer is thrown away whole rather than run cut
+// short.
+//
+// Command names are looked up through a perfect hash built at compile
+// time: consoleFindSeed() searches for an FNV-1a basis that puts every name
+// in CONSOLE_COMMAND_NAMES in its own slot of CONSOLE_HASH_SLOTS, so a
+// lookup is one hash of the word, one table read and one strcmp(). Adding
+// a name that can't be placed fails the build.
+//
+// Hardware-free, so tools/consolebench.cpp can benchmark and fuzz it.
+
+#define CONSOLE_LINE_LENGTH 64         // Longest line, including the terminator
+#define CONSOLE_MAX_ARGS 4             // Command name plus up to three arguments
+#define CONSOLE_HASH_SLOTS 16          // Power of two, at least the number of commands
+#define CONSOLE_MAX_SEED 1000          // Give up the seed search here
+
+enum ConsoleCommandId {
+  CMD_HELP,
+  CMD_MODE,
+  CMD_DRIVE,
+  CMD_STOP,
+  CMD_STATS,
+  CMD_LOG,
+  CMD_LATENCY,
+  CMD_CONFIG,
+  CONSOLE_NUM_COMMANDS
+};
+
+// Indexed by ConsoleCommandId
+constexpr const char* CONSOLE_COMMAND_NAMES[CONSOLE_NUM_COMMANDS] = {
+  "help", "mode", "drive", "stop", "stats", "log", "latency", "config"
+};
+
+constexpr uint32_t consoleHash(const char* word, uint32_t seed) {
+  uint32_t hash = 2166136261u ^ seed;
+  for (; *word != '\0'; word++) {
+    hash = (hash ^ (uint8_t)*word) * 16777619u;
+  }
+  return hash;
+}
+
+constexpr uint32_t consoleSlot(const char* word, uint32_t seed) {
+  return consoleHash(word, seed) & (CONSOLE_HASH_SLOTS - 1);
+}
+
+// First seed that gives every command its own slot (CONSOLE_MAX_SEED if
+// there is none below it)
+constexpr uint32_t consoleFindSeed() {
+  for (uint32_t seed = 0; seed < CONSOLE_MAX_SEED; seed++) {
+    bool taken[CONSOLE_HASH_SLOTS] = {};
+    bool perfect = true;
+    for (int command = 0; command < CONSOLE_NUM_COMMANDS && perfect; command++) {
+      uint32_t slot = consoleSlot(CONSOLE_COMMAND_NAMES[command], seed);
+      perfect = !taken[slot];
+      taken[slot] = true;
+    }
+    if (perfect) {
+      return seed;
+    }
+  }
+  return CONSOLE_MAX_SEED;
+}
+
+constexpr uint32_t CONSOLE_HASH_SEED = consoleFindSeed();
+static_assert((CONSOLE_HASH_SLOTS & (CONSOLE_HASH_SLOTS - 1)) == 0, "CONSOLE_HASH_SLOTS must be a power of two");
+static_assert(CONSOLE_HASH_SEED < CONSOLE_MAX_SEED, "No perfect hash for the console commands - raise CONSOLE_HASH_SLOTS");
+
+// Slot -> ConsoleCommandId, -1 for an empty slot
+struct ConsoleHashTable {
+  int8_t command[CONSOLE_HASH_SLOTS];
+};
+
+constexpr ConsoleHashTable consoleBuildTable() {
+  ConsoleHashTable table = {};
+  for (int slot = 0; slot < CONSOLE_HASH_SLOTS; slot++) {
+    table.command[slot] = -1;
+  }
+  for (int command = 0; command < CONSOLE_NUM_COMMANDS; command++) {
+    table.command[consoleSlot(CONSOLE_COMMAND_NAMES[command], CONSOLE_HASH_SEED)] = (int8_t)command;
+  }
+  return table;
+}
+
+constexpr ConsoleHashTable CONSOLE_HASH_TABLE = consoleBuildTable();
+
+// ConsoleCommandId of a word, or -1
+int consoleLookup(const char* word);
+
+// Parses a whole word as a decimal integer in low..high
+bool consoleParseInt(const char* word, long low, long high, long& value);
+
+class ConsoleLineReader {
+public:
+  // Feeds one received byte. Returns true when it ends a non-empty line
+  // that fitted; argc() and argv() then hold its words until the next call.
+  // argc() is CONSOLE_MAX_ARGS + 1 if the line had more words than that.
+  bool feed(char c);
+
+  int argc() const { return argCount; }
+  char* const* argv() const { return args; }
+
+  // Lines thrown away for not fitting the buffer
+  uint32_t overflows() const { return overflowCount; }
+
+private:
+  void split();
+
+  char line[CONSOLE_LINE_LENGTH];
+  size_t length = 0;
+  bool discarding = false;     // Rest of an overlong line
+  char* args[CONSOLE_MAX_ARGS + 1];
+  int argCount = 0;
+  uint32_t overflowCount = 0;
+};
+
+#endif // CONSOLE_PARSE_H
@@ -0,0 +1,306 @@
+#include "hal.h"
+#include "control.h"
+#include "mailbox.h"
+#include "motion_profile.h"
+#include "current_budget.h"
+#include "motor_control.h"
+#include "speed_control.h"
+#include "current_sense.h"
+#include "pwm_sweep.h"
+#include "calibration.h"
+#include "encoder.h"
+#include "trace.h"
+#include "log.h"
+
+// Behaviour -> control
+static Mailbox<MotorSetpoint> setpointMailbox;
+
+// Control -> behaviour
+static Mailbox<ControlStats> statsMailbox;
+static volatile bool faultActive = false;
+static std::atomic<uint32_t> peakCurrentMa(0);   // Since the behaviour side last took it
+static std::atomic<bool> outputsLive(false);      // A wheel driven or ramping, as of the last period
+
+// Both sides: set by controlPostSetpoint(), cleared by the control task
+// before it takes the mailbox, so a post it misses stays pending
+static std::atomic<bool> setpointPending(false);
+
+#ifdef CONTROL_HOST_SETPOINTS
+// Protocol or teleop task <-> control
+static Mailbox<HostSetpoint> hostSetpointMailbox;
+#endif
+#ifdef ENABLE_PROTOCOL
+static Mailbox<ControlTelemetry> telemetryMailbox;
+#endif
+
+// Control task state
+static MotorSetpoint setpoint = {0, 0, STOP_COAST};
+#ifdef CONTROL_HOST_SETPOINTS
+static MotorSetpoint modeSetpoint = {0, 0, STOP_COAST};   // Newest from the behaviour side
+static HostSetpoint hostSetpoint = {};
+static unsigned long hostSetpointUs = 0;
+static bool hostActive = false;
+#endif
+#ifdef ENABLE_PROTOCOL
+static int16_t outputDuty[2] = {0, 0};
+#endif
+static MotionProfile wheelProfiles[2];
+static ControlStats stats = {};
+static uint64_t jitterAbsSum = 0;
+static unsigned long lastStartUs = 0;
+static bool firstPeriod = true;
+static bool outputsStale = true;   // Setpoint or fault state changed since the last commit
+
+// Behaviour side copy of the latest snapshot
+static ControlStats latestStats = {};
+static bool haveStats = false;
+
+static void recordTiming(unsigned long startUs) {
+  if (firstPeriod) {
+    firstPeriod = false;
+    stats.jitterMinUs = INT32_MAX;
+    stats.jitterMaxUs = INT32_MIN;
+  } else {
+    int32_t jitter = (int32_t)(startUs - lastStartUs) - CONTROL_PERIOD_US;
+    stats.jitterMinUs = min(stats.jitterMinUs, jitter);
+    stats.jitterMaxUs = max(stats.jitterMaxUs, jitter);
+    jitterAbsSum += (uint32_t)abs(jitter);
+    if (jitter >= CONTROL_PERIOD_US) {
+      stats.overruns++;
+    }
+    stats.periods++;
+    stats.jitterMeanAbsUs = (uint32_t)(jitterAbsSum / stats.periods);
+  }
+  lastStartUs = startUs;
+}
+
+// Moves the outputs one tick along the S-curve towards the setpoint,
+// within the supply current budget
+static void stepOutputs() {
+  // A fault cuts the outputs at once (coasting, not braked); recovery then
+  // ramps up from zero
+  if (faultActive) {
+    profileReset(wheelProfiles[MOTOR_A], 0);
+    profileReset(wheelProfiles[MOTOR_B], 0);
+    setStopMode(STOP_COAST);
+  } else {
+    setStopMode(setpoint.stop);
+    profileSetTarget(wheelProfiles[MOTOR_A], setpoint.left);
+    profileSetTarget(wheelProfiles[MOTOR_B], setpoint.right);
+  }
+  if (profileIsMoving(wheelProfiles[MOTOR_A]) || profileIsMoving(wheelProfiles[MOTOR_B])) {
+    outputsStale = true;
+  }
+  int duty[2];
+  currentBudgetStep(wheelProfiles, duty);
+  int left = duty[MOTOR_A];
+  int right = duty[MOTOR_B];
+  outputsLive.store(left != 0 || right != 0 || profileIsMoving(wheelProfiles[MOTOR_A]) ||
+                    profileIsMoving(wheelProfiles[MOTOR_B]), std::memory_order_relaxed);
+#ifdef ENABLE_PROTOCOL
+  outputDuty[MOTOR_A] = left;
+  outputDuty[MOTOR_B] = right;
+#endif
+
+  // Single writer, but the reader resets it - only raise it if still lower
+  uint32_t estimateMa = currentBudgetEstimateMa();
+  uint32_t peak = peakCurrentMa.load(std::memory_order_relaxed);
+  while (estimateMa > peak &&
+         !peakCurrentMa.compare_exchange_weak(peak, estimateMa, std::memory_order_relaxed)) {
+  }
+  if (estimateMa > stats.peakCurrentMa) {
+    stats.peakCurrentMa = estimateMa;
+  }
+  stats.budgetHolds = currentBudgetHolds();
+
+#ifdef ENABLE_SPEED_CONTROL
+  setWheelSpeedTargets(left, right);
+  speedControlStep();
+#else
+  if (outputsStale) {
+    moveDifferential(left, right);
+    outputsStale = false;
+  }
+#endif
+}
+
+// Picks up new setpoints. With the host link, a host setpoint wins until
+// HOST_SETPOINT_TIMEOUT_MS passes without another one.
+static void takeSetpoints(unsigned long nowUs) {
+#ifdef CONTROL_HOST_SETPOINTS
+  setpointPending.store(false);
+  bool changed = setpointMailbox.take(modeSetpoint);
+  if (hostSetpointMailbox.take(hostSetpoint)) {
+    hostSetpointUs = nowUs;
+    hostActive = true;
+    changed = true;
+  }
+  if (hostActive && nowUs - hostSetpointUs >= HOST_SETPOINT_TIMEOUT_MS * 1000UL) {
+    hostActive = false;
+    changed = true;
+  }
+  if (changed) {
+    setpoint = hostActive ? hostSetpoint.setpoint : modeSetpoint;
+    outputsStale = true;
+  }
+#else
+  setpointPending.store(false);
+  if (setpointMailbox.take(setpoint)) {
+    outputsStale = true;
+  }
+#endif
+}
+
+#ifdef ENABLE_PROTOCOL
+static void publishTelemetry(unsigned long startUs) {
+#if !defined(ENABLE_SPEED_CONTROL) && !defined(ENABLE_PWM_SWEEP) && !defined(ENABLE_CALIBRATION)
+  // Nothing else reads the encoders in this build - keep the positions current
+  encoderReadDelta(MOTOR_A);
+  encoderReadDelta(MOTOR_B);
+#endif
+  ControlTelemetry sample;
+  sample.timeUs = startUs;
+  sample.hostSeq = hostSetpoint.seq;
+  sample.hostActive = hostActive;
+  sample.fault = faultActive;
+  sample.setpoint = setpoint;
+  sample.output[MOTOR_A] = outputDuty[MOTOR_A];
+  sample.output[MOTOR_B] = outputDuty[MOTOR_B];
+  sample.encoder[MOTOR_A] = encoderGetPosition(MOTOR_A);
+  sample.encoder[MOTOR_B] = encoderGetPosition(MOTOR_B);
+  sample.currentMa = currentBudgetEstimateMa();
+  telemetryMailbox.post(sample);
+}
+#endif
+
+// One control period: check the fault pin, pick up the newest setpoint and
+// step the outputs
+static void controlStep() {
+  unsigned long startUs = halMicros();
+  recordTiming(startUs);
+
+  bool fault = checkFault();
+  if (fault != faultActive) {
+    TRACE_EVENT(TRACE_FAULT_CHECK, fault, 0);
+    faultActive = fault;
+    outputsStale = true;
+    if (fault) {
+      stats.faults++;
+    }
+  }
+
+  takeSetpoints(startUs);
+
+#ifdef ENABLE_CURRENT_SENSE
+  currentSenseStep();
+#endif
+
+#if defined(ENABLE_PWM_SWEEP)
+  // The sweep drives the outputs itself while it runs
+  if (pwmSweepStep(faultActive)) {
+    outputsStale = true;
+  } else {
+    stepOutputs();
+  }
+#elif defined(ENABLE_CALIBRATION)
+  // So does the calibration
+  if (calibrationStep(faultActive)) {
+    outputsStale = true;
+  } else {
+    stepOutputs();
+  }
+#else
+  stepOutputs();
+#endif
+
+#ifdef ENABLE_PROTOCOL
+  publishTelemetry(startUs);
+#endif
+
+  uint32_t execUs = halMicros() - startUs;
+  if (execUs > stats.execMaxUs) {
+    stats.execMaxUs = execUs;
+  }
+  if (stats.periods != 0 && stats.periods % CONTROL_STATS_PERIODS == 0) {
+    statsMailbox.post(stats);
+  }
+}
+
+void controlBegin() {
+  profileReset(wheelProfiles[MOTOR_A], 0);
+  profileReset(wheelProfiles[MOTOR_B], 0);
+  currentBudgetReset();
+#if defined(ENABLE_PROTOCOL) && !defined(ENABLE_SPEED_CONTROL) && !defined(ENABLE_PWM_SWEEP) && \
+    !defined(ENABLE_CALIBRATION)
+  encoderBegin();
+#endif
+  halTaskStartPeriodic(controlStep, CONTROL_PERIOD_US, CONTROL_TASK_PRIORITY, "motor_control");
+}
+
+// Behaviour side: hand a new wheel command to the control task
+void controlPostSetpoint(int left, int right, StopMode stop) {
+  MotorSetpoint next;
+  next.left = constrain(left, -255, 255);
+  next.right = constrain(right, -255, 255);
+  next.stop = stop;
+  setpointMailbox.post(next);
+  setpointPending.store(true);
+}
+
+// Behaviour side: true while the control task has work every period - a
+// setpoint it hasn't taken yet, or a wheel that is driven or ramping. Its
+// timer stops in light sleep, so powerIdle() stays awake meanwhile.
+bool controlNeedsCpu() {
+  return setpointPending.load() || outputsLive.load(std::memory_order_relaxed);
+}
+
+#ifdef CONTROL_HOST_SETPOINTS
+// Protocol or teleop task: hand a host wheel command to the control task
+void controlPostHostSetpoint(uint16_t seq, int left, int right, StopMode stop) {
+  HostSetpoint next;
+  next.setpoint.left = constrain(left, -255, 255);
+  next.setpoint.right = constrain(right, -255, 255);
+  next.setpoint.stop = stop;
+  next.seq = seq;
+  hostSetpointMailbox.post(next);
+}
+#endif
+
+#ifdef ENABLE_PROTOCOL
+// Protocol task: newest telemetry sample, if there is one it hasn't seen
+bool controlTakeTelemetry(ControlTelemetry& telemetry) {
+  return telemetryMailbox.take(telemetry);
+}
+#endif
+
+bool controlFaultActive() {
+  return faultActive;
+}
+
+// Highest estimated motor current since the last call
+uint32_t controlTakePeakCurrentMa() {
+  return peakCurrentMa.exchange(0, std::memory_order_relaxed);
+}
+
+// Behaviour side: latest stats snapshot (false until the first one arrives)
+bool controlGetStats(ControlStats& out) {
+  if (statsMailbox.take(latestStats)) {
+    haveStats = true;
+  }
+  out = latestStats;
+  return haveStats;
+}
+
+void controlReport() {
+  ControlStats snapshot;
+  if (!controlGetStats(snapshot)) {
+    return;
+  }
+  LOG_INFO("Control: %lu periods, %lu overruns, %lu faults",
+           (unsigned long)snapshot.periods, (unsigned long)snapshot.overruns, (unsigned long)snapshot.faults);
+  LOG_INFO("Control: jitter %ld..%ld us (mean |%lu| us), exec max %lu us",
+           (long)snapshot.jitterMinUs, (long)snapshot.jitterMaxUs,
+           (unsigned long)snapshot.jitterMeanAbsUs, (unsigned long)snapshot.execMaxUs);
+  LOG_INFO("Control: peak est. motor current %lu mA (budget %d mA), %lu holds",
+           (unsigned long)snapshot.peakCurrentMa, CURRENT_BUDGET_MA, (unsigned long)snapshot.budgetHolds);
+}
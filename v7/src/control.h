@@ -0,0 +1,90 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+#include "motor_control.h"
+
+// Fixed-period motor control task.
+//
+// The control task is the only code that writes the LEDC channels or reads
+// the DRV8833 fault pin once setupMotors() has finished. It runs every
+// CONTROL_PERIOD_US at a priority above the loop (behaviour) task, so mode
+// logic, logging and serial output can't delay actuation or fault reaction.
+// The behaviour side hands over wheel setpoints through a wait-free mailbox
+// (driveWheels() posts them); the control task moves towards the newest one
+// along a jerk-limited profile (motion_profile.h) within the supply current
+// budget (current_budget.h), or holds the outputs at zero while the driver
+// reports a fault.
+//
+// With -DENABLE_PROTOCOL or -DENABLE_TELEOP a host can take over from the
+// behaviour side: setpoints posted with controlPostHostSetpoint() win for
+// as long as they keep arriving, and the newest behaviour setpoint takes
+// over again HOST_SETPOINT_TIMEOUT_MS after the last one. With the
+// protocol, the control task also publishes a ControlTelemetry sample
+// every period for the protocol task.
+
+#define CONTROL_PERIOD_US 2000         // 500 Hz
+#define CONTROL_TASK_PRIORITY 20       // Above loop/log (1), below the esp_timer task (22)
+#define CONTROL_STATS_PERIODS 500      // Publish a stats snapshot this often (1 s)
+#define CONTROL_REPORT_INTERVAL_MS 60000  // How often main.cpp logs the stats
+#define HOST_SETPOINT_TIMEOUT_MS 250   // Host control lapses this long after its last setpoint
+
+// Builds with a host link posting setpoints (there can only be one)
+#if defined(ENABLE_PROTOCOL) || defined(ENABLE_TELEOP)
+#define CONTROL_HOST_SETPOINTS
+#endif
+
+// Wheel command on the moveDifferential() scale (-255..255)
+struct MotorSetpoint {
+  int16_t left;
+  int16_t right;
+  StopMode stop;     // What a wheel at zero does
+};
+
+// Setpoint from the host link, numbered by the host
+struct HostSetpoint {
+  MotorSetpoint setpoint;
+  uint16_t seq;
+};
+
+// One control period as the host sees it (ENABLE_PROTOCOL)
+struct ControlTelemetry {
+  uint32_t timeUs;             // Start of the period
+  uint16_t hostSeq;            // Last host setpoint taken
+  bool hostActive;             // Host setpoints in control
+  bool fault;
+  MotorSetpoint setpoint;      // In effect
+  int16_t output[2];           // Duty on the -255..255 scale, after profile and budget
+  int32_t encoder[2];          // Accumulated counts
+  uint32_t currentMa;          // Estimated motor current
+};
+
+// Period timing measured by the control task since it started. Jitter is
+// the actual start-to-start interval minus CONTROL_PERIOD_US.
+struct ControlStats {
+  uint32_t periods;
+  int32_t jitterMinUs;
+  int32_t jitterMaxUs;
+  uint32_t jitterMeanAbsUs;
+  uint32_t execMaxUs;          // Longest single control step
+  uint32_t overruns;           // Periods that started a full period late or more
+  uint32_t faults;             // Fault pin assertions seen
+  uint32_t peakCurrentMa;      // Highest estimated motor current
+  uint32_t budgetHolds;        // Wheel-ticks held back by the current budget
+};
+
+void controlBegin();
+void controlPostSetpoint(int left, int right, StopMode stop = STOP_COAST);
+bool controlFaultActive();
+bool controlNeedsCpu();
+uint32_t controlTakePeakCurrentMa();
+bool controlGetStats(ControlStats& stats);
+void controlReport();
+
+// Protocol or teleop task (CONTROL_HOST_SETPOINTS)
+void controlPostHostSetpoint(uint16_t seq, int left, int right, StopMode stop);
+
+// Protocol task (ENABLE_PROTOCOL)
+bool controlTakeTelemetry(ControlTelemetry& telemetry);
+
+#endif // CONTROL_H
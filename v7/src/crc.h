@@ -0,0 +1,11 @@
+#ifndef CRC_H
+#define CRC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32 (IEEE 802.3, as zlib computes it). Pass the previous result as
+// crc to continue over more data.
+uint32_t crc32(const void* data, size_t length, uint32_t crc = 0);
+
+#endif // CRC_H
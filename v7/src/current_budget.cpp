@@ -0,0 +1,81 @@
+#include "hal.h"
+#include "current_budget.h"
+#include "motor_control.h"
+
+static const Fixed SPEED_ALPHA = Fixed::fromFloat((float)CONTROL_PERIOD_US / MOTOR_MODEL_TAU_US);
+static const Fixed FREE_RUN_SCALE = Fixed::fromFloat(255.0f / (255 - MOTOR_BREAKAWAY_DUTY));
+static const Fixed MA_PER_DUTY = Fixed::fromFloat(MOTOR_STALL_CURRENT_MA / 255.0f);
+
+// Estimated speed per motor, as the duty whose back-EMF it produces
+static Fixed modelSpeed[2];
+static int appliedDuty[2];
+static uint32_t estimateMa = 0;
+static uint32_t holds = 0;
+
+// Speed the motor settles at for a duty, past static friction
+static Fixed steadySpeed(int duty) {
+  int magnitude = abs(duty);
+  if (magnitude <= MOTOR_BREAKAWAY_DUTY) {
+    return Fixed::fromInt(0);
+  }
+  Fixed speed = FREE_RUN_SCALE * (int32_t)(magnitude - MOTOR_BREAKAWAY_DUTY);
+  return duty > 0 ? speed : -speed;
+}
+
+static uint32_t motorCurrentMa(int motor, int duty) {
+  return (uint32_t)(MA_PER_DUTY * fixedAbs(Fixed::fromInt(duty) - modelSpeed[motor])).toInt();
+}
+
+void currentBudgetReset() {
+  for (int motor = 0; motor < 2; motor++) {
+    modelSpeed[motor] = Fixed::fromInt(0);
+    appliedDuty[motor] = 0;
+  }
+  estimateMa = 0;
+}
+
+// Advances both profiles by one tick within the budget and returns the
+// duties to apply. A step is allowed if it doesn't raise the motor's own
+// current, or if the total with the other motor at its present duty stays
+// within the budget. The wheel further into its move goes first; on a tie
+// (both started together) Motor A does, so Motor B waits its turn.
+void currentBudgetStep(MotionProfile profiles[2], int duty[2]) {
+  int first = (profiles[MOTOR_B].tick > profiles[MOTOR_A].tick) ? MOTOR_B : MOTOR_A;
+  uint32_t motorMa[2] = {motorCurrentMa(MOTOR_A, appliedDuty[MOTOR_A]),
+                         motorCurrentMa(MOTOR_B, appliedDuty[MOTOR_B])};
+
+  for (int i = 0; i < 2; i++) {
+    int motor = (i == 0) ? first : 1 - first;
+    MotionProfile& profile = profiles[motor];
+    bool moving = profileIsMoving(profile);
+
+    MotionProfile saved = profile;
+    int next = profileStep(profile);
+    uint32_t nextMa = motorCurrentMa(motor, next);
+    if (moving && nextMa > motorMa[motor] && nextMa + motorMa[1 - motor] > CURRENT_BUDGET_MA) {
+      profile = saved;
+      holds++;
+    } else {
+      appliedDuty[motor] = next;
+      motorMa[motor] = nextMa;
+    }
+    duty[motor] = appliedDuty[motor];
+  }
+
+  estimateMa = motorMa[MOTOR_A] + motorMa[MOTOR_B];
+
+  // First-order lag towards the steady-state speed for each duty
+  for (int motor = 0; motor < 2; motor++) {
+    modelSpeed[motor] += SPEED_ALPHA * (steadySpeed(appliedDuty[motor]) - modelSpeed[motor]);
+  }
+}
+
+// Estimated combined motor current for the duties applied last tick
+uint32_t currentBudgetEstimateMa() {
+  return estimateMa;
+}
+
+// Wheel-ticks held back to stay within the budget
+uint32_t currentBudgetHolds() {
+  return holds;
+}
@@ -0,0 +1,29 @@
+#ifndef CURRENT_BUDGET_H
+#define CURRENT_BUDGET_H
+
+#include <stdint.h>
+#include "motion_profile.h"
+
+// Supply current budget for the two motors.
+//
+// The robot runs from a powerbank through a step-up converter, which sags
+// when both motors draw start current at once. Each motor is modelled as
+// a DC motor whose current is proportional to the applied duty minus its
+// back-EMF; its speed follows the duty with a first-order lag and static
+// friction. Each control tick, currentBudgetStep() advances both wheel
+// profiles in priority order. A wheel whose next step would push the
+// estimated total over CURRENT_BUDGET_MA, and would draw more than it does
+// now, is held for that tick. Two simultaneous starts or reversals are
+// therefore staggered instead of overlapping.
+
+#define MOTOR_STALL_CURRENT_MA 800     // Per motor at full duty, stalled
+#define MOTOR_MODEL_TAU_US 50000       // Mechanical time constant
+#define MOTOR_BREAKAWAY_DUTY 31        // Duty below which the wheel doesn't turn
+#define CURRENT_BUDGET_MA 900          // Combined motor budget
+
+void currentBudgetReset();
+void currentBudgetStep(MotionProfile profiles[2], int duty[2]);
+uint32_t currentBudgetEstimateMa();
+uint32_t currentBudgetHolds();
+
+#endif // CURRENT_BUDGET_H
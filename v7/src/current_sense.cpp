@@ -0,0 +1,157 @@
+#include "hal.h"
+#include "current_sense.h"
+#include "current_window.h"
+#include "mailbox.h"
+#include "power.h"
+#include "log.h"
+
+// Words taken from the DMA ring per read - a control period's worth plus
+// headroom
+#define SENSE_READ_WORDS 32
+
+static_assert((uint64_t)CURRENT_SENSE_WINDOW_SAMPLES * HAL_ADC_STREAM_FULL_SCALE * HAL_ADC_STREAM_FULL_SCALE <= UINT32_MAX,
+              "sumSquares would overflow - shorten the window");
+
+static const uint8_t sensePins[2] = {CURRENT_SENSE_PIN_A, CURRENT_SENSE_PIN_B};
+
+// Control -> behaviour
+static Mailbox<CurrentSenseWindow> windowMailbox;
+
+// Control task state
+static volatile bool senseRunning = false;
+static uint8_t senseChannel[2];
+static SenseAccumulator accumulators[2];
+static CurrentSenseWindow pending = {};
+static uint8_t pendingMask = 0;         // Motors whose window in pending is complete
+static CurrentSenseWindow lastWindow = {};
+static uint16_t readBuffer[SENSE_READ_WORDS];
+
+// Behaviour side copy of the latest window
+static CurrentSenseWindow latestWindow = {};
+static bool haveWindow = false;
+
+static uint16_t countsToMa(uint32_t counts) {
+  return (uint16_t)(counts * (HAL_ADC_STREAM_FULL_SCALE_MV * 1000UL / CURRENT_SENSE_SHUNT_MOHM) /
+                    HAL_ADC_STREAM_FULL_SCALE);
+}
+
+static void resetAccumulators() {
+  for (int motor = 0; motor < 2; motor++) {
+    currentWindowReset(accumulators[motor]);
+  }
+  pending = {};
+  pendingMask = 0;
+  lastWindow = {};
+}
+
+// Closes one motor's window, and posts once both motors have one
+static void finishWindow(int motor) {
+  SenseWindowStats stats = currentWindowStats(accumulators[motor]);
+  pending.peakMa[motor] = countsToMa(stats.peak);
+  pending.meanMa[motor] = countsToMa(stats.mean);
+  pending.rmsMa[motor] = countsToMa(stats.rms);
+  pending.maxPeakMa[motor] = max(pending.maxPeakMa[motor], pending.peakMa[motor]);
+  currentWindowReset(accumulators[motor]);
+
+  pendingMask |= 1 << motor;
+  if (pendingMask == 0x03) {
+    pending.windows++;
+    windowMailbox.post(pending);
+    lastWindow = pending;
+    pendingMask = 0;
+  }
+}
+
+// Folds conversion words into the running sums where they lie - no copy,
+// one pass, integer only
+void currentSenseProcess(const uint16_t* words, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    uint8_t channel = halAdcSampleChannel(words[i]);
+    int motor = channel == senseChannel[0] ? 0 : (channel == senseChannel[1] ? 1 : -1);
+    if (motor < 0) {
+      continue;
+    }
+
+    if (currentWindowAdd(accumulators[motor], halAdcSampleValue(words[i]))) {
+      finishWindow(motor);
+    }
+  }
+}
+
+// Starts sampling the shunts. Both share ADC1 with the rail and seed reads,
+// so call this once those are done.
+void currentSenseBegin() {
+  for (int motor = 0; motor < 2; motor++) {
+    senseChannel[motor] = halAdcChannel(sensePins[motor]);
+  }
+  resetAccumulators();
+
+  // The ADC's DMA stops in light sleep
+  powerSetSleepInhibit(POWER_INHIBIT_CURRENT_SENSE, true);
+  halAdcStreamStart(sensePins, 2, CURRENT_SENSE_SAMPLE_RATE_HZ);
+  senseRunning = true;
+}
+
+// Control task: drains the DMA ring
+void currentSenseStep() {
+  if (!senseRunning) {
+    return;
+  }
+  size_t count;
+  do {
+    count = halAdcStreamRead(readBuffer, SENSE_READ_WORDS);
+    currentSenseProcess(readBuffer, count);
+  } while (count == SENSE_READ_WORDS);
+}
+
+// Control task: the window most recently posted
+const CurrentSenseWindow& currentSenseLastWindow() {
+  return lastWindow;
+}
+
+// Behaviour side: latest window (false until the first one arrives)
+bool currentSenseTake(CurrentSenseWindow& window) {
+  if (windowMailbox.take(latestWindow)) {
+    haveWindow = true;
+  }
+  window = latestWindow;
+  return haveWindow;
+}
+
+void currentSenseReport() {
+  CurrentSenseWindow window;
+  if (!currentSenseTake(window)) {
+    return;
+  }
+  for (int motor = 0; motor < 2; motor++) {
+    LOG_INFO("Current %c: peak %u mean %u rms %u mA (max peak %u mA)",
+             motor == 0 ? 'A' : 'B', window.peakMa[motor], window.meanMa[motor],
+             window.rmsMa[motor], window.maxPeakMa[motor]);
+  }
+}
+
+// Times the processing stage on 1000 synthetic samples: a PWM-chopped
+// current on each motor, alternating as the DMA delivers them. Uses the
+// live accumulators, so call it before currentSenseBegin(). The native
+// build's cycle counter follows the virtual clock, so it reads 0 there.
+void currentSenseMeasureOverhead() {
+  const int samples = 1000;
+  static uint16_t words[samples];
+
+  for (int motor = 0; motor < 2; motor++) {
+    senseChannel[motor] = halAdcChannel(sensePins[motor]);
+  }
+  for (int i = 0; i < samples; i++) {
+    uint16_t value = (i / 2) % 8 < 3 ? 600 + (i % 16) * 8 : 0;
+    words[i] = (uint16_t)(senseChannel[i & 1] << 12) | value;
+  }
+
+  resetAccumulators();
+  uint32_t start = halCycleCount();
+  currentSenseProcess(words, samples);
+  uint32_t cycles = halCycleCount() - start;
+  resetAccumulators();
+
+  LOG_INFO("Current sense cost: %lu cycles per 1000 samples (%lu us)",
+           (unsigned long)cycles, (unsigned long)(cycles / getCpuFrequencyMhz()));
+}
@@ -0,0 +1,43 @@
+#ifndef CURRENT_SENSE_H
+#define CURRENT_SENSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Measured motor current from shunts on the DRV8833 AISEN/BISEN pins
+// (optional - build with -DENABLE_CURRENT_SENSE).
+//
+// The ESP32-S2's continuous ADC samples both shunts into a DMA ring with no
+// CPU involvement. Each control period, currentSenseStep() folds the new
+// conversions into running per-motor sums straight from the read buffer
+// (current_window.h).
+// Every CURRENT_SENSE_WINDOW_SAMPLES samples per motor it publishes that
+// window's peak, mean and RMS through a mailbox. Unlike the estimate in
+// current_budget.h, this is what the motors really draw, PWM ripple
+// included.
+
+#define CURRENT_SENSE_PIN_A 2                  // GPIO2 (ADC1_CH1) - Motor A shunt
+#define CURRENT_SENSE_PIN_B 3                  // GPIO3 (ADC1_CH2) - Motor B shunt
+#define CURRENT_SENSE_SHUNT_MOHM 200           // 800 mA stall -> 160 mV
+#define CURRENT_SENSE_SAMPLE_RATE_HZ 4000      // Both shunts together
+#define CURRENT_SENSE_WINDOW_SAMPLES 200       // Per motor (100 ms)
+#define CURRENT_SENSE_REPORT_INTERVAL_MS 60000 // How often main.cpp logs the last window
+
+// The latest completed window, in mA
+struct CurrentSenseWindow {
+  uint16_t peakMa[2];
+  uint16_t meanMa[2];
+  uint16_t rmsMa[2];
+  uint16_t maxPeakMa[2];   // Highest window peak since sensing started
+  uint32_t windows;        // Windows completed since sensing started
+};
+
+void currentSenseBegin();
+void currentSenseStep();
+void currentSenseProcess(const uint16_t* words, size_t count);
+bool currentSenseTake(CurrentSenseWindow& window);
+const CurrentSenseWindow& currentSenseLastWindow();
+void currentSenseReport();
+void currentSenseMeasureOverhead();
+
+#endif // CURRENT_SENSE_H
@@ -0,0 +1,27 @@
+#include "current_window.h"
+
+// Integer square root, bit by bit
+static uint32_t isqrt32(uint32_t value) {
+  uint32_t root = 0;
+  uint32_t bit = 1UL << 30;
+  while (bit > value) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (value >= root + bit) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+SenseWindowStats currentWindowStats(const SenseAccumulator& acc) {
+  if (acc.count == 0) {
+    return {0, 0, 0};
+  }
+  return {acc.peak, (uint16_t)(acc.sum / acc.count), (uint16_t)isqrt32(acc.sumSquares / acc.count)};
+}
@@ -0,0 +1,48 @@
+#ifndef CURRENT_WINDOW_H
+#define CURRENT_WINDOW_H
+
+#include <stdint.h>
+#include "current_sense.h"
+
+// Per-window peak, mean and RMS of one shunt's samples (current_sense.h).
+//
+// currentWindowAdd() folds one conversion into running integer sums and
+// says when CURRENT_SENSE_WINDOW_SAMPLES of them are in; currentWindowStats()
+// then turns the sums into the window's figures, still in ADC counts.
+// Nothing is stored per sample, so the fold is a few adds and a multiply.
+//
+// Hardware-free, so tools/sensecheck.cpp can check and time it.
+
+// Running sums for one motor's window, in raw ADC counts
+struct SenseAccumulator {
+  uint32_t count;
+  uint32_t sum;
+  uint32_t sumSquares;
+  uint16_t peak;
+};
+
+// One finished window, in raw ADC counts
+struct SenseWindowStats {
+  uint16_t peak;
+  uint16_t mean;
+  uint16_t rms;
+};
+
+// True once the window is full; take currentWindowStats() and reset it then
+static inline bool currentWindowAdd(SenseAccumulator& acc, uint16_t value) {
+  acc.sum += value;
+  acc.sumSquares += (uint32_t)value * value;
+  if (value > acc.peak) {
+    acc.peak = value;
+  }
+  return ++acc.count == CURRENT_SENSE_WINDOW_SAMPLES;
+}
+
+static inline void currentWindowReset(SenseAccumulator& acc) {
+  acc = {0, 0, 0, 0};
+}
+
+// Mean and RMS round down. An empty window reads all zero.
+SenseWindowStats currentWindowStats(const SenseAccumulator& acc);
+
+#endif // CURRENT_WINDOW_H
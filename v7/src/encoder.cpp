@@ -0,0 +1,37 @@
+#include "hal.h"
+#include "encoder.h"
+#include "motor_control.h"
+
+static int16_t lastRaw[2] = {0, 0};
+static int32_t position[2] = {0, 0};
+
+void encoderBegin() {
+  halEncoderSetup(MOTOR_A, ENCODER_A_PIN_A, ENCODER_A_PIN_B);
+  halEncoderSetup(MOTOR_B, ENCODER_B_PIN_A, ENCODER_B_PIN_B);
+  lastRaw[MOTOR_A] = halEncoderRead(MOTOR_A);
+  lastRaw[MOTOR_B] = halEncoderRead(MOTOR_B);
+}
+
+// Counts since the previous call. The hardware counter resets to zero when
+// it hits +/-HAL_ENCODER_LIMIT, so a jump of more than half the range is
+// taken as a wrap. Must be called often enough that a wheel moves less
+// than HAL_ENCODER_LIMIT/2 counts between calls.
+int32_t encoderReadDelta(int motor) {
+  int16_t raw = halEncoderRead(motor);
+  int32_t delta = (int32_t)raw - lastRaw[motor];
+  lastRaw[motor] = raw;
+
+  if (delta > HAL_ENCODER_LIMIT / 2) {
+    delta -= HAL_ENCODER_LIMIT;
+  } else if (delta < -HAL_ENCODER_LIMIT / 2) {
+    delta += HAL_ENCODER_LIMIT;
+  }
+
+  position[motor] += delta;
+  return delta;
+}
+
+// Accumulated counts, updated by encoderReadDelta()
+int32_t encoderGetPosition(int motor) {
+  return position[motor];
+}
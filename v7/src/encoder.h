@@ -0,0 +1,13 @@
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <stdint.h>
+
+// Quadrature wheel encoders counted by the PCNT peripheral. Encoder unit 0
+// is on Motor A (left), unit 1 on Motor B (right).
+
+void encoderBegin();
+int32_t encoderReadDelta(int motor);
+int32_t encoderGetPosition(int motor);
+
+#endif // ENCODER_H
@@ -0,0 +1,158 @@
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#include <stdint.h>
+
+// Q16.16 fixed-point number for the control and kinematics math.
+//
+// The ESP32-S2 has no FPU, so float math is done in software. Fixed uses
+// plain 32-bit integer arithmetic instead. All operators saturate at the
+// ends of the range (about +/-32768) rather than wrapping. Float constants
+// convert at compile time with Fixed::fromFloat().
+
+struct Fixed {
+  int32_t raw;
+
+  static const int FRAC_BITS = 16;
+  static const int32_t ONE = 1 << FRAC_BITS;
+
+  static constexpr Fixed fromRaw(int32_t value) {
+    return Fixed{value};
+  }
+
+  static constexpr Fixed fromInt(int32_t value) {
+    return Fixed{value > 32767 ? INT32_MAX : (value < -32768 ? INT32_MIN : value * ONE)};
+  }
+
+  // For constants - evaluated at compile time when the argument is constant
+  static constexpr Fixed fromFloat(float value) {
+    return Fixed{(int32_t)(value * ONE + (value >= 0 ? 0.5f : -0.5f))};
+  }
+
+  // Rounds to the nearest integer
+  constexpr int32_t toInt() const {
+    return (int32_t)(((int64_t)raw + (ONE / 2)) >> FRAC_BITS);
+  }
+
+  // Debug output only - this is the soft-float path Fixed avoids
+  float toFloat() const {
+    return (float)raw / ONE;
+  }
+};
+
+static inline int32_t fixedSaturate(int64_t value) {
+  if (value > INT32_MAX) return INT32_MAX;
+  if (value < INT32_MIN) return INT32_MIN;
+  return (int32_t)value;
+}
+
+static inline Fixed operator+(Fixed a, Fixed b) {
+  return Fixed::fromRaw(fixedSaturate((int64_t)a.raw + b.raw));
+}
+
+static inline Fixed operator-(Fixed a, Fixed b) {
+  return Fixed::fromRaw(fixedSaturate((int64_t)a.raw - b.raw));
+}
+
+static inline Fixed operator-(Fixed a) {
+  return Fixed::fromRaw(a.raw == INT32_MIN ? INT32_MAX : -a.raw);
+}
+
+static inline Fixed operator*(Fixed a, Fixed b) {
+  return Fixed::fromRaw(fixedSaturate(((int64_t)a.raw * b.raw) >> Fixed::FRAC_BITS));
+}
+
+// Multiplying by an integer needs no shift
+static inline Fixed operator*(Fixed a, int32_t b) {
+  return Fixed::fromRaw(fixedSaturate((int64_t)a.raw * b));
+}
+
+// Division uses a 64-bit divide - keep it out of per-tick code where possible
+static inline Fixed operator/(Fixed a, Fixed b) {
+  if (b.raw == 0) {
+    return Fixed::fromRaw(a.raw >= 0 ? INT32_MAX : INT32_MIN);
+  }
+  return Fixed::fromRaw(fixedSaturate(((int64_t)a.raw << Fixed::FRAC_BITS) / b.raw));
+}
+
+static inline Fixed& operator+=(Fixed& a, Fixed b) { a = a + b; return a; }
+static inline Fixed& operator-=(Fixed& a, Fixed b) { a = a - b; return a; }
+
+static inline bool operator==(Fixed a, Fixed b) { return a.raw == b.raw; }
+static inline bool operator!=(Fixed a, Fixed b) { return a.raw != b.raw; }
+static inline bool operator<(Fixed a, Fixed b) { return a.raw < b.raw; }
+static inline bool operator>(Fixed a, Fixed b) { return a.raw > b.raw; }
+static inline bool operator<=(Fixed a, Fixed b) { return a.raw <= b.raw; }
+static inline bool operator>=(Fixed a, Fixed b) { return a.raw >= b.raw; }
+
+static inline Fixed fixedClamp(Fixed value, Fixed low, Fixed high) {
+  return value < low ? low : (value > high ? high : value);
+}
+
+static inline Fixed fixedAbs(Fixed value) {
+  return value.raw < 0 ? -value : value;
+}
+
+// Quarter-wave sine table, sin(i * 90deg / 64) in Q16.16
+static const int32_t FIXED_SIN_TABLE[65] = {
+  0, 1608, 3216, 4821, 6424, 8022, 9616, 11204,
+  12785, 14359, 15924, 17479, 19024, 20557, 22078, 23586,
+  25080, 26558, 28020, 29466, 30893, 32303, 33692, 35062,
+  36410, 37736, 39040, 40320, 41576, 42806, 44011, 45190,
+  46341, 47464, 48559, 49624, 50660, 51665, 52639, 53581,
+  54491, 55368, 56212, 57022, 57798, 58538, 59244, 59914,
+  60547, 61145, 61705, 62228, 62714, 63162, 63572, 63944,
+  64277, 64571, 64827, 65043, 65220, 65358, 65457, 65516,
+  65536
+};
+
+// Sine of an angle in binary degrees (65536 = one full turn), linearly
+// interpolated from the quarter-wave table. Worst-case error ~1e-4.
+static inline Fixed fixedSin(uint16_t angle) {
+  uint16_t quadrant = angle >> 14;
+  uint16_t offset = angle & 0x3FFF;        // Position within the quadrant
+  if (quadrant & 1) {
+    offset = 0x4000 - offset;              // Mirror for the falling quadrants
+  }
+
+  uint16_t index = offset >> 8;            // 64 table steps per quadrant
+  uint16_t fraction = offset & 0xFF;
+  int32_t value = FIXED_SIN_TABLE[index];
+  if (index < 64) {
+    value += ((FIXED_SIN_TABLE[index + 1] - value) * fraction) >> 8;
+  }
+
+  return Fixed::fromRaw(quadrant & 2 ? -value : value);
+}
+
+static inline Fixed fixedCos(uint16_t angle) {
+  return fixedSin(angle + 0x4000);
+}
+
+// Square root by the bitwise integer method (16 iterations, exact to the
+// last bit). Negative inputs return zero.
+static inline Fixed fixedSqrt(Fixed value) {
+  if (value.raw <= 0) {
+    return Fixed::fromRaw(0);
+  }
+
+  // sqrt(raw / 2^16) * 2^16 == sqrt(raw * 2^16)
+  uint64_t remainder = (uint64_t)value.raw << Fixed::FRAC_BITS;
+  uint64_t root = 0;
+  uint64_t bit = (uint64_t)1 << 46;
+  while (bit > remainder) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (remainder >= root + bit) {
+      remainder -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return Fixed::fromRaw((int32_t)root);
+}
+
+#endif // FIXED_POINT_H
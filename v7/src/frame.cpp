@@ -0,0 +1,115 @@
+#include "frame.h"
+#include "crc.h"
+
+void FrameWriter::begin(uint8_t type) {
+  length = 1;                 // buffer[0] is the first code byte
+  codeIndex = 0;
+  code = 1;
+  decodedLength = 0;
+  crc = 0;
+  putU8(type);
+}
+
+// COBS: a code byte gives the distance to the next zero, which is then
+// left out. A block that reaches 254 data bytes ends without one.
+void FrameWriter::putEncoded(uint8_t byte) {
+  if (byte == 0) {
+    buffer[codeIndex] = code;
+    codeIndex = length++;
+    code = 1;
+    return;
+  }
+  buffer[length++] = byte;
+  if (++code == 0xFF) {
+    buffer[codeIndex] = code;
+    codeIndex = length++;
+    code = 1;
+  }
+}
+
+void FrameWriter::putU8(uint8_t value) {
+  // Past the limit the frame is only counted, and finish() refuses it
+  if (++decodedLength > 1 + FRAME_MAX_PAYLOAD) {
+    return;
+  }
+  crc = crc32(&value, 1, crc);
+  putEncoded(value);
+}
+
+void FrameWriter::putU16(uint16_t value) {
+  putU8((uint8_t)value);
+  putU8((uint8_t)(value >> 8));
+}
+
+void FrameWriter::putU32(uint32_t value) {
+  putU16((uint16_t)value);
+  putU16((uint16_t)(value >> 16));
+}
+
+void FrameWriter::putBytes(const void* data, size_t count) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  for (size_t i = 0; i < count; i++) {
+    putU8(bytes[i]);
+  }
+}
+
+size_t FrameWriter::finish() {
+  if (decodedLength > 1 + FRAME_MAX_PAYLOAD) {
+    return 0;
+  }
+  for (int shift = 0; shift < 32; shift += 8) {
+    putEncoded((uint8_t)(crc >> shift));
+  }
+  buffer[codeIndex] = code;
+  buffer[length++] = 0;
+  return length;
+}
+
+bool FrameReader::feed(uint8_t byte) {
+  if (byte == 0) {
+    bool good = false;
+    if (overflow || remaining != 0 || (decodedLength != 0 && decodedLength < 1 + FRAME_CRC_SIZE)) {
+      errorCount++;
+    } else if (decodedLength != 0) {
+      size_t crcAt = decodedLength - FRAME_CRC_SIZE;
+      if (crc32(buffer, crcAt) == frameGetU32(buffer + crcAt)) {
+        frameLength = decodedLength;
+        good = true;
+      } else {
+        errorCount++;
+      }
+    }
+    // Back-to-back delimiters are just idle line, not errors
+    decodedLength = 0;
+    remaining = 0;
+    zeroPending = false;
+    overflow = false;
+    return good;
+  }
+
+  if (overflow) {
+    return false;
+  }
+  if (remaining == 0) {
+    // Code byte: the previous block's implied zero is real data only now
+    // that another block follows it
+    if (zeroPending) {
+      if (decodedLength == FRAME_MAX_DECODED) {
+        overflow = true;
+        return false;
+      }
+      buffer[decodedLength++] = 0;
+    }
+    remaining = byte - 1;
+    zeroPending = byte != 0xFF;
+    return false;
+  }
+
+  if (decodedLength == FRAME_MAX_DECODED) {
+    overflow = true;
+    return false;
+  }
+  buffer[decodedLength++] = byte;
+  remaining--;
+  return false;
+}
@@ -0,0 +1,98 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// COBS framing for the binary serial link (protocol.h).
+//
+// A frame is a type byte, up to FRAME_MAX_PAYLOAD payload bytes and a
+// CRC-32 (crc.h) of both, little-endian, all COBS-encoded so the frame
+// holds no zero bytes and ends with a single 0x00. A receiver that joins
+// mid-stream, or loses bytes, picks up again at the next zero.
+//
+// Neither side allocates or copies a frame around. FrameWriter encodes
+// each field into its fixed buffer as it is appended, with a running CRC,
+// so finish() leaves the wire bytes ready to write. FrameReader decodes a
+// byte at a time into its own buffer and exposes the payload in place.
+// Hardware-free: the host tools in tools/ build these files too.
+
+#define FRAME_MAX_PAYLOAD 120
+#define FRAME_CRC_SIZE 4
+#define FRAME_MAX_DECODED (1 + FRAME_MAX_PAYLOAD + FRAME_CRC_SIZE)
+
+// COBS adds a code byte per 254 data bytes (and one to start), plus the
+// delimiter
+#define FRAME_MAX_ENCODED (FRAME_MAX_DECODED + FRAME_MAX_DECODED / 254 + 2)
+
+class FrameWriter {
+public:
+  // Starts a new frame, discarding anything not yet sent
+  void begin(uint8_t type);
+
+  void putU8(uint8_t value);
+  void putU16(uint16_t value);
+  void putU32(uint32_t value);
+  void putI16(int16_t value) { putU16((uint16_t)value); }
+  void putI32(int32_t value) { putU32((uint32_t)value); }
+  void putBytes(const void* data, size_t length);
+
+  // Appends the CRC and the delimiter. Returns the encoded length, or 0 if
+  // the payload outgrew FRAME_MAX_PAYLOAD.
+  size_t finish();
+
+  const uint8_t* data() const { return buffer; }
+
+private:
+  void putEncoded(uint8_t byte);
+
+  uint8_t buffer[FRAME_MAX_ENCODED];
+  size_t length = 0;          // Encoded bytes so far
+  size_t codeIndex = 0;       // Where the open COBS block's code byte goes
+  uint8_t code = 1;           // That block's length so far, plus one
+  size_t decodedLength = 0;
+  uint32_t crc = 0;
+};
+
+class FrameReader {
+public:
+  // Feeds one received byte. Returns true when it ends a frame that
+  // decoded cleanly and passed its CRC; type() and payload() then hold it
+  // until the next call.
+  bool feed(uint8_t byte);
+
+  uint8_t type() const { return buffer[0]; }
+  const uint8_t* payload() const { return buffer + 1; }
+  size_t payloadLength() const { return frameLength - 1 - FRAME_CRC_SIZE; }
+
+  // Frames dropped for a bad CRC, bad encoding or overflow
+  uint32_t errors() const { return errorCount; }
+
+private:
+  uint8_t buffer[FRAME_MAX_DECODED];
+  size_t decodedLength = 0;
+  size_t frameLength = 0;     // Decoded length of the last good frame
+  uint8_t remaining = 0;      // Data bytes left in the current COBS block
+  bool zeroPending = false;   // The current block ends in an implied zero
+  bool overflow = false;      // Discarding until the next delimiter
+  uint32_t errorCount = 0;
+};
+
+// Little-endian payload fields
+static inline uint16_t frameGetU16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t frameGetU32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline int16_t frameGetI16(const uint8_t* p) {
+  return (int16_t)frameGetU16(p);
+}
+
+static inline int32_t frameGetI32(const uint8_t* p) {
+  return (int32_t)frameGetU32(p);
+}
+
+#endif // FRAME_H
@@ -0,0 +1,450 @@
+#ifndef HAL_H
+#define HAL_H
+
+// Thin hardware abstraction for PWM, GPIO, ADC, NVS, the serial link, the
+// network and the clock.
+//
+// On the ESP32 every call is an inline forward to the Arduino core, so it
+// compiles to exactly the same code as calling ledcWrite() etc. directly.
+// Building with -DHAL_NATIVE (the [env:native] environment) swaps in the
+// simulated backend from hal_native.cpp, which runs on a virtual clock.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Periodic timer callback
+typedef void (*HalTimerCallback)();
+
+// Encoder counters wrap back to zero when they reach +/-HAL_ENCODER_LIMIT
+#define HAL_ENCODER_LIMIT 32767
+
+// LEDC source clocks, for working out the finest resolution at a frequency
+#define HAL_PWM_CLOCK_HZ 80000000UL        // APB
+#define HAL_PWM_SLEEP_CLOCK_HZ 8000000UL   // RTC8M
+#define HAL_PWM_MAX_RESOLUTION 14          // LEDC counter width on the ESP32-S2
+
+// Continuous ADC conversions arrive as 16-bit words in the ESP32-S2 DMA
+// format: ADC1 channel in the top 4 bits, 12-bit result below
+#define HAL_ADC_STREAM_MAX_PINS 4
+#define HAL_ADC_STREAM_FULL_SCALE 4095
+#define HAL_ADC_STREAM_FULL_SCALE_MV 750     // 0 dB attenuation
+
+static inline uint8_t halAdcSampleChannel(uint16_t word) {
+  return word >> 12;
+}
+
+static inline uint16_t halAdcSampleValue(uint16_t word) {
+  return word & 0x0FFF;
+}
+
+// Where a UDP datagram came from, to send replies back to. The address is
+// IPv4 in network byte order.
+struct HalUdpPeer {
+  uint32_t address;
+  uint16_t port;
+};
+
+#ifdef HAL_NATIVE
+
+#include "hal_native.h"
+
+#else
+
+#include <Arduino.h>
+#include <driver/ledc.h>
+#include <driver/pcnt.h>
+#include <esp_timer.h>
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+#include <driver/adc.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+
+// PWM (LEDC)
+static inline void halPwmSetup(uint8_t channel, uint32_t freq, uint8_t resolution) {
+  ledcSetup(channel, freq, resolution);
+}
+
+static inline void halPwmAttach(uint8_t pin, uint8_t channel) {
+  ledcAttachPin(pin, channel);
+}
+
+static inline void halPwmWrite(uint8_t channel, uint32_t duty) {
+  ledcWrite(channel, duty);
+}
+
+// Staged duty updates: halPwmSetDuty() only loads the new duty, which the
+// hardware applies at the next period boundary after halPwmLatch(). All
+// channels on the ESP32-S2 are low-speed channels.
+static inline void halPwmSetDuty(uint8_t channel, uint32_t duty) {
+  ledc_set_duty(LEDC_LOW_SPEED_MODE, (ledc_channel_t)channel, duty);
+}
+
+static inline void halPwmLatch(uint8_t channelMask) {
+  static portMUX_TYPE latchMux = portMUX_INITIALIZER_UNLOCKED;
+
+  // Set every update bit inside one critical section so they all land
+  // before the same timer overflow
+  portENTER_CRITICAL(&latchMux);
+  for (uint8_t channel = 0; channelMask != 0; channel++, channelMask >>= 1) {
+    if (channelMask & 1) {
+      ledc_update_duty(LEDC_LOW_SPEED_MODE, (ledc_channel_t)channel);
+    }
+  }
+  portEXIT_CRITICAL(&latchMux);
+}
+
+// Moves a channel onto another LEDC timer so channels share period boundaries
+static inline void halPwmBindTimer(uint8_t channel, uint8_t timer) {
+  ledc_bind_channel_timer(LEDC_LOW_SPEED_MODE, (ledc_channel_t)channel, (ledc_timer_t)timer);
+}
+
+// Sets the frequency and resolution of an LEDC timer, running from the APB
+// clock or (sleepClock) RTC8M. The timer's counter restarts, so a pulse in
+// progress is cut short - zero the duties on its channels first.
+static inline void halPwmConfigureTimer(uint8_t timer, uint32_t freq, uint8_t resolution, bool sleepClock) {
+  ledc_timer_config_t config = {};
+  config.speed_mode = LEDC_LOW_SPEED_MODE;
+  config.timer_num = (ledc_timer_t)timer;
+  config.duty_resolution = (ledc_timer_bit_t)resolution;
+  config.freq_hz = freq;
+  config.clk_cfg = sleepClock ? LEDC_USE_RTC8M_CLK : LEDC_USE_APB_CLK;
+  ledc_timer_config(&config);
+}
+
+// Moves an LEDC timer onto the RTC8M (RC_FAST) clock, which keeps running
+// in light sleep, so PWM outputs continue while the CPU sleeps. Call after
+// halPwmSetup() and halPwmAttach() for the channels on the timer.
+static inline void halPwmUseSleepClock(uint8_t timer, uint32_t freq, uint8_t resolution) {
+  halPwmConfigureTimer(timer, freq, resolution, true);
+  esp_sleep_pd_config(ESP_PD_DOMAIN_RTC8M, ESP_PD_OPTION_ON);
+}
+
+// GPIO
+static inline void halGpioMode(uint8_t pin, uint8_t mode) {
+  pinMode(pin, mode);
+}
+
+static inline void halGpioWrite(uint8_t pin, uint8_t level) {
+  digitalWrite(pin, level);
+}
+
+static inline int halGpioRead(uint8_t pin) {
+  return digitalRead(pin);
+}
+
+// ADC
+static inline uint16_t halAdcRead(uint8_t pin) {
+  return analogRead(pin);
+}
+
+// Calibrated pin voltage in mV (11 dB attenuation, about 0-2500 mV)
+static inline uint32_t halAdcReadMilliVolts(uint8_t pin) {
+  return analogReadMilliVolts(pin);
+}
+
+// ADC1 channel number of a pin, as reported by halAdcSampleChannel()
+static inline uint8_t halAdcChannel(uint8_t pin) {
+  return digitalPinToAnalogChannel(pin);
+}
+
+// Starts continuous conversion of the given ADC1 pins, in turn, at
+// sampleRateHz in total. The DMA engine fills a driver-owned ring without
+// the CPU; halAdcStreamRead() collects what has arrived since the last call.
+// Single-shot reads of ADC1 pins must be finished before this is called.
+static inline void halAdcStreamStart(const uint8_t* pins, uint8_t count, uint32_t sampleRateHz) {
+  adc_digi_init_config_t init = {};
+  init.max_store_buf_size = 1024;          // 512 samples of headroom in the ring
+  init.conv_num_each_intr = 64;            // Bytes per DMA frame
+  adc_digi_pattern_config_t pattern[HAL_ADC_STREAM_MAX_PINS] = {};
+  for (uint8_t i = 0; i < count && i < HAL_ADC_STREAM_MAX_PINS; i++) {
+    uint8_t channel = halAdcChannel(pins[i]);
+    init.adc1_chan_mask |= 1UL << channel;
+    pattern[i].atten = ADC_ATTEN_DB_0;
+    pattern[i].channel = channel;
+    pattern[i].unit = 0;                   // ADC1
+    pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+  }
+  adc_digi_initialize(&init);
+
+  adc_digi_configuration_t config = {};
+  config.conv_limit_en = true;             // Required on the ESP32-S2
+  config.conv_limit_num = 250;
+  config.pattern_num = count;
+  config.adc_pattern = pattern;
+  config.sample_freq_hz = sampleRateHz;
+  config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+  adc_digi_controller_configure(&config);
+  adc_digi_start();
+}
+
+// Copies up to maxWords conversion words out of the DMA ring without
+// waiting. Returns the number of words.
+static inline size_t halAdcStreamRead(uint16_t* words, size_t maxWords) {
+  uint32_t bytes = 0;
+  if (adc_digi_read_bytes((uint8_t*)words, maxWords * sizeof(uint16_t), &bytes, 0) != ESP_OK) {
+    return 0;
+  }
+  return bytes / sizeof(uint16_t);
+}
+
+// Quadrature encoder on a PCNT unit, counting all four edges per cycle
+// in hardware (no per-edge interrupts)
+static inline void halEncoderSetup(uint8_t unit, uint8_t pinA, uint8_t pinB) {
+  pcnt_config_t config = {};
+  config.unit = (pcnt_unit_t)unit;
+  config.counter_h_lim = HAL_ENCODER_LIMIT;
+  config.counter_l_lim = -HAL_ENCODER_LIMIT;
+  config.lctrl_mode = PCNT_MODE_REVERSE;
+  config.hctrl_mode = PCNT_MODE_KEEP;
+
+  // Channel 0: edges on A, direction from B
+  config.channel = PCNT_CHANNEL_0;
+  config.pulse_gpio_num = pinA;
+  config.ctrl_gpio_num = pinB;
+  config.pos_mode = PCNT_COUNT_DEC;
+  config.neg_mode = PCNT_COUNT_INC;
+  pcnt_unit_config(&config);
+
+  // Channel 1: edges on B, direction from A
+  config.channel = PCNT_CHANNEL_1;
+  config.pulse_gpio_num = pinB;
+  config.ctrl_gpio_num = pinA;
+  config.pos_mode = PCNT_COUNT_INC;
+  config.neg_mode = PCNT_COUNT_DEC;
+  pcnt_unit_config(&config);
+
+  // Ignore glitches shorter than 100 APB cycles (1.25us)
+  pcnt_set_filter_value((pcnt_unit_t)unit, 100);
+  pcnt_filter_enable((pcnt_unit_t)unit);
+
+  pcnt_counter_pause((pcnt_unit_t)unit);
+  pcnt_counter_clear((pcnt_unit_t)unit);
+  pcnt_counter_resume((pcnt_unit_t)unit);
+}
+
+static inline int16_t halEncoderRead(uint8_t unit) {
+  int16_t count = 0;
+  pcnt_get_counter_value((pcnt_unit_t)unit, &count);
+  return count;
+}
+
+// Periodic timer (esp_timer, runs the callback in the esp_timer task)
+static inline void halTimerStartPeriodic(HalTimerCallback callback, uint32_t periodUs) {
+  esp_timer_create_args_t args = {};
+  args.callback = [](void* arg) { ((HalTimerCallback)arg)(); };
+  args.arg = (void*)callback;
+  args.name = "hal_periodic";
+
+  esp_timer_handle_t handle;
+  esp_timer_create(&args, &handle);
+  esp_timer_start_periodic(handle, periodUs);
+}
+
+// Runs the callback every periodUs in its own FreeRTOS task at the given
+// priority. An esp_timer wakes the task, so periods start on the
+// microsecond rather than on the 1 ms FreeRTOS tick.
+static inline void halTaskStartPeriodic(HalTimerCallback callback, uint32_t periodUs,
+                                        uint8_t priority, const char* name) {
+  TaskHandle_t task;
+  xTaskCreate([](void* arg) {
+    for (;;) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      ((HalTimerCallback)arg)();
+    }
+  }, name, 4096, (void*)callback, priority, &task);
+
+  esp_timer_create_args_t args = {};
+  args.callback = [](void* arg) { xTaskNotifyGive((TaskHandle_t)arg); };
+  args.arg = task;
+  args.name = name;
+
+  esp_timer_handle_t handle;
+  esp_timer_create(&args, &handle);
+  esp_timer_start_periodic(handle, periodUs);
+}
+
+// Clock
+static inline unsigned long halMillis() {
+  return millis();
+}
+
+static inline unsigned long halMicros() {
+  return micros();
+}
+
+static inline void halDelay(unsigned long ms) {
+  delay(ms);
+}
+
+// Busy-waits - for waits shorter than a FreeRTOS tick only
+static inline void halDelayMicros(uint32_t us) {
+  delayMicroseconds(us);
+}
+
+// Blocks the calling task until halMillis() reaches deadlineMs. An esp_timer
+// one-shot wakes it with a task notification, so the wake-up lands on the
+// millisecond rather than on the next FreeRTOS tick.
+static inline void halIdleUntil(unsigned long deadlineMs) {
+  static esp_timer_handle_t wakeTimer = nullptr;
+  static TaskHandle_t waitingTask = nullptr;
+
+  if (wakeTimer == nullptr) {
+    esp_timer_create_args_t args = {};
+    args.callback = [](void* arg) { xTaskNotifyGive(*(TaskHandle_t*)arg); };
+    args.arg = &waitingTask;
+    args.name = "hal_idle";
+    esp_timer_create(&args, &wakeTimer);
+  }
+
+  int64_t nowUs = esp_timer_get_time();
+  long remainingMs = (long)(deadlineMs - (unsigned long)(nowUs / 1000));
+  if (remainingMs <= 0) {
+    return;
+  }
+
+  waitingTask = xTaskGetCurrentTaskHandle();
+  esp_timer_start_once(wakeTimer, (int64_t)remainingMs * 1000 - nowUs % 1000);
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+// Light-sleeps until halMillis() reaches deadlineMs or a wake pin fires.
+// Only peripherals on sleep-capable clocks (see halPwmUseSleepClock) keep
+// running; esp_timer time is corrected on wake-up.
+static inline void halLightSleepUntil(unsigned long deadlineMs) {
+  int64_t nowUs = esp_timer_get_time();
+  long remainingMs = (long)(deadlineMs - (unsigned long)(nowUs / 1000));
+  if (remainingMs <= 0) {
+    return;
+  }
+
+  esp_sleep_enable_timer_wakeup((uint64_t)remainingMs * 1000 - nowUs % 1000);
+  esp_light_sleep_start();
+}
+
+// Wakes light sleep while the pin is held low, and keeps its normal pin
+// configuration in sleep
+static inline void halSleepWakeOnLow(uint8_t pin) {
+  gpio_sleep_sel_dis((gpio_num_t)pin);
+  gpio_wakeup_enable((gpio_num_t)pin, GPIO_INTR_LOW_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+}
+
+// Keeps a pin's normal (awake) configuration in light sleep
+static inline void halSleepHoldPin(uint8_t pin) {
+  gpio_sleep_sel_dis((gpio_num_t)pin);
+}
+
+static inline uint32_t halCycleCount() {
+  return ESP.getCycleCount();
+}
+
+// Serial link (USB CDC on the ESP32-S2). Neither call waits: a read takes
+// what has arrived, up to maxLength bytes, and a write goes out whole or
+// not at all, so a frame is never split when the TX buffer is full.
+static inline size_t halSerialRead(uint8_t* data, size_t maxLength) {
+  int available = Serial.available();
+  if (available <= 0) {
+    return 0;
+  }
+  return Serial.read(data, min((size_t)available, maxLength));
+}
+
+static inline size_t halSerialWrite(const uint8_t* data, size_t length) {
+  if (Serial.availableForWrite() < (int)length) {
+    return 0;
+  }
+  return Serial.write(data, length);
+}
+
+// Non-volatile storage: whole blobs under a namespace and key. Reads copy
+// up to maxLength bytes and return the stored blob's length (0 if there
+// is none), so callers can tell an older, shorter layout from a missing
+// one. Writes go to flash and can take milliseconds - never from the
+// control task.
+static inline size_t halNvsRead(const char* space, const char* key, void* data, size_t maxLength) {
+  Preferences prefs;
+  if (!prefs.begin(space, true)) {
+    return 0;
+  }
+  size_t length = prefs.getBytesLength(key);
+  if (length != 0) {
+    if (length <= maxLength) {
+      prefs.getBytes(key, data, length);
+    } else {
+      // getBytes() refuses a buffer shorter than the blob
+      uint8_t* copy = new uint8_t[length];
+      prefs.getBytes(key, copy, length);
+      memcpy(data, copy, maxLength);
+      delete[] copy;
+    }
+  }
+  prefs.end();
+  return length;
+}
+
+static inline bool halNvsWrite(const char* space, const char* key, const void* data, size_t length) {
+  Preferences prefs;
+  if (!prefs.begin(space, false)) {
+    return false;
+  }
+  bool ok = prefs.putBytes(key, data, length) == length;
+  prefs.end();
+  return ok;
+}
+
+// Wi-Fi station. halWifiBegin() starts joining the network and returns at
+// once; the driver keeps reconnecting in the background.
+static inline void halWifiBegin(const char* ssid, const char* password) {
+  WiFi.mode(WIFI_STA);
+  WiFi.setSleep(false);   // Modem sleep holds received packets back by up to a beacon interval
+  WiFi.begin(ssid, password);
+}
+
+static inline bool halWifiConnected() {
+  return WiFi.status() == WL_CONNECTED;
+}
+
+// Own IPv4 address in network byte order, 0 until connected
+static inline uint32_t halWifiAddress() {
+  return (uint32_t)WiFi.localIP();
+}
+
+// One UDP socket. Neither call waits: a receive takes one datagram if one
+// has arrived and returns its full length, which is more than maxLength if
+// it was cut short; a send hands one datagram to the network stack.
+static inline WiFiUDP& halUdpSocket() {
+  static WiFiUDP socket;
+  return socket;
+}
+
+static inline bool halUdpBegin(uint16_t port) {
+  return halUdpSocket().begin(port) == 1;
+}
+
+static inline size_t halUdpReceive(uint8_t* data, size_t maxLength, HalUdpPeer& from) {
+  WiFiUDP& socket = halUdpSocket();
+  int length = socket.parsePacket();
+  if (length <= 0) {
+    return 0;
+  }
+  from.address = (uint32_t)socket.remoteIP();
+  from.port = socket.remotePort();
+  socket.read(data, min((size_t)length, maxLength));
+  return length;
+}
+
+static inline bool halUdpSend(const HalUdpPeer& to, const uint8_t* data, size_t length) {
+  WiFiUDP& socket = halUdpSocket();
+  if (socket.beginPacket(IPAddress(to.address), to.port) != 1) {
+    return false;
+  }
+  socket.write(data, length);
+  return socket.endPacket() == 1;
+}
+
+#endif // HAL_NATIVE
+
+#endif // HAL_H
@@ -0,0 +1,757 @@
+#ifdef HAL_NATIVE
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdarg.h>
+#include <termios.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "hal.h"
+#include "log.h"
+
+// Simulated backend: an hour of firmware time runs in well under a second
+// because the clock only moves when the firmware waits or loop() returns.
+//
+// Usage: program [--seconds N] [--step-us N] [--seed N] [--pty] [--udp-port N]
+//
+// --pty puts the serial link (halSerialRead/halSerialWrite) on a
+// pseudo-terminal, whose path is printed at startup, and paces the virtual
+// clock to wall time so a host program can talk to the firmware as it
+// would to the robot. Log output stays on stdout.
+//
+// --udp-port does the same for the network: halUdpBegin() binds a socket
+// to 127.0.0.1 on that port (whatever port the firmware asks for) and the
+// clock is paced to wall time.
+
+HalSerial Serial;
+
+static uint64_t virtualMicros = 0;
+static uint32_t pwmDuty[HAL_NATIVE_NUM_PWM_CHANNELS];
+static uint32_t pwmPendingDuty[HAL_NATIVE_NUM_PWM_CHANNELS];
+static unsigned long pwmWriteCount = 0;
+static unsigned long pwmLatchCount = 0;
+static HalSimLatchHook pwmLatchHook = nullptr;
+static uint32_t pwmPeakDriveStep = 0;   // Largest per-latch change of a motor's signed drive
+static uint8_t pinLevel[HAL_NATIVE_NUM_PINS];
+static uint8_t pinModes[HAL_NATIVE_NUM_PINS];
+static uint16_t adcValue[HAL_NATIVE_NUM_PINS];
+static uint32_t randomState = 1;
+static uint32_t pwmMaxDuty = 255;
+
+// Simulated drivetrain: a first-order DC motor model with static friction
+// per wheel, feeding the encoder counters. Motor A (PWM channels 0/1) drives
+// encoder unit 0, Motor B (channels 2/3) drives unit 1.
+#define SIM_MOTOR_MAX_CPS 2000.0      // Encoder counts/s at full duty with gain 1.0
+#define SIM_MOTOR_TAU_US 50000.0      // Mechanical time constant
+#define SIM_MOTOR_BREAKAWAY 0.12      // Duty fraction needed to overcome friction
+static double simMotorGain[2] = {1.0, 0.88};  // Motor B slightly weaker, like the robot
+static double simMotorSpeed[2] = {0, 0};      // counts/s
+static double simMotorPosition[2] = {0, 0};   // counts
+
+// Simulated supply current, for comparing power modes. The MCU figures are
+// typical ESP32-S2 values with the radio off; firmware time that isn't
+// spent in halIdleUntil() or halLightSleepUntil() counts as active.
+#define SIM_CURRENT_ACTIVE_MA 45.0        // CPU running at 240 MHz
+#define SIM_CURRENT_IDLE_MA 22.0          // CPU waiting in the FreeRTOS idle task
+#define SIM_CURRENT_LIGHT_SLEEP_MA 1.2    // Light sleep with RTC8M kept on for LEDC
+#define SIM_MOTOR_STALL_MA 800.0          // Per motor at 100% duty, stalled
+enum SimPowerState { SIM_POWER_ACTIVE, SIM_POWER_IDLE, SIM_POWER_LIGHT_SLEEP };
+static SimPowerState simPowerState = SIM_POWER_ACTIVE;
+static double simChargeMas = 0;           // mA*s drawn so far
+static bool pwmSleepClock = false;        // LEDC keeps running in light sleep
+static int simWakePin = -1;
+
+// Simulated supply: powerbank -> step-up converter -> motor rail, with the
+// ESP32's 3.3 V LDO fed from that rail. The converter droops under load.
+#define SIM_SUPPLY_VOLTAGE 5.0            // Step-up converter output, unloaded
+#define SIM_SUPPLY_RESISTANCE 1.2         // Ohms: converter droop plus wiring
+#define SIM_LDO_DROPOUT 0.25              // Volts
+#define SIM_LDO_OUTPUT 3.3
+#define SIM_BROWNOUT_VOLTAGE 2.74         // ESP32-S2 brown-out detector default
+static double simMinRail = SIM_LDO_OUTPUT;   // Lowest 3.3 V rail since last taken
+static double simMinRailTotal = SIM_LDO_OUTPUT;
+static unsigned long simBrownouts = 0;
+static bool simInBrownout = false;
+
+// Motor rail sense input, wired as on the robot (MOTOR_RAIL_SENSE_PIN and
+// MOTOR_RAIL_DIVIDER in motor_control.h). From power-on the converter
+// charges the two 2200 uF capacitors at its current limit.
+#define SIM_RAIL_SENSE_PIN 1
+#define SIM_RAIL_SENSE_DIVIDER 3.0
+#define SIM_RAIL_CAPACITANCE 0.0044       // Farads
+#define SIM_SUPPLY_CURRENT_LIMIT 1.0      // Amps
+
+// Motor current shunts, wired as on the robot (CURRENT_SENSE_PIN_A/B and
+// CURRENT_SENSE_SHUNT_MOHM in current_sense.h). The bridge only pulls
+// current through the shunt while its PWM output is on, so the continuous
+// ADC sees the armature current chopped at the PWM frequency.
+#define SIM_CURRENT_SENSE_PIN_A 2
+#define SIM_CURRENT_SENSE_PIN_B 3
+#define SIM_CURRENT_SENSE_SHUNT_OHMS 0.2
+static uint8_t adcStreamPins[HAL_ADC_STREAM_MAX_PINS];
+static uint8_t adcStreamPinCount = 0;
+static uint64_t adcStreamIntervalUs = 0;
+static uint64_t adcStreamNextUs = 0;
+static uint8_t adcStreamNextPin = 0;
+static uint64_t pwmPeriodUs = 2000;
+
+// NVS blobs, keyed by "namespace/key"
+static std::map<std::string, std::vector<uint8_t>> simNvs;
+
+// Serial link: the pty master with --pty, and the wall time the virtual
+// clock is paced against
+static int simLinkFd = -1;
+static int simUdpFd = -1;
+static uint16_t simUdpPort = 0;        // --udp-port
+static bool simRealTime = false;
+static std::chrono::steady_clock::time_point simWallStart;
+static uint64_t simWallStartMicros = 0;
+
+// Periodic timers
+#define SIM_MAX_TIMERS 8
+struct SimTimer {
+  HalTimerCallback callback;
+  uint64_t periodUs;
+  uint64_t dueUs;
+};
+static SimTimer simTimers[SIM_MAX_TIMERS];
+static int simTimerCount = 0;
+
+int HalSerial::printf(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  int n = vprintf(format, args);
+  va_end(args);
+  return n;
+}
+
+// Arduino-compatible random(): xorshift32, deterministic for a given seed
+static uint32_t nextRandom() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+long random(long howbig) {
+  if (howbig <= 0) {
+    return 0;
+  }
+  return nextRandom() % howbig;
+}
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) {
+    return howsmall;
+  }
+  return howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed) {
+  if (seed != 0) {
+    randomState = seed;
+  }
+}
+
+uint32_t getCpuFrequencyMhz() {
+  return HAL_NATIVE_CPU_MHZ;
+}
+
+void halPwmSetup(uint8_t channel, uint32_t freq, uint8_t resolution) {
+  if (channel < HAL_NATIVE_NUM_PWM_CHANNELS) {
+    pwmDuty[channel] = 0;
+  }
+  pwmMaxDuty = (1u << resolution) - 1;
+  pwmPeriodUs = 1000000 / freq;
+}
+
+void halPwmAttach(uint8_t pin, uint8_t channel) {
+}
+
+void halPwmWrite(uint8_t channel, uint32_t duty) {
+  halPwmSetDuty(channel, duty);
+  halPwmLatch(1 << channel);
+}
+
+void halPwmSetDuty(uint8_t channel, uint32_t duty) {
+  if (channel < HAL_NATIVE_NUM_PWM_CHANNELS) {
+    pwmPendingDuty[channel] = duty;
+  }
+}
+
+// Pending duties become visible all at once, like the LEDC period latch
+void halPwmLatch(uint8_t channelMask) {
+  for (int motor = 0; motor < 2; motor++) {
+    uint8_t in1 = motor * 2;
+    uint8_t in2 = motor * 2 + 1;
+    int32_t before = (int32_t)pwmDuty[in1] - (int32_t)pwmDuty[in2];
+    int32_t after = (int32_t)((channelMask & (1 << in1)) ? pwmPendingDuty[in1] : pwmDuty[in1])
+                  - (int32_t)((channelMask & (1 << in2)) ? pwmPendingDuty[in2] : pwmDuty[in2]);
+    uint32_t step = (uint32_t)abs(after - before);
+    if (step > pwmPeakDriveStep) {
+      pwmPeakDriveStep = step;
+    }
+  }
+
+  for (uint8_t channel = 0; channel < HAL_NATIVE_NUM_PWM_CHANNELS; channel++) {
+    if (channelMask & (1 << channel)) {
+      pwmDuty[channel] = pwmPendingDuty[channel];
+      pwmWriteCount++;
+    }
+  }
+  pwmLatchCount++;
+  if (pwmLatchHook != nullptr) {
+    pwmLatchHook(channelMask);
+  }
+}
+
+void halPwmBindTimer(uint8_t channel, uint8_t timer) {
+}
+
+// The simulation has a single PWM timer
+void halPwmConfigureTimer(uint8_t timer, uint32_t freq, uint8_t resolution, bool sleepClock) {
+  pwmMaxDuty = (1u << resolution) - 1;
+  pwmPeriodUs = 1000000 / freq;
+}
+
+void halPwmUseSleepClock(uint8_t timer, uint32_t freq, uint8_t resolution) {
+  pwmSleepClock = true;
+}
+
+void halGpioMode(uint8_t pin, uint8_t mode) {
+  if (pin < HAL_NATIVE_NUM_PINS) {
+    pinModes[pin] = mode;
+    if (mode == INPUT_PULLUP) {
+      pinLevel[pin] = HIGH;
+    }
+  }
+}
+
+void halGpioWrite(uint8_t pin, uint8_t level) {
+  if (pin < HAL_NATIVE_NUM_PINS) {
+    pinLevel[pin] = level;
+  }
+}
+
+int halGpioRead(uint8_t pin) {
+  return pin < HAL_NATIVE_NUM_PINS ? pinLevel[pin] : LOW;
+}
+
+uint16_t halAdcRead(uint8_t pin) {
+  return pin < HAL_NATIVE_NUM_PINS ? adcValue[pin] : 0;
+}
+
+// The rail sense pin follows the capacitor charge; other pins read their
+// halSimSetAdc() value as 12-bit counts of 2500 mV
+uint32_t halAdcReadMilliVolts(uint8_t pin) {
+  if (pin == SIM_RAIL_SENSE_PIN) {
+    double rail = min(SIM_SUPPLY_VOLTAGE,
+                      SIM_SUPPLY_CURRENT_LIMIT * (virtualMicros / 1e6) / SIM_RAIL_CAPACITANCE);
+    return (uint32_t)(rail * 1000 / SIM_RAIL_SENSE_DIVIDER);
+  }
+  return (uint32_t)halAdcRead(pin) * 2500 / 4095;
+}
+
+// ADC1_CHn is GPIO(n + 1) on the ESP32-S2
+uint8_t halAdcChannel(uint8_t pin) {
+  return pin - 1;
+}
+
+void halAdcStreamStart(const uint8_t* pins, uint8_t count, uint32_t sampleRateHz) {
+  adcStreamPinCount = min(count, (uint8_t)HAL_ADC_STREAM_MAX_PINS);
+  memcpy(adcStreamPins, pins, adcStreamPinCount);
+  adcStreamIntervalUs = 1000000 / sampleRateHz;
+  adcStreamNextUs = virtualMicros;
+  adcStreamNextPin = 0;
+}
+
+static double simMotorDrive(int motor);
+static double simMotorCurrentMa(int motor);
+
+// Shunt voltage of one motor at a point in its PWM period, in ADC counts.
+// The winding inductance keeps the armature current flowing through the
+// off-time, but only the on-time part of it passes through the shunt.
+static uint16_t simShuntSample(int motor, uint64_t us) {
+  double duty = fabs(simMotorDrive(motor));
+  if ((double)(us % pwmPeriodUs) >= duty * pwmPeriodUs) {
+    return 0;
+  }
+  double shuntMv = simMotorCurrentMa(motor) * SIM_CURRENT_SENSE_SHUNT_OHMS;
+  double counts = shuntMv * HAL_ADC_STREAM_FULL_SCALE / HAL_ADC_STREAM_FULL_SCALE_MV;
+  return (uint16_t)min(counts, (double)HAL_ADC_STREAM_FULL_SCALE);
+}
+
+// Produces the conversions that fell due since the last read, at their own
+// sample times (the motor state is whatever it is now)
+size_t halAdcStreamRead(uint16_t* words, size_t maxWords) {
+  // Like the driver's ring, keep only the newest 512 samples
+  uint64_t ringUs = 512 * adcStreamIntervalUs;
+  if (virtualMicros > adcStreamNextUs + ringUs) {
+    adcStreamNextUs = virtualMicros - ringUs;
+  }
+  
+  size_t count = 0;
+  while (adcStreamPinCount != 0 && count < maxWords && adcStreamNextUs <= virtualMicros) {
+    uint8_t pin = adcStreamPins[adcStreamNextPin];
+    uint16_t value = pin == SIM_CURRENT_SENSE_PIN_A ? simShuntSample(0, adcStreamNextUs)
+                   : pin == SIM_CURRENT_SENSE_PIN_B ? simShuntSample(1, adcStreamNextUs)
+                   : adcValue[pin] & HAL_ADC_STREAM_FULL_SCALE;
+    words[count++] = (uint16_t)(halAdcChannel(pin) << 12) | value;
+    adcStreamNextPin = (adcStreamNextPin + 1) % adcStreamPinCount;
+    adcStreamNextUs += adcStreamIntervalUs;
+  }
+  return count;
+}
+
+void halEncoderSetup(uint8_t unit, uint8_t pinA, uint8_t pinB) {
+}
+
+// Like the PCNT counter, wraps back to zero at +/-HAL_ENCODER_LIMIT
+int16_t halEncoderRead(uint8_t unit) {
+  if (unit > 1) {
+    return 0;
+  }
+  return (int16_t)((int64_t)simMotorPosition[unit] % HAL_ENCODER_LIMIT);
+}
+
+void halTimerStartPeriodic(HalTimerCallback callback, uint32_t periodUs) {
+  if (simTimerCount < SIM_MAX_TIMERS) {
+    simTimers[simTimerCount++] = {callback, periodUs, virtualMicros + periodUs};
+  }
+}
+
+// There are no real tasks on the host: a periodic task is a periodic
+// timer, so it preempts the firmware exactly on its period
+void halTaskStartPeriodic(HalTimerCallback callback, uint32_t periodUs, uint8_t priority, const char* name) {
+  halTimerStartPeriodic(callback, periodUs);
+}
+
+unsigned long halMillis() {
+  return (unsigned long)(virtualMicros / 1000);
+}
+
+unsigned long halMicros() {
+  return (unsigned long)virtualMicros;
+}
+
+// delay() blocks the task, so the CPU sits in the idle task meanwhile
+void halDelay(unsigned long ms) {
+  simPowerState = SIM_POWER_IDLE;
+  halSimAdvance(ms * 1000);
+  simPowerState = SIM_POWER_ACTIVE;
+}
+
+// Latched duties take effect at once in the simulation, and these short
+// waits happen inside timer callbacks, so the clock is left alone
+void halDelayMicros(uint32_t us) {
+}
+
+// Idling just jumps the virtual clock to the deadline, so a sleepy
+// firmware simulates an hour in a handful of loop iterations
+void halIdleUntil(unsigned long deadlineMs) {
+  long remainingMs = (long)(deadlineMs - halMillis());
+  if (remainingMs > 0) {
+    simPowerState = SIM_POWER_IDLE;
+    halSimAdvance(remainingMs * 1000 - virtualMicros % 1000);
+    simPowerState = SIM_POWER_ACTIVE;
+  }
+}
+
+// After light sleep, each timer that fell due while asleep fires once, and
+// then keeps its phase: a task woken by notifications runs once however
+// many it missed
+static void simWakeTimers() {
+  for (int i = 0; i < simTimerCount; i++) {
+    SimTimer& timer = simTimers[i];
+    if (timer.dueUs <= virtualMicros) {
+      timer.dueUs += ((virtualMicros - timer.dueUs) / timer.periodUs + 1) * timer.periodUs;
+      timer.callback();
+    }
+  }
+}
+
+// Light sleep also jumps the clock, with the periodic timers stopped. PWM
+// stops for the duration unless halPwmUseSleepClock() was called, as it
+// would on the real LEDC.
+void halLightSleepUntil(unsigned long deadlineMs) {
+  if (simWakePin >= 0 && pinLevel[simWakePin] == LOW) {
+    return;
+  }
+  long remainingMs = (long)(deadlineMs - halMillis());
+  if (remainingMs > 0) {
+    simPowerState = SIM_POWER_LIGHT_SLEEP;
+    halSimAdvance(remainingMs * 1000 - virtualMicros % 1000);
+    simPowerState = SIM_POWER_ACTIVE;
+    simWakeTimers();
+  }
+}
+
+void halSleepWakeOnLow(uint8_t pin) {
+  if (pin < HAL_NATIVE_NUM_PINS) {
+    simWakePin = pin;
+  }
+}
+
+void halSleepHoldPin(uint8_t pin) {
+}
+
+uint32_t halCycleCount() {
+  return (uint32_t)(virtualMicros * HAL_NATIVE_CPU_MHZ);
+}
+
+size_t halNvsRead(const char* space, const char* key, void* data, size_t maxLength) {
+  auto entry = simNvs.find(std::string(space) + "/" + key);
+  if (entry == simNvs.end()) {
+    return 0;
+  }
+  memcpy(data, entry->second.data(), min(maxLength, entry->second.size()));
+  return entry->second.size();
+}
+
+bool halNvsWrite(const char* space, const char* key, const void* data, size_t length) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  simNvs[std::string(space) + "/" + key].assign(bytes, bytes + length);
+  return true;
+}
+
+size_t halSerialRead(uint8_t* data, size_t maxLength) {
+  if (simLinkFd < 0) {
+    return 0;
+  }
+  ssize_t count = read(simLinkFd, data, maxLength);
+  return count > 0 ? (size_t)count : 0;
+}
+
+// A pty can't report its free space up front, so unlike USB CDC a write
+// can be cut short - the host then loses that one frame
+size_t halSerialWrite(const uint8_t* data, size_t length) {
+  if (simLinkFd < 0) {
+    return length;
+  }
+  ssize_t count = write(simLinkFd, data, length);
+  return count > 0 ? (size_t)count : 0;
+}
+
+// Paces the virtual clock to wall time from now on (see simPace())
+static void simStartRealTime() {
+  if (!simRealTime) {
+    simRealTime = true;
+    simWallStart = std::chrono::steady_clock::now();
+    simWallStartMicros = virtualMicros;
+  }
+}
+
+// Opens the --pty link. The sim holds the far end open too, in raw mode,
+// so there is no echo or line editing before the host sets its own modes
+// and the link survives the host closing and reopening it.
+static bool simOpenLink() {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    return false;
+  }
+  const char* path = ptsname(master);
+  int far = open(path, O_RDWR | O_NOCTTY);
+  if (far < 0) {
+    return false;
+  }
+  termios modes;
+  tcgetattr(far, &modes);
+  cfmakeraw(&modes);
+  tcsetattr(far, TCSANOW, &modes);
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+  simLinkFd = master;
+  simStartRealTime();
+  printf("[native] serial link on %s\n", path);
+  fflush(stdout);
+  return true;
+}
+
+void halWifiBegin(const char* ssid, const char* password) {
+}
+
+bool halWifiConnected() {
+  return true;
+}
+
+uint32_t halWifiAddress() {
+  return htonl(INADDR_LOOPBACK);
+}
+
+bool halUdpBegin(uint16_t port) {
+  if (simUdpPort == 0) {
+    return true;
+  }
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(simUdpPort);
+  if (fd < 0 || bind(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+    fprintf(stderr, "[native] could not bind UDP port %u\n", simUdpPort);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  simUdpFd = fd;
+  printf("[native] UDP on 127.0.0.1:%u\n", simUdpPort);
+  fflush(stdout);
+  return true;
+}
+
+// MSG_TRUNC makes recvfrom() return the full length of a datagram that
+// didn't fit, like halUdpReceive() on the robot
+size_t halUdpReceive(uint8_t* data, size_t maxLength, HalUdpPeer& from) {
+  if (simUdpFd < 0) {
+    return 0;
+  }
+  sockaddr_in address;
+  socklen_t addressLength = sizeof(address);
+  ssize_t length = recvfrom(simUdpFd, data, maxLength, MSG_TRUNC, (sockaddr*)&address, &addressLength);
+  if (length <= 0) {
+    return 0;
+  }
+  from.address = address.sin_addr.s_addr;
+  from.port = ntohs(address.sin_port);
+  return (size_t)length;
+}
+
+bool halUdpSend(const HalUdpPeer& to, const uint8_t* data, size_t length) {
+  if (simUdpFd < 0) {
+    return true;
+  }
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = to.address;
+  address.sin_port = htons(to.port);
+  return sendto(simUdpFd, data, length, 0, (sockaddr*)&address, sizeof(address)) == (ssize_t)length;
+}
+
+// With --pty or --udp-port, holds the virtual clock back until wall time
+// catches up
+static void simPace(uint64_t untilMicros) {
+  if (simRealTime) {
+    std::this_thread::sleep_until(simWallStart + std::chrono::microseconds(untilMicros - simWallStartMicros));
+  }
+}
+
+// Drive fraction (-1..1) the motor actually sees right now
+static double simMotorDrive(int motor) {
+  if (simPowerState == SIM_POWER_LIGHT_SLEEP && !pwmSleepClock) {
+    return 0;
+  }
+  return ((double)pwmDuty[motor * 2] - (double)pwmDuty[motor * 2 + 1]) / pwmMaxDuty;
+}
+
+// Armature current is set by the applied voltage minus the back-EMF, so
+// it peaks when a stalled (or reversing) motor gets a large duty
+static double simMotorCurrentMa(int motor) {
+  double backEmf = simMotorSpeed[motor] / (SIM_MOTOR_MAX_CPS * simMotorGain[motor]);
+  return fabs(simMotorDrive(motor) - backEmf) * SIM_MOTOR_STALL_MA;
+}
+
+// Charges the supply for an interval at the current load, and checks the
+// 3.3 V rail against the brown-out threshold (at the start of the interval,
+// where the current is highest)
+static void accumulateCharge(uint64_t us) {
+  double currentMa = simPowerState == SIM_POWER_LIGHT_SLEEP ? SIM_CURRENT_LIGHT_SLEEP_MA
+                   : simPowerState == SIM_POWER_IDLE ? SIM_CURRENT_IDLE_MA
+                   : SIM_CURRENT_ACTIVE_MA;
+  for (int motor = 0; motor < 2; motor++) {
+    currentMa += simMotorCurrentMa(motor);
+  }
+  simChargeMas += currentMa * us / 1e6;
+
+  double rail = SIM_SUPPLY_VOLTAGE - currentMa / 1000 * SIM_SUPPLY_RESISTANCE - SIM_LDO_DROPOUT;
+  rail = min(rail, SIM_LDO_OUTPUT);
+  simMinRail = min(simMinRail, rail);
+  simMinRailTotal = min(simMinRailTotal, rail);
+  bool brownout = rail < SIM_BROWNOUT_VOLTAGE;
+  if (brownout && !simInBrownout) {
+    simBrownouts++;
+  }
+  simInBrownout = brownout;
+}
+
+static void simulateDrivetrain(uint64_t us) {
+  if (us == 0) {
+    return;
+  }
+  double decay = exp(-(double)us / SIM_MOTOR_TAU_US);
+
+  for (int motor = 0; motor < 2; motor++) {
+    double drive = simMotorDrive(motor);
+    double magnitude = fabs(drive);
+    double target = 0;
+    if (magnitude > SIM_MOTOR_BREAKAWAY) {
+      target = (drive > 0 ? 1 : -1) * (magnitude - SIM_MOTOR_BREAKAWAY) / (1 - SIM_MOTOR_BREAKAWAY)
+               * SIM_MOTOR_MAX_CPS * simMotorGain[motor];
+    }
+
+    // Exact solution of the first-order step response over the interval
+    double start = simMotorSpeed[motor];
+    simMotorSpeed[motor] = target + (start - target) * decay;
+    simMotorPosition[motor] += target * us / 1e6
+                               + (start - target) * (1 - decay) * SIM_MOTOR_TAU_US / 1e6;
+  }
+}
+
+// Moves the virtual clock forward, running the drivetrain model and firing
+// any periodic timers that fall due on the way. esp_timer doesn't run in
+// light sleep, so neither do the timers (nor the tasks they wake) - see
+// simWakeTimers().
+void halSimAdvance(unsigned long us) {
+  uint64_t endMicros = virtualMicros + us;
+  bool timersRun = simPowerState != SIM_POWER_LIGHT_SLEEP;
+
+  for (;;) {
+    SimTimer* next = nullptr;
+    for (int i = 0; timersRun && i < simTimerCount; i++) {
+      if (simTimers[i].dueUs <= endMicros && (next == nullptr || simTimers[i].dueUs < next->dueUs)) {
+        next = &simTimers[i];
+      }
+    }
+
+    uint64_t stopMicros = (next != nullptr) ? next->dueUs : endMicros;
+    simPace(stopMicros);
+    accumulateCharge(stopMicros - virtualMicros);
+    simulateDrivetrain(stopMicros - virtualMicros);
+    virtualMicros = stopMicros;
+
+    if (next == nullptr) {
+      break;
+    }
+    next->dueUs += next->periodUs;
+    next->callback();
+  }
+}
+
+uint32_t halSimPwmDuty(uint8_t channel) {
+  return channel < HAL_NATIVE_NUM_PWM_CHANNELS ? pwmDuty[channel] : 0;
+}
+
+unsigned long halSimPwmWriteCount() {
+  return pwmWriteCount;
+}
+
+unsigned long halSimPwmLatchCount() {
+  return pwmLatchCount;
+}
+
+void halSimSetLatchHook(HalSimLatchHook hook) {
+  pwmLatchHook = hook;
+}
+
+void halSimSetInput(uint8_t pin, uint8_t level) {
+  if (pin < HAL_NATIVE_NUM_PINS) {
+    pinLevel[pin] = level;
+  }
+}
+
+void halSimSetAdc(uint8_t pin, uint16_t value) {
+  if (pin < HAL_NATIVE_NUM_PINS) {
+    adcValue[pin] = value;
+  }
+}
+
+void halSimSetMotorGain(uint8_t motor, double gain) {
+  if (motor < 2) {
+    simMotorGain[motor] = gain;
+  }
+}
+
+double halSimMotorSpeed(uint8_t motor) {
+  return motor < 2 ? simMotorSpeed[motor] : 0;
+}
+
+// Largest single change of a motor's signed drive (IN1 - IN2 duty) since
+// the last call - the current surge a brownout comes from
+uint32_t halSimTakePeakDriveStep() {
+  uint32_t peak = pwmPeakDriveStep;
+  pwmPeakDriveStep = 0;
+  return peak;
+}
+
+// Lowest simulated 3.3 V rail since the last call, in mV
+uint32_t halSimTakeMinRailMv() {
+  uint32_t railMv = (uint32_t)(simMinRail * 1000);
+  simMinRail = SIM_LDO_OUTPUT;
+  return railMv;
+}
+
+// Host wall clock in nanoseconds (wrapping), for timing code on the host:
+// halCycleCount() follows the virtual clock, which stands still while
+// code runs
+uint32_t halSimHostNanos() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Total simulated supply charge so far (mA*s)
+double halSimChargeMas() {
+  return simChargeMas;
+}
+
+int main(int argc, char** argv) {
+  unsigned long runSeconds = 3600;
+  unsigned long stepMicros = 1000;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--pty") == 0) {
+      if (!simOpenLink()) {
+        fprintf(stderr, "[native] could not open a pty\n");
+        return 1;
+      }
+    } else if (i + 1 >= argc) {
+      break;
+    } else if (strcmp(argv[i], "--seconds") == 0) {
+      runSeconds = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--step-us") == 0) {
+      stepMicros = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--udp-port") == 0) {
+      simUdpPort = (uint16_t)strtoul(argv[++i], nullptr, 10);
+      simStartRealTime();
+    } else if (strcmp(argv[i], "--seed") == 0) {
+      // initMovementModes() seeds random() from ADC pin 0
+      halSimSetAdc(0, strtoul(argv[++i], nullptr, 10));
+    }
+  }
+
+  auto wallStart = std::chrono::steady_clock::now();
+
+  setup();
+  logFlush();
+
+  uint64_t endMicros = virtualMicros + (uint64_t)runSeconds * 1000000;
+  unsigned long iterations = 0;
+  while (virtualMicros < endMicros) {
+    uint64_t loopStart = virtualMicros;
+    loop();
+    logFlush();
+
+    // Only step the clock for loops that didn't idle (or delay) themselves
+    if (virtualMicros == loopStart) {
+      halSimAdvance(stepMicros);
+    }
+    iterations++;
+  }
+
+  auto wallMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - wallStart).count();
+  printf("[native] simulated %lu s in %lld ms wall time (%lu loop iterations, %lu PWM writes in %lu commits)\n",
+         runSeconds, (long long)wallMs, iterations, pwmWriteCount, pwmLatchCount);
+  printf("[native] average supply current %.2f mA, lowest 3.3 V rail %.2f V, %lu brown-outs (below %.2f V)\n",
+         simChargeMas / (virtualMicros / 1e6), simMinRailTotal, simBrownouts, SIM_BROWNOUT_VOLTAGE);
+  return 0;
+}
+
+#endif // HAL_NATIVE
@@ -0,0 +1,142 @@
+#ifndef HAL_NATIVE_H
+#define HAL_NATIVE_H
+
+// Simulated HAL backend for the [env:native] build. Provides the HAL calls
+// on top of a virtual clock, plus the small subset of the Arduino API the
+// firmware uses outside the HAL (Serial, random, pin constants).
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <exception>
+
+using std::min;
+using std::max;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define HAL_NATIVE_CPU_MHZ 240
+#define HAL_NATIVE_NUM_PWM_CHANNELS 8
+#define HAL_NATIVE_NUM_PINS 48
+
+// Arduino sketch entry points (main() lives in hal_native.cpp)
+void setup();
+void loop();
+
+// Serial output goes to stdout
+class HalSerial {
+ public:
+  void begin(unsigned long baud) {}
+  size_t write(uint8_t c) { return fwrite(&c, 1, 1, stdout); }
+  size_t write(const uint8_t* data, size_t length) { return fwrite(data, 1, length, stdout); }
+  size_t print(const char* s) { return fputs(s, stdout) >= 0 ? strlen(s) : 0; }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int n) { return printf("%d", n); }
+  size_t print(unsigned int n) { return printf("%u", n); }
+  size_t print(long n) { return printf("%ld", n); }
+  size_t print(unsigned long n) { return printf("%lu", n); }
+  size_t print(double n) { return printf("%.2f", n); }
+  template <typename T>
+  size_t println(T value) { size_t n = print(value); return n + print("\r\n"); }
+  size_t println() { return print("\r\n"); }
+  int printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+  int available() { return 0; }
+  int read() { return -1; }
+  void flush() { fflush(stdout); }
+  operator bool() { return true; }
+};
+
+extern HalSerial Serial;
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+uint32_t getCpuFrequencyMhz();
+
+// PWM
+void halPwmSetup(uint8_t channel, uint32_t freq, uint8_t resolution);
+void halPwmAttach(uint8_t pin, uint8_t channel);
+void halPwmWrite(uint8_t channel, uint32_t duty);
+void halPwmSetDuty(uint8_t channel, uint32_t duty);
+void halPwmLatch(uint8_t channelMask);
+void halPwmBindTimer(uint8_t channel, uint8_t timer);
+void halPwmConfigureTimer(uint8_t timer, uint32_t freq, uint8_t resolution, bool sleepClock);
+void halPwmUseSleepClock(uint8_t timer, uint32_t freq, uint8_t resolution);
+
+// GPIO
+void halGpioMode(uint8_t pin, uint8_t mode);
+void halGpioWrite(uint8_t pin, uint8_t level);
+int halGpioRead(uint8_t pin);
+
+// ADC
+uint16_t halAdcRead(uint8_t pin);
+uint32_t halAdcReadMilliVolts(uint8_t pin);
+uint8_t halAdcChannel(uint8_t pin);
+void halAdcStreamStart(const uint8_t* pins, uint8_t count, uint32_t sampleRateHz);
+size_t halAdcStreamRead(uint16_t* words, size_t maxWords);
+
+// Encoders (driven by the simulated drivetrain)
+void halEncoderSetup(uint8_t unit, uint8_t pinA, uint8_t pinB);
+int16_t halEncoderRead(uint8_t unit);
+
+// Periodic timers and tasks (fired by halSimAdvance() at their virtual due times)
+void halTimerStartPeriodic(HalTimerCallback callback, uint32_t periodUs);
+void halTaskStartPeriodic(HalTimerCallback callback, uint32_t periodUs, uint8_t priority, const char* name);
+
+// Clock (virtual - only advances through halDelay() and halSimAdvance())
+unsigned long halMillis();
+unsigned long halMicros();
+void halDelay(unsigned long ms);
+void halDelayMicros(uint32_t us);
+void halIdleUntil(unsigned long deadlineMs);
+void halLightSleepUntil(unsigned long deadlineMs);
+void halSleepWakeOnLow(uint8_t pin);
+void halSleepHoldPin(uint8_t pin);
+uint32_t halCycleCount();
+
+// Serial link (a pseudo-terminal with --pty, otherwise discarded like USB
+// CDC with no host attached)
+size_t halSerialRead(uint8_t* data, size_t maxLength);
+size_t halSerialWrite(const uint8_t* data, size_t length);
+
+// Wi-Fi is always connected; UDP is a socket on the loopback interface
+// with --udp-port, otherwise nothing arrives and sends are discarded
+void halWifiBegin(const char* ssid, const char* password);
+bool halWifiConnected();
+uint32_t halWifiAddress();
+bool halUdpBegin(uint16_t port);
+size_t halUdpReceive(uint8_t* data, size_t maxLength, HalUdpPeer& from);
+bool halUdpSend(const HalUdpPeer& to, const uint8_t* data, size_t length);
+
+// NVS (in memory - empty at the start of every run)
+size_t halNvsRead(const char* space, const char* key, void* data, size_t maxLength);
+bool halNvsWrite(const char* space, const char* key, const void* data, size_t length);
+
+// Simulation controls
+void halSimAdvance(unsigned long us);
+uint32_t halSimPwmDuty(uint8_t channel);
+unsigned long halSimPwmWriteCount();
+unsigned long halSimPwmLatchCount();
+// Called after every latch with the channels it applied, for checks that
+// watch each output change (tools/framecheck.cpp)
+typedef void (*HalSimLatchHook)(uint8_t channelMask);
+void halSimSetLatchHook(HalSimLatchHook hook);
+void halSimSetInput(uint8_t pin, uint8_t level);
+void halSimSetAdc(uint8_t pin, uint16_t value);
+void halSimSetMotorGain(uint8_t motor, double gain);
+double halSimMotorSpeed(uint8_t motor);
+double halSimChargeMas();
+uint32_t halSimTakePeakDriveStep();
+uint32_t halSimTakeMinRailMv();
+uint32_t halSimHostNanos();
+
+#endif // HAL_NATIVE_H
@@ -0,0 +1,109 @@
+#include "hal.h"
+#include "latency.h"
+#include "log.h"
+
+#ifdef ENABLE_LATENCY
+
+// Written by the task that runs the timed code: the control task for
+// LATENCY_COMMIT, the loop task for the rest
+static LatencyHistogram histograms[LATENCY_NUM_HISTOGRAMS];
+
+static uint32_t cyclesFromUs(uint32_t us) {
+  return us * getCpuFrequencyMhz();
+}
+
+// Tenths of a microsecond, for one decimal place
+static unsigned long tenthsUs(uint32_t cycles) {
+  return (unsigned long)((uint64_t)cycles * 10 / getCpuFrequencyMhz());
+}
+
+static void formatName(int id, char* name, size_t size) {
+  if (id == LATENCY_LOOP) {
+    snprintf(name, size, "loop");
+  } else if (id == LATENCY_COMMIT) {
+    snprintf(name, size, "commit");
+  } else if (id < LATENCY_AUX) {
+    snprintf(name, size, "%s move", getModeName(id - LATENCY_MOVEMENT));
+  } else {
+    snprintf(name, size, "%s aux", getModeName(id - LATENCY_AUX));
+  }
+}
+
+void latencyBegin() {
+  histograms[LATENCY_LOOP].setBudget(cyclesFromUs(LATENCY_LOOP_BUDGET_US));
+  histograms[LATENCY_COMMIT].setBudget(cyclesFromUs(LATENCY_COMMIT_BUDGET_US));
+  for (int mode = 0; mode < NUM_MODES; mode++) {
+    histograms[LATENCY_MOVEMENT + mode].setBudget(cyclesFromUs(LATENCY_CALLBACK_BUDGET_US));
+    histograms[LATENCY_AUX + mode].setBudget(cyclesFromUs(LATENCY_CALLBACK_BUDGET_US));
+  }
+}
+
+void latencyRecord(int id, uint32_t cycles) {
+  histograms[id].record(cycles);
+}
+
+// The overrun count carries on against the new budget
+bool latencySetBudgetUs(int id, uint32_t budgetUs) {
+  if (id < 0 || id >= LATENCY_NUM_HISTOGRAMS) {
+    return false;
+  }
+  histograms[id].setBudget(cyclesFromUs(budgetUs));
+  return true;
+}
+
+// One line per histogram with samples: percentiles are bucket upper
+// bounds (at most 12.5% high), the maximum is exact
+void latencyPrintSummary(int level) {
+  int lines = 0;
+  for (int id = 0; id < LATENCY_NUM_HISTOGRAMS; id++) {
+    const LatencyHistogram& histogram = histograms[id];
+    if (histogram.count() == 0) {
+      continue;
+    }
+    char name[24];
+    formatName(id, name, sizeof(name));
+    unsigned long p50 = tenthsUs(histogram.percentile(500));
+    unsigned long p99 = tenthsUs(histogram.percentile(990));
+    unsigned long peak = tenthsUs(histogram.maximum());
+    logWrite(level, "Latency %2d %-12s n=%lu p50=%lu.%lu p99=%lu.%lu max=%lu.%lu us, %lu over %lu",
+             id, name, (unsigned long)histogram.count(), p50 / 10, p50 % 10, p99 / 10, p99 % 10,
+             peak / 10, peak % 10, (unsigned long)histogram.overruns(), tenthsUs(histogram.budget()) / 10);
+    if (++lines % LATENCY_DUMP_BATCH == 0) {
+      logFlush();
+    }
+  }
+  if (lines == 0) {
+    logWrite(level, "Latency: no samples yet");
+  }
+}
+
+void latencyReport() {
+  latencyPrintSummary(LOG_LEVEL_INFO);
+}
+
+// Every non-empty bucket of one histogram, as cycle ranges with counts
+bool latencyPrintBuckets(int id, int level) {
+  if (id < 0 || id >= LATENCY_NUM_HISTOGRAMS) {
+    return false;
+  }
+  const LatencyHistogram& histogram = histograms[id];
+  char name[24];
+  formatName(id, name, sizeof(name));
+  logWrite(level, "Latency %d %s: %lu samples, cycles at %lu MHz", id, name,
+           (unsigned long)histogram.count(), (unsigned long)getCpuFrequencyMhz());
+  int lines = 0;
+  for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+    uint32_t count = histogram.bucketCount(bucket);
+    if (count == 0) {
+      continue;
+    }
+    logWrite(level, "  %lu..%lu: %lu", (unsigned long)latencyBucketLowest(bucket),
+             (unsigned long)latencyBucketHighest(bucket), (unsigned long)count);
+    if (++lines % LATENCY_DUMP_BATCH == 0) {
+      logFlush();
+    }
+  }
+  return true;
+}
+
+#endif // ENABLE_LATENCY
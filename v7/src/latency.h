@@ -0,0 +1,62 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "hal.h"
+#include "latency_histogram.h"
+#include "movement_modes.h"
+
+// Run-time latency histograms for the behaviour loop and the motor outputs.
+//
+// Build with -DENABLE_LATENCY to compile the instrumentation in. Each
+// histogram times one piece of code in CPU cycles (latency_histogram.h)
+// and counts the runs that went over its budget:
+//
+//   loop         one pass of loop() up to the idle wait - what the loop
+//                period was before the scheduler let the loop sleep
+//   commit       commitMotorFrame(), the LEDC duty update (control task)
+//   NAME move    each mode's movement callback (pattern step or function)
+//   NAME aux     each mode's aux pin callback
+//
+// main.cpp logs a summary of every histogram with samples each
+// LATENCY_REPORT_INTERVAL_MS. With ENABLE_CONSOLE, "latency" prints the
+// summary on demand, "latency N" dumps histogram N's buckets and
+// "latency N US" sets its budget. The default budgets below can be
+// overridden with -D.
+
+#ifndef LATENCY_LOOP_BUDGET_US
+#define LATENCY_LOOP_BUDGET_US 1000
+#endif
+#ifndef LATENCY_COMMIT_BUDGET_US
+#define LATENCY_COMMIT_BUDGET_US 20
+#endif
+#ifndef LATENCY_CALLBACK_BUDGET_US
+#define LATENCY_CALLBACK_BUDGET_US 200    // Each movement and aux callback
+#endif
+
+#define LATENCY_REPORT_INTERVAL_MS 60000  // How often main.cpp logs the summary
+#define LATENCY_DUMP_BATCH 8              // Lines queued before waiting for the log to drain
+
+enum LatencyId {
+  LATENCY_LOOP,
+  LATENCY_COMMIT,
+  LATENCY_MOVEMENT,                               // + ModeID
+  LATENCY_AUX = LATENCY_MOVEMENT + NUM_MODES,     // + ModeID
+  LATENCY_NUM_HISTOGRAMS = LATENCY_AUX + NUM_MODES
+};
+
+void latencyBegin();
+void latencyRecord(int id, uint32_t cycles);
+bool latencySetBudgetUs(int id, uint32_t budgetUs);
+void latencyReport();
+void latencyPrintSummary(int level);
+bool latencyPrintBuckets(int id, int level);
+
+#ifdef ENABLE_LATENCY
+#define LATENCY_START(start) uint32_t start = halCycleCount()
+#define LATENCY_RECORD(id, start) latencyRecord((id), halCycleCount() - (start))
+#else
+#define LATENCY_START(start) do {} while (0)
+#define LATENCY_RECORD(id, start) do {} while (0)
+#endif
+
+#endif // LATENCY_H
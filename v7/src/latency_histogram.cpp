@@ -0,0 +1,29 @@
+#include <string.h>
+#include "latency_histogram.h"
+
+uint32_t LatencyHistogram::percentile(uint32_t perMille) const {
+  if (total == 0) {
+    return 0;
+  }
+  // The rank-th smallest sample, counting from 1
+  uint32_t rank = (uint32_t)(((uint64_t)total * perMille + 999) / 1000);
+  if (rank == 0) {
+    rank = 1;
+  }
+  uint32_t seen = 0;
+  for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+    seen += counts[bucket];
+    if (seen >= rank) {
+      uint32_t highest = latencyBucketHighest(bucket);
+      return highest < maxValue ? highest : maxValue;
+    }
+  }
+  return maxValue;
+}
+
+void LatencyHistogram::reset() {
+  memset(counts, 0, sizeof(counts));
+  total = 0;
+  overrunCount = 0;
+  maxValue = 0;
+}
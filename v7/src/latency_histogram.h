@@ -0,0 +1,91 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Log-bucketed (HDR-style) histogram of durations, in CPU cycles.
+//
+// Values below LATENCY_SUB_BUCKETS get a bucket each. Above that, every
+// power of two is split into LATENCY_SUB_BUCKETS equal buckets, so a
+// bucket is never wider than 1/LATENCY_SUB_BUCKETS of the values in it:
+// reporting a bucket's highest value overstates a duration by at most
+// 12.5% (and never understates it). Values from 2^LATENCY_MAX_BITS up
+// land in one overflow bucket; the exact maximum is kept separately.
+//
+// record() is constant time - a count-leading-zeros, a shift and an
+// increment - so it can sit in the control path. Each histogram has one
+// writer; another task may read it, and sees each counter whole but may
+// catch a dump one sample out.
+//
+// Hardware-free, so tools/latencycheck.cpp can check the bucket bounds.
+
+#define LATENCY_SUB_BUCKET_BITS 3
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAX_BITS 28             // 2^28 cycles is 1.1 s at 240 MHz
+#define LATENCY_OVERFLOW_BUCKET ((LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS)
+#define LATENCY_BUCKETS (LATENCY_OVERFLOW_BUCKET + 1)
+
+static inline int latencyBucket(uint32_t value) {
+  if (value < LATENCY_SUB_BUCKETS) {
+    return value;
+  }
+  if (value >= (1UL << LATENCY_MAX_BITS)) {
+    return LATENCY_OVERFLOW_BUCKET;
+  }
+  int shift = (31 - __builtin_clz(value)) - LATENCY_SUB_BUCKET_BITS;
+  return (shift + 1) * LATENCY_SUB_BUCKETS + (int)((value >> shift) - LATENCY_SUB_BUCKETS);
+}
+
+// Smallest value in a bucket
+static inline uint32_t latencyBucketLowest(int bucket) {
+  if (bucket < 2 * LATENCY_SUB_BUCKETS) {
+    return bucket;
+  }
+  int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+  return (uint32_t)(LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << shift;
+}
+
+// Largest value in a bucket (UINT32_MAX for the overflow bucket)
+static inline uint32_t latencyBucketHighest(int bucket) {
+  return bucket < LATENCY_OVERFLOW_BUCKET ? latencyBucketLowest(bucket + 1) - 1 : UINT32_MAX;
+}
+
+class LatencyHistogram {
+public:
+  void record(uint32_t value) {
+    counts[latencyBucket(value)]++;
+    total++;
+    if (value > maxValue) {
+      maxValue = value;
+    }
+    if (budgetValue != 0 && value > budgetValue) {
+      overrunCount++;
+    }
+  }
+
+  // Values above the budget count as overruns; 0 turns the count off
+  void setBudget(uint32_t value) { budgetValue = value; }
+  uint32_t budget() const { return budgetValue; }
+
+  uint32_t count() const { return total; }
+  uint32_t overruns() const { return overrunCount; }
+  uint32_t maximum() const { return maxValue; }
+  uint32_t bucketCount(int bucket) const { return counts[bucket]; }
+
+  // Highest value of the bucket holding the given fraction of the samples
+  // (0 if there are none). Never below the exact percentile, and at most
+  // one bucket width above it. The top one is the exact maximum.
+  uint32_t percentile(uint32_t perMille) const;
+
+  void reset();
+
+private:
+  uint32_t counts[LATENCY_BUCKETS] = {};
+  uint32_t total = 0;
+  uint32_t overrunCount = 0;
+  uint32_t maxValue = 0;
+  uint32_t budgetValue = 0;
+};
+
+#endif // LATENCY_HISTOGRAM_H
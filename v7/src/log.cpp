@@ -0,0 +1,157 @@
+#include "hal.h"
+#include <atomic>
+#include <stdarg.h>
+#include <stdio.h>
+#include "log.h"
+
+// Single-producer / single-consumer ring of fixed-size message slots.
+// The producer is the loop task (logWrite), the consumer is the drain task.
+// Only the producer writes head and only the consumer writes tail, so no
+// lock is needed. Messages are formatted straight into their slot.
+struct LogSlot {
+  uint8_t length;
+  char text[LOG_MESSAGE_SIZE];
+};
+
+static LogSlot slots[LOG_QUEUE_LENGTH];
+static std::atomic<uint32_t> head(0);   // Next slot to write
+static std::atomic<uint32_t> tail(0);   // Next slot to read
+static std::atomic<uint32_t> dropped(0);
+static int runtimeLevel = LOG_LEVEL;    // Producer side only, like head
+#ifndef HAL_NATIVE
+static TaskHandle_t drainTaskHandle = nullptr;
+#endif
+
+static_assert((LOG_QUEUE_LENGTH & (LOG_QUEUE_LENGTH - 1)) == 0,
+              "LOG_QUEUE_LENGTH must be a power of two");
+
+void logWrite(int level, const char* format, ...) {
+  if (level > runtimeLevel) {
+    return;
+  }
+  uint32_t h = head.load(std::memory_order_relaxed);
+  uint32_t t = tail.load(std::memory_order_acquire);
+
+  // Never block the caller - drop the message if the ring is full
+  if (h - t >= LOG_QUEUE_LENGTH) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  LogSlot& slot = slots[h & (LOG_QUEUE_LENGTH - 1)];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(slot.text, LOG_MESSAGE_SIZE - 2, format, args);
+  va_end(args);
+
+  if (length < 0) {
+    return;
+  }
+  if (length > LOG_MESSAGE_SIZE - 3) {
+    length = LOG_MESSAGE_SIZE - 3;  // Truncated
+  }
+  slot.text[length++] = '\r';
+  slot.text[length++] = '\n';
+  slot.length = length;
+
+  head.store(h + 1, std::memory_order_release);
+}
+
+static bool serialSink(const char* text, size_t length) {
+  Serial.write((const uint8_t*)text, length);
+  return true;
+}
+
+// Hands pending messages to the sink until it refuses one. Called from the
+// drain task only (or, with ENABLE_PROTOCOL, the protocol task).
+static void drainPending(LogSink sink) {
+  static uint32_t reportedDropped = 0;
+
+  uint32_t t = tail.load(std::memory_order_relaxed);
+  uint32_t h = head.load(std::memory_order_acquire);
+
+  while (t != h) {
+    LogSlot& slot = slots[t & (LOG_QUEUE_LENGTH - 1)];
+    if (!sink(slot.text, slot.length)) {
+      return;
+    }
+    t++;
+    tail.store(t, std::memory_order_release);
+  }
+
+  uint32_t droppedNow = dropped.load(std::memory_order_relaxed);
+  if (droppedNow != reportedDropped) {
+    char line[40];
+    int length = snprintf(line, sizeof(line), "[log] dropped messages: %lu\r\n", (unsigned long)droppedNow);
+    if (sink(line, length)) {
+      reportedDropped = droppedNow;
+    }
+  }
+}
+
+void logDrain(LogSink sink) {
+  drainPending(sink);
+}
+
+#ifdef HAL_NATIVE
+
+// The native build has no FreeRTOS - the simulator drains the ring with
+// logFlush() after every loop() pass.
+void logInit() {
+}
+
+void logFlush() {
+  drainPending(serialSink);
+}
+
+#else
+
+// Low-priority task that owns Serial output. Runs at the same priority as
+// the Arduino loop task so it gets time slices while loop() busy-polls.
+static void logDrainTask(void* parameter) {
+  for (;;) {
+    drainPending(serialSink);
+    vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+  }
+}
+
+// With ENABLE_PROTOCOL the protocol task owns Serial instead, and sends
+// the messages as LOG frames
+void logInit() {
+#ifndef ENABLE_PROTOCOL
+  if (drainTaskHandle != nullptr) {
+    return;
+  }
+  xTaskCreate(logDrainTask, "log_drain", 3072, nullptr, tskIDLE_PRIORITY + 1, &drainTaskHandle);
+#endif
+}
+
+// Waits until the drain task has written everything queued so far
+void logFlush() {
+#ifndef ENABLE_PROTOCOL
+  if (drainTaskHandle == nullptr) {
+    drainPending(serialSink);
+    return;
+  }
+#endif
+  while (tail.load(std::memory_order_acquire) != head.load(std::memory_order_acquire)) {
+    vTaskDelay(1);
+  }
+}
+
+#endif // HAL_NATIVE
+
+// Messages compiled out stay out: the level can't go above LOG_LEVEL.
+// Returns the level now in force.
+int logSetLevel(int level) {
+  runtimeLevel = constrain(level, LOG_LEVEL_NONE, LOG_LEVEL);
+  return runtimeLevel;
+}
+
+int logGetLevel() {
+  return runtimeLevel;
+}
+
+unsigned long logGetDroppedCount() {
+  return dropped.load(std::memory_order_relaxed);
+}
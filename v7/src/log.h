@@ -0,0 +1,62 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include "hal.h"
+
+// Log levels - messages above LOG_LEVEL are compiled out completely
+// (disabled macros keep printf format checking but generate no code).
+// logSetLevel() filters further at run time, down to LOG_LEVEL_NONE;
+// logWrite(LOG_LEVEL_NONE, ...) is never filtered.
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Ring buffer sizing
+#define LOG_QUEUE_LENGTH 32          // Number of message slots (power of two)
+#define LOG_MESSAGE_SIZE 96          // Maximum message length including terminator
+#define LOG_DRAIN_INTERVAL_MS 10     // How often the drain task checks for messages
+
+// Takes one formatted line (with its CR LF); returns false to leave it,
+// and the rest, queued for the next logDrain()
+typedef bool (*LogSink)(const char* text, size_t length);
+
+// Function declarations
+void logInit();
+void logWrite(int level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+void logFlush();
+void logDrain(LogSink sink);
+int logSetLevel(int level);
+int logGetLevel();
+unsigned long logGetDroppedCount();
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logWrite(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do { if (0) logWrite(0, __VA_ARGS__); } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) logWrite(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do { if (0) logWrite(0, __VA_ARGS__); } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) logWrite(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do { if (0) logWrite(0, __VA_ARGS__); } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logWrite(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do { if (0) logWrite(0, __VA_ARGS__); } while (0)
+#endif
+
+#endif // LOG_H
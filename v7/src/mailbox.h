@@ -0,0 +1,46 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <atomic>
+#include <stdint.h>
+
+// Wait-free single-slot mailbox for one writer task and one reader task.
+//
+// The latest posted value wins: a value that is overwritten before the
+// reader takes it is simply lost. Implemented as a triple buffer - the
+// writer and reader each own one buffer and swap it with the shared middle
+// one in a single atomic exchange - so neither side ever blocks, spins or
+// disables interrupts, and the reader never sees a half-written value.
+template <typename T>
+class Mailbox {
+public:
+  // Writer side: publish a value
+  void post(const T& value) {
+    buffers[writeIndex] = value;
+    uint8_t previous = middle.exchange(writeIndex | FRESH, std::memory_order_acq_rel);
+    writeIndex = previous & INDEX_MASK;
+  }
+
+  // Reader side: copies out the newest value if one was posted since the
+  // last take, otherwise returns false and leaves value alone
+  bool take(T& value) {
+    if ((middle.load(std::memory_order_relaxed) & FRESH) == 0) {
+      return false;
+    }
+    uint8_t previous = middle.exchange(readIndex, std::memory_order_acq_rel);
+    readIndex = previous & INDEX_MASK;
+    value = buffers[readIndex];
+    return true;
+  }
+
+private:
+  static const uint8_t INDEX_MASK = 0x03;
+  static const uint8_t FRESH = 0x04;   // Set in middle when it holds an untaken value
+
+  T buffers[3];
+  std::atomic<uint8_t> middle{1};
+  uint8_t writeIndex = 0;              // Only touched by the writer
+  uint8_t readIndex = 2;               // Only touched by the reader
+};
+
+#endif // MAILBOX_H
@@ -1,80 +1,243 @@
-#include <Arduino.h>
+#include "hal.h"
 #include "motor_control.h"
 #include "movement_modes.h"
+#include "log.h"
+#include "trace.h"
+#include "scheduler.h"
+#include "power.h"
+#include "control.h"
+#include "current_sense.h"
+#include "pwm_sweep.h"
+#include "calibration.h"
+#include "config.h"
+#include "protocol.h"
+#include "console.h"
+#include "teleop.h"
+#include "latency.h"
+
+#if defined(ENABLE_PWM_SWEEP) && defined(ENABLE_CALIBRATION)
+#error "ENABLE_PWM_SWEEP and ENABLE_CALIBRATION both take over the motors - pick one"
+#endif
+
+#if defined(ENABLE_TRACE) && defined(ENABLE_PROTOCOL)
+#error "ENABLE_TRACE dumps text into the ENABLE_PROTOCOL frame stream - pick one"
+#endif
+
+#if defined(ENABLE_CONSOLE) && defined(ENABLE_PROTOCOL)
+#error "ENABLE_CONSOLE and ENABLE_PROTOCOL both read the serial port - pick one"
+#endif
+
+#if defined(ENABLE_TELEOP) && defined(ENABLE_PROTOCOL)
+#error "ENABLE_TELEOP and ENABLE_PROTOCOL both post host setpoints - pick one"
+#endif
+
+#if defined(ENABLE_BENCHMARK) && defined(ENABLE_PROTOCOL)
+#error "ENABLE_BENCHMARK prints straight to the ENABLE_PROTOCOL frame stream - pick one"
+#endif
 
 // Timing
 const unsigned long BLINK_INTERVAL = 1000;      // 1 second blink interval for pin 39
+const unsigned long BOOT_LED_INTERVAL = 200;    // Half-period of the version blink
+const int BOOT_LED_BLINKS = 7;                  // Blink 7 times for version 7
 
-// Capacitor charging delays
+// Capacitor charging: the motors start once the rail has read above
+// MOTOR_RAIL_READY_MV for RAIL_READY_SAMPLES samples in a row, or after
+// the old fixed delay if it never does (e.g. no sense divider fitted)
+const unsigned long RAIL_SAMPLE_INTERVAL = 5;          // ms between rail samples
+const int RAIL_READY_SAMPLES = 4;
 const unsigned long INITIAL_CAP_CHARGE_DELAY = 15000;  // 15 seconds for initial capacitor charging
 
 // Program state
-unsigned long lastBlinkTime = 0;
+SchedulerTimer blinkTimer;
+SchedulerTimer bootLedTimer;
+SchedulerTimer railCheckTimer;
+SchedulerTimer powerReportTimer;
+SchedulerTimer controlReportTimer;
+#ifdef ENABLE_CURRENT_SENSE
+SchedulerTimer currentReportTimer;
+#endif
+#ifdef ENABLE_PWM_SWEEP
+SchedulerTimer sweepReportTimer;
+#endif
+#ifdef ENABLE_CALIBRATION
+SchedulerTimer calibrationReportTimer;
+#endif
+#ifdef ENABLE_CONSOLE
+SchedulerTimer consoleTimer;
+#endif
+#ifdef ENABLE_TELEOP
+SchedulerTimer teleopReportTimer;
+#endif
+#ifdef ENABLE_LATENCY
+SchedulerTimer latencyReportTimer;
+#endif
 bool auxPinState = false;
 bool initialStartupComplete = false;
+int bootLedToggles = 0;
+int railReadySamples = 0;
+
+// Version blink, one LED edge per call, so it runs alongside the rest of boot
+void stepBootLed() {
+  bootLedToggles++;
+  halGpioWrite(LED_PIN, (bootLedToggles & 1) ? HIGH : LOW);
+  if (bootLedToggles >= BOOT_LED_BLINKS * 2) {
+    schedulerCancel(&bootLedTimer);
+  }
+}
+
+// Continuously blink AUX_PIN (GPIO39) regardless of motor state
+void blinkAuxPin() {
+  auxPinState = !auxPinState;
+  writeAuxPin(auxPinState);
+}
+
+// Releases the motors to the movement modes (or the PWM sweep or the
+// calibration)
+void startMovement() {
+#if !defined(ENABLE_PWM_SWEEP) && !defined(ENABLE_CALIBRATION)
+  LOG_INFO("Initializing movement modes");
+  // Initialize movement modes
+  initMovementModes();
+  
+  // Start with motors stopped
+  setDirection(STOP);
+#endif
+  
+#ifdef ENABLE_CURRENT_SENSE
+  // The shunts share ADC1 with the rail and seed reads, which are done now
+  currentSenseMeasureOverhead();
+  currentSenseBegin();
+  schedulerAdd(&currentReportTimer, currentSenseReport,
+               CURRENT_SENSE_REPORT_INTERVAL_MS, CURRENT_SENSE_REPORT_INTERVAL_MS);
+#endif
+  
+#ifdef ENABLE_PWM_SWEEP
+  // Characterise the PWM profiles instead of running the movement modes
+  pwmSweepStart();
+  schedulerAdd(&sweepReportTimer, pwmSweepReport, PWM_SWEEP_REPORT_INTERVAL_MS, PWM_SWEEP_REPORT_INTERVAL_MS);
+#endif
+  
+#ifdef ENABLE_CALIBRATION
+  // Measure the motor speed tables instead of running the movement modes
+  calibrationStart();
+  schedulerAdd(&calibrationReportTimer, calibrationReport,
+               CALIBRATION_REPORT_INTERVAL_MS, CALIBRATION_REPORT_INTERVAL_MS);
+#endif
+  
+#ifdef ENABLE_TRACE
+  // Start capturing events; the trace is dumped once the buffer is full
+  traceMeasureOverhead();
+  traceStart();
+#endif
+  
+  // Mark initial startup as complete
+  initialStartupComplete = true;
+}
 
-void blinkLED(int times, int onTime = 200, int offTime = 200) {
-  for (int i = 0; i < times; i++) {
-    digitalWrite(LED_PIN, HIGH);
-    delay(onTime);
-    digitalWrite(LED_PIN, LOW);
-    delay(offTime);
+// Samples the motor rail until the capacitors are charged
+void checkMotorRail() {
+  uint32_t railMv = readMotorRailMillivolts();
+  railReadySamples = railMv >= MOTOR_RAIL_READY_MV ? railReadySamples + 1 : 0;
+  
+  if (railReadySamples >= RAIL_READY_SAMPLES) {
+    LOG_INFO("Capacitors charged: rail %lu mV after %lu ms", (unsigned long)railMv, halMillis());
+  } else if (halMillis() >= INITIAL_CAP_CHARGE_DELAY) {
+    LOG_WARN("Rail still %lu mV after %lu ms - starting anyway",
+             (unsigned long)railMv, INITIAL_CAP_CHARGE_DELAY);
+  } else {
+    return;
   }
+  schedulerCancel(&railCheckTimer);
+  startMovement();
 }
 
 void setup() {
-  // Initialize Serial for debugging
+  // Initialize Serial for debugging. There is no wait for a host: boot
+  // messages queue in the log ring, and USB CDC drops output when nothing
+  // is attached.
   Serial.begin(115200);
-  delay(500); // Give serial time to initialize
-  Serial.println("\n\n----- ESP32 Motor Controller v7 with Movement Modes -----");
+  
+  // Start the log drain task - all output after this goes through the log
+  // ring (with ENABLE_PROTOCOL, sent as LOG frames by the protocol task)
+  logInit();
+  LOG_INFO("\n\n----- ESP32 Motor Controller v7 with Movement Modes -----");
   
   // Configure LED and AUX pins
-  pinMode(LED_PIN, OUTPUT);
-  pinMode(AUX_PIN, OUTPUT);
-  digitalWrite(AUX_PIN, LOW);
+  halGpioMode(LED_PIN, OUTPUT);
+  halGpioMode(AUX_PIN, OUTPUT);
+  halGpioWrite(AUX_PIN, LOW);
+  
+  schedulerInit();
   
-  Serial.println("Starting up - blinking LED 7 times");
-  // Blink LED 7 times to indicate version 7
-  blinkLED(7);
+#ifdef ENABLE_LATENCY
+  // Budgets for the latency histograms, before anything is timed
+  latencyBegin();
+  schedulerAdd(&latencyReportTimer, latencyReport, LATENCY_REPORT_INTERVAL_MS, LATENCY_REPORT_INTERVAL_MS);
+#endif
   
-  Serial.println("Initializing motors");
+  LOG_INFO("Starting up - blinking LED %d times", BOOT_LED_BLINKS);
+  // Blink the version in the background while the capacitors charge
+  schedulerAdd(&bootLedTimer, stepBootLed, 0, BOOT_LED_INTERVAL);
+  
+  // Tunables from NVS, before anything uses them
+  configLoad();
+  
+  LOG_INFO("Initializing motors");
   // Initialize motors
-  setupMotors();
+  setupMotors({robotConfig.pwmFreqHz, robotConfig.pwmResolution});
   
-  Serial.println("Initial capacitor charging delay starting");
-  Serial.print("Waiting for ");
-  Serial.print(INITIAL_CAP_CHARGE_DELAY);
-  Serial.println(" ms");
+#ifdef ENABLE_PROTOCOL
+  // Binary setpoint and telemetry link, once the control task is running
+  LOG_INFO("Starting the host link");
+  protocolBegin();
+#endif
   
-  // Initial capacitor charging delay
-  // This gives time for both 2200uF capacitors to charge up
-  delay(INITIAL_CAP_CHARGE_DELAY);
-  Serial.println("Initial capacitor charging complete");
+#ifdef ENABLE_CONSOLE
+  // Operator commands, polled without ever waiting for input
+  consoleBegin();
+  schedulerAdd(&consoleTimer, consolePoll, CONSOLE_POLL_INTERVAL_MS, CONSOLE_POLL_INTERVAL_MS);
+#endif
   
-  Serial.println("Initializing movement modes");
-  // Initialize movement modes
-  initMovementModes();
+#ifdef ENABLE_TELEOP
+  // Wheel commands over Wi-Fi, once the control task is running
+  LOG_INFO("Starting teleop");
+  teleopBegin();
+  schedulerAdd(&teleopReportTimer, teleopReport, TELEOP_REPORT_INTERVAL_MS, TELEOP_REPORT_INTERVAL_MS);
+#endif
   
-  // Start with motors stopped
-  setDirection(STOP);
+  // The 2200uF capacitors charge from power-on; the motors are released
+  // from checkMotorRail() as soon as the rail says they are ready
+  LOG_INFO("Waiting for the motor rail to reach %d mV", MOTOR_RAIL_READY_MV);
+  schedulerAdd(&railCheckTimer, checkMotorRail, 0, RAIL_SAMPLE_INTERVAL);
   
-  // Mark initial startup as complete
-  initialStartupComplete = true;
-  Serial.println("Setup complete - entering main loop");
+  schedulerAdd(&blinkTimer, blinkAuxPin, BLINK_INTERVAL, BLINK_INTERVAL);
+  schedulerAdd(&powerReportTimer, powerReport, POWER_REPORT_INTERVAL_MS, POWER_REPORT_INTERVAL_MS);
+  schedulerAdd(&controlReportTimer, controlReport, CONTROL_REPORT_INTERVAL_MS, CONTROL_REPORT_INTERVAL_MS);
+  
+  LOG_INFO("Setup complete - entering main loop");
 }
 
+// loop() is the behaviour task: it runs the mode state machine and posts
+// wheel setpoints, while the motor control task (control.cpp) owns the
+// outputs at a higher priority
 void loop() {
-  unsigned long currentTime = millis();
-  
-  // Continuously blink AUX_PIN (GPIO39) regardless of motor state
-  if (currentTime - lastBlinkTime >= BLINK_INTERVAL) {
-    lastBlinkTime = currentTime;
-    
-    // Toggle AUX_PIN state
-    auxPinState = !auxPinState;
-    digitalWrite(AUX_PIN, auxPinState);
+  LATENCY_START(passStart);
+  
+  // Run the boot, blink, movement, aux pin and mode timeout callbacks that
+  // are due
+  schedulerRun();
+  
+#ifdef ENABLE_TRACE
+  static bool traceDumped = false;
+  if (!traceDumped && traceIsFull()) {
+    traceDump();
+    traceDumped = true;
   }
-
-  // Update current movement mode - this handles all movement patterns
-  updateCurrentMode();
-}
\ No newline at end of file
+#endif
+  
+  LATENCY_RECORD(LATENCY_LOOP, passStart);
+  
+  // Wait (or light-sleep) until the next callback is due rather than
+  // polling millis()
+  powerIdle(schedulerTimeUntilNext());
+}
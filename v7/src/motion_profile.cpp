@@ -0,0 +1,92 @@
+#include "hal.h"
+#include "motion_profile.h"
+
+static const Fixed FULL_PHASE_DELTA = Fixed::fromFloat(PROFILE_PHASE_DELTA);
+static const Fixed ACCEL_PER_TICK = Fixed::fromFloat(PROFILE_ACCEL_PER_TICK);
+
+// Shape value at a table position (integer part = index), interpolated
+static Fixed shapeAt(Fixed position) {
+  int32_t index = position.raw >> Fixed::FRAC_BITS;
+  if (index >= PROFILE_SHAPE_POINTS) {
+    return Fixed::fromRaw(Fixed::ONE);
+  }
+  Fixed fraction = Fixed::fromRaw(position.raw & (Fixed::ONE - 1));
+  Fixed low = Fixed::fromRaw(PROFILE_SHAPE.value[index]);
+  Fixed high = Fixed::fromRaw(PROFILE_SHAPE.value[index + 1]);
+  return low + (high - low) * fraction;
+}
+
+// Jumps straight to a duty with no profile (start-up and faults)
+void profileReset(MotionProfile& profile, int duty) {
+  profile.output = Fixed::fromInt(duty);
+  profile.target = duty;
+  profile.moving = false;
+}
+
+// Starts a new move from the current duty. A move already in progress is
+// replaced; it restarts from zero acceleration, which keeps the duty
+// continuous and the per-tick change bounded.
+void profileSetTarget(MotionProfile& profile, int target) {
+  if (target == profile.target) {
+    return;
+  }
+  profile.target = target;
+  profile.start = profile.output;
+  profile.tick = 0;
+
+  Fixed change = Fixed::fromInt(target) - profile.output;
+  profile.direction = change.raw >= 0 ? 1 : -1;
+  Fixed distance = fixedAbs(change);
+  int distanceInt = distance.toInt();
+
+  if (distanceInt == 0) {
+    profile.output = Fixed::fromInt(target);
+    profile.moving = false;
+    return;
+  }
+
+  if (distanceInt < PROFILE_SHORT_LIMIT) {
+    // Never reaches full acceleration: two shorter phases, no hold
+    profile.jerkTicks = PROFILE_SHORT.jerkTicks[distanceInt];
+    profile.phaseDelta = Fixed::fromRaw(distance.raw / 2);
+    profile.holdTicks = 0;
+  } else {
+    profile.jerkTicks = PROFILE_JERK_TICKS;
+    profile.phaseDelta = FULL_PHASE_DELTA;
+    Fixed holdDistance = distance - FULL_PHASE_DELTA * 2;
+    profile.holdTicks = (holdDistance / ACCEL_PER_TICK).toInt() + 1;
+    profile.holdStep = holdDistance / Fixed::fromInt(profile.holdTicks);
+  }
+  profile.shapeStep = Fixed::fromInt(PROFILE_SHAPE_POINTS) / Fixed::fromInt(profile.jerkTicks);
+  profile.moving = true;
+}
+
+// Advances one control tick and returns the duty to apply
+int profileStep(MotionProfile& profile) {
+  if (!profile.moving) {
+    return profile.target;
+  }
+  profile.tick++;
+
+  uint16_t riseEnd = profile.jerkTicks;
+  uint16_t holdEnd = riseEnd + profile.holdTicks;
+  uint16_t fallEnd = holdEnd + profile.jerkTicks;
+  Fixed travelled;
+
+  if (profile.tick >= fallEnd) {
+    profile.output = Fixed::fromInt(profile.target);
+    profile.moving = false;
+    return profile.target;
+  } else if (profile.tick <= riseEnd) {
+    travelled = profile.phaseDelta * shapeAt(profile.shapeStep * (int32_t)profile.tick);
+  } else if (profile.tick <= holdEnd) {
+    travelled = profile.phaseDelta + profile.holdStep * (int32_t)(profile.tick - riseEnd);
+  } else {
+    // The fall mirrors the rise, measured back from the target
+    Fixed remaining = profile.phaseDelta * shapeAt(profile.shapeStep * (int32_t)(fallEnd - profile.tick));
+    travelled = fixedAbs(Fixed::fromInt(profile.target) - profile.start) - remaining;
+  }
+
+  profile.output = (profile.direction > 0) ? profile.start + travelled : profile.start - travelled;
+  return profile.output.toInt();
+}
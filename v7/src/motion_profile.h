@@ -0,0 +1,135 @@
+#ifndef MOTION_PROFILE_H
+#define MOTION_PROFILE_H
+
+#include <stdint.h>
+#include "control.h"
+#include "fixed_point.h"
+
+// Jerk-limited S-curve profile for wheel duty.
+//
+// A change of duty goes through three phases: acceleration rises smoothly
+// to its peak, holds, then falls back to zero as the target is reached.
+// Acceleration follows a raised cosine during the rise and fall, so jerk
+// is continuous and peaks at PROFILE_MAX_JERK. Changes too small to reach
+// PROFILE_MAX_ACCEL skip the hold and use shorter rise/fall phases.
+//
+// The curve shape and the phase lengths for short changes are constexpr
+// tables built by the compiler (needs C++17), so a control tick costs one
+// table lookup and a linear interpolation.
+
+#define PROFILE_MAX_ACCEL 1000.0    // Duty units per second
+#define PROFILE_MAX_JERK 10000.0    // Duty units per second^2
+#define PROFILE_SHAPE_POINTS 32     // Interpolation segments in the shape table
+
+// Compile-time math for building the tables
+namespace profile_detail {
+
+constexpr double PI = 3.14159265358979323846;
+
+constexpr double sine(double x) {
+  // Taylor series, good to ~1e-12 on [-pi, pi]
+  double term = x;
+  double sum = x;
+  for (int n = 1; n < 12; n++) {
+    term *= -x * x / ((2 * n) * (2 * n + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+constexpr double squareRoot(double x) {
+  if (x <= 0) {
+    return 0;
+  }
+  double guess = x > 1 ? x : 1;
+  for (int i = 0; i < 64; i++) {
+    guess = (guess + x / guess) / 2;
+  }
+  return guess;
+}
+
+constexpr int ceilPositive(double x) {
+  int whole = (int)x;
+  return (x > whole) ? whole + 1 : whole;
+}
+
+}  // namespace profile_detail
+
+constexpr double PROFILE_TICK_S = CONTROL_PERIOD_US / 1000000.0;
+
+// Rise/fall phase at full acceleration. The raised cosine peaks its jerk at
+// pi/2 * accel / phase time, which sets the phase length.
+constexpr int PROFILE_JERK_TICKS =
+    profile_detail::ceilPositive(profile_detail::PI * PROFILE_MAX_ACCEL / (2 * PROFILE_MAX_JERK) / PROFILE_TICK_S);
+constexpr double PROFILE_JERK_TIME_S = PROFILE_JERK_TICKS * PROFILE_TICK_S;
+
+// Duty change covered by one full rise (or fall) phase, and per tick while
+// holding full acceleration
+constexpr double PROFILE_PHASE_DELTA = PROFILE_MAX_ACCEL * PROFILE_JERK_TIME_S / 2;
+constexpr double PROFILE_ACCEL_PER_TICK = PROFILE_MAX_ACCEL * PROFILE_TICK_S;
+
+// Changes below this never reach full acceleration
+constexpr int PROFILE_SHORT_LIMIT = (int)(2 * PROFILE_PHASE_DELTA);
+
+// Normalised duty over a rise phase: u - sin(pi u) / pi for u in [0, 1]
+// (the integral of a raised-cosine acceleration), in Q16.16
+struct ProfileShapeTable {
+  int32_t value[PROFILE_SHAPE_POINTS + 1];
+};
+
+constexpr ProfileShapeTable makeProfileShapeTable() {
+  ProfileShapeTable table = {};
+  for (int i = 0; i <= PROFILE_SHAPE_POINTS; i++) {
+    double u = (double)i / PROFILE_SHAPE_POINTS;
+    double shape = u - profile_detail::sine(profile_detail::PI * u) / profile_detail::PI;
+    table.value[i] = (int32_t)(shape * Fixed::ONE + 0.5);
+  }
+  return table;
+}
+
+// Rise/fall phase length in ticks for each change below PROFILE_SHORT_LIMIT.
+// With no hold the peak acceleration is lower, and keeping the peak jerk
+// at PROFILE_MAX_JERK gives a phase of sqrt(pi * delta / (2 * jerk)).
+struct ProfileShortTable {
+  uint16_t jerkTicks[PROFILE_SHORT_LIMIT + 1];
+};
+
+constexpr ProfileShortTable makeProfileShortTable() {
+  ProfileShortTable table = {};
+  for (int delta = 0; delta <= PROFILE_SHORT_LIMIT; delta++) {
+    double seconds = profile_detail::squareRoot(profile_detail::PI * delta / (2 * PROFILE_MAX_JERK));
+    int ticks = profile_detail::ceilPositive(seconds / PROFILE_TICK_S);
+    table.jerkTicks[delta] = ticks < 1 ? 1 : ticks;
+  }
+  return table;
+}
+
+constexpr ProfileShapeTable PROFILE_SHAPE = makeProfileShapeTable();
+constexpr ProfileShortTable PROFILE_SHORT = makeProfileShortTable();
+
+static_assert(PROFILE_SHAPE.value[PROFILE_SHAPE_POINTS] == Fixed::ONE, "shape must end at 1");
+
+// Profile state for one wheel
+struct MotionProfile {
+  Fixed output;        // Current duty
+  Fixed start;         // Duty when the current move began
+  Fixed phaseDelta;    // Duty covered by each rise/fall phase
+  Fixed holdStep;      // Duty per tick while holding peak acceleration
+  Fixed shapeStep;     // Shape table positions per tick during rise/fall
+  int16_t target;
+  int8_t direction;    // +1 or -1
+  uint16_t jerkTicks;  // Length of the rise and fall phases
+  uint16_t holdTicks;  // Length of the hold phase
+  uint16_t tick;       // Ticks since the move began
+  bool moving;
+};
+
+void profileReset(MotionProfile& profile, int duty);
+void profileSetTarget(MotionProfile& profile, int target);
+int profileStep(MotionProfile& profile);
+
+static inline bool profileIsMoving(const MotionProfile& profile) {
+  return profile.moving;
+}
+
+#endif // MOTION_PROFILE_H
@@ -1,106 +1,341 @@
-#include <Arduino.h>
+#include "hal.h"
 #include "motor_control.h"
+#include "log.h"
+#include "trace.h"
+#include "latency.h"
+#include "benchmark.h"
+#include "speed_control.h"
+#include "power.h"
+#include "control.h"
+#include "calibration.h"
+#include "config.h"
 
 // PWM configuration
-const int PWM_FREQ = 500;
-const int PWM_RESOLUTION = 8;  // 8-bit resolution (0-255)
+static PwmProfile pwmProfile = {PWM_DEFAULT_FREQ, PWM_DEFAULT_RESOLUTION};
+static uint32_t pwmMaxDuty = (1UL << PWM_DEFAULT_RESOLUTION) - 1;
 
 const int MOTOR_SPEED_ACTUAL = 200;  // Reduced for avoiding brownouts
 
-void setupMotors() {
-  Serial.println("Setting up motors with:");
-  Serial.print("PWM Frequency: ");
-  Serial.print(PWM_FREQ);
-  Serial.print("Hz, Resolution: ");
-  Serial.print(PWM_RESOLUTION);
-  Serial.print(" bits, Motor Speed: ");
-  Serial.println(MOTOR_SPEED_ACTUAL);
+// Duty value that never matches a real duty, so the first commit writes every channel
+#define DUTY_UNKNOWN 0xFFFF
+
+// Double-buffered output frames: committedFrame mirrors what the LEDC
+// hardware holds (shadow state), stagedFrame is where the next one is built.
+static MotorFrame committedFrame = {{DUTY_UNKNOWN, DUTY_UNKNOWN, DUTY_UNKNOWN, DUTY_UNKNOWN}, {DECAY_FAST, DECAY_FAST}};
+static MotorFrame stagedFrame = {{0, 0, 0, 0}, {DECAY_FAST, DECAY_FAST}};
+static unsigned long pwmWritesIssued = 0;
+static unsigned long pwmWritesAvoided = 0;
+static int stagedSpeed[2] = {0, 0};   // Last speeds staged, for rescaling on a profile change
+static DecayMode motorDecay[2] = {DECAY_FAST, DECAY_FAST};
+static StopMode stopMode = STOP_COAST;
+static bool firstMotionLogged = false;
+
+#ifdef ENABLE_LIGHT_SLEEP
+// Light sleep ended early on the fault pin. The control task zeroes the
+// outputs on its next period; this just records why we woke.
+static void onFaultWake() {
+  LOG_WARN("DRV8833 fault woke the CPU");
+}
+#endif
+
+void setupMotors(const PwmProfile& profile) {
+  pwmProfile = profile;
+  if (pwmProfile.resolution > pwmMaxResolution(pwmProfile.freqHz)) {
+    LOG_WARN("%lu-bit PWM not possible at %lu Hz", (unsigned long)pwmProfile.resolution,
+             (unsigned long)pwmProfile.freqHz);
+    pwmProfile.resolution = pwmMaxResolution(pwmProfile.freqHz);
+  }
+  pwmMaxDuty = (1UL << pwmProfile.resolution) - 1;
+  
+  LOG_INFO("Setting up motors with:");
+  LOG_INFO("PWM Frequency: %luHz, Resolution: %d bits, Motor Speed: %d",
+           (unsigned long)pwmProfile.freqHz, pwmProfile.resolution, robotConfig.motorSpeed);
   
   // Configure PWM
-  ledcSetup(0, PWM_FREQ, PWM_RESOLUTION);  // Channel 0 for Motor A IN1
-  ledcSetup(1, PWM_FREQ, PWM_RESOLUTION);  // Channel 1 for Motor A IN2
-  ledcSetup(2, PWM_FREQ, PWM_RESOLUTION);  // Channel 2 for Motor B IN1
-  ledcSetup(3, PWM_FREQ, PWM_RESOLUTION);  // Channel 3 for Motor B IN2
+  halPwmSetup(PWM_CHANNEL_A_IN1, pwmProfile.freqHz, pwmProfile.resolution);  // Channel 0 for Motor A IN1
+  halPwmSetup(PWM_CHANNEL_A_IN2, pwmProfile.freqHz, pwmProfile.resolution);  // Channel 1 for Motor A IN2
+  halPwmSetup(PWM_CHANNEL_B_IN1, pwmProfile.freqHz, pwmProfile.resolution);  // Channel 2 for Motor B IN1
+  halPwmSetup(PWM_CHANNEL_B_IN2, pwmProfile.freqHz, pwmProfile.resolution);  // Channel 3 for Motor B IN2
   
   // Attach PWM channels to pins
-  Serial.println("Attaching PWM channels to pins:");
-  Serial.print("Motor A: IN1=");
-  Serial.print(MOTOR_A_IN1);
-  Serial.print(", IN2=");
-  Serial.println(MOTOR_A_IN2);
-  Serial.print("Motor B: IN1=");
-  Serial.print(MOTOR_B_IN1);
-  Serial.print(", IN2=");
-  Serial.println(MOTOR_B_IN2);
-  
-  ledcAttachPin(MOTOR_A_IN1, 0);
-  ledcAttachPin(MOTOR_A_IN2, 1);
-  ledcAttachPin(MOTOR_B_IN1, 2);
-  ledcAttachPin(MOTOR_B_IN2, 3);
+  for (int motor = 0; motor < 2; motor++) {
+    motorDecay[motor] = (DecayMode)robotConfig.decay[motor];
+    if (motorDecay[motor] == DECAY_SLOW) {
+      LOG_INFO("Motor %c: slow decay (brake between PWM pulses)", motor == MOTOR_A ? 'A' : 'B');
+    }
+  }
+  
+  LOG_INFO("Attaching PWM channels to pins:");
+  LOG_INFO("Motor A: IN1=%d, IN2=%d", MOTOR_A_IN1, MOTOR_A_IN2);
+  LOG_INFO("Motor B: IN1=%d, IN2=%d", MOTOR_B_IN1, MOTOR_B_IN2);
+  
+  halPwmAttach(MOTOR_A_IN1, PWM_CHANNEL_A_IN1);
+  halPwmAttach(MOTOR_A_IN2, PWM_CHANNEL_A_IN2);
+  halPwmAttach(MOTOR_B_IN1, PWM_CHANNEL_B_IN1);
+  halPwmAttach(MOTOR_B_IN2, PWM_CHANNEL_B_IN2);
+  
+  // The core puts channels 2/3 on their own timer. Run all four from
+  // timer 0 so a committed frame takes effect on one period boundary.
+  halPwmBindTimer(PWM_CHANNEL_B_IN1, 0);
+  halPwmBindTimer(PWM_CHANNEL_B_IN2, 0);
+  
+  // Set fault pin as input with pullup (nFAULT is open-drain, active low)
+  halGpioMode(FAULT_PIN, INPUT_PULLUP);
+  
+#ifdef ENABLE_LIGHT_SLEEP
+  // Keep PWM and the pins running through light sleep, and let the driver
+  // wake the CPU when it reports a fault
+  LOG_INFO("Light sleep enabled - LEDC on RTC8M, waking on fault pin %d", FAULT_PIN);
+  halPwmUseSleepClock(0, pwmProfile.freqHz, pwmProfile.resolution);
+  halSleepHoldPin(MOTOR_A_IN1);
+  halSleepHoldPin(MOTOR_A_IN2);
+  halSleepHoldPin(MOTOR_B_IN1);
+  halSleepHoldPin(MOTOR_B_IN2);
+  halSleepHoldPin(AUX_PIN);
+  halSleepWakeOnLow(FAULT_PIN);
+  powerSetWakeCallback(onFaultWake);
+#endif
+  
+  // Per-motor speed tables, if the robot has been calibrated
+  calibrationLoad();
   
   // Initialize motors in stopped state
-  Serial.println("Initializing motors in stopped state");
-  stopMotors();
+  LOG_INFO("Initializing motors in stopped state");
+  moveDifferential(0, 0);
+  
+#ifdef ENABLE_SPEED_CONTROL
+  // The closed-loop wheel speed controller runs in the control task
+  LOG_INFO("Starting wheel speed control at %d Hz", 1000000 / SPEED_CONTROL_PERIOD_US);
+  speedControlBegin();
+#endif
+  
+#ifdef ENABLE_BENCHMARK
+  // Time the primitives while this task still owns the outputs
+  benchmarkRun();
+#endif
   
-  // Short delay to ensure PWM channels are properly initialized
-  delay(100);
-  Serial.println("Motor setup complete");
+  // From here on only the control task touches the PWM channels and the
+  // fault pin
+  LOG_INFO("Starting motor control task at %d Hz", 1000000 / CONTROL_PERIOD_US);
+  controlBegin();
+  
+  LOG_INFO("Motor setup complete");
 }
 
-void moveForward() {
-  Serial.println("Motor control: FORWARD");
-  // Motor A forward
-  ledcWrite(0, MOTOR_SPEED_ACTUAL);  // IN1
-  ledcWrite(1, 0);                   // IN2
+// Finest resolution the LEDC can give at a frequency: the timer clock
+// divider must stay at 1 or more
+uint8_t pwmMaxResolution(uint32_t freqHz) {
+#ifdef ENABLE_LIGHT_SLEEP
+  uint32_t ticksPerPeriod = HAL_PWM_SLEEP_CLOCK_HZ / freqHz;
+#else
+  uint32_t ticksPerPeriod = HAL_PWM_CLOCK_HZ / freqHz;
+#endif
+  uint8_t bits = 0;
+  while (bits < HAL_PWM_MAX_RESOLUTION && (2UL << bits) <= ticksPerPeriod) {
+    bits++;
+  }
+  return bits;
+}
+
+// Switches the motor channels to a new frequency and resolution while
+// running. Reconfiguring the timer restarts its counter, which would cut
+// a pulse short or stretch it, so the outputs coast for one period first;
+// then the last staged speeds are rescaled and committed on the new timer.
+// Returns false (and changes nothing) for an unsupported profile.
+bool setPwmProfile(const PwmProfile& profile) {
+  if (profile.freqHz < PWM_MIN_FREQ || profile.resolution == 0 ||
+      profile.resolution > pwmMaxResolution(profile.freqHz)) {
+    return false;
+  }
+  
+  int speedA = stagedSpeed[MOTOR_A];
+  int speedB = stagedSpeed[MOTOR_B];
+  moveDifferential(0, 0);
+  halDelayMicros(1000000 / pwmProfile.freqHz + 50);
   
-  // Motor B forward
-  ledcWrite(2, MOTOR_SPEED_ACTUAL);  // IN1
-  ledcWrite(3, 0);                   // IN2
+#ifdef ENABLE_LIGHT_SLEEP
+  halPwmConfigureTimer(0, profile.freqHz, profile.resolution, true);
+#else
+  halPwmConfigureTimer(0, profile.freqHz, profile.resolution, false);
+#endif
+  pwmProfile = profile;
+  pwmMaxDuty = (1UL << profile.resolution) - 1;
+  
+  // The channels still hold the zero duty committed above
+  moveDifferential(speedA, speedB);
+  return true;
 }
 
-void moveBackward() {
-  Serial.println("Motor control: BACKWARD");
-  // Motor A backward
-  ledcWrite(0, 0);                   // IN1
-  ledcWrite(1, MOTOR_SPEED_ACTUAL);  // IN2
+const PwmProfile& getPwmProfile() {
+  return pwmProfile;
+}
+
+uint32_t getPwmMaxDuty() {
+  return pwmMaxDuty;
+}
+
+void setMotorDecay(int motor, DecayMode mode) {
+  motorDecay[motor] = mode;
+}
+
+DecayMode getMotorDecay(int motor) {
+  return motorDecay[motor];
+}
+
+void setStopMode(StopMode mode) {
+  stopMode = mode;
+}
+
+// Returns the staging buffer, holding the last committed frame plus any
+// changes staged since
+MotorFrame& stageMotorFrame() {
+  return stagedFrame;
+}
+
+// Stages a signed speed for one motor (positive = forward), scaling the
+// -255..255 speed to the LEDC duty range - through the motor's speed table
+// once it has been calibrated (calibration.h)
+void stageMotorSpeed(MotorFrame& frame, int motor, int speed) {
+  speed = constrain(speed, -255, 255);
+  stagedSpeed[motor] = speed;
+  if (calibrationActive()) {
+    int32_t duty = calibrationMapSpeed(motor, speed);
+    int32_t half = duty >= 0 ? CALIBRATION_DUTY_SCALE / 2 : -CALIBRATION_DUTY_SCALE / 2;
+    stageMotorDuty(frame, motor, (duty * (int32_t)pwmMaxDuty + half) / CALIBRATION_DUTY_SCALE);
+    return;
+  }
+  stageMotorDuty(frame, motor, (speed * (int32_t)pwmMaxDuty + (speed >= 0 ? 127 : -127)) / 255);
+}
+
+// Stages a signed raw LEDC duty for one motor, for callers that need the
+// full resolution, in the motor's decay mode. Zero duty stages the stop
+// mode instead.
+void stageMotorDuty(MotorFrame& frame, int motor, int32_t duty) {
+  uint16_t magnitude = (uint16_t)min((uint32_t)abs(duty), pwmMaxDuty);
+  int in1 = (motor == MOTOR_A) ? PWM_CHANNEL_A_IN1 : PWM_CHANNEL_B_IN1;
+  int in2 = (motor == MOTOR_A) ? PWM_CHANNEL_A_IN2 : PWM_CHANNEL_B_IN2;
+  // An LEDC duty of 2^resolution holds the output high for the whole period
+  uint16_t fullOn = (uint16_t)(pwmMaxDuty + 1);
   
-  // Motor B backward
-  ledcWrite(2, 0);                   // IN1
-  ledcWrite(3, MOTOR_SPEED_ACTUAL);  // IN2
+  frame.decay[motor] = motorDecay[motor];
+  if (magnitude == 0) {
+    frame.duty[in1] = frame.duty[in2] = (stopMode == STOP_BRAKE) ? fullOn : 0;
+  } else if (motorDecay[motor] == DECAY_FAST) {
+    // PWM on one input, other input held low: drive, then coast
+    frame.duty[in1] = (duty > 0) ? magnitude : 0;
+    frame.duty[in2] = (duty > 0) ? 0 : magnitude;
+  } else {
+    // One input held high, the other low for the drive part of each
+    // period: drive, then brake. The same magnitude gives the same
+    // drive time as fast decay.
+    frame.duty[in1] = (duty > 0) ? fullOn : fullOn - magnitude;
+    frame.duty[in2] = (duty > 0) ? fullOn - magnitude : fullOn;
+  }
 }
 
-void turnLeft() {
-  Serial.println("Motor control: TURN LEFT");
-  // Motor A backward
-  ledcWrite(0, 0);                   // IN1
-  ledcWrite(1, MOTOR_SPEED_ACTUAL);  // IN2
+// Loads every changed channel and latches them together, so the new duties
+// all take effect at the same PWM period boundary. Unchanged channels are
+// skipped.
+void commitMotorFrame() {
+  LATENCY_START(start);
+  uint8_t changedMask = 0;
+  
+  for (int channel = 0; channel < NUM_MOTOR_CHANNELS; channel++) {
+    if (stagedFrame.duty[channel] == committedFrame.duty[channel]) {
+      pwmWritesAvoided++;
+      continue;
+    }
+    TRACE_EVENT(TRACE_PWM_WRITE, channel, stagedFrame.duty[channel]);
+    halPwmSetDuty(channel, stagedFrame.duty[channel]);
+    changedMask |= 1 << channel;
+    pwmWritesIssued++;
+  }
   
-  // Motor B forward
-  ledcWrite(2, MOTOR_SPEED_ACTUAL);  // IN1
-  ledcWrite(3, 0);                   // IN2
+  if (changedMask != 0) {
+    halPwmLatch(changedMask);
+  }
+  committedFrame = stagedFrame;
+  LATENCY_RECORD(LATENCY_COMMIT, start);
+}
+
+const MotorFrame& getCommittedFrame() {
+  return committedFrame;
+}
+
+unsigned long getPwmWritesIssued() {
+  return pwmWritesIssued;
+}
+
+unsigned long getPwmWritesAvoided() {
+  return pwmWritesAvoided;
+}
+
+// Function to set motor A (left) speed and direction
+void setMotorA(int speed, bool forward) {
+  stageMotorSpeed(stagedFrame, MOTOR_A, forward ? speed : -speed);
+  commitMotorFrame();
+}
+
+// Function to set motor B (right) speed and direction
+void setMotorB(int speed, bool forward) {
+  stageMotorSpeed(stagedFrame, MOTOR_B, forward ? speed : -speed);
+  commitMotorFrame();
+}
+
+// Function to move with different speeds for each wheel
+// Positive values: forward, Negative values: backward
+void moveDifferential(int leftSpeed, int rightSpeed) {
+  stageMotorSpeed(stagedFrame, MOTOR_A, leftSpeed);
+  stageMotorSpeed(stagedFrame, MOTOR_B, rightSpeed);
+  commitMotorFrame();
+}
+
+// Wheel command for movement code. Posts the setpoint to the control task,
+// which applies it on its next period (as speed loop targets when that is
+// enabled, otherwise as PWM duties). A wheel that reaches zero speed
+// coasts or brakes as stop says.
+void driveWheels(int leftSpeed, int rightSpeed, StopMode stop) {
+  controlPostSetpoint(leftSpeed, rightSpeed, stop);
+  if (!firstMotionLogged && (leftSpeed != 0 || rightSpeed != 0)) {
+    LOG_INFO("Time to first motion: %lu ms", halMillis());
+    firstMotionLogged = true;
+  }
+#ifdef ENABLE_SPEED_CONTROL
+  // The speed loop needs the CPU awake while a wheel is commanded to move
+  powerSetSleepInhibit(POWER_INHIBIT_SPEED_CONTROL, leftSpeed != 0 || rightSpeed != 0);
+#endif
+}
+
+void moveForward() {
+  LOG_DEBUG("Motor control: FORWARD");
+  driveWheels(robotConfig.motorSpeed, robotConfig.motorSpeed);
+}
+
+void moveBackward() {
+  LOG_DEBUG("Motor control: BACKWARD");
+  driveWheels(-robotConfig.motorSpeed, -robotConfig.motorSpeed);
+}
+
+void turnLeft() {
+  LOG_DEBUG("Motor control: TURN LEFT");
+  // Motor A backward, Motor B forward
+  driveWheels(-robotConfig.motorSpeed, robotConfig.motorSpeed);
 }
 
 void turnRight() {
-  Serial.println("Motor control: TURN RIGHT");
-  // Motor A forward
-  ledcWrite(0, MOTOR_SPEED_ACTUAL);  // IN1
-  ledcWrite(1, 0);                   // IN2
-  
-  // Motor B backward
-  ledcWrite(2, 0);                   // IN1
-  ledcWrite(3, MOTOR_SPEED_ACTUAL);  // IN2
+  LOG_DEBUG("Motor control: TURN RIGHT");
+  // Motor A forward, Motor B backward
+  driveWheels(robotConfig.motorSpeed, -robotConfig.motorSpeed);
 }
 
-void stopMotors() {
-  Serial.println("Motor control: STOP");
-  // Stop both motors
-  ledcWrite(0, 0);
-  ledcWrite(1, 0);
-  ledcWrite(2, 0);
-  ledcWrite(3, 0);
+// Ramps both wheels down, then lets them coast or holds them braked
+void stopMotors(StopMode mode) {
+  LOG_DEBUG("Motor control: STOP (%s)", mode == STOP_BRAKE ? "brake" : "coast");
+  driveWheels(0, 0, mode);
 }
 
 void setDirection(MotorDirection direction) {
+  TRACE_EVENT(TRACE_SET_DIRECTION, direction, 0);
   switch (direction) {
     case FORWARD:
       moveForward();
@@ -121,6 +356,21 @@ void setDirection(MotorDirection direction) {
   }
 }
 
+// Reads the nFAULT pin (control task only - others use controlFaultActive())
+bool checkFault() {
+  return !halGpioRead(FAULT_PIN);
+}
+
+// Motor rail voltage in mV, undoing the sense divider
+uint32_t readMotorRailMillivolts() {
+  return halAdcReadMilliVolts(MOTOR_RAIL_SENSE_PIN) * MOTOR_RAIL_DIVIDER;
+}
+
+void writeAuxPin(bool state) {
+  TRACE_EVENT(TRACE_AUX_WRITE, state, 0);
+  halGpioWrite(AUX_PIN, state);
+}
+
 // No longer used - GPIO39 is handled in main.cpp
 void toggleAuxPin() {
   // Empty implementation - kept for API compatibility
@@ -1,11 +1,20 @@
 #ifndef MOTOR_CONTROL_H
 #define MOTOR_CONTROL_H
 
+#include <stdint.h>
+
 // Motor control pins
 #define MOTOR_A_IN1 11  // GPIO11
 #define MOTOR_A_IN2 9   // GPIO9
 #define MOTOR_B_IN1 7   // GPIO7
 #define MOTOR_B_IN2 5   // GPIO5
+#define FAULT_PIN 12    // GPIO12 for DRV8833 nFAULT pin
+
+// Wheel encoder pins (quadrature, only used with ENABLE_SPEED_CONTROL)
+#define ENCODER_A_PIN_A 16  // GPIO16 - left wheel
+#define ENCODER_A_PIN_B 17  // GPIO17
+#define ENCODER_B_PIN_A 18  // GPIO18 - right wheel
+#define ENCODER_B_PIN_B 21  // GPIO21
 
 // Auxiliary pin
 #define AUX_PIN 39    // GPIO39 for auxiliary control
@@ -13,9 +22,65 @@
 // LED pin
 #define LED_PIN 15    // Onboard LED
 
-// Motor speed constant
+// Motor rail sense: the step-up output through a 200k/100k divider
+#define MOTOR_RAIL_SENSE_PIN 1     // GPIO1 (ADC1_CH0)
+#define MOTOR_RAIL_DIVIDER 3
+#define MOTOR_RAIL_READY_MV 4500   // Capacitors charged enough to start the motors
+
+// PWM channels
+#define PWM_CHANNEL_A_IN1 0
+#define PWM_CHANNEL_A_IN2 1
+#define PWM_CHANNEL_B_IN1 2
+#define PWM_CHANNEL_B_IN2 3
+#define NUM_MOTOR_CHANNELS 4
+
+// Default cruise speed (robotConfig.motorSpeed holds the one in use)
 extern const int MOTOR_SPEED_ACTUAL;
 
+// PWM timer settings shared by the four motor channels. Speeds stay on the
+// -255..255 scale whatever the resolution; only the LEDC duty is scaled.
+struct PwmProfile {
+  uint32_t freqHz;
+  uint8_t resolution;   // Bits, up to pwmMaxResolution(freqHz)
+};
+
+#define PWM_MIN_FREQ 500            // A profile change coasts for one period, at most 2 ms
+#define PWM_DEFAULT_FREQ 500
+#define PWM_DEFAULT_RESOLUTION 8
+
+// Motors (Motor A is the left wheel, Motor B the right wheel)
+#define MOTOR_A 0
+#define MOTOR_B 1
+
+// H-bridge decay mode, per motor. DRV8833 truth table per bridge:
+//   IN1 IN2
+//    0   0   coast (outputs off)
+//    1   0   forward
+//    0   1   reverse
+//    1   1   brake (winding shorted through the low-side FETs)
+// Both modes give the same average drive for the same speed; they differ
+// in what the bridge does between pulses. Slow decay keeps the current
+// flowing through the off-time, which gives a more linear low-speed
+// response and half the current ripple of fast decay.
+enum DecayMode {
+  DECAY_FAST,     // PWM on one input, other input held low (coast between pulses)
+  DECAY_SLOW      // One input held high, inverted PWM on the other (brake between pulses)
+};
+
+// What a motor commanded to zero speed does, in either decay mode
+enum StopMode {
+  STOP_COAST,     // Both inputs low - the wheel rolls to a stop
+  STOP_BRAKE      // Both inputs high - the wheel is held
+};
+
+// One complete output state for the DRV8833. Frames are staged and then
+// committed in one operation so the bridge never sees a half-updated set
+// of inputs.
+struct MotorFrame {
+  uint16_t duty[NUM_MOTOR_CHANNELS];  // LEDC duty per PWM channel
+  DecayMode decay[2];                 // Mode each motor was staged in
+};
+
 // Motor direction states
 enum MotorDirection {
   FORWARD,
@@ -26,13 +91,43 @@ enum MotorDirection {
 };
 
 // Function declarations
-void setupMotors();
+void setupMotors(const PwmProfile& profile = {PWM_DEFAULT_FREQ, PWM_DEFAULT_RESOLUTION});
 void moveForward();
 void moveBackward();
 void turnLeft();
 void turnRight();
-void stopMotors();
+void stopMotors(StopMode mode = STOP_COAST);
 void setDirection(MotorDirection direction);
 void toggleAuxPin();
+void writeAuxPin(bool state);
+bool checkFault();
+uint32_t readMotorRailMillivolts();
+
+// Direct output control - setupMotors() and the control task only.
+// Everything else commands the wheels through driveWheels().
+void setMotorA(int speed, bool forward);
+void setMotorB(int speed, bool forward);
+void moveDifferential(int leftSpeed, int rightSpeed);
+void driveWheels(int leftSpeed, int rightSpeed, StopMode stop = STOP_COAST);
+
+// PWM profile (setPwmProfile() is control task only)
+uint8_t pwmMaxResolution(uint32_t freqHz);
+bool setPwmProfile(const PwmProfile& profile);
+const PwmProfile& getPwmProfile();
+uint32_t getPwmMaxDuty();
+
+// Decay and stop mode (control task only), used from the next staged speed
+void setMotorDecay(int motor, DecayMode mode);
+DecayMode getMotorDecay(int motor);
+void setStopMode(StopMode mode);
+
+// Frame staging and commit (control task only)
+MotorFrame& stageMotorFrame();
+void stageMotorSpeed(MotorFrame& frame, int motor, int speed);
+void stageMotorDuty(MotorFrame& frame, int motor, int32_t duty);
+void commitMotorFrame();
+const MotorFrame& getCommittedFrame();
+unsigned long getPwmWritesIssued();
+unsigned long getPwmWritesAvoided();
 
 #endif // MOTOR_CONTROL_H 
\ No newline at end of file
@@ -1,23 +1,41 @@
-#include <Arduino.h>
+#include "hal.h"
 #include "movement_modes.h"
 #include "motor_control.h"
+#include "log.h"
+#include "trace.h"
+#include "latency.h"
+#include "patterns.h"
+#include "scheduler.h"
+#include "power.h"
+#include "control.h"
+#include "config.h"
 
 // Global state
-static MovementMode* currentMode = nullptr;
+static const MovementMode* currentMode = nullptr;
 static int currentModeIndex = 0;
 static int currentDurationIndex = 0;
 static unsigned long modeStartTime = 0;
-static unsigned long lastMovementUpdate = 0;
-static unsigned long lastAuxPinUpdate = 0;
 static bool auxPinState = false;
 static bool inRestPeriod = false;
+static bool paused = false;
 static int restDuration = 0;
+static PatternRunner patternRunner;
+
+// Scheduled callbacks driving the current mode
+static SchedulerTimer movementTimer;
+static SchedulerTimer auxPinTimer;
+static SchedulerTimer modeTimeoutTimer;
+
+static void onMovementTimer();
+static void onAuxPinTimer();
+static void onModeTimeout();
 
 // Define all movement modes
-static MovementMode movementModes[] = {
+static const MovementMode movementModes[] = {
   {
     "Spin",
-    spinPattern,
+    SPIN_PATTERN,
+    nullptr,
     auxPinBlink,
     100,    // Update movement every 100ms
     100,    // Update aux pin every 100ms
@@ -25,7 +43,8 @@ static MovementMode movementModes[] = {
   },
   {
     "Wander",
-    wanderPattern,
+    WANDER_PATTERN,
+    nullptr,
     auxPinRandom,
     500,    // Update movement every 500ms
     200,    // Update aux pin every 200ms
@@ -33,7 +52,8 @@ static MovementMode movementModes[] = {
   },
   {
     "Pulse",
-    pulsePattern,
+    PULSE_PATTERN,
+    nullptr,
     auxPinPulse,
     1000,   // Update movement every 1000ms
     500,    // Update aux pin every 500ms
@@ -41,7 +61,8 @@ static MovementMode movementModes[] = {
   },
   {
     "Circle",
-    circlePattern,
+    CIRCLE_PATTERN,
+    nullptr,
     auxPinWave,
     200,    // Update movement every 200ms
     100,    // Update aux pin every 100ms
@@ -49,7 +70,8 @@ static MovementMode movementModes[] = {
   },
   {
     "Zigzag",
-    zigzagPattern,
+    ZIGZAG_PATTERN,
+    nullptr,
     auxPinBlink,
     300,    // Update movement every 300ms
     150,    // Update aux pin every 150ms
@@ -57,6 +79,7 @@ static MovementMode movementModes[] = {
   },
   {
     "Stop",
+    nullptr,
     stopPattern,
     auxPinOff,
     1000,   // Update movement every 1000ms
@@ -65,6 +88,7 @@ static MovementMode movementModes[] = {
   },
   {
     "Rest",
+    nullptr,
     restPattern,
     auxPinOff,
     2000,   // Update movement every 2000ms (just to check status)
@@ -73,27 +97,63 @@ static MovementMode movementModes[] = {
   }
 };
 
+// (Re)arms the movement, aux pin and timeout timers for the current mode,
+// starting either immediately or one interval from now
+static void scheduleCurrentMode(bool immediate) {
+  unsigned long movementInterval = robotConfig.movementIntervalMs[currentModeIndex];
+  unsigned long auxPinInterval = robotConfig.auxPinIntervalMs[currentModeIndex];
+  schedulerAdd(&movementTimer, onMovementTimer, immediate ? 0 : movementInterval, movementInterval);
+  schedulerAdd(&auxPinTimer, onAuxPinTimer, immediate ? 0 : auxPinInterval, auxPinInterval);
+  schedulerAdd(&modeTimeoutTimer, onModeTimeout,
+               (unsigned long)getCurrentModeDuration() * 1000);
+}
+
 int getRandomRestDuration() {
-  return random(MIN_REST_DURATION, MAX_REST_DURATION + 1);
+  return random(robotConfig.minRestDuration, robotConfig.maxRestDuration + 1);
 }
 
 void initMovementModes() {
   // Initialize random seed
-  randomSeed(analogRead(0));
+  randomSeed(halAdcRead(0));
   
   // Select initial mode and duration
   currentModeIndex = 0; // Start with the first mode (Spin)
   currentDurationIndex = 0; // Start with the first duration (5 seconds)
   currentMode = &movementModes[currentModeIndex];
-  modeStartTime = millis();
+  modeStartTime = halMillis();
   inRestPeriod = false;
+  patternStart(patternRunner, currentMode->pattern, modeStartTime);
+  scheduleCurrentMode(true);
+  powerSetMode(currentModeIndex);
+  
+  LOG_INFO("Movement modes initialized");
+  LOG_INFO("Initial mode: %s, Duration: %d seconds",
+           currentMode->name, robotConfig.durationOptions[currentDurationIndex]);
+}
+
+// Starts the mode selectNextMode() or selectMode() picked: restarts its
+// pattern and timers and logs it
+static void enterMode(bool immediate) {
+  currentMode = &movementModes[currentModeIndex];
+  paused = false;
+  
+  TRACE_EVENT(TRACE_MODE_SELECT, currentModeIndex, getCurrentModeDuration());
+  
+  // Reset timers
+  modeStartTime = halMillis();
+  patternStart(patternRunner, currentMode->pattern, modeStartTime);
+  scheduleCurrentMode(immediate);
+  powerSetMode(currentModeIndex);
   
-  Serial.println("Movement modes initialized");
-  Serial.print("Initial mode: ");
-  Serial.print(currentMode->name);
-  Serial.print(", Duration: ");
-  Serial.print(DURATION_OPTIONS[currentDurationIndex]);
-  Serial.println(" seconds");
+  LOG_INFO("\n--- Mode Change ---");
+  if (inRestPeriod) {
+    LOG_INFO("New mode: %s, Rest Duration: %d seconds", currentMode->name, restDuration);
+  } else {
+    LOG_INFO("New mode: %s, Duration: %d seconds",
+             currentMode->name, robotConfig.durationOptions[currentDurationIndex]);
+  }
+  LOG_INFO("Movement interval: %ums, Aux pin interval: %ums",
+           robotConfig.movementIntervalMs[currentModeIndex], robotConfig.auxPinIntervalMs[currentModeIndex]);
 }
 
 void selectNextMode() {
@@ -101,207 +161,135 @@ void selectNextMode() {
     // Coming out of rest, select next active mode
     inRestPeriod = false;
     currentModeIndex = (currentModeIndex + 1) % (NUM_MODES - 1); // Skip the REST mode
-    currentMode = &movementModes[currentModeIndex];
     
     // Select next duration
-    currentDurationIndex = (currentDurationIndex + 1) % NUM_DURATION_OPTIONS;
+    currentDurationIndex = (currentDurationIndex + 1) % CONFIG_NUM_DURATIONS;
   } else {
     // Entering rest period
     inRestPeriod = true;
     currentModeIndex = MODE_REST;
-    currentMode = &movementModes[currentModeIndex];
     
     // Random rest duration
     restDuration = getRandomRestDuration();
   }
-  
-  // Reset timers
-  modeStartTime = millis();
-  lastMovementUpdate = millis();
-  lastAuxPinUpdate = millis();
-  
-  Serial.println("\n--- Mode Change ---");
-  Serial.print("New mode: ");
-  Serial.print(currentMode->name);
-  
+  enterMode(false);
+}
+
+// Jumps straight to a mode, for its usual duration; the rotation carries
+// on from it afterwards. Also ends a pause.
+void selectMode(int modeId) {
+  inRestPeriod = modeId == MODE_REST;
+  if (inRestPeriod) {
+    restDuration = getRandomRestDuration();
+  }
+  currentModeIndex = modeId;
+  enterMode(true);
+}
+
+// Stops the mode timers and leaves the motors to the caller until
+// selectMode() or selectNextMode()
+void pauseMovementModes() {
+  schedulerCancel(&movementTimer);
+  schedulerCancel(&auxPinTimer);
+  schedulerCancel(&modeTimeoutTimer);
+  paused = true;
+}
+
+bool movementModesPaused() {
+  return paused;
+}
+
+static void onModeTimeout() {
   if (inRestPeriod) {
-    Serial.print(", Rest Duration: ");
-    Serial.print(restDuration);
-    Serial.println(" seconds");
+    LOG_INFO("Rest period ended after %d seconds", restDuration);
   } else {
-    Serial.print(", Duration: ");
-    Serial.print(DURATION_OPTIONS[currentDurationIndex]);
-    Serial.println(" seconds");
+    LOG_INFO("Mode timeout reached after %lu seconds", (halMillis() - modeStartTime) / 1000);
   }
-  
-  Serial.print("Movement interval: ");
-  Serial.print(currentMode->movementInterval);
-  Serial.print("ms, Aux pin interval: ");
-  Serial.print(currentMode->auxPinInterval);
-  Serial.println("ms");
+  selectNextMode();
 }
 
-void updateCurrentMode() {
-  unsigned long currentTime = millis();
+static void onMovementTimer() {
+  LATENCY_START(start);
+  LOG_DEBUG("Updating movement pattern: %s", currentMode->name);
   
-  // Check if it's time to change mode
-  if (inRestPeriod) {
-    if (currentTime - modeStartTime >= (restDuration * 1000)) {
-      Serial.print("Rest period ended after ");
-      Serial.print(restDuration);
-      Serial.println(" seconds");
-      selectNextMode();
-      return;
-    }
-  } else if (currentTime - modeStartTime >= (DURATION_OPTIONS[currentDurationIndex] * 1000)) {
-    Serial.print("Mode timeout reached after ");
-    Serial.print((currentTime - modeStartTime) / 1000);
-    Serial.println(" seconds");
-    selectNextMode();
+  // Don't drive the motors while the driver reports a fault
+  if (controlFaultActive()) {
+    LOG_WARN("DRV8833 fault detected - stopping motors");
+    setDirection(STOP);
+    LATENCY_RECORD(LATENCY_MOVEMENT + currentModeIndex, start);
     return;
   }
   
-  // Update movement if needed
-  if (currentTime - lastMovementUpdate >= currentMode->movementInterval) {
-    lastMovementUpdate = currentTime;
-    Serial.print("Updating movement pattern: ");
-    Serial.println(currentMode->name);
+  TRACE_EVENT(TRACE_MOVEMENT_BEGIN, currentModeIndex, 0);
+  if (currentMode->pattern != nullptr) {
+    patternUpdate(patternRunner, halMillis());
+  } else {
     currentMode->movementFunction();
   }
-  
-  // Update aux pin if needed
-  if (currentTime - lastAuxPinUpdate >= currentMode->auxPinInterval) {
-    lastAuxPinUpdate = currentTime;
-    Serial.print("Updating aux pin behavior for mode: ");
-    Serial.println(currentMode->name);
-    currentMode->auxPinFunction();
-  }
+  TRACE_EVENT(TRACE_MOVEMENT_END, currentModeIndex, 0);
+  LATENCY_RECORD(LATENCY_MOVEMENT + currentModeIndex, start);
 }
 
-MovementMode* getCurrentMode() {
-  return currentMode;
-}
-
-int getCurrentModeDuration() {
-  if (inRestPeriod) {
-    return restDuration;
-  }
-  return DURATION_OPTIONS[currentDurationIndex];
+static void onAuxPinTimer() {
+  LATENCY_START(start);
+  LOG_DEBUG("Updating aux pin behavior for mode: %s", currentMode->name);
+  TRACE_EVENT(TRACE_AUX_BEGIN, currentModeIndex, 0);
+  currentMode->auxPinFunction();
+  TRACE_EVENT(TRACE_AUX_END, currentModeIndex, 0);
+  LATENCY_RECORD(LATENCY_AUX + currentModeIndex, start);
 }
 
-unsigned long getModeStartTime() {
-  return modeStartTime;
+const MovementMode* getCurrentMode() {
+  return currentMode;
 }
 
-// Movement pattern implementations
-void spinPattern() {
-  // Alternate between left and right turns
-  static bool turnLeft = true;
-  Serial.print("Spin pattern: turning ");
-  Serial.println(turnLeft ? "LEFT" : "RIGHT");
-  setDirection(turnLeft ? TURN_LEFT : TURN_RIGHT);
-  turnLeft = !turnLeft;
+// Mode table entry, for the configuration defaults
+const MovementMode* getMovementMode(int modeId) {
+  return &movementModes[modeId];
 }
 
-void wanderPattern() {
-  // Randomly choose a direction
-  int direction = random(4);  // 0-3
-  const char* directionStr;
-  switch (direction) {
-    case 0: setDirection(FORWARD); directionStr = "FORWARD"; break;
-    case 1: setDirection(BACKWARD); directionStr = "BACKWARD"; break;
-    case 2: setDirection(TURN_LEFT); directionStr = "TURN_LEFT"; break;
-    case 3: setDirection(TURN_RIGHT); directionStr = "TURN_RIGHT"; break;
+const char* getModeName(int modeId) {
+  if (modeId < 0 || modeId >= NUM_MODES) {
+    return "?";
   }
-  Serial.print("Wander pattern: random direction = ");
-  Serial.println(directionStr);
+  return movementModes[modeId].name;
 }
 
-void pulsePattern() {
-  // Alternate between forward and backward
-  static bool forward = true;
-  Serial.print("Pulse pattern: ");
-  Serial.println(forward ? "FORWARD" : "BACKWARD");
-  setDirection(forward ? FORWARD : BACKWARD);
-  forward = !forward;
-}
-
-void circlePattern() {
-  // Create a circle by turning one motor faster than the other
-  static int phase = 0;
-  Serial.print("Circle pattern: phase = ");
-  Serial.println(phase);
-  
-  // Debug the MOTOR_SPEED_ACTUAL value
-  Serial.print("MOTOR_SPEED_ACTUAL = ");
-  Serial.println(MOTOR_SPEED_ACTUAL);
-  
-  try {
-    switch (phase) {
-      case 0: 
-        Serial.println("Setting Motor A to full speed, Motor B to half speed");
-        ledcWrite(0, MOTOR_SPEED_ACTUAL);  // Motor A full speed
-        ledcWrite(1, 0);
-        ledcWrite(2, MOTOR_SPEED_ACTUAL/2);  // Motor B half speed
-        ledcWrite(3, 0);
-        break;
-      case 1:
-        Serial.println("Setting Motor A to half speed, Motor B to full speed");
-        ledcWrite(0, MOTOR_SPEED_ACTUAL/2);  // Motor A half speed
-        ledcWrite(1, 0);
-        ledcWrite(2, MOTOR_SPEED_ACTUAL);  // Motor B full speed
-        ledcWrite(3, 0);
-        break;
-    }
-    phase = (phase + 1) % 2;
-  } catch (const std::exception& e) {
-    Serial.print("Exception in circlePattern: ");
-    Serial.println(e.what());
-  } catch (...) {
-    Serial.println("Unknown exception in circlePattern");
+int getCurrentModeDuration() {
+  if (inRestPeriod) {
+    return restDuration;
   }
+  return robotConfig.durationOptions[currentDurationIndex];
 }
 
-void zigzagPattern() {
-  // Alternate between forward and turns
-  static int phase = 0;
-  const char* phaseStr;
-  switch (phase) {
-    case 0: setDirection(FORWARD); phaseStr = "FORWARD"; break;
-    case 1: setDirection(TURN_LEFT); phaseStr = "TURN_LEFT"; break;
-    case 2: setDirection(FORWARD); phaseStr = "FORWARD"; break;
-    case 3: setDirection(TURN_RIGHT); phaseStr = "TURN_RIGHT"; break;
-  }
-  Serial.print("Zigzag pattern: phase = ");
-  Serial.print(phase);
-  Serial.print(", direction = ");
-  Serial.println(phaseStr);
-  phase = (phase + 1) % 4;
+unsigned long getModeStartTime() {
+  return modeStartTime;
 }
 
+// Movement functions for modes without a pattern
 void stopPattern() {
-  Serial.println("Stop pattern: motors stopped");
+  LOG_DEBUG("Stop pattern: motors stopped");
   setDirection(STOP);
 }
 
 // Aux pin behavior implementations
 void auxPinBlink() {
-  Serial.println("Aux pin: BLINK");
+  LOG_DEBUG("Aux pin: BLINK");
   // Just toggle the pin - non-blocking
   static bool auxState = false;
   auxState = !auxState;
-  digitalWrite(AUX_PIN, auxState);
+  writeAuxPin(auxState);
 }
 
 void auxPinPulse() {
   // Create a pulsing effect (non-blocking)
-  Serial.println("Aux pin: PULSE");
+  LOG_DEBUG("Aux pin: PULSE");
   static int pulsePhase = 0;
   static bool auxState = false;
   
   if (pulsePhase % 2 == 0) {
     auxState = !auxState;
-    digitalWrite(AUX_PIN, auxState);
+    writeAuxPin(auxState);
   }
   
   pulsePhase = (pulsePhase + 1) % 10;
@@ -309,13 +297,13 @@ void auxPinPulse() {
 
 void auxPinWave() {
   // Create a wave effect (non-blocking)
-  Serial.println("Aux pin: WAVE");
+  LOG_DEBUG("Aux pin: WAVE");
   static int wavePhase = 0;
   
   if (wavePhase < 3) {
-    digitalWrite(AUX_PIN, HIGH);
+    writeAuxPin(HIGH);
   } else {
-    digitalWrite(AUX_PIN, LOW);
+    writeAuxPin(LOW);
   }
   
   wavePhase = (wavePhase + 1) % 6;
@@ -324,20 +312,18 @@ void auxPinWave() {
 void auxPinRandom() {
   // Random on/off pattern (non-blocking)
   bool shouldTurnOn = random(2) == 0;
-  Serial.print("Aux pin: RANDOM (");
-  Serial.print(shouldTurnOn ? "ON" : "OFF");
-  Serial.println(")");
+  LOG_DEBUG("Aux pin: RANDOM (%s)", shouldTurnOn ? "ON" : "OFF");
   
-  digitalWrite(AUX_PIN, shouldTurnOn);
+  writeAuxPin(shouldTurnOn);
 }
 
 void auxPinOff() {
-  Serial.println("Aux pin: OFF");
-  digitalWrite(AUX_PIN, LOW);
+  LOG_DEBUG("Aux pin: OFF");
+  writeAuxPin(LOW);
 }
 
 void restPattern() {
   // Rest pattern - just stop motors
-  Serial.println("Rest pattern: motors stopped");
+  LOG_DEBUG("Rest pattern: motors stopped");
   setDirection(STOP);
 } 
\ No newline at end of file
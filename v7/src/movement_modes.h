@@ -1,10 +1,12 @@
 #ifndef MOVEMENT_MODES_H
 #define MOVEMENT_MODES_H
 
-#include <Arduino.h>
+#include "hal.h"
 #include "motor_control.h"
+#include "pattern.h"
 
-// Mode duration options (in seconds)
+// Mode duration options (in seconds). These and the intervals in the mode
+// table are the defaults; robotConfig (config.h) holds the values in use.
 const int DURATION_OPTIONS[] = {5, 10, 15, 20, 25, 30};
 const int NUM_DURATION_OPTIONS = sizeof(DURATION_OPTIONS) / sizeof(DURATION_OPTIONS[0]);
 
@@ -15,7 +17,8 @@ const int MAX_REST_DURATION = 15;
 // Movement mode structure
 struct MovementMode {
   const char* name;                    // Name of the mode
-  void (*movementFunction)();          // Function pointer to movement pattern
+  const PatternStep* pattern;          // Movement pattern bytecode (nullptr = use movementFunction)
+  void (*movementFunction)();          // Function pointer to movement behavior
   void (*auxPinFunction)();            // Function pointer to aux pin behavior
   unsigned long movementInterval;      // How often to update movement (ms)
   unsigned long auxPinInterval;        // How often to update aux pin (ms)
@@ -37,18 +40,17 @@ enum ModeID {
 // Function declarations
 void initMovementModes();
 void selectNextMode();
-void updateCurrentMode();
-MovementMode* getCurrentMode();
+void selectMode(int modeId);
+void pauseMovementModes();
+bool movementModesPaused();
+const MovementMode* getCurrentMode();
+const MovementMode* getMovementMode(int modeId);
+const char* getModeName(int modeId);
 int getCurrentModeDuration();
 unsigned long getModeStartTime();
 int getRandomRestDuration();
 
-// Movement pattern functions
-void spinPattern();
-void wanderPattern();
-void pulsePattern();
-void circlePattern();
-void zigzagPattern();
+// Movement functions for modes without a pattern
 void stopPattern();
 void restPattern();
 
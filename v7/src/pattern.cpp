@@ -0,0 +1,75 @@
+#include "hal.h"
+#include "pattern.h"
+#include "motor_control.h"
+#include "config.h"
+#include "log.h"
+
+// Upper bound on non-drive steps executed in one update, so a pattern made
+// only of jumps can't hang the loop
+#define PATTERN_MAX_STEPS_PER_UPDATE 16
+
+void patternStart(PatternRunner& runner, const PatternStep* program, unsigned long now) {
+  runner.program = program;
+  runner.pc = 0;
+  runner.loopCount = 0;
+  runner.finished = false;
+  runner.stepEndTime = now;
+}
+
+// Runs the pattern up to its next DRIVE step. Does nothing while the
+// current drive step's duration has not elapsed.
+void patternUpdate(PatternRunner& runner, unsigned long now) {
+  if (runner.finished || runner.program == nullptr) {
+    return;
+  }
+  if ((long)(now - runner.stepEndTime) < 0) {
+    return;
+  }
+
+  for (int executed = 0; executed < PATTERN_MAX_STEPS_PER_UPDATE; executed++) {
+    const PatternStep& step = runner.program[runner.pc];
+
+    switch (step.op) {
+      case PATTERN_OP_DRIVE:
+        LOG_DEBUG("Pattern step %d: drive L=%d%% R=%d%%", runner.pc, step.a, step.b);
+        driveWheels(step.a * robotConfig.motorSpeed / 100, step.b * robotConfig.motorSpeed / 100);
+        // Time the step from the end of the last one, not from now: the
+        // movement timer ticks on its due time, so a callback that runs a
+        // little late would otherwise miss the next tick and double the
+        // step. A runner more than a step behind starts afresh from now.
+        runner.stepEndTime += (unsigned long)step.c * PATTERN_TIME_UNIT_MS;
+        if ((long)(now - runner.stepEndTime) >= 0) {
+          runner.stepEndTime = now + (unsigned long)step.c * PATTERN_TIME_UNIT_MS;
+        }
+        runner.pc++;
+        return;
+
+      case PATTERN_OP_LOOP:
+        if (step.b == 0 || ++runner.loopCount < step.b) {
+          runner.pc = step.c;
+        } else {
+          runner.loopCount = 0;
+          runner.pc++;
+        }
+        break;
+
+      case PATTERN_OP_BRANCH:
+        if (random(100) < step.b) {
+          runner.pc = step.c;
+        } else {
+          runner.pc++;
+        }
+        break;
+
+      case PATTERN_OP_END:
+      default:
+        LOG_DEBUG("Pattern finished");
+        driveWheels(0, 0);
+        runner.finished = true;
+        return;
+    }
+  }
+
+  LOG_WARN("Pattern made no drive step in %d steps - stopping", PATTERN_MAX_STEPS_PER_UPDATE);
+  runner.finished = true;
+}
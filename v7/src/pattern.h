@@ -0,0 +1,48 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <stdint.h>
+
+// Movement pattern bytecode.
+//
+// A pattern is a const array of 4-byte steps kept in flash. The interpreter
+// runs it one step at a time from the movement update, so a new movement
+// mode is just a new array - no new function and no static state.
+// Patterns are normally generated from CSV choreography by
+// tools/patternc.cpp (see patterns/ and patterns.h).
+
+enum PatternOp : uint8_t {
+  PATTERN_OP_END,      // Stop the motors and end the pattern
+  PATTERN_OP_DRIVE,    // a = left %, b = right % of the cruise speed, c = duration (10 ms units)
+  PATTERN_OP_LOOP,     // Jump to step c; b = total repeats of the block (0 = forever)
+  PATTERN_OP_BRANCH    // Jump to step c with probability b percent
+};
+
+struct PatternStep {
+  PatternOp op;
+  int8_t a;
+  int8_t b;
+  uint8_t c;
+};
+
+#define PATTERN_TIME_UNIT_MS 10
+
+#define PATTERN_DRIVE(left, right, ms) {PATTERN_OP_DRIVE, (left), (right), (ms) / PATTERN_TIME_UNIT_MS}
+#define PATTERN_LOOP(target, count)    {PATTERN_OP_LOOP, 0, (count), (target)}
+#define PATTERN_BRANCH(target, percent) {PATTERN_OP_BRANCH, 0, (percent), (target)}
+#define PATTERN_END()                  {PATTERN_OP_END, 0, 0, 0}
+
+// Interpreter state for the running pattern. Counted loops don't nest -
+// there is one repeat counter, and tools/patternc.cpp rejects nesting.
+struct PatternRunner {
+  const PatternStep* program;
+  uint8_t pc;
+  uint8_t loopCount;
+  bool finished;
+  unsigned long stepEndTime;
+};
+
+void patternStart(PatternRunner& runner, const PatternStep* program, unsigned long now);
+void patternUpdate(PatternRunner& runner, unsigned long now);
+
+#endif // PATTERN_H
@@ -0,0 +1,53 @@
+#ifndef PATTERNS_H
+#define PATTERNS_H
+
+// Generated by tools/patternc.cpp from patterns/movement_patterns.csv - do not edit.
+
+#include "pattern.h"
+
+static const PatternStep SPIN_PATTERN[] = {
+  PATTERN_DRIVE(-100, 100, 100),  // 0
+  PATTERN_DRIVE(100, -100, 100),  // 1
+  PATTERN_LOOP(0, 0),  // 2
+  PATTERN_END(),  // 3, sentinel
+};
+
+static const PatternStep WANDER_PATTERN[] = {
+  PATTERN_BRANCH(5, 25),  // 0
+  PATTERN_BRANCH(7, 33),  // 1
+  PATTERN_BRANCH(9, 50),  // 2
+  PATTERN_DRIVE(100, -100, 500),  // 3
+  PATTERN_LOOP(0, 0),  // 4
+  PATTERN_DRIVE(100, 100, 500),  // 5
+  PATTERN_LOOP(0, 0),  // 6
+  PATTERN_DRIVE(-100, -100, 500),  // 7
+  PATTERN_LOOP(0, 0),  // 8
+  PATTERN_DRIVE(-100, 100, 500),  // 9
+  PATTERN_LOOP(0, 0),  // 10
+  PATTERN_END(),  // 11, sentinel
+};
+
+static const PatternStep PULSE_PATTERN[] = {
+  PATTERN_DRIVE(100, 100, 1000),  // 0
+  PATTERN_DRIVE(-100, -100, 1000),  // 1
+  PATTERN_LOOP(0, 0),  // 2
+  PATTERN_END(),  // 3, sentinel
+};
+
+static const PatternStep CIRCLE_PATTERN[] = {
+  PATTERN_DRIVE(100, 50, 200),  // 0
+  PATTERN_DRIVE(50, 100, 200),  // 1
+  PATTERN_LOOP(0, 0),  // 2
+  PATTERN_END(),  // 3, sentinel
+};
+
+static const PatternStep ZIGZAG_PATTERN[] = {
+  PATTERN_DRIVE(100, 100, 300),  // 0
+  PATTERN_DRIVE(-100, 100, 300),  // 1
+  PATTERN_DRIVE(100, 100, 300),  // 2
+  PATTERN_DRIVE(100, -100, 300),  // 3
+  PATTERN_LOOP(0, 0),  // 4
+  PATTERN_END(),  // 5, sentinel
+};
+
+#endif // PATTERNS_H
@@ -0,0 +1,130 @@
+#include "hal.h"
+#include "power.h"
+#include "movement_modes.h"
+#include "log.h"
+#include "control.h"
+
+struct ModePowerStats {
+  uint64_t totalUs;
+  uint64_t idleUs;
+  uint64_t sleepUs;
+  uint32_t peakCurrentMa;   // Highest estimated motor current (control task model)
+#ifdef HAL_NATIVE
+  double chargeMas;
+  uint32_t peakDriveStep;   // Largest per-tick drive change (duty units)
+  uint32_t minRailMv;       // Lowest simulated 3.3 V rail
+#endif
+};
+
+static ModePowerStats modeStats[NUM_MODES] = {};
+static int currentModeId = -1;
+static unsigned long periodStartUs = 0;
+#ifdef HAL_NATIVE
+static double periodStartCharge = 0;
+#endif
+
+static volatile uint8_t sleepInhibit = 0;
+static PowerWakeCallback wakeCallback = nullptr;
+
+// Charges the time since the last call to the current mode
+static void closePeriod() {
+  unsigned long now = halMicros();
+  uint32_t peakMa = controlTakePeakCurrentMa();
+  if (currentModeId >= 0) {
+    modeStats[currentModeId].totalUs += now - periodStartUs;
+    modeStats[currentModeId].peakCurrentMa = max(modeStats[currentModeId].peakCurrentMa, peakMa);
+#ifdef HAL_NATIVE
+    modeStats[currentModeId].chargeMas += halSimChargeMas() - periodStartCharge;
+    modeStats[currentModeId].peakDriveStep = max(modeStats[currentModeId].peakDriveStep,
+                                                 halSimTakePeakDriveStep());
+    uint32_t railMv = halSimTakeMinRailMv();
+    if (modeStats[currentModeId].minRailMv == 0 || railMv < modeStats[currentModeId].minRailMv) {
+      modeStats[currentModeId].minRailMv = railMv;
+    }
+#endif
+  }
+  periodStartUs = now;
+#ifdef HAL_NATIVE
+  periodStartCharge = halSimChargeMas();
+  if (currentModeId < 0) {
+    halSimTakePeakDriveStep();
+    halSimTakeMinRailMv();
+  }
+#endif
+}
+
+// Waits up to waitMs, in light sleep when it is enabled and allowed
+void powerIdle(uint32_t waitMs) {
+  if (waitMs == 0) {
+    return;
+  }
+  unsigned long deadline = halMillis() + waitMs;
+  unsigned long start = halMicros();
+
+#ifdef ENABLE_LIGHT_SLEEP
+  if (waitMs >= POWER_LIGHT_SLEEP_MIN_MS && sleepInhibit == 0 && !controlNeedsCpu()) {
+    // Serial output stops while asleep - get queued messages out first
+    logFlush();
+    halLightSleepUntil(deadline);
+    if (currentModeId >= 0) {
+      modeStats[currentModeId].sleepUs += halMicros() - start;
+    }
+
+    // Woken early by a wake pin: let the owner react, then wait out the
+    // rest awake so a pin held low doesn't turn into a busy loop
+    if ((long)(deadline - halMillis()) <= 0) {
+      return;
+    }
+    if (wakeCallback != nullptr) {
+      wakeCallback();
+    }
+    start = halMicros();
+  }
+#endif
+
+  halIdleUntil(deadline);
+  if (currentModeId >= 0) {
+    modeStats[currentModeId].idleUs += halMicros() - start;
+  }
+}
+
+void powerSetSleepInhibit(uint8_t source, bool inhibit) {
+  if (inhibit) {
+    sleepInhibit |= source;
+  } else {
+    sleepInhibit &= ~source;
+  }
+}
+
+void powerSetWakeCallback(PowerWakeCallback callback) {
+  wakeCallback = callback;
+}
+
+// Starts accounting time to a new movement mode
+void powerSetMode(int modeId) {
+  closePeriod();
+  currentModeId = (modeId >= 0 && modeId < NUM_MODES) ? modeId : -1;
+}
+
+// Logs time per mode and how much of it was spent idle and in light sleep
+void powerReport() {
+  closePeriod();
+  LOG_INFO("--- Power by mode ---");
+  for (int mode = 0; mode < NUM_MODES; mode++) {
+    const ModePowerStats& stats = modeStats[mode];
+    if (stats.totalUs == 0) {
+      continue;
+    }
+    int idlePercent = (int)(stats.idleUs * 100 / stats.totalUs);
+    int sleepPercent = (int)(stats.sleepUs * 100 / stats.totalUs);
+    LOG_INFO("%-7s %6lu s  awake %3d%%  idle %3d%%  sleep %3d%%  peak est %4lu mA",
+             getModeName(mode), (unsigned long)(stats.totalUs / 1000000),
+             100 - idlePercent - sleepPercent, idlePercent, sleepPercent,
+             (unsigned long)stats.peakCurrentMa);
+#ifdef HAL_NATIVE
+    LOG_INFO("        sim %.1f mA  peak step %lu  min 3V3 %.2f V",
+             stats.chargeMas * 1e6 / stats.totalUs, (unsigned long)stats.peakDriveStep,
+             stats.minRailMv / 1000.0);
+#endif
+  }
+}
@@ -0,0 +1,40 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+
+// Power management between scheduled deadlines.
+//
+// powerIdle() waits out the gap until the next scheduler deadline. Built
+// with -DENABLE_LIGHT_SLEEP, gaps of POWER_LIGHT_SLEEP_MIN_MS or more are
+// spent in light sleep instead: setupMotors() moves LEDC onto the RTC8M
+// clock so the motors keep running, and the DRV8833 fault pin wakes the
+// CPU early. The control task's timer stops in light sleep, so the loop
+// stays awake while it has work (controlNeedsCpu()), and other code that
+// can't tolerate the CPU stopping holds a sleep inhibit. Time awake, idle and asleep is accounted per
+// movement mode, with the peak estimated motor current; the native build
+// adds the simulated supply current, the largest per-tick drive step and
+// the lowest simulated 3.3 V rail.
+
+#define POWER_LIGHT_SLEEP_MIN_MS 5        // Shorter gaps don't repay the wake-up cost
+#define POWER_REPORT_INTERVAL_MS 600000   // How often main.cpp logs the per-mode table
+
+// Sleep inhibit sources (bit mask)
+#define POWER_INHIBIT_SPEED_CONTROL 0x01
+#define POWER_INHIBIT_CURRENT_SENSE 0x02
+#define POWER_INHIBIT_PWM_SWEEP 0x04
+#define POWER_INHIBIT_CALIBRATION 0x08
+#define POWER_INHIBIT_PROTOCOL 0x10
+#define POWER_INHIBIT_CONSOLE 0x20
+#define POWER_INHIBIT_TELEOP 0x40
+
+// Called when light sleep ends before its deadline (i.e. on a wake pin)
+typedef void (*PowerWakeCallback)();
+
+void powerIdle(uint32_t waitMs);
+void powerSetSleepInhibit(uint8_t source, bool inhibit);
+void powerSetWakeCallback(PowerWakeCallback callback);
+void powerSetMode(int modeId);
+void powerReport();
+
+#endif // POWER_H
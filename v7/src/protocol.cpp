@@ -0,0 +1,133 @@
+#include "hal.h"
+#include "protocol.h"
+#include "frame.h"
+#include "control.h"
+#include "power.h"
+#include "log.h"
+
+#ifdef ENABLE_PROTOCOL
+
+// Protocol task state. Everything here belongs to the protocol task.
+static FrameReader reader;
+static FrameWriter writer;
+static uint32_t rejectedFrames = 0;     // Decoded cleanly but malformed or unknown
+static uint16_t telemetryPeriods = 0;   // Periods between telemetry frames, 0 = off
+static uint16_t telemetryCountdown = 0;
+static uint16_t telemetrySeq = 0;
+static ControlTelemetry telemetry = {};
+static bool haveTelemetry = false;
+
+static bool sendFrame() {
+  size_t length = writer.finish();
+  return length != 0 && halSerialWrite(writer.data(), length) == length;
+}
+
+static void handleFrame() {
+  const uint8_t* payload = reader.payload();
+  size_t length = reader.payloadLength();
+
+  switch (reader.type()) {
+    case MSG_SETPOINT:
+      if (length < MSG_SETPOINT_LENGTH) {
+        break;
+      }
+      controlPostHostSetpoint(frameGetU16(payload), frameGetI16(payload + 2), frameGetI16(payload + 4),
+                              payload[6] == STOP_BRAKE ? STOP_BRAKE : STOP_COAST);
+      return;
+
+    case MSG_PING:
+      if (length < MSG_PING_LENGTH) {
+        break;
+      }
+      // No room for the pong: the host times out and pings again
+      writer.begin(MSG_PONG);
+      writer.putU32(frameGetU32(payload));
+      writer.putU32(halMicros());
+      sendFrame();
+      return;
+
+    case MSG_TELEMETRY_RATE: {
+      if (length < MSG_TELEMETRY_RATE_LENGTH) {
+        break;
+      }
+      uint16_t hz = min(frameGetU16(payload), (uint16_t)PROTOCOL_TELEMETRY_MAX_HZ);
+      telemetryPeriods = hz != 0 ? PROTOCOL_TELEMETRY_MAX_HZ / hz : 0;
+      telemetryCountdown = 1;
+      return;
+    }
+
+    default:
+      break;
+  }
+  rejectedFrames++;
+}
+
+// Dropped, not queued, when the TX buffer is full: the next one is newer
+static void sendTelemetry() {
+  uint8_t flags = (telemetry.fault ? TELEMETRY_FLAG_FAULT : 0) | (telemetry.hostActive ? TELEMETRY_FLAG_HOST : 0);
+  uint32_t rejected = reader.errors() + rejectedFrames;
+
+  writer.begin(MSG_TELEMETRY);
+  writer.putU16(telemetrySeq++);
+  writer.putU32(telemetry.timeUs);
+  writer.putU16(telemetry.hostSeq);
+  writer.putI16(telemetry.setpoint.left);
+  writer.putI16(telemetry.setpoint.right);
+  writer.putI16(telemetry.output[MOTOR_A]);
+  writer.putI16(telemetry.output[MOTOR_B]);
+  writer.putI32(telemetry.encoder[MOTOR_A]);
+  writer.putI32(telemetry.encoder[MOTOR_B]);
+  writer.putU16((uint16_t)min(telemetry.currentMa, (uint32_t)UINT16_MAX));
+  writer.putU8(flags);
+  writer.putU16((uint16_t)min(rejected, (uint32_t)UINT16_MAX));
+  sendFrame();
+}
+
+#ifndef HAL_NATIVE
+// Log lines become LOG frames. A line that doesn't fit stays queued for
+// the next period.
+static bool sendLogFrame(const char* text, size_t length) {
+  writer.begin(MSG_LOG);
+  writer.putBytes(text, min(length, (size_t)FRAME_MAX_PAYLOAD));
+  return sendFrame();
+}
+#endif
+
+// One protocol period: decode what has arrived, then send
+static void protocolStep() {
+  uint8_t received[64];
+  size_t budget = PROTOCOL_RX_BUDGET;
+  while (budget != 0) {
+    size_t count = halSerialRead(received, min(sizeof(received), budget));
+    if (count == 0) {
+      break;
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (reader.feed(received[i])) {
+        handleFrame();
+      }
+    }
+    budget -= count;
+  }
+
+  if (controlTakeTelemetry(telemetry)) {
+    haveTelemetry = true;
+  }
+  if (telemetryPeriods != 0 && haveTelemetry && --telemetryCountdown == 0) {
+    telemetryCountdown = telemetryPeriods;
+    sendTelemetry();
+  }
+
+#ifndef HAL_NATIVE
+  // The native build keeps its log on stdout (logFlush() in hal_native.cpp)
+  logDrain(sendLogFrame);
+#endif
+}
+
+void protocolBegin() {
+  // USB serial stops while the CPU is in light sleep
+  powerSetSleepInhibit(POWER_INHIBIT_PROTOCOL, true);
+  halTaskStartPeriodic(protocolStep, PROTOCOL_PERIOD_US, PROTOCOL_TASK_PRIORITY, "protocol");
+}
+
+#endif // ENABLE_PROTOCOL
@@ -0,0 +1,55 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+
+// Binary setpoint and telemetry link over the native USB serial port.
+//
+// Build with -DENABLE_PROTOCOL. Frames (frame.h) carry one message each,
+// identified by their type byte; all fields are little-endian. A host
+// streams SETPOINT messages, which override the movement modes for as long
+// as they keep arriving (HOST_SETPOINT_TIMEOUT_MS in control.h), and asks
+// for TELEMETRY at up to PROTOCOL_TELEMETRY_MAX_HZ.
+//
+// The protocol task runs every PROTOCOL_PERIOD_US between the control task
+// and loop(). Each period it decodes whatever has arrived, answers it,
+// sends telemetry if it is due and wraps pending log lines in LOG frames:
+// it is the only writer of Serial, so text never lands inside a frame.
+// Writes never wait - a frame that doesn't fit the USB TX buffer is
+// dropped (telemetry) or retried next period (log lines).
+//
+// tools/robot_link.h is the matching host client; tools/linkbench.cpp
+// tests it end to end against the native build's --pty link.
+
+#define PROTOCOL_PERIOD_US 1000                 // 1 kHz
+#define PROTOCOL_TASK_PRIORITY 10               // Below control (20), above loop/log (1)
+#define PROTOCOL_RX_BUDGET 512                  // Most bytes decoded per period
+#define PROTOCOL_TELEMETRY_MAX_HZ (1000000 / PROTOCOL_PERIOD_US)
+
+// Host -> robot
+#define MSG_SETPOINT 0x01         // u16 seq, i16 left, i16 right, u8 StopMode
+#define MSG_PING 0x02             // u32 token
+#define MSG_TELEMETRY_RATE 0x03   // u16 Hz (0 = off, the default)
+
+// Robot -> host
+#define MSG_TELEMETRY 0x81        // See below
+#define MSG_PONG 0x82             // u32 token, u32 robot time (us)
+#define MSG_LOG 0x83              // Log line text
+
+#define MSG_SETPOINT_LENGTH 7
+#define MSG_PING_LENGTH 4
+#define MSG_TELEMETRY_RATE_LENGTH 2
+#define MSG_PONG_LENGTH 8
+
+// TELEMETRY: u16 telemetry seq, u32 control time (us), u16 last host
+// setpoint seq, i16 setpoint left/right, i16 output left/right (duty on
+// the -255..255 scale), i32 encoder left/right, u16 estimated motor
+// current (mA), u8 flags, u16 frames rejected by the robot
+#define MSG_TELEMETRY_LENGTH 29
+
+#define TELEMETRY_FLAG_FAULT 0x01         // DRV8833 fault asserted
+#define TELEMETRY_FLAG_HOST 0x02          // Host setpoints in control
+
+void protocolBegin();
+
+#endif // PROTOCOL_H
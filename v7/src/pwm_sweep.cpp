@@ -0,0 +1,262 @@
+#include <atomic>
+#include "hal.h"
+#include "pwm_sweep.h"
+#include "encoder.h"
+#include "current_sense.h"
+#include "control.h"
+#include "power.h"
+#include "log.h"
+
+// The settings v2-v7 used (all 8-bit), the same frequencies at the finest
+// resolution, and inaudible ones above 20 kHz. pwmMaxResolution() caps
+// each resolution for the clock in use.
+static const PwmProfile sweepProfiles[] = {
+  {500, 8}, {1000, 8}, {5000, 8},
+  {500, 14}, {1000, 14}, {5000, 14},
+  {20000, 12}, {25000, 12}, {40000, 12},
+};
+#define SWEEP_NUM_PROFILES (sizeof(sweepProfiles) / sizeof(sweepProfiles[0]))
+#define SWEEP_NUM_RUNS (SWEEP_NUM_PROFILES * 2)    // Each profile in fast, then slow decay
+
+// Bridge and motor model for the efficiency figure: DRV8833 datasheet
+// values and a small 6 V gearmotor. Only good for comparing profiles.
+#define SWEEP_MODEL_SUPPLY_V 5.0f
+#define SWEEP_MODEL_WINDING_OHMS 6.25f     // 5 V / 800 mA stall
+#define SWEEP_MODEL_WINDING_HENRY 0.0008f
+#define SWEEP_MODEL_RDS_ON_OHMS 0.36f      // High side + low side
+#define SWEEP_MODEL_SWITCH_S 0.4e-6f       // Rise + fall time per PWM period
+#define SWEEP_MODEL_RUN_MA 200.0f          // Armature current when not sensed
+
+#define MS_TO_PERIODS(ms) ((ms) * 1000L / CONTROL_PERIOD_US)
+#define RAMP_PPM_PER_PERIOD (PWM_SWEEP_RAMP_PERCENT_PER_S * 10000L * CONTROL_PERIOD_US / 1000000)
+
+enum SweepState {
+  SWEEP_IDLE,
+  SWEEP_SWITCH,      // Move to the next profile and decay mode
+  SWEEP_RAMP,        // Raising the duty until both wheels turn
+  SWEEP_HOLD,        // Holding the ripple duty
+  SWEEP_COAST,       // Outputs off between profiles
+  SWEEP_DONE
+};
+
+// Behaviour -> control
+static std::atomic<bool> sweepRequested(false);
+
+// Control -> behaviour: results[0..resultCount) are complete
+static PwmSweepResult results[SWEEP_NUM_RUNS];
+static std::atomic<uint8_t> resultCount(0);
+static std::atomic<bool> sweepAborted(false);
+
+// Control task state
+static SweepState state = SWEEP_IDLE;
+static uint8_t runIndex = 0;
+static DecayMode savedDecay[2];
+static PwmProfile savedProfile;
+static uint32_t dutyPpm = 0;
+static int32_t motion[2] = {0, 0};
+static uint32_t periodsLeft = 0;
+
+// Behaviour side
+static uint8_t resultsReported = 0;
+static bool endReported = false;
+
+// Duty as a raw count at the current resolution
+static uint32_t rawDuty(uint32_t ppm) {
+  return (uint32_t)((uint64_t)ppm * getPwmMaxDuty() / 1000000);
+}
+
+static void driveBoth(uint32_t duty) {
+  MotorFrame& frame = stageMotorFrame();
+  stageMotorDuty(frame, MOTOR_A, duty);
+  stageMotorDuty(frame, MOTOR_B, duty);
+  commitMotorFrame();
+}
+
+// Behaviour side: hands the motors to the sweep
+void pwmSweepStart() {
+#ifndef ENABLE_SPEED_CONTROL
+  // Only the speed loop starts the encoders otherwise
+  encoderBegin();
+#endif
+  // The control task times the ramp, and it stops in light sleep
+  powerSetSleepInhibit(POWER_INHIBIT_PWM_SWEEP, true);
+  LOG_INFO("PWM sweep: %d profiles x 2 decay modes - wheels must be off the ground",
+           (int)SWEEP_NUM_PROFILES);
+  sweepRequested.store(true, std::memory_order_release);
+}
+
+// Control task: puts the profile and decay modes from before the sweep back
+static void finish() {
+  setMotorDecay(MOTOR_A, savedDecay[MOTOR_A]);
+  setMotorDecay(MOTOR_B, savedDecay[MOTOR_B]);
+  setPwmProfile(savedProfile);
+  state = SWEEP_DONE;
+}
+
+// Control task: one period of the sweep. Returns true while the sweep owns
+// the outputs.
+bool pwmSweepStep(bool fault) {
+  if (state == SWEEP_IDLE) {
+    if (!sweepRequested.load(std::memory_order_acquire)) {
+      return false;
+    }
+    runIndex = 0;
+    savedDecay[MOTOR_A] = getMotorDecay(MOTOR_A);
+    savedDecay[MOTOR_B] = getMotorDecay(MOTOR_B);
+    savedProfile = getPwmProfile();
+    state = SWEEP_SWITCH;
+  }
+  if (state == SWEEP_DONE) {
+    return false;
+  }
+
+  if (fault) {
+    moveDifferential(0, 0);
+    finish();
+    sweepAborted.store(true, std::memory_order_release);
+    return false;
+  }
+
+  PwmSweepResult& result = results[runIndex];
+  switch (state) {
+    case SWEEP_SWITCH: {
+      PwmProfile profile = sweepProfiles[runIndex / 2];
+      profile.resolution = min(profile.resolution, pwmMaxResolution(profile.freqHz));
+      result = {};
+      result.profile = profile;
+      result.decay = (runIndex % 2 == 0) ? DECAY_FAST : DECAY_SLOW;
+      // Outputs are at zero here, so the mode change alone moves nothing
+      setMotorDecay(MOTOR_A, result.decay);
+      setMotorDecay(MOTOR_B, result.decay);
+      if (!setPwmProfile(profile)) {
+        periodsLeft = 0;
+        state = SWEEP_COAST;
+        break;
+      }
+      result.maxDuty = getPwmMaxDuty();
+      encoderReadDelta(MOTOR_A);
+      encoderReadDelta(MOTOR_B);
+      motion[MOTOR_A] = motion[MOTOR_B] = 0;
+      dutyPpm = PWM_SWEEP_START_PERCENT * 10000L;
+      state = SWEEP_RAMP;
+      break;
+    }
+
+    case SWEEP_RAMP: {
+      uint32_t duty = rawDuty(dutyPpm);
+      for (int motor = 0; motor < 2; motor++) {
+        motion[motor] += encoderReadDelta(motor);
+        if (result.stallDuty[motor] == 0 && abs(motion[motor]) >= PWM_SWEEP_MOTION_COUNTS) {
+          result.stallDuty[motor] = duty;
+        }
+      }
+      bool bothTurning = result.stallDuty[MOTOR_A] != 0 && result.stallDuty[MOTOR_B] != 0;
+      if (bothTurning || dutyPpm >= PWM_SWEEP_MAX_STALL_PERCENT * 10000L) {
+        periodsLeft = MS_TO_PERIODS(PWM_SWEEP_HOLD_MS);
+        state = SWEEP_HOLD;
+        break;
+      }
+      dutyPpm += RAMP_PPM_PER_PERIOD;
+      driveBoth(rawDuty(dutyPpm));
+      break;
+    }
+
+    case SWEEP_HOLD:
+      driveBoth(rawDuty(PWM_SWEEP_HOLD_PERCENT * 10000L));
+      if (--periodsLeft == 0) {
+#ifdef ENABLE_CURRENT_SENSE
+        const CurrentSenseWindow& window = currentSenseLastWindow();
+        for (int motor = 0; motor < 2; motor++) {
+          uint32_t rms = window.rmsMa[motor];
+          uint32_t mean = window.meanMa[motor];
+          result.meanMa[motor] = mean;
+          result.rippleMa[motor] = (uint16_t)sqrtf((float)(rms * rms - min(mean * mean, rms * rms)));
+        }
+#endif
+        moveDifferential(0, 0);
+        periodsLeft = MS_TO_PERIODS(PWM_SWEEP_COAST_MS);
+        state = SWEEP_COAST;
+      }
+      break;
+
+    case SWEEP_COAST:
+      if (periodsLeft == 0 || --periodsLeft == 0) {
+        resultCount.store(runIndex + 1, std::memory_order_release);
+        if (++runIndex < SWEEP_NUM_RUNS) {
+          state = SWEEP_SWITCH;
+        } else {
+          finish();
+        }
+      }
+      break;
+
+    default:
+      break;
+  }
+  return true;
+}
+
+// Share of the bridge input power that reaches the motor as DC current, in
+// tenths of a percent. Losses are the copper loss of the PWM current ripple
+// and the bridge switching loss; the DC conduction loss is the same for
+// every profile and left out. In fast decay the winding sees the supply
+// reversed during the off-time rather than shorted, which doubles the
+// ripple for continuous current.
+static uint32_t modelEfficiencyTenths(const PwmSweepResult& result, int motor) {
+  float duty = PWM_SWEEP_HOLD_PERCENT / 100.0f;
+  float freq = (float)result.profile.freqHz;
+  float armatureA = result.meanMa[motor] != 0 ? result.meanMa[motor] / duty / 1000.0f
+                                              : SWEEP_MODEL_RUN_MA / 1000.0f;
+
+  float rippleA = SWEEP_MODEL_SUPPLY_V * duty * (1 - duty) / (SWEEP_MODEL_WINDING_HENRY * freq);
+  if (result.decay == DECAY_FAST) {
+    rippleA *= 2;
+  }
+  rippleA = min(rippleA, SWEEP_MODEL_SUPPLY_V / SWEEP_MODEL_WINDING_OHMS);
+  float rippleW = (SWEEP_MODEL_WINDING_OHMS + SWEEP_MODEL_RDS_ON_OHMS) * rippleA * rippleA / 12;
+  float switchW = SWEEP_MODEL_SUPPLY_V * armatureA * SWEEP_MODEL_SWITCH_S * freq;
+  float dcW = SWEEP_MODEL_SUPPLY_V * duty * armatureA;
+  return (uint32_t)(1000 * dcW / (dcW + rippleW + switchW) + 0.5f);
+}
+
+// Stall duty in tenths of a percent of full scale
+static uint32_t dutyTenths(uint32_t duty, uint32_t maxDuty) {
+  return (uint32_t)(((uint64_t)duty * 1000 + maxDuty / 2) / maxDuty);
+}
+
+// Behaviour side: logs any profiles finished since the last call
+void pwmSweepReport() {
+  uint8_t count = resultCount.load(std::memory_order_acquire);
+  for (; resultsReported < count; resultsReported++) {
+    const PwmSweepResult& r = results[resultsReported];
+    unsigned long freq = r.profile.freqHz;
+    const char* decay = r.decay == DECAY_SLOW ? "slow" : "fast";
+    if (r.maxDuty == 0) {
+      LOG_WARN("Sweep %lu Hz %d bit: not possible on this clock", freq, r.profile.resolution);
+      continue;
+    }
+    uint32_t stallA = dutyTenths(r.stallDuty[MOTOR_A], r.maxDuty);
+    uint32_t stallB = dutyTenths(r.stallDuty[MOTOR_B], r.maxDuty);
+    LOG_INFO("Sweep %lu Hz %d bit %s: stall A %lu.%lu%% B %lu.%lu%% (%lu steps)",
+             freq, r.profile.resolution, decay,
+             (unsigned long)(stallA / 10), (unsigned long)(stallA % 10),
+             (unsigned long)(stallB / 10), (unsigned long)(stallB % 10), (unsigned long)r.maxDuty);
+    uint32_t effA = modelEfficiencyTenths(r, MOTOR_A);
+    uint32_t effB = modelEfficiencyTenths(r, MOTOR_B);
+    LOG_INFO("Sweep %lu Hz %s: ripple A %u B %u mA rms, model eff. A %lu.%lu%% B %lu.%lu%%",
+             freq, decay, r.rippleMa[MOTOR_A], r.rippleMa[MOTOR_B],
+             (unsigned long)(effA / 10), (unsigned long)(effA % 10),
+             (unsigned long)(effB / 10), (unsigned long)(effB % 10));
+  }
+
+  if (!endReported && (count == SWEEP_NUM_RUNS || sweepAborted.load(std::memory_order_acquire))) {
+    endReported = true;
+    if (sweepAborted.load(std::memory_order_relaxed)) {
+      LOG_WARN("PWM sweep aborted by a driver fault after %d runs", (int)count);
+    } else {
+      LOG_INFO("PWM sweep complete - back on %lu Hz %d bit",
+               (unsigned long)getPwmProfile().freqHz, getPwmProfile().resolution);
+    }
+    powerSetSleepInhibit(POWER_INHIBIT_PWM_SWEEP, false);
+  }
+}
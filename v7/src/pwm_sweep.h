@@ -0,0 +1,41 @@
+#ifndef PWM_SWEEP_H
+#define PWM_SWEEP_H
+
+#include <stdint.h>
+#include "motor_control.h"
+
+// PWM profile sweep (build with -DENABLE_PWM_SWEEP, wheels off the ground).
+//
+// Runs instead of the movement modes. For each profile in the sweep table,
+// first in fast and then in slow decay, the control task switches the
+// motor channels over with setPwmProfile().
+// It then raises both wheels' duty, in whatever steps the resolution
+// allows, until the encoders see them turn, which gives the stall duty.
+// Next it holds PWM_SWEEP_HOLD_PERCENT to measure current ripple (with
+// ENABLE_CURRENT_SENSE). main.cpp logs each result with a modelled
+// efficiency for the bridge and motor. The profile and decay modes in use
+// before are restored at the end.
+
+#define PWM_SWEEP_START_PERCENT 5          // Ramp start - well below breakaway
+#define PWM_SWEEP_RAMP_PERCENT_PER_S 5     // Duty rise while looking for breakaway
+#define PWM_SWEEP_MOTION_COUNTS 4          // Encoder counts that mean the wheel turned
+#define PWM_SWEEP_MAX_STALL_PERCENT 60     // Give up looking above this duty
+#define PWM_SWEEP_HOLD_PERCENT 50          // Duty for the ripple measurement
+#define PWM_SWEEP_HOLD_MS 500
+#define PWM_SWEEP_COAST_MS 500             // Outputs off between profiles so the wheels stop
+#define PWM_SWEEP_REPORT_INTERVAL_MS 100   // How often main.cpp checks for new results
+
+struct PwmSweepResult {
+  PwmProfile profile;
+  DecayMode decay;
+  uint32_t maxDuty;          // 0 if the profile isn't possible
+  uint32_t stallDuty[2];     // Raw duty where each wheel started turning (0 = it didn't)
+  uint16_t meanMa[2];        // Shunt current at the hold duty (0 without current sense)
+  uint16_t rippleMa[2];      // RMS of the AC part of the shunt current
+};
+
+void pwmSweepStart();
+bool pwmSweepStep(bool fault);
+void pwmSweepReport();
+
+#endif // PWM_SWEEP_H
@@ -0,0 +1,214 @@
+#include <string.h>
+#include "hal.h"
+#include "scheduler.h"
+
+#define LEVEL0_MASK (SCHEDULER_LEVEL0_SIZE - 1)
+#define LEVEL_MASK (SCHEDULER_LEVEL_SIZE - 1)
+#define LEVEL1_SHIFT SCHEDULER_LEVEL0_BITS
+#define LEVEL2_SHIFT (SCHEDULER_LEVEL0_BITS + SCHEDULER_LEVEL_BITS)
+
+static SchedulerTimer* level0[SCHEDULER_LEVEL0_SIZE];
+static SchedulerTimer* level1[SCHEDULER_LEVEL_SIZE];
+static SchedulerTimer* level2[SCHEDULER_LEVEL_SIZE];
+
+// One bit per non-empty level 0 slot, for finding the next deadline
+static uint32_t level0Occupied[SCHEDULER_LEVEL0_SIZE / 32];
+static uint16_t upperLevelCount = 0;  // Timers waiting in level 1 or 2
+
+static uint32_t currentTick = 0;      // Next tick to be processed
+
+static void linkTimer(SchedulerTimer** head, SchedulerTimer* timer) {
+  timer->next = *head;
+  if (timer->next != nullptr) {
+    timer->next->pprev = &timer->next;
+  }
+  timer->pprev = head;
+  *head = timer;
+}
+
+static void insertTimer(SchedulerTimer* timer) {
+  int32_t delta = (int32_t)(timer->expires - currentTick);
+
+  if (delta < 0) {
+    // Already due - run on the next processed tick
+    timer->expires = currentTick;
+    delta = 0;
+  } else if ((uint32_t)delta > SCHEDULER_MAX_DELAY_MS) {
+    timer->expires = currentTick + SCHEDULER_MAX_DELAY_MS;
+    delta = SCHEDULER_MAX_DELAY_MS;
+  }
+
+  if (delta < SCHEDULER_LEVEL0_SIZE) {
+    uint32_t slot = timer->expires & LEVEL0_MASK;
+    linkTimer(&level0[slot], timer);
+    timer->slot = slot;
+    level0Occupied[slot / 32] |= 1UL << (slot % 32);
+  } else if (delta < (1L << LEVEL2_SHIFT)) {
+    linkTimer(&level1[(timer->expires >> LEVEL1_SHIFT) & LEVEL_MASK], timer);
+    timer->slot = SCHEDULER_SLOT_UPPER;
+    upperLevelCount++;
+  } else {
+    linkTimer(&level2[(timer->expires >> LEVEL2_SHIFT) & LEVEL_MASK], timer);
+    timer->slot = SCHEDULER_SLOT_UPPER;
+    upperLevelCount++;
+  }
+}
+
+void schedulerInit() {
+  memset(level0, 0, sizeof(level0));
+  memset(level1, 0, sizeof(level1));
+  memset(level2, 0, sizeof(level2));
+  memset(level0Occupied, 0, sizeof(level0Occupied));
+  upperLevelCount = 0;
+  currentTick = halMillis();
+}
+
+void schedulerCancel(SchedulerTimer* timer) {
+  if (timer->pprev == nullptr) {
+    return;
+  }
+
+  *timer->pprev = timer->next;
+  if (timer->next != nullptr) {
+    timer->next->pprev = timer->pprev;
+  }
+  timer->next = nullptr;
+  timer->pprev = nullptr;
+
+  if (timer->slot >= 0) {
+    if (level0[timer->slot] == nullptr) {
+      level0Occupied[timer->slot / 32] &= ~(1UL << (timer->slot % 32));
+    }
+  } else if (timer->slot == SCHEDULER_SLOT_UPPER) {
+    upperLevelCount--;
+  }
+}
+
+void schedulerAdd(SchedulerTimer* timer, SchedulerCallback callback, uint32_t delayMs, uint32_t periodMs) {
+  schedulerCancel(timer);
+  timer->callback = callback;
+  timer->period = periodMs;
+  timer->expires = halMillis() + delayMs;
+  insertTimer(timer);
+}
+
+bool schedulerIsActive(const SchedulerTimer* timer) {
+  return timer->pprev != nullptr;
+}
+
+// Moves every timer in an upper-level slot down to where it now belongs
+static void cascade(SchedulerTimer** head) {
+  SchedulerTimer* timer = *head;
+  *head = nullptr;
+  while (timer != nullptr) {
+    SchedulerTimer* next = timer->next;
+    upperLevelCount--;
+    insertTimer(timer);
+    timer = next;
+  }
+}
+
+static void processTick() {
+  uint32_t slot = currentTick & LEVEL0_MASK;
+
+  if (slot == 0) {
+    uint32_t slot1 = (currentTick >> LEVEL1_SHIFT) & LEVEL_MASK;
+    if (slot1 == 0) {
+      cascade(&level2[(currentTick >> LEVEL2_SHIFT) & LEVEL_MASK]);
+    }
+    cascade(&level1[slot1]);
+  }
+
+  // Detach the slot and move on a tick before running anything, so
+  // callbacks can add or cancel timers (including this slot's) freely
+  SchedulerTimer* timer = level0[slot];
+  level0[slot] = nullptr;
+  level0Occupied[slot / 32] &= ~(1UL << (slot % 32));
+  currentTick++;
+
+  for (SchedulerTimer* t = timer; t != nullptr; t = t->next) {
+    t->slot = SCHEDULER_SLOT_RUNNING;
+  }
+  if (timer != nullptr) {
+    timer->pprev = &timer;
+  }
+
+  while (timer != nullptr) {
+    SchedulerTimer* expired = timer;
+    schedulerCancel(expired);
+
+    // Re-arm periodic timers from their due time so they don't drift; an
+    // overrun makes them run once on the next tick rather than catch up
+    if (expired->period != 0) {
+      expired->expires += expired->period;
+      insertTimer(expired);
+    }
+    expired->callback();
+  }
+}
+
+// Runs every timer that has fallen due
+void schedulerRun() {
+  uint32_t now = halMillis();
+
+  while ((int32_t)(now - currentTick) >= 0) {
+    // Skip straight to the next cascade point when level 0 is empty
+    bool level0Empty = true;
+    for (uint32_t i = 0; i < SCHEDULER_LEVEL0_SIZE / 32; i++) {
+      if (level0Occupied[i] != 0) {
+        level0Empty = false;
+        break;
+      }
+    }
+    if (level0Empty && (currentTick & LEVEL0_MASK) != 0) {
+      uint32_t boundary = (currentTick | LEVEL0_MASK) + 1;
+      if ((int32_t)(now - boundary) < 0) {
+        currentTick = now + 1;
+        break;
+      }
+      currentTick = boundary;
+    }
+    processTick();
+  }
+}
+
+// Milliseconds until the next timer is due (0 if one is due now). For
+// timers still in an upper level this is the time of the next cascade,
+// which is never later than the timer itself.
+uint32_t schedulerTimeUntilNext() {
+  uint32_t now = halMillis();
+  if ((int32_t)(now - currentTick) >= 0) {
+    return 0;
+  }
+
+  // Search level 0 from the current slot onwards, but no further than the
+  // next cascade while upper-level timers wait: one of them may come down
+  // into a slot before a level 0 timer that lies beyond it
+  uint32_t limit = SCHEDULER_LEVEL0_SIZE;
+  if (upperLevelCount > 0) {
+    if ((currentTick & LEVEL0_MASK) == 0) {
+      return currentTick - now;     // The next tick is itself the cascade
+    }
+    limit = ((currentTick | LEVEL0_MASK) + 1) - currentTick;
+  }
+  uint32_t start = currentTick & LEVEL0_MASK;
+  for (uint32_t offset = 0; offset < limit; offset++) {
+    uint32_t slot = (start + offset) & LEVEL0_MASK;
+    uint32_t word = level0Occupied[slot / 32] >> (slot % 32);
+    if (word == 0) {
+      // Nothing else in this word - jump to the next one
+      offset += 31 - (slot % 32);
+      continue;
+    }
+    offset += __builtin_ctz(word);
+    if (offset < limit) {
+      return currentTick + offset - now;
+    }
+    break;
+  }
+
+  if (upperLevelCount > 0) {
+    return currentTick + limit - now;
+  }
+  return SCHEDULER_MAX_IDLE_MS;
+}
@@ -0,0 +1,43 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+// Hierarchical timer wheel with 1 ms ticks.
+//
+// Timers are caller-owned (usually static) SchedulerTimer structs linked
+// into the wheel, so the scheduler allocates nothing and insert/cancel are
+// O(1). Three levels cover 256 ms, 16.4 s and 17.5 min; later timers are
+// moved down a level as their time approaches. Callbacks run from
+// schedulerRun() in the loop task; between runs the loop blocks for
+// schedulerTimeUntilNext() instead of busy-polling.
+
+#define SCHEDULER_LEVEL0_BITS 8
+#define SCHEDULER_LEVEL_BITS 6
+#define SCHEDULER_LEVEL0_SIZE (1 << SCHEDULER_LEVEL0_BITS)   // 256 slots of 1 ms
+#define SCHEDULER_LEVEL_SIZE (1 << SCHEDULER_LEVEL_BITS)     // 64 slots per upper level
+#define SCHEDULER_MAX_DELAY_MS ((1UL << (SCHEDULER_LEVEL0_BITS + 2 * SCHEDULER_LEVEL_BITS)) - 1)
+#define SCHEDULER_MAX_IDLE_MS 1000   // Reported wait when no timers are pending
+
+#define SCHEDULER_SLOT_UPPER -1     // Waiting in level 1 or 2
+#define SCHEDULER_SLOT_RUNNING -2   // Detached for this tick's run
+
+typedef void (*SchedulerCallback)();
+
+struct SchedulerTimer {
+  SchedulerTimer* next;
+  SchedulerTimer** pprev;       // Points at whatever points at us (nullptr = not scheduled)
+  uint32_t expires;             // Absolute tick
+  uint32_t period;              // Ticks between runs (0 = one-shot)
+  int16_t slot;                 // Level 0 slot, or SCHEDULER_SLOT_UPPER / _RUNNING
+  SchedulerCallback callback;
+};
+
+void schedulerInit();
+void schedulerAdd(SchedulerTimer* timer, SchedulerCallback callback, uint32_t delayMs, uint32_t periodMs = 0);
+void schedulerCancel(SchedulerTimer* timer);
+bool schedulerIsActive(const SchedulerTimer* timer);
+void schedulerRun();
+uint32_t schedulerTimeUntilNext();
+
+#endif // SCHEDULER_H
@@ -0,0 +1,79 @@
+#include "hal.h"
+#include "speed_control.h"
+#include "encoder.h"
+#include "motor_control.h"
+#include "fixed_point.h"
+
+struct WheelController {
+  Fixed target;     // counts/s
+  Fixed speed;      // filtered measured speed, counts/s
+  Fixed integral;   // integrator state, duty
+};
+
+static WheelController wheels[2] = {};
+
+// Written by the mode code, read by the control loop
+static volatile int commandedSpeed[2] = {0, 0};
+
+// Loop constants in Q16.16
+static const Fixed CPS_PER_COMMAND = Fixed::fromFloat((float)WHEEL_MAX_SPEED_CPS / 255.0f);
+static const Fixed KP = Fixed::fromFloat(SPEED_KP);
+static const Fixed KI_DT = Fixed::fromFloat(SPEED_KI * SPEED_CONTROL_PERIOD_US / 1000000.0f);
+static const Fixed KFF = Fixed::fromFloat(SPEED_KFF);
+static const Fixed FILTER_ALPHA = Fixed::fromFloat(SPEED_FILTER_ALPHA);
+static const Fixed MAX_DUTY = Fixed::fromInt(255);
+static const int32_t TICKS_PER_SECOND = 1000000 / SPEED_CONTROL_PERIOD_US;
+
+// The control task calls speedControlStep() every SPEED_CONTROL_PERIOD_US
+void speedControlBegin() {
+  encoderBegin();
+}
+
+// Sets the wheel speed targets on the moveDifferential() scale (-255..255)
+void setWheelSpeedTargets(int leftCommand, int rightCommand) {
+  commandedSpeed[MOTOR_A] = constrain(leftCommand, -255, 255);
+  commandedSpeed[MOTOR_B] = constrain(rightCommand, -255, 255);
+}
+
+// One control period: measure, run the PI loop for each wheel, then commit
+// both outputs in a single frame. All fixed point - no soft-float.
+void speedControlStep() {
+  int output[2] = {0, 0};
+
+  for (int motor = 0; motor < 2; motor++) {
+    WheelController& wheel = wheels[motor];
+    wheel.target = CPS_PER_COMMAND * (int32_t)commandedSpeed[motor];
+
+    Fixed measured = Fixed::fromInt(encoderReadDelta(motor) * TICKS_PER_SECOND);
+    wheel.speed += FILTER_ALPHA * (measured - wheel.speed);
+
+    // A zero target means stop: coast and forget the integrator
+    if (commandedSpeed[motor] == 0) {
+      wheel.integral = Fixed::fromRaw(0);
+      continue;
+    }
+
+    Fixed error = wheel.target - wheel.speed;
+    Fixed feedforward = KFF * wheel.target + KP * error;
+    Fixed unclamped = feedforward + wheel.integral;
+
+    // Anti-windup: stop integrating while the output is saturated in the
+    // direction the error would push it
+    bool saturated = (unclamped >= MAX_DUTY && error.raw > 0) || (unclamped <= -MAX_DUTY && error.raw < 0);
+    if (!saturated) {
+      wheel.integral = fixedClamp(wheel.integral + KI_DT * error, -MAX_DUTY, MAX_DUTY);
+    }
+
+    output[motor] = fixedClamp(feedforward + wheel.integral, -MAX_DUTY, MAX_DUTY).toInt();
+  }
+
+  moveDifferential(output[MOTOR_A], output[MOTOR_B]);
+}
+
+int getWheelSpeed(int motor) {
+  return wheels[motor].speed.toInt();
+}
+
+int getWheelTarget(int motor) {
+  return wheels[motor].target.toInt();
+}
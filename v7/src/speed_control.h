@@ -0,0 +1,28 @@
+#ifndef SPEED_CONTROL_H
+#define SPEED_CONTROL_H
+
+#include "control.h"
+
+// Closed-loop wheel speed control (build with -DENABLE_SPEED_CONTROL).
+//
+// A PI loop per wheel runs in the motor control task, measures speed from
+// the encoders and drives the motors through moveDifferential(). Commands use
+// the same -255..255 scale as moveDifferential(), where 255 maps to
+// WHEEL_MAX_SPEED_CPS, so the movement modes don't need to change.
+
+#define SPEED_CONTROL_PERIOD_US CONTROL_PERIOD_US   // One step per control period
+#define WHEEL_MAX_SPEED_CPS 1600       // Encoder counts/s for a full-scale command
+
+// Controller gains (duty units, converted to fixed point at compile time)
+#define SPEED_KP 0.08f                 // Duty per count/s of error
+#define SPEED_KI 2.0f                  // Duty per count of accumulated error
+#define SPEED_KFF (255.0f / WHEEL_MAX_SPEED_CPS)  // Feedforward duty per count/s
+#define SPEED_FILTER_ALPHA 0.25f       // Low-pass on the measured speed (0-1)
+
+void speedControlBegin();
+void setWheelSpeedTargets(int leftCommand, int rightCommand);
+void speedControlStep();
+int getWheelSpeed(int motor);
+int getWheelTarget(int motor);
+
+#endif // SPEED_CONTROL_H
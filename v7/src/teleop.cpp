@@ -0,0 +1,250 @@
+#include "hal.h"
+#include "teleop.h"
+#include "frame.h"
+#include "control.h"
+#include "config.h"
+#include "mailbox.h"
+#include "power.h"
+#include "log.h"
+
+#ifdef ENABLE_TELEOP
+
+// Teleop task -> behaviour
+static Mailbox<TeleopStats> statsMailbox;
+
+// Teleop task state. Everything here belongs to the teleop task.
+static TeleopStats stats = {};
+static bool engaged = false;           // An operator has had the wheels since boot
+static bool deadmanStopped = false;
+static uint32_t session = 0;
+static uint32_t lastSeq = 0;
+static unsigned long lastCommandUs = 0;
+static uint32_t lastOperatorUs = 0;    // Operator's time stamp on that command
+static MotorSetpoint command = {0, 0, STOP_COAST};
+static uint32_t periods = 0;
+
+// Behaviour side copy of the latest snapshot
+static TeleopStats latestStats = {};
+static bool haveStats = false;
+
+static uint8_t* putU8(uint8_t* p, uint8_t value) {
+  *p = value;
+  return p + 1;
+}
+
+static uint8_t* putU16(uint8_t* p, uint16_t value) {
+  p[0] = value;
+  p[1] = value >> 8;
+  return p + 2;
+}
+
+static uint8_t* putU32(uint8_t* p, uint32_t value) {
+  p = putU16(p, value);
+  return putU16(p, value >> 16);
+}
+
+static uint8_t* putHeader(uint8_t* p, uint8_t type) {
+  p = putU16(p, TELEOP_MAGIC);
+  p = putU8(p, TELEOP_VERSION);
+  p = putU8(p, type);
+  return putU32(p, session);
+}
+
+static uint8_t currentFlags() {
+  return (engaged ? TELEOP_FLAG_ENGAGED : 0) | (deadmanStopped ? TELEOP_FLAG_DEADMAN : 0) |
+         (controlFaultActive() ? TELEOP_FLAG_FAULT : 0);
+}
+
+// Takes a command if it is newer than the last one, from the operator in
+// control (or one allowed to take over). Besides reordering, a command
+// is stale if it took longer than the deadman window more to arrive than
+// the last one did - comparing the two clocks' intervals needs no common
+// time base.
+static bool takeCommand(const uint8_t* datagram, unsigned long nowUs) {
+  uint32_t from = frameGetU32(datagram + 4);
+  uint32_t seq = frameGetU32(datagram + 8);
+  uint32_t operatorUs = frameGetU32(datagram + 18);
+  if (from != session || !engaged) {
+    if (engaged && !deadmanStopped) {
+      stats.foreign++;
+      return false;
+    }
+    session = from;
+  } else {
+    int32_t extraDelayUs = (int32_t)((uint32_t)(nowUs - lastCommandUs) - (operatorUs - lastOperatorUs));
+    if (seq <= lastSeq || extraDelayUs > (int32_t)(robotConfig.teleopDeadmanMs * 1000UL)) {
+      stats.stale++;
+      return false;
+    }
+  }
+
+  lastSeq = seq;
+  lastCommandUs = nowUs;
+  lastOperatorUs = operatorUs;
+  engaged = true;
+  deadmanStopped = false;
+  command.left = constrain(frameGetI16(datagram + 12), -255, 255);
+  command.right = constrain(frameGetI16(datagram + 14), -255, 255);
+  command.stop = (datagram[16] & TELEOP_COMMAND_BRAKE) != 0 ? STOP_BRAKE : STOP_COAST;
+  stats.accepted++;
+
+  // Round trip of the ACK the operator echoes, less the time it held it.
+  // The robot only sees a datagram at the start of a period, so a round
+  // trip shorter than that can come out slightly negative: count it as 0.
+  uint32_t echoUs = frameGetU32(datagram + 22);
+  if (echoUs != 0) {
+    int32_t rttUs = (int32_t)((uint32_t)nowUs - echoUs - frameGetU32(datagram + 26));
+    stats.rtt[teleopRttBucket(max(rttUs, (int32_t)0))]++;
+  }
+  return true;
+}
+
+static void sendAck(const HalUdpPeer& to, unsigned long nowUs) {
+  uint8_t ack[TELEOP_ACK_LENGTH];
+  uint8_t* p = putHeader(ack, TELEOP_ACK);
+  p = putU32(p, lastSeq);
+  p = putU32(p, lastOperatorUs);
+  p = putU32(p, nowUs);
+  p = putU8(p, currentFlags());
+  putU8(p, 0);
+  halUdpSend(to, ack, sizeof(ack));
+}
+
+static void sendStats(const HalUdpPeer& to, unsigned long nowUs) {
+  uint8_t reply[TELEOP_STATS_LENGTH];
+  uint8_t* p = putHeader(reply, TELEOP_STATS);
+  p = putU32(p, stats.accepted);
+  p = putU32(p, stats.stale);
+  p = putU32(p, stats.foreign);
+  p = putU32(p, stats.malformed);
+  p = putU32(p, stats.deadmanStops);
+  p = putU32(p, engaged ? (nowUs - lastCommandUs) / 1000 : UINT32_MAX);
+  p = putU16(p, robotConfig.teleopDeadmanMs);
+  p = putU8(p, currentFlags());
+  p = putU8(p, 0);
+  for (int bucket = 0; bucket < TELEOP_RTT_BUCKETS; bucket++) {
+    p = putU32(p, stats.rtt[bucket]);
+  }
+  halUdpSend(to, reply, sizeof(reply));
+}
+
+static void handleDatagram(const uint8_t* datagram, size_t length, const HalUdpPeer& from, unsigned long nowUs) {
+  if (length < TELEOP_HEADER_LENGTH || frameGetU16(datagram) != TELEOP_MAGIC || datagram[2] != TELEOP_VERSION) {
+    stats.malformed++;
+    return;
+  }
+  switch (datagram[3]) {
+    case TELEOP_COMMAND:
+      if (length != TELEOP_COMMAND_LENGTH) {
+        break;
+      }
+      if (takeCommand(datagram, nowUs)) {
+        sendAck(from, nowUs);
+      }
+      return;
+
+    case TELEOP_STATS_REQUEST:
+      sendStats(from, nowUs);
+      return;
+
+    default:
+      break;
+  }
+  stats.malformed++;
+}
+
+// One teleop period: read what has arrived, check the deadman, then keep
+// the control task fed
+static void teleopStep() {
+  unsigned long nowUs = halMicros();
+
+  // A longer datagram is cut short, but its full length marks it malformed
+  uint8_t datagram[TELEOP_COMMAND_LENGTH];
+  HalUdpPeer from;
+  for (int i = 0; i < TELEOP_RX_BUDGET; i++) {
+    size_t length = halUdpReceive(datagram, sizeof(datagram), from);
+    if (length == 0) {
+      break;
+    }
+    handleDatagram(datagram, length, from, nowUs);
+  }
+
+  if (engaged && !deadmanStopped && nowUs - lastCommandUs >= robotConfig.teleopDeadmanMs * 1000UL) {
+    deadmanStopped = true;
+    stats.deadmanStops++;
+  }
+  if (engaged) {
+    if (deadmanStopped) {
+      controlPostHostSetpoint(lastSeq, 0, 0, STOP_BRAKE);
+    } else {
+      controlPostHostSetpoint(lastSeq, command.left, command.right, command.stop);
+    }
+  }
+
+  if (++periods % TELEOP_STATS_PERIODS == 0) {
+    stats.flags = currentFlags();
+    statsMailbox.post(stats);
+  }
+}
+
+void teleopBegin() {
+  // The station drops off the network while the CPU is in light sleep
+  powerSetSleepInhibit(POWER_INHIBIT_TELEOP, true);
+#ifndef HAL_NATIVE
+  if (TELEOP_WIFI_SSID[0] == '\0') {
+    LOG_WARN("Teleop: built without TELEOP_WIFI_SSID - no network to join");
+  }
+#endif
+  halWifiBegin(TELEOP_WIFI_SSID, TELEOP_WIFI_PASSWORD);
+  if (!halUdpBegin(robotConfig.teleopPort)) {
+    LOG_ERROR("Teleop: could not open UDP port %u", robotConfig.teleopPort);
+    return;
+  }
+  halTaskStartPeriodic(teleopStep, TELEOP_PERIOD_US, TELEOP_TASK_PRIORITY, "teleop");
+}
+
+// Round trip below which a fraction of the samples fall, as a bucket limit
+static uint32_t rttPercentileUs(const TeleopStats& snapshot, uint32_t total, uint32_t perMille) {
+  uint32_t wanted = (uint32_t)(((uint64_t)total * perMille + 999) / 1000);
+  uint32_t seen = 0;
+  for (int bucket = 0; bucket < TELEOP_RTT_BUCKETS; bucket++) {
+    seen += snapshot.rtt[bucket];
+    if (seen >= wanted) {
+      return teleopRttBucketLimit(bucket);
+    }
+  }
+  return UINT32_MAX;
+}
+
+void teleopReport() {
+  if (statsMailbox.take(latestStats)) {
+    haveStats = true;
+  }
+  uint32_t address = halWifiAddress();
+  if (!halWifiConnected()) {
+    LOG_INFO("Teleop: Wi-Fi not connected");
+  } else {
+    LOG_INFO("Teleop: listening on %u.%u.%u.%u:%u, deadman %u ms", (unsigned)(address & 0xFF),
+             (unsigned)((address >> 8) & 0xFF), (unsigned)((address >> 16) & 0xFF), (unsigned)(address >> 24),
+             robotConfig.teleopPort, robotConfig.teleopDeadmanMs);
+  }
+  if (!haveStats || latestStats.accepted == 0) {
+    return;
+  }
+  LOG_INFO("Teleop: %lu commands, %lu stale, %lu foreign, %lu malformed, %lu deadman stops%s",
+           (unsigned long)latestStats.accepted, (unsigned long)latestStats.stale,
+           (unsigned long)latestStats.foreign, (unsigned long)latestStats.malformed,
+           (unsigned long)latestStats.deadmanStops,
+           (latestStats.flags & TELEOP_FLAG_DEADMAN) != 0 ? " (stopped)" : "");
+  uint32_t total = 0;
+  for (int bucket = 0; bucket < TELEOP_RTT_BUCKETS; bucket++) {
+    total += latestStats.rtt[bucket];
+  }
+  if (total != 0) {
+    LOG_INFO("Teleop: round trip median < %lu us, p99 < %lu us (%lu samples)",
+             (unsigned long)rttPercentileUs(latestStats, total, 500),
+             (unsigned long)rttPercentileUs(latestStats, total, 990), (unsigned long)total);
+  }
+}
+
+#endif // ENABLE_TELEOP
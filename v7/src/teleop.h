@@ -0,0 +1,120 @@
+#ifndef TELEOP_H
+#define TELEOP_H
+
+#include <stdint.h>
+
+// Remote driving over Wi-Fi: wheel commands in UDP datagrams.
+//
+// Build with -DENABLE_TELEOP and the network credentials
+// (-DTELEOP_WIFI_SSID=\"name\" -DTELEOP_WIFI_PASSWORD=\"secret\"). The robot
+// joins the network as a station and listens on robotConfig.teleopPort.
+// An operator streams COMMAND datagrams, each carrying a session id, a
+// sequence number and a moveDifferential() setpoint; the robot takes a
+// command only if its sequence number is above the last one taken, so
+// late and reordered datagrams are thrown away rather than undoing a
+// newer command. The first command takes the wheels from the movement
+// modes. If robotConfig.teleopDeadmanMs passes without a fresh command the
+// robot brakes and holds the wheels at zero until commands come back.
+//
+// A new session (an operator restarting, or another one) is only taken
+// while the robot has no operator: never engaged, or stopped by the
+// deadman.
+//
+// The teleop task runs every TELEOP_PERIOD_US below the control task. Each
+// period it reads what has arrived, acknowledges every command it takes,
+// and posts the current command (or the deadman stop) through
+// controlPostHostSetpoint(), so control.cpp's own host timeout never
+// fires while an operator is engaged.
+//
+// Latency: each ACK carries the robot's time; the operator echoes the
+// newest one in its next command, with how long it held it, and the robot
+// records the round trip (datagram out and back plus up to a teleop
+// period of queueing) in a log2 histogram. STATS returns it with the
+// counters, and main.cpp logs a summary every TELEOP_REPORT_INTERVAL_MS.
+//
+// Wi-Fi's own tasks run above the control task on the single-core
+// ESP32-S2 - check the control jitter (ControlStats) with teleop running.
+//
+// The native build listens on loopback with --udp-port; tools/teleopbench.cpp
+// tests the whole path there with injected loss and jitter.
+
+#ifndef TELEOP_WIFI_SSID
+#define TELEOP_WIFI_SSID ""
+#endif
+#ifndef TELEOP_WIFI_PASSWORD
+#define TELEOP_WIFI_PASSWORD ""
+#endif
+
+#define TELEOP_PORT 4210                  // Default robotConfig.teleopPort
+#define TELEOP_DEADMAN_MS 200             // Default robotConfig.teleopDeadmanMs
+#define TELEOP_MIN_DEADMAN_MS 20
+#define TELEOP_MAX_DEADMAN_MS 2000
+#define TELEOP_PERIOD_US 2000             // 500 Hz, like the control task
+#define TELEOP_TASK_PRIORITY 10           // Below control (20), above loop/log (1)
+#define TELEOP_RX_BUDGET 8                // Most datagrams read per period
+#define TELEOP_STATS_PERIODS 500          // Publish a stats snapshot this often (1 s)
+#define TELEOP_REPORT_INTERVAL_MS 10000   // How often main.cpp logs the summary
+
+// Round-trip histogram: bucket 0 is under TELEOP_RTT_FIRST_US, each
+// following bucket twice as wide as the last, the top one open-ended
+#define TELEOP_RTT_BUCKETS 16
+#define TELEOP_RTT_FIRST_US 250
+
+// Every datagram starts with u16 magic, u8 version, u8 type, u32 session;
+// all fields are little-endian
+#define TELEOP_MAGIC 0x5054               // "TP"
+#define TELEOP_VERSION 1
+#define TELEOP_HEADER_LENGTH 8
+
+// Operator -> robot
+#define TELEOP_COMMAND 0x01          // u32 seq, i16 left, i16 right, u8 flags, u8 reserved,
+                                     // u32 operator time (us), u32 echoed robot time (us, 0 = none),
+                                     // u32 time the echo was held (us)
+#define TELEOP_STATS_REQUEST 0x02    // Header only
+
+// Robot -> operator
+#define TELEOP_ACK 0x81              // u32 seq, u32 echoed operator time, u32 robot time, u8 flags, u8 reserved
+#define TELEOP_STATS 0x82            // u32 accepted, u32 stale, u32 foreign, u32 malformed, u32 deadman stops,
+                                     // u32 ms since the last command, u16 deadman ms, u8 flags, u8 reserved,
+                                     // u32 round trips per histogram bucket
+
+#define TELEOP_COMMAND_LENGTH 30
+#define TELEOP_STATS_REQUEST_LENGTH TELEOP_HEADER_LENGTH
+#define TELEOP_ACK_LENGTH 22
+#define TELEOP_STATS_LENGTH (TELEOP_HEADER_LENGTH + 28 + 4 * TELEOP_RTT_BUCKETS)
+
+#define TELEOP_COMMAND_BRAKE 0x01         // COMMAND flags: wheels at zero brake
+
+#define TELEOP_FLAG_ENGAGED 0x01          // ACK/STATS flags: an operator has the wheels
+#define TELEOP_FLAG_DEADMAN 0x02          // Stopped by the deadman
+#define TELEOP_FLAG_FAULT 0x04            // DRV8833 fault asserted
+
+// Counters kept by the teleop task
+struct TeleopStats {
+  uint32_t accepted;
+  uint32_t stale;              // Not newer than the last command taken
+  uint32_t foreign;            // From another session while one is engaged
+  uint32_t malformed;
+  uint32_t deadmanStops;
+  uint32_t rtt[TELEOP_RTT_BUCKETS];
+  uint8_t flags;
+};
+
+// Histogram bucket of a round trip
+static inline int teleopRttBucket(uint32_t us) {
+  int bucket = 0;
+  for (uint32_t limit = TELEOP_RTT_FIRST_US; us >= limit && bucket < TELEOP_RTT_BUCKETS - 1; limit *= 2) {
+    bucket++;
+  }
+  return bucket;
+}
+
+// Upper bound of a bucket (UINT32_MAX for the top one)
+static inline uint32_t teleopRttBucketLimit(int bucket) {
+  return bucket < TELEOP_RTT_BUCKETS - 1 ? (uint32_t)TELEOP_RTT_FIRST_US << bucket : UINT32_MAX;
+}
+
+void teleopBegin();
+void teleopReport();
+
+#endif // TELEOP_H
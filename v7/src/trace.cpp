@@ -0,0 +1,69 @@
+#include "hal.h"
+#include "trace.h"
+#include "log.h"
+
+TraceEvent traceBuffer[TRACE_BUFFER_EVENTS];
+std::atomic<uint16_t> traceCount(0);
+volatile bool traceRecording = false;
+
+void traceStart() {
+  traceCount = 0;
+  traceRecording = true;
+}
+
+bool traceIsFull() {
+  return traceCount >= TRACE_BUFFER_EVENTS;
+}
+
+// Prints the recorded events as hex, 4 events per line. Each event is
+// cycles (4 bytes, little-endian), type, arg8, arg16 (2 bytes, little-endian).
+// Written directly to Serial after flushing the log so lines are not dropped.
+void traceDump() {
+  bool wasRecording = traceRecording;
+  traceRecording = false;
+  logFlush();
+
+  uint16_t count = traceCount;
+  Serial.printf("TRACE BEGIN cpu_mhz=%u events=%u\r\n", getCpuFrequencyMhz(), count);
+
+  char line[4 * 16 + 3];
+  int pos = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    const TraceEvent& e = traceBuffer[i];
+    uint8_t bytes[8] = {
+      (uint8_t)(e.cycles), (uint8_t)(e.cycles >> 8), (uint8_t)(e.cycles >> 16), (uint8_t)(e.cycles >> 24),
+      e.type, e.arg8, (uint8_t)(e.arg16), (uint8_t)(e.arg16 >> 8)
+    };
+    for (int b = 0; b < 8; b++) {
+      pos += snprintf(line + pos, sizeof(line) - pos, "%02x", bytes[b]);
+    }
+    if ((i % 4) == 3 || i == count - 1) {
+      Serial.println(line);
+      pos = 0;
+    }
+  }
+
+  Serial.println("TRACE END");
+  traceRecording = wasRecording;
+}
+
+// Times a batch of records to check the per-event cost stays well under 1us.
+// Uses the start of the trace buffer, so call it before traceStart().
+void traceMeasureOverhead() {
+  const int iterations = 256;
+
+  traceCount = 0;
+  traceRecording = true;
+  uint32_t start = halCycleCount();
+  for (int i = 0; i < iterations; i++) {
+    traceRecord(TRACE_PWM_WRITE, 0, i);
+  }
+  uint32_t cycles = halCycleCount() - start;
+  traceCount = 0;
+  traceRecording = false;
+
+  uint32_t cyclesPerEvent = cycles / iterations;
+  LOG_INFO("Trace overhead: %lu cycles/event (%lu ns)",
+           (unsigned long)cyclesPerEvent,
+           (unsigned long)(cyclesPerEvent * 1000 / getCpuFrequencyMhz()));
+}
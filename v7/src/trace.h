@@ -0,0 +1,76 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include "hal.h"
+
+// Compact event trace recorder.
+//
+// Each event is an 8-byte record with a CPU cycle counter timestamp, stored
+// in a static buffer. Recording starts at traceStart() and stops when the
+// buffer is full; traceDump() then prints the buffer as hex lines that
+// tools/trace2json.cpp converts into Chrome/Perfetto trace JSON.
+//
+// Build with -DENABLE_TRACE to compile the instrumentation in.
+
+#define TRACE_BUFFER_EVENTS 1024   // 8 KB of RAM
+
+// Event types (keep in sync with tools/trace2json.cpp)
+enum TraceEventType : uint8_t {
+  TRACE_PWM_WRITE = 1,        // arg8 = channel, arg16 = duty
+  TRACE_SET_DIRECTION,        // arg8 = MotorDirection
+  TRACE_MODE_SELECT,          // arg8 = ModeID, arg16 = duration (s)
+  TRACE_MOVEMENT_BEGIN,       // arg8 = ModeID
+  TRACE_MOVEMENT_END,         // arg8 = ModeID
+  TRACE_AUX_BEGIN,            // arg8 = ModeID
+  TRACE_AUX_END,              // arg8 = ModeID
+  TRACE_AUX_WRITE,            // arg8 = pin state
+  TRACE_FAULT_CHECK           // arg8 = 1 if fault (recorded when the fault state changes)
+};
+
+struct TraceEvent {
+  uint32_t cycles;
+  uint8_t type;
+  uint8_t arg8;
+  uint16_t arg16;
+};
+
+extern TraceEvent traceBuffer[TRACE_BUFFER_EVENTS];
+extern std::atomic<uint16_t> traceCount;
+extern volatile bool traceRecording;
+
+static inline void traceRecord(uint8_t type, uint8_t arg8, uint16_t arg16) {
+  if (!traceRecording) {
+    return;
+  }
+
+  // Claim the slot atomically - the control task can preempt the loop task
+  // part-way through a record
+  uint16_t index = traceCount.fetch_add(1, std::memory_order_relaxed);
+  if (index >= TRACE_BUFFER_EVENTS) {
+    traceCount.store(TRACE_BUFFER_EVENTS, std::memory_order_relaxed);
+    traceRecording = false;
+    return;
+  }
+  TraceEvent& event = traceBuffer[index];
+  event.cycles = halCycleCount();
+  event.type = type;
+  event.arg8 = arg8;
+  event.arg16 = arg16;
+  if (index == TRACE_BUFFER_EVENTS - 1) {
+    traceRecording = false;
+  }
+}
+
+void traceStart();
+bool traceIsFull();
+void traceDump();
+void traceMeasureOverhead();
+
+#ifdef ENABLE_TRACE
+#define TRACE_EVENT(type, arg8, arg16) traceRecord((type), (arg8), (arg16))
+#else
+#define TRACE_EVENT(type, arg8, arg16) do {} while (0)
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,216 @@
+// Checks v7 microbenchmark results against stored thresholds.
+//
+// Capture the serial output of a build with -DENABLE_BENCHMARK (pio run
+// -e benchmark) into a file, or the stdout of the native one (pio run -e
+// native_benchmark), then run:
+//
+//   g++ -std=gnu++17 -O2 -o benchcheck tools/benchcheck.cpp
+//   ./benchcheck serial.log tools/benchmark_thresholds.csv
+//
+// Each result is compared with the thresholds stored for the target that
+// produced it (the bench-target line, see src/benchmark.h). A median or
+// p99 above its threshold is a regression; a result with no thresholds
+// is listed as untracked. Exits 1 on any regression, or if the capture
+// has no results or is cut short.
+//
+// To store new thresholds for a target, record them from a capture with
+// a margin in percent and replace that target's rows in the file:
+//
+//   ./benchcheck --record 150 serial.log
+//
+// Only lines starting with "bench" are read, wherever they are in the
+// line, so the log output and printed strings around them are ignored.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+struct Result {
+  std::string name;
+  unsigned long iterations;
+  unsigned long min;
+  unsigned long median;
+  unsigned long p99;
+};
+
+struct Threshold {
+  unsigned long median;      // 0 = not checked
+  unsigned long p99;
+};
+
+struct Capture {
+  std::string target;
+  unsigned long clockMhz = 0;
+  unsigned long overhead = 0;
+  std::vector<Result> results;
+  long expected = -1;        // From bench-end; -1 if it never came
+};
+
+// Splits a CSV line. Names never contain commas.
+static std::vector<std::string> splitFields(const std::string& line) {
+  std::vector<std::string> fields;
+  size_t start = 0;
+  while (true) {
+    size_t comma = line.find(',', start);
+    fields.push_back(line.substr(start, comma - start));
+    if (comma == std::string::npos) {
+      return fields;
+    }
+    start = comma + 1;
+  }
+}
+
+static bool parseNumber(const std::string& field, unsigned long& value) {
+  char* end;
+  value = strtoul(field.c_str(), &end, 10);
+  return !field.empty() && *end == '\0';
+}
+
+static bool readCapture(const char* path, Capture& capture) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "cannot open " << path << "\n";
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    while (!line.empty() && (line.back() == '\r' || line.back() == '\n')) {
+      line.pop_back();
+    }
+    size_t at = line.find("bench");
+    if (at == std::string::npos) {
+      continue;
+    }
+    std::vector<std::string> fields = splitFields(line.substr(at));
+    if (fields[0] == "bench-target" && fields.size() == 4) {
+      // A new run (the board reset) starts over
+      capture = Capture();
+      capture.target = fields[1];
+      parseNumber(fields[2], capture.clockMhz);
+      parseNumber(fields[3], capture.overhead);
+    } else if (fields[0] == "bench" && fields.size() == 6) {
+      Result result;
+      result.name = fields[1];
+      if (parseNumber(fields[2], result.iterations) && parseNumber(fields[3], result.min) &&
+          parseNumber(fields[4], result.median) && parseNumber(fields[5], result.p99)) {
+        capture.results.push_back(result);
+      }
+    } else if (fields[0] == "bench-end" && fields.size() == 2) {
+      capture.expected = atol(fields[1].c_str());
+    }
+  }
+  return true;
+}
+
+// target,name,median_max,p99_max - lines starting with # are comments
+static bool readThresholds(const char* path, const std::string& target,
+                           std::map<std::string, Threshold>& thresholds) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "cannot open " << path << "\n";
+    return false;
+  }
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(in, line)) {
+    lineNumber++;
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::vector<std::string> fields = splitFields(line);
+    Threshold threshold;
+    if (fields.size() != 4 || !parseNumber(fields[2], threshold.median) ||
+        !parseNumber(fields[3], threshold.p99)) {
+      std::cerr << path << ":" << lineNumber << ": expected target,name,median_max,p99_max\n";
+      return false;
+    }
+    if (fields[0] == target) {
+      thresholds[fields[1]] = threshold;
+    }
+  }
+  return true;
+}
+
+static unsigned long withMargin(unsigned long value, unsigned long percent) {
+  return (value * percent + 99) / 100;
+}
+
+int main(int argc, char** argv) {
+  bool record = argc == 4 && strcmp(argv[1], "--record") == 0;
+  if (argc != 3 && !record) {
+    std::cerr << "usage: " << argv[0] << " <serial-log> <thresholds.csv>\n"
+              << "       " << argv[0] << " --record <margin-percent> <serial-log>\n";
+    return 2;
+  }
+
+  Capture capture;
+  if (!readCapture(argv[record ? 3 : 1], capture)) {
+    return 2;
+  }
+  if (capture.results.empty()) {
+    std::cerr << "no benchmark results in " << argv[record ? 3 : 1] << "\n";
+    return 1;
+  }
+  bool complete = capture.expected == (long)capture.results.size();
+
+  if (record) {
+    unsigned long margin = strtoul(argv[2], nullptr, 10);
+    printf("# %s: %lu MHz clock, %lu ticks of counter overhead taken off, %lu%% margin\n",
+           capture.target.c_str(), capture.clockMhz, capture.overhead, margin);
+    for (const Result& result : capture.results) {
+      printf("%s,%s,%lu,%lu\n", capture.target.c_str(), result.name.c_str(),
+             withMargin(result.median, margin), withMargin(result.p99, margin));
+    }
+    if (!complete) {
+      std::cerr << "capture cut short - only " << capture.results.size() << " results\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  std::map<std::string, Threshold> thresholds;
+  if (!readThresholds(argv[2], capture.target, thresholds)) {
+    return 2;
+  }
+
+  printf("%s: %zu results, ticks at %lu MHz\n", capture.target.c_str(), capture.results.size(),
+         capture.clockMhz);
+  int regressions = 0;
+  for (const Result& result : capture.results) {
+    auto found = thresholds.find(result.name);
+    const char* verdict = "untracked";
+    if (found != thresholds.end()) {
+      const Threshold& threshold = found->second;
+      bool slow = (threshold.median != 0 && result.median > threshold.median) ||
+                  (threshold.p99 != 0 && result.p99 > threshold.p99);
+      verdict = slow ? "REGRESSION" : "ok";
+      regressions += slow;
+      thresholds.erase(found);
+    }
+    printf("  %-22s min %7lu  median %7lu  p99 %7lu  %s\n", result.name.c_str(), result.min,
+           result.median, result.p99, verdict);
+  }
+  for (const auto& missing : thresholds) {
+    printf("  %-22s not in the capture\n", missing.first.c_str());
+  }
+
+  if (!complete) {
+    printf("FAILED: capture cut short\n");
+    return 1;
+  }
+  if (regressions != 0) {
+    printf("FAILED: %d regressions\n", regressions);
+    return 1;
+  }
+  printf("PASSED\n");
+  return 0;
+}
@@ -0,0 +1,212 @@
+// Sim check of the v7 feedforward calibration tables (calibrationBuild()
+// and calibrationMapSpeed() in src/calibration.cpp).
+//
+// Each trial makes up a pair of motors: per motor and direction a
+// breakaway duty, a top speed and a speed curve, with a jump to a few
+// percent of top speed as the wheel breaks free. It measures them the way
+// calibrationStep() does (breakaway first, then CALIBRATION_POINTS duties
+// from there to full, with some measurement noise), builds the tables,
+// stores them in the native HAL's NVS and loads them back. Then, for every
+// speed from -255 to 255, the mapped duty must never step backwards, the
+// smallest speed must already turn the wheel (no deadband), 255 must map
+// to exactly the last table entry, and the modelled wheel speed must land
+// within CHECK_LINEARITY_PERCENT of the requested share of the slower
+// wheel's top speed - for reverse speeds, of the reverse curve - or, for
+// speeds under the breakaway jump, at the jump. Last,
+// curves that dip must still give monotonic tables, and a wheel that never
+// moved must fail the build.
+//
+// Links the whole firmware but main.cpp, like rampcheck, and runs from
+// setup():
+//
+//   g++ -std=gnu++17 -DHAL_NATIVE -Isrc -o calcheck tools/calcheck.cpp $(ls src/*.cpp | grep -v src/main.cpp)
+//   ./calcheck [--seed N]
+//
+// Exits non-zero if any check fails.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal.h"
+#include "calibration.h"
+#include "log.h"
+#include "motor_control.h"
+
+#define CHECK_LINEARITY_PERCENT 4       // Of top speed: piecewise-linear table over a curved motor
+#define CHECK_NOISE_PERCENT 1           // Measurement noise on each point
+#define CHECK_JUMP_PERCENT 2            // Of top speed, as the wheel breaks free
+
+static uint32_t randomState = 1;
+
+// xorshift32: fast, and the same sequence everywhere for a given seed
+static uint32_t nextRandom() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+// Uniform in [low, high)
+static double randomBetween(double low, double high) {
+  return low + (high - low) * (nextRandom() / 4294967296.0);
+}
+
+static unsigned long failures = 0;
+
+static void check(bool ok, const char* what, int motor, int dir, int speed) {
+  if (!ok && failures++ < 20) {
+    printf("FAIL %s (motor %c %s, speed %d)\n", what, motor == MOTOR_A ? 'A' : 'B',
+           dir == CALIBRATION_FORWARD ? "fwd" : "rev", speed);
+  }
+}
+
+// One wheel in one direction: still below breakaway, then a jump and a
+// curve up to top speed at full duty
+struct MotorModel {
+  double breakaway;     // Fraction of full duty
+  double topCps;
+  double exponent;      // Under 1 bends the curve over, as back-EMF does
+};
+
+static double modelSpeed(const MotorModel& model, double duty) {
+  if (duty < model.breakaway) {
+    return 0;
+  }
+  double x = (duty - model.breakaway) / (1 - model.breakaway);
+  double jump = model.topCps * CHECK_JUMP_PERCENT / 100;
+  return jump + (model.topCps - jump) * pow(x, model.exponent);
+}
+
+static MotorModel randomModel() {
+  return {randomBetween(0.10, 0.45), randomBetween(600, 1400), randomBetween(0.85, 1.1)};
+}
+
+// What calibrationStep() would record: the ramp's first duty that turns
+// the wheel, then evenly spaced points to full
+static CalibrationCurve measure(const MotorModel& model, double noisePercent) {
+  CalibrationCurve curve;
+  uint16_t breakaway = (uint16_t)ceil(model.breakaway * CALIBRATION_DUTY_SCALE);
+  for (int point = 0; point < CALIBRATION_POINTS; point++) {
+    curve.duty[point] = breakaway + (CALIBRATION_DUTY_SCALE - breakaway) * point / (CALIBRATION_POINTS - 1);
+    double speed = modelSpeed(model, curve.duty[point] / (double)CALIBRATION_DUTY_SCALE);
+    speed *= 1 + randomBetween(-noisePercent, noisePercent) / 100;
+    curve.speedCps[point] = (uint16_t)speed;
+  }
+  return curve;
+}
+
+// Builds, stores and loads the tables, as main.cpp and setupMotors() do
+static bool install(const CalibrationCurve curves[2][2], CalibrationTable& table) {
+  if (!calibrationBuild(curves, table)) {
+    return false;
+  }
+  halNvsWrite(CALIBRATION_NVS_NAMESPACE, CALIBRATION_NVS_KEY, &table, sizeof(table));
+  return calibrationLoad() && calibrationActive();
+}
+
+static void checkTrial(double noisePercent, double& worstPercent) {
+  MotorModel models[2][2];
+  CalibrationCurve curves[2][2];
+  for (int motor = 0; motor < 2; motor++) {
+    for (int dir = 0; dir < 2; dir++) {
+      models[motor][dir] = randomModel();
+      curves[motor][dir] = measure(models[motor][dir], noisePercent);
+    }
+  }
+  CalibrationTable table;
+  if (!install(curves, table)) {
+    check(false, "build or load failed", 0, 0, 0);
+    return;
+  }
+
+  for (int dir = 0; dir < 2; dir++) {
+    int sign = dir == CALIBRATION_FORWARD ? 1 : -1;
+    double top = table.topSpeedCps[dir];
+    for (int motor = 0; motor < 2; motor++) {
+      const uint16_t* steps = table.duty[motor][dir];
+      check(steps[0] == curves[motor][dir].duty[0], "entry 0 is not the breakaway duty", motor, dir, 0);
+      check(calibrationMapSpeed(motor, sign * 255) == sign * steps[CALIBRATION_SEGMENTS],
+            "255 is not the last entry", motor, dir, sign * 255);
+      check(calibrationMapSpeed(motor, 0) == 0, "speed 0 drives", motor, dir, 0);
+
+      int32_t previous = 0;
+      for (int speed = 1; speed <= 255; speed++) {
+        int32_t mapped = calibrationMapSpeed(motor, sign * speed);
+        check(mapped * sign > 0, "mapped duty has the wrong sign", motor, dir, sign * speed);
+        int32_t duty = abs(mapped);
+        check(duty >= previous && duty <= CALIBRATION_DUTY_SCALE, "mapped duty stepped back", motor, dir,
+              sign * speed);
+        previous = duty;
+
+        double actual = modelSpeed(models[motor][dir], duty / (double)CALIBRATION_DUTY_SCALE);
+        if (speed == 1) {
+          check(actual > 0, "smallest speed left the wheel still", motor, dir, sign * speed);
+        }
+        // No speed between still and the breakaway jump: below it, the jump
+        double expected = fmax(top * speed / 255, modelSpeed(models[motor][dir], models[motor][dir].breakaway));
+        double errorPercent = fabs(actual - expected) * 100 / top;
+        worstPercent = errorPercent > worstPercent ? errorPercent : worstPercent;
+        check(errorPercent <= CHECK_LINEARITY_PERCENT, "wheel speed off the requested speed", motor, dir,
+              sign * speed);
+      }
+    }
+  }
+}
+
+// Noise or a sticky gearbox can make a later point read slower
+static void checkDip() {
+  CalibrationCurve curves[2][2];
+  for (int motor = 0; motor < 2; motor++) {
+    for (int dir = 0; dir < 2; dir++) {
+      curves[motor][dir] = measure(randomModel(), 0);
+      curves[motor][dir].speedCps[3] = curves[motor][dir].speedCps[1] / 2;
+      curves[motor][dir].speedCps[5] = 0;
+    }
+  }
+  CalibrationTable table;
+  check(install(curves, table), "dipping curves failed to build", 0, 0, 0);
+  for (int motor = 0; motor < 2; motor++) {
+    for (int dir = 0; dir < 2; dir++) {
+      for (int step = 1; step <= CALIBRATION_SEGMENTS; step++) {
+        check(table.duty[motor][dir][step] >= table.duty[motor][dir][step - 1], "table stepped back after a dip",
+              motor, dir, step);
+      }
+    }
+  }
+
+  // A wheel that never moved in one direction
+  curves[MOTOR_B][CALIBRATION_REVERSE] = {};
+  check(!calibrationBuild(curves, table), "built a table for a wheel that never moved", MOTOR_B,
+        CALIBRATION_REVERSE, 0);
+  printf("Dips: tables stay monotonic; a still wheel fails the build\n");
+}
+
+void setup() {
+  const unsigned long trials = 1000;
+  logInit();
+  logSetLevel(LOG_LEVEL_WARN);      // One "calibration loaded" per trial otherwise
+  randomState = halAdcRead(0) * 2 + 1;   // The sim's --seed, as initMovementModes() reads it
+
+  double worstClean = 0;
+  double worstNoisy = 0;
+  for (unsigned long trial = 0; trial < trials; trial++) {
+    checkTrial(0, worstClean);
+    checkTrial(CHECK_NOISE_PERCENT, worstNoisy);
+  }
+  logFlush();
+  printf("Tables: %lu clean and %lu noisy motor pairs, worst speed error %.2f%% and %.2f%% of top (bound %d%%)\n",
+         trials, trials, worstClean, worstNoisy, CHECK_LINEARITY_PERCENT);
+  checkDip();
+  logFlush();
+
+  if (failures != 0) {
+    printf("FAILED: %lu checks\n", failures);
+    exit(1);
+  }
+  printf("ALL PASSED\n");
+  exit(0);
+}
+
+void loop() {
+}
@@ -0,0 +1,267 @@
+// Host check for the v7 stored configuration (src/config.cpp).
+//
+// Round-trips configurations through configEncode()/configDecode(), then
+// checks that every single-bit flip, every truncation and a run of random
+// blobs are rejected, that a layout 1 blob (which ended at
+// maxRestDuration) comes back with the defaults for the fields appended
+// since, and that a blob from a newer layout keeps the fields this one
+// knows. Last, it runs configLoad() and configStore() against the native
+// HAL's in-memory NVS: nothing stored, a good blob, a corrupt one, one out
+// of range, one too long to read, and a layout 1 blob that is stored back
+// in the current layout.
+//
+// Links the whole firmware but main.cpp, like rampcheck, and runs from
+// setup():
+//
+//   g++ -std=gnu++17 -DHAL_NATIVE -Isrc -o configcheck tools/configcheck.cpp $(ls src/*.cpp | grep -v src/main.cpp)
+//   ./configcheck
+//
+// Exits non-zero if any check fails.
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal.h"
+#include "config.h"
+#include "crc.h"
+#include "log.h"
+#include "motor_control.h"
+
+#define CHECK_RANDOM_BLOBS 100000
+#define CHECK_MAX_BLOB_LENGTH 256           // CONFIG_MAX_BLOB_LENGTH in config.cpp
+#define CHECK_LAYOUT1_LENGTH offsetof(RobotConfig, reserved)           // Layout 1 ended at maxRestDuration
+#define CHECK_PAYLOAD_LENGTH (offsetof(RobotConfig, teleopPort) + sizeof(uint16_t))
+#define CHECK_NEWER_EXTRA 8                 // Bytes a future layout appends
+
+static uint32_t randomState = 1;
+
+// xorshift32: fast, and the same sequence everywhere for a given seed
+static uint32_t nextRandom() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+static unsigned long failures = 0;
+
+static void check(bool ok, const char* what) {
+  if (!ok && failures++ < 20) {
+    printf("FAIL %s\n", what);
+  }
+}
+
+// A valid configuration with every field away from its default
+static RobotConfig changedConfig() {
+  RobotConfig config;
+  configDefaults(config);
+  config.pwmFreqHz = 1000;
+  config.motorSpeed = 180;
+  config.pwmResolution = 10;
+  config.decay[0] = config.decay[0] == DECAY_FAST ? DECAY_SLOW : DECAY_FAST;
+  for (int i = 0; i < CONFIG_NUM_DURATIONS; i++) {
+    config.durationOptions[i] = 3 + i;
+  }
+  config.minRestDuration = 2;
+  config.maxRestDuration = 9;
+  for (int mode = 0; mode < CONFIG_NUM_MODES; mode++) {
+    config.movementIntervalMs[mode] = 50 + 10 * mode;
+    config.auxPinIntervalMs[mode] = 70 + 10 * mode;
+  }
+  config.teleopDeadmanMs = 300;
+  config.teleopPort = 4321;
+  return config;
+}
+
+// Header plus payload as some other layout wrote it
+static size_t buildBlob(uint8_t* blob, uint16_t version, const void* payload, uint16_t length) {
+  ConfigHeader header;
+  header.magic = CONFIG_MAGIC;
+  header.version = version;
+  header.length = length;
+  header.crc = crc32(payload, length);
+  memcpy(blob, &header, sizeof(header));
+  memcpy(blob + sizeof(header), payload, length);
+  return sizeof(header) + length;
+}
+
+static bool sameConfig(const RobotConfig& a, const RobotConfig& b) {
+  return memcmp(&a, &b, CHECK_PAYLOAD_LENGTH) == 0;
+}
+
+static void checkRoundTrip() {
+  RobotConfig defaults;
+  configDefaults(defaults);
+  check(configValidate(defaults), "defaults validate");
+  RobotConfig changed = changedConfig();
+  check(configValidate(changed), "changed config validates");
+
+  for (const RobotConfig* config : {&defaults, &changed}) {
+    uint8_t blob[CHECK_MAX_BLOB_LENGTH];
+    size_t length = configEncode(*config, blob, sizeof(blob));
+    check(length == sizeof(ConfigHeader) + CHECK_PAYLOAD_LENGTH, "encoded length");
+    check(configEncode(*config, blob, length - 1) == 0, "encode into a short buffer");
+
+    RobotConfig decoded;
+    uint16_t version = 0;
+    check(configDecode(blob, length, decoded, version), "decode");
+    check(version == CONFIG_LAYOUT_VERSION, "decoded version");
+    check(sameConfig(decoded, *config), "round trip");
+  }
+  printf("Round trip: defaults and changed config, %zu byte blob\n",
+         sizeof(ConfigHeader) + CHECK_PAYLOAD_LENGTH);
+}
+
+static void checkCorruption() {
+  RobotConfig changed = changedConfig();
+  uint8_t blob[CHECK_MAX_BLOB_LENGTH];
+  size_t length = configEncode(changed, blob, sizeof(blob));
+  RobotConfig decoded;
+  uint16_t version;
+
+  // The version is outside the CRC: a flipped one reads as another layout,
+  // with the payload intact, so those bits are checked for that instead
+  unsigned long flips = 0;
+  for (size_t bit = 0; bit < length * 8; bit++) {
+    blob[bit / 8] ^= 1 << (bit % 8);
+    bool inVersion = bit / 8 >= offsetof(ConfigHeader, version) &&
+                     bit / 8 < offsetof(ConfigHeader, version) + sizeof(uint16_t);
+    bool accepted = configDecode(blob, length, decoded, version);
+    if (inVersion) {
+      check(accepted && version != CONFIG_LAYOUT_VERSION, "flipped version bit reads as another layout");
+    } else {
+      check(!accepted, "bit flip accepted");
+    }
+    blob[bit / 8] ^= 1 << (bit % 8);
+    flips++;
+  }
+
+  for (size_t shorter = 0; shorter < length; shorter++) {
+    check(!configDecode(blob, shorter, decoded, version), "truncated blob accepted");
+  }
+
+  unsigned long accepted = 0;
+  for (unsigned long i = 0; i < CHECK_RANDOM_BLOBS; i++) {
+    uint8_t noise[CHECK_MAX_BLOB_LENGTH];
+    size_t noiseLength = nextRandom() % sizeof(noise);
+    for (size_t j = 0; j < noiseLength; j++) {
+      noise[j] = nextRandom();
+    }
+    // Half of them with a good magic and length, so the CRC has to catch them
+    if (i & 1 && noiseLength >= sizeof(ConfigHeader)) {
+      ConfigHeader header;
+      memcpy(&header, noise, sizeof(header));
+      header.magic = CONFIG_MAGIC;
+      header.length = noiseLength - sizeof(header);
+      memcpy(noise, &header, sizeof(header));
+    }
+    accepted += configDecode(noise, noiseLength, decoded, version);
+  }
+  check(accepted == 0, "random blob accepted");
+  printf("Corruption: %lu bit flips, %zu truncations, %d random blobs\n", flips, length,
+         CHECK_RANDOM_BLOBS);
+}
+
+static void checkLayouts() {
+  RobotConfig changed = changedConfig();
+  RobotConfig defaults;
+  configDefaults(defaults);
+  uint8_t blob[CHECK_MAX_BLOB_LENGTH];
+  RobotConfig decoded;
+  uint16_t version;
+
+  // Layout 1: its fields come through, the appended ones are the defaults
+  size_t length = buildBlob(blob, 1, &changed, CHECK_LAYOUT1_LENGTH);
+  check(configDecode(blob, length, decoded, version) && version == 1, "layout 1 decode");
+  check(memcmp(&decoded, &changed, CHECK_LAYOUT1_LENGTH) == 0, "layout 1 fields kept");
+  check(decoded.teleopDeadmanMs == defaults.teleopDeadmanMs && decoded.teleopPort == defaults.teleopPort,
+        "layout 2 fields default after a layout 1 blob");
+  check(configValidate(decoded), "migrated layout 1 validates");
+
+  // A newer layout: the fields known here come through, the rest are dropped
+  uint8_t payload[CHECK_PAYLOAD_LENGTH + CHECK_NEWER_EXTRA];
+  memcpy(payload, &changed, CHECK_PAYLOAD_LENGTH);
+  memset(payload + CHECK_PAYLOAD_LENGTH, 0xa5, CHECK_NEWER_EXTRA);
+  length = buildBlob(blob, CONFIG_LAYOUT_VERSION + 1, payload, sizeof(payload));
+  check(configDecode(blob, length, decoded, version) && version == CONFIG_LAYOUT_VERSION + 1,
+        "newer layout decode");
+  check(sameConfig(decoded, changed), "newer layout fields kept");
+  printf("Layouts: 1 (%zu bytes), %d, %d (%zu bytes)\n", (size_t)CHECK_LAYOUT1_LENGTH,
+         CONFIG_LAYOUT_VERSION, CONFIG_LAYOUT_VERSION + 1, sizeof(payload));
+}
+
+// Stored blob, as configLoad() would read it
+static size_t readStored(uint8_t* blob, size_t maxLength) {
+  return halNvsRead(CONFIG_NVS_NAMESPACE, CONFIG_NVS_KEY, blob, maxLength);
+}
+
+static void store(const void* blob, size_t length) {
+  halNvsWrite(CONFIG_NVS_NAMESPACE, CONFIG_NVS_KEY, blob, length);
+}
+
+static void checkLoadStore() {
+  RobotConfig defaults;
+  configDefaults(defaults);
+  RobotConfig changed = changedConfig();
+  uint8_t blob[CHECK_MAX_BLOB_LENGTH * 2];
+
+  check(!configLoad() && sameConfig(robotConfig, defaults), "nothing stored loads the defaults");
+
+  check(configStore(changed) && sameConfig(robotConfig, changed), "store puts the config in use");
+  configDefaults(robotConfig);
+  check(configLoad() && sameConfig(robotConfig, changed), "stored config loads");
+
+  RobotConfig invalid = changed;
+  invalid.motorSpeed = 0;
+  check(!configStore(invalid) && sameConfig(robotConfig, changed), "store rejects an invalid config");
+  check(configLoad() && sameConfig(robotConfig, changed), "rejected store leaves NVS alone");
+
+  size_t length = configEncode(changed, blob, sizeof(blob));
+  blob[length - 1] ^= 0x40;
+  store(blob, length);
+  check(!configLoad() && sameConfig(robotConfig, defaults), "corrupt blob loads the defaults");
+
+  length = configEncode(invalid, blob, sizeof(blob));
+  store(blob, length);
+  check(!configLoad() && sameConfig(robotConfig, defaults), "out-of-range blob loads the defaults");
+
+  // Longer than configLoad() reads; the CRC would pass if it read it all
+  uint8_t payload[CHECK_MAX_BLOB_LENGTH] = {};
+  memcpy(payload, &changed, CHECK_PAYLOAD_LENGTH);
+  length = buildBlob(blob, CONFIG_LAYOUT_VERSION + 1, payload, sizeof(payload));
+  store(blob, length);
+  check(!configLoad() && sameConfig(robotConfig, defaults), "oversized blob loads the defaults");
+
+  // A layout 1 blob loads and is stored back in the current layout
+  length = buildBlob(blob, 1, &changed, CHECK_LAYOUT1_LENGTH);
+  store(blob, length);
+  check(configLoad(), "layout 1 blob loads");
+  check(memcmp(&robotConfig, &changed, CHECK_LAYOUT1_LENGTH) == 0, "layout 1 fields in use");
+  RobotConfig restored;
+  uint16_t version = 0;
+  length = readStored(blob, sizeof(blob));
+  check(configDecode(blob, length, restored, version) && version == CONFIG_LAYOUT_VERSION &&
+            sameConfig(restored, robotConfig),
+        "layout 1 blob stored back in the current layout");
+  printf("NVS: load and store with nothing, good, corrupt, out-of-range, oversized and layout 1 blobs\n");
+}
+
+void setup() {
+  logInit();
+  checkRoundTrip();
+  checkCorruption();
+  checkLayouts();
+  checkLoadStore();
+  logFlush();
+
+  if (failures != 0) {
+    printf("FAILED: %lu checks\n", failures);
+    exit(1);
+  }
+  printf("ALL PASSED\n");
+  exit(0);
+}
+
+void loop() {
+}
@@ -0,0 +1,276 @@
+// Benchmark and fuzz test for the v7 console parser (src/console_parse.h).
+//
+// The benchmark feeds a million generated command lines through
+// ConsoleLineReader and consoleLookup() and reports the time per command.
+// The fuzz test feeds random bytes, mutated commands and overlong lines,
+// and checks every line the reader produces against a simple reference
+// parser built on std::string, every lookup against a linear search of
+// the command names and consoleParseInt() against strtol(). Run it under
+// the sanitizers to catch out-of-bounds access as well:
+//
+//   g++ -std=gnu++17 -O2 -Isrc -o consolebench tools/consolebench.cpp src/console_parse.cpp
+//   ./consolebench [--commands N] [--fuzz-bytes N] [--seed N]
+//
+//   g++ -std=gnu++17 -O1 -g -fsanitize=address,undefined -Isrc -o consolebench tools/consolebench.cpp src/console_parse.cpp
+//
+// Exits non-zero if the fuzz test finds a mismatch.
+
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "console_parse.h"
+
+static uint32_t randomState = 1;
+
+static uint32_t nextRandom() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+static uint32_t randomBelow(uint32_t n) {
+  return nextRandom() % n;
+}
+
+// A plausible operator line
+static std::string randomCommand() {
+  static const char* const lines[] = {
+    "help", "stats", "log", "log 2", "log 4", "mode next", "mode Wander", "mode 3", "stop", "stop brake",
+  };
+  if (randomBelow(3) == 0) {
+    return "drive " + std::to_string((int)randomBelow(511) - 255) + " " + std::to_string((int)randomBelow(511) - 255);
+  }
+  return lines[randomBelow(sizeof(lines) / sizeof(lines[0]))];
+}
+
+static void benchmark(long count) {
+  std::string stream;
+  for (long i = 0; i < count; i++) {
+    stream += randomCommand();
+    stream += "\r\n";
+  }
+
+  ConsoleLineReader reader;
+  long found = 0;
+  long lines = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (char c : stream) {
+    if (reader.feed(c)) {
+      lines++;
+      found += consoleLookup(reader.argv()[0]) >= 0;
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("parse: %ld lines (%ld commands found) in %.1f ms: %.1f ns/command, %.1f MB/s\n", lines, found,
+         seconds * 1e3, seconds * 1e9 / lines, stream.size() / seconds / 1e6);
+
+  // Lookup alone, over the names and some misses
+  static const char* const words[] = {"help", "mode", "drive", "stop", "stats", "log", "drivex", "Mode", "x", ""};
+  const int numWords = sizeof(words) / sizeof(words[0]);
+  long hits = 0;
+  start = std::chrono::steady_clock::now();
+  for (long i = 0; i < count; i++) {
+    hits += consoleLookup(words[i % numWords]) >= 0;
+  }
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("lookup: %ld words (%ld hits), %.1f ns/lookup (hash seed %u)\n", count, hits,
+         seconds * 1e9 / count, (unsigned)CONSOLE_HASH_SEED);
+}
+
+// What ConsoleLineReader is meant to do, written the obvious way
+struct ReferenceReader {
+  std::string line;
+  bool discarding = false;
+  std::vector<std::string> words;
+
+  bool feed(char c) {
+    if (c == '\r' || c == '\n') {
+      bool complete = !discarding && !line.empty();
+      words.clear();
+      if (complete) {
+        std::string word;
+        for (char w : line + ' ') {
+          if (w == ' ' || w == '\t') {
+            if (!word.empty() && words.size() <= CONSOLE_MAX_ARGS) {
+              words.push_back(word);
+            }
+            word.clear();
+          } else {
+            word += w;
+          }
+        }
+        complete = !words.empty();
+      }
+      line.clear();
+      discarding = false;
+      return complete;
+    }
+    if (c == '\b' || c == 0x7F) {
+      if (!line.empty() && !discarding) {
+        line.pop_back();
+      }
+      return false;
+    }
+    if ((uint8_t)c < ' ' && c != '\t') {
+      return false;
+    }
+    if (discarding) {
+      return false;
+    }
+    if (line.size() == CONSOLE_LINE_LENGTH - 1) {
+      discarding = true;
+      return false;
+    }
+    line += c;
+    return false;
+  }
+};
+
+static int linearLookup(const char* word) {
+  for (int command = 0; command < CONSOLE_NUM_COMMANDS; command++) {
+    if (strcmp(word, CONSOLE_COMMAND_NAMES[command]) == 0) {
+      return command;
+    }
+  }
+  return -1;
+}
+
+static long mismatches = 0;
+
+static void mismatch(const char* what, const std::string& detail) {
+  if (mismatches++ < 10) {
+    printf("MISMATCH: %s: '%s'\n", what, detail.c_str());
+  }
+}
+
+static void checkParseInt(const char* word) {
+  long value = 0;
+  bool ok = consoleParseInt(word, -255, 255, value);
+  char* end;
+  errno = 0;
+  long expected = strtol(word, &end, 10);
+  bool expectOk = end != word && *end == '\0' && errno == 0 && expected >= -255 && expected <= 255;
+  if (ok != expectOk || (ok && value != expected)) {
+    mismatch("consoleParseInt", word);
+  }
+}
+
+// Random bytes, weighted towards the ones the parser treats specially
+static char fuzzByte() {
+  static const char special[] = {'\r', '\n', ' ', '\t', '\b', 0x7F, 0, '-', '+', '0', '9'};
+  switch (randomBelow(4)) {
+    case 0:
+      return special[randomBelow(sizeof(special))];
+    case 1:
+      return (char)randomBelow(256);
+    default:
+      return (char)(' ' + randomBelow(95));
+  }
+}
+
+static std::string fuzzInput() {
+  std::string input;
+  switch (randomBelow(4)) {
+    case 0:
+      // Noise
+      for (uint32_t i = randomBelow(100); i > 0; i--) {
+        input += fuzzByte();
+      }
+      break;
+    case 1:
+      // Around the line length limit
+      input.assign(CONSOLE_LINE_LENGTH - 3 + randomBelow(6), 'a' + randomBelow(26));
+      break;
+    default: {
+      // A command with a few bytes changed, added or removed
+      input = randomCommand();
+      for (uint32_t edits = randomBelow(4); edits > 0; edits--) {
+        size_t at = randomBelow(input.size() + 1);
+        switch (randomBelow(3)) {
+          case 0:
+            input.insert(at, 1, fuzzByte());
+            break;
+          case 1:
+            if (at < input.size()) {
+              input.erase(at, 1);
+            }
+            break;
+          default:
+            if (at < input.size()) {
+              input[at] = fuzzByte();
+            }
+            break;
+        }
+      }
+      break;
+    }
+  }
+  if (randomBelow(4) != 0) {
+    input += randomBelow(2) ? "\r\n" : "\n";
+  }
+  return input;
+}
+
+static void fuzz(long byteCount) {
+  ConsoleLineReader reader;
+  ReferenceReader reference;
+  long bytes = 0;
+  long lines = 0;
+  while (bytes < byteCount) {
+    for (char c : fuzzInput()) {
+      bytes++;
+      bool got = reader.feed(c);
+      bool expected = reference.feed(c);
+      if (got != expected) {
+        mismatch("line completion", reference.line);
+        continue;
+      }
+      if (!got) {
+        continue;
+      }
+      lines++;
+      if (reader.argc() != (int)reference.words.size()) {
+        mismatch("word count", reference.words[0]);
+        continue;
+      }
+      for (int i = 0; i < reader.argc(); i++) {
+        if (reference.words[i] != reader.argv()[i]) {
+          mismatch("word", reference.words[i]);
+        }
+        checkParseInt(reader.argv()[i]);
+      }
+      if (consoleLookup(reader.argv()[0]) != linearLookup(reader.argv()[0])) {
+        mismatch("lookup", reader.argv()[0]);
+      }
+    }
+  }
+  printf("fuzz: %ld bytes, %ld lines, %u overlong, %ld mismatches\n", bytes, lines,
+         (unsigned)reader.overflows(), mismatches);
+}
+
+int main(int argc, char** argv) {
+  long commands = 1000000;
+  long fuzzBytes = 20000000;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--commands") == 0) {
+      commands = atol(argv[i + 1]);
+    } else if (strcmp(argv[i], "--fuzz-bytes") == 0) {
+      fuzzBytes = atol(argv[i + 1]);
+    } else if (strcmp(argv[i], "--seed") == 0) {
+      randomState = strtoul(argv[i + 1], nullptr, 10) | 1;
+    }
+  }
+
+  benchmark(commands);
+  fuzz(fuzzBytes);
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,191 @@
+// Host check for the v7 Q16.16 fixed-point math (src/fixed_point.h).
+//
+// Runs random and edge-case operands through +, -, * and / and compares
+// each result with the same operation in double, clamped to the Q16.16
+// range: sums and differences must be exact, products and quotients
+// within one LSB, and anything out of range must saturate to the right
+// end instead of wrapping, division by zero included. Then checks
+// fixedSin() and fixedCos() at every one of the 65536 angles against
+// sin() and cos() (the header promises about 1e-4), and fixedSqrt() for
+// exactness to the last bit: root^2 <= value < (root + 1)^2 in raw units.
+//
+//   g++ -std=gnu++17 -O2 -Isrc -o fixedcheck tools/fixedcheck.cpp
+//   ./fixedcheck [--samples N] [--seed N]
+//
+// Exits non-zero if any check fails.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "fixed_point.h"
+
+#define CHECK_TRIG_MAX_ERROR 1e-4       // fixedSin()'s stated worst case
+#define CHECK_ARITH_MAX_LSB 1           // Products and quotients round towards zero or down
+
+static uint32_t randomState = 1;
+
+// xorshift32: fast, and the same sequence everywhere for a given seed
+static uint32_t nextRandom() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+static unsigned long failures = 0;
+
+static void check(bool ok, const char* what, int32_t a, int32_t b, int32_t result) {
+  if (!ok && failures++ < 20) {
+    printf("FAIL %s: a %ld b %ld -> %ld\n", what, (long)a, (long)b, (long)result);
+  }
+}
+
+// Operands: a quarter of them anywhere in the raw range, the rest shifted
+// down so that products and quotients mostly stay in range
+static int32_t randomRaw() {
+  uint32_t value = nextRandom();
+  switch (nextRandom() % 4) {
+    case 0: return (int32_t)value;
+    case 1: return (int32_t)value >> 8;
+    case 2: return (int32_t)value >> 16;
+    default: return (int32_t)value >> 24;
+  }
+}
+
+// The exact result in raw units, clamped as the operators saturate
+static double clampRaw(double raw) {
+  return raw > INT32_MAX ? INT32_MAX : (raw < INT32_MIN ? INT32_MIN : raw);
+}
+
+static const int32_t EDGES[] = {
+  0, 1, -1, Fixed::ONE, -Fixed::ONE, Fixed::ONE / 2, INT32_MAX, INT32_MIN, INT32_MAX - 1, INT32_MIN + 1,
+  256 * Fixed::ONE, -256 * Fixed::ONE, 181 * Fixed::ONE, -181 * Fixed::ONE,
+};
+#define NUM_EDGES (sizeof(EDGES) / sizeof(EDGES[0]))
+
+static void checkPair(int32_t a, int32_t b) {
+  Fixed x = Fixed::fromRaw(a);
+  Fixed y = Fixed::fromRaw(b);
+
+  check((x + y).raw == clampRaw((double)a + b), "add", a, b, (x + y).raw);
+  check((x - y).raw == clampRaw((double)a - b), "subtract", a, b, (x - y).raw);
+
+  double product = clampRaw(floor((double)a * b / Fixed::ONE));
+  check(fabs((x * y).raw - product) <= CHECK_ARITH_MAX_LSB, "multiply", a, b, (x * y).raw);
+
+  if (b == 0) {
+    check((x / y).raw == (a >= 0 ? INT32_MAX : INT32_MIN), "divide by zero", a, b, (x / y).raw);
+  } else {
+    double quotient = clampRaw(trunc((double)a * Fixed::ONE / b));
+    check(fabs((x / y).raw - quotient) <= CHECK_ARITH_MAX_LSB, "divide", a, b, (x / y).raw);
+  }
+}
+
+static void checkArithmetic(unsigned long samples) {
+  for (size_t i = 0; i < NUM_EDGES; i++) {
+    for (size_t j = 0; j < NUM_EDGES; j++) {
+      checkPair(EDGES[i], EDGES[j]);
+    }
+  }
+  for (unsigned long i = 0; i < samples; i++) {
+    checkPair(randomRaw(), randomRaw());
+  }
+
+  // Saturation by hand, in case double and the operators agree on a wrap
+  Fixed big = Fixed::fromInt(300);
+  check((big * big).raw == INT32_MAX, "300 * 300 saturates high", big.raw, big.raw, (big * big).raw);
+  check((big * -big).raw == INT32_MIN, "300 * -300 saturates low", big.raw, -big.raw, (big * -big).raw);
+  Fixed tiny = Fixed::fromRaw(1);
+  check((big / tiny).raw == INT32_MAX, "300 / 2^-16 saturates high", big.raw, 1, (big / tiny).raw);
+  check((-big / tiny).raw == INT32_MIN, "-300 / 2^-16 saturates low", -big.raw, 1, (-big / tiny).raw);
+  Fixed top = Fixed::fromRaw(INT32_MAX);
+  check((top + tiny).raw == INT32_MAX, "max + LSB saturates", INT32_MAX, 1, (top + tiny).raw);
+  check((-top - tiny - tiny).raw == INT32_MIN, "min - LSB saturates", -INT32_MAX, 2, (-top - tiny - tiny).raw);
+  check((-Fixed::fromRaw(INT32_MIN)).raw == INT32_MAX, "negate min", INT32_MIN, 0,
+        (-Fixed::fromRaw(INT32_MIN)).raw);
+  check((big * 200).raw == INT32_MAX, "300 * int 200 saturates", big.raw, 200, (big * 200).raw);
+  check(Fixed::fromInt(40000).raw == INT32_MAX && Fixed::fromInt(-40000).raw == INT32_MIN, "fromInt saturates",
+        40000, 0, Fixed::fromInt(40000).raw);
+  check(Fixed::fromRaw(Fixed::ONE * 3 / 2).toInt() == 2 && Fixed::fromRaw(-Fixed::ONE * 3 / 2).toInt() == -1,
+        "toInt rounds half up", 3, 2, Fixed::fromRaw(Fixed::ONE * 3 / 2).toInt());
+  printf("Arithmetic: %zu edge pairs and %lu random pairs through + - * /\n", NUM_EDGES * NUM_EDGES, samples);
+}
+
+static void checkTrig() {
+  double worstSin = 0;
+  double worstCos = 0;
+  for (uint32_t angle = 0; angle < 65536; angle++) {
+    double radians = angle * (2 * M_PI / 65536);
+    double sinError = fabs(fixedSin(angle).raw / (double)Fixed::ONE - sin(radians));
+    double cosError = fabs(fixedCos(angle).raw / (double)Fixed::ONE - cos(radians));
+    worstSin = sinError > worstSin ? sinError : worstSin;
+    worstCos = cosError > worstCos ? cosError : worstCos;
+    check(sinError <= CHECK_TRIG_MAX_ERROR, "sin error", angle, 0, fixedSin(angle).raw);
+    check(cosError <= CHECK_TRIG_MAX_ERROR, "cos error", angle, 0, fixedCos(angle).raw);
+  }
+  // The quadrant ends land exactly on the table
+  check(fixedSin(0).raw == 0 && fixedSin(0x4000).raw == Fixed::ONE && fixedSin(0x8000).raw == 0 &&
+            fixedSin(0xC000).raw == -Fixed::ONE,
+        "sin at the quadrant ends", 0, 0, fixedSin(0x4000).raw);
+  printf("Trig: 65536 angles, worst error sin %.2e cos %.2e (bound %.0e)\n", worstSin, worstCos,
+         CHECK_TRIG_MAX_ERROR);
+}
+
+// root = floor(sqrt(raw * 2^16)), checked in integers
+static void checkSqrtOf(int32_t raw) {
+  int32_t root = fixedSqrt(Fixed::fromRaw(raw)).raw;
+  if (raw <= 0) {
+    check(root == 0, "sqrt of a non-positive value", raw, 0, root);
+    return;
+  }
+  uint64_t scaled = (uint64_t)raw << Fixed::FRAC_BITS;
+  uint64_t low = (uint64_t)root * root;
+  uint64_t high = (uint64_t)(root + 1) * (root + 1);
+  check(root > 0 && low <= scaled && scaled < high, "sqrt not exact", raw, 0, root);
+}
+
+static void checkSqrt(unsigned long samples) {
+  for (size_t i = 0; i < NUM_EDGES; i++) {
+    checkSqrtOf(EDGES[i]);
+  }
+  for (int32_t raw = 0; raw < 1 << 20; raw++) {
+    checkSqrtOf(raw);
+  }
+  double worst = 0;
+  for (unsigned long i = 0; i < samples; i++) {
+    int32_t raw = randomRaw();
+    checkSqrtOf(raw);
+    if (raw > 0) {
+      double error = fabs(fixedSqrt(Fixed::fromRaw(raw)).raw / (double)Fixed::ONE - sqrt(raw / (double)Fixed::ONE));
+      worst = error > worst ? error : worst;
+    }
+  }
+  printf("Sqrt: every raw value below 2^20 and %lu random ones exact, worst error %.2e\n", samples, worst);
+}
+
+int main(int argc, char** argv) {
+  unsigned long samples = 1000000;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--samples") && i + 1 < argc) {
+      samples = strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      randomState = strtoul(argv[++i], nullptr, 0) | 1;
+    } else {
+      fprintf(stderr, "usage: %s [--samples N] [--seed N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  checkArithmetic(samples);
+  checkTrig();
+  checkSqrt(samples);
+
+  if (failures != 0) {
+    printf("FAILED: %lu checks\n", failures);
+    return 1;
+  }
+  printf("ALL PASSED\n");
+  return 0;
+}
@@ -0,0 +1,81 @@
+// Sim check that the v7 motor outputs only ever change as whole frames
+// (commitMotorFrame() in src/motor_control.cpp).
+//
+// Runs the whole firmware, main.cpp included, under the native HAL with a
+// hook on every PWM latch. At each latch the channels latched must be
+// exactly the ones where the staged frame differs from the committed one,
+// and all four visible duties must equal the staged frame: no channel may
+// be latched on its own, none left behind from the last frame, and none
+// changed outside a commit. Build it with the same feature flags as the
+// firmware under test and give it the usual sim options:
+//
+//   g++ -std=gnu++17 -DHAL_NATIVE [-DENABLE_...] -Isrc -o framecheck tools/framecheck.cpp src/*.cpp
+//   ./framecheck --seconds 3600 --seed 42
+//
+// Not for -DENABLE_BENCHMARK builds: the benchmark latches one channel at
+// a time with halPwmWrite() on purpose.
+//
+// Exits non-zero at the first latch that is not a committed frame.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "hal.h"
+#include "motor_control.h"
+
+static unsigned long latches = 0;
+static unsigned long channelsLatched = 0;
+static bool failed = false;
+
+// Called from inside commitMotorFrame(), before committedFrame is updated
+static void onLatch(uint8_t channelMask) {
+  const MotorFrame& staged = stageMotorFrame();
+  const MotorFrame& committed = getCommittedFrame();
+  uint8_t changedMask = 0;
+  for (int channel = 0; channel < NUM_MOTOR_CHANNELS; channel++) {
+    if (staged.duty[channel] != committed.duty[channel]) {
+      changedMask |= 1 << channel;
+    }
+  }
+
+  bool ok = channelMask == changedMask;
+  for (int channel = 0; channel < NUM_MOTOR_CHANNELS; channel++) {
+    ok = ok && halSimPwmDuty(channel) == staged.duty[channel];
+  }
+  if (!ok) {
+    printf("FAIL latch %lu at %lu ms: mask 0x%x, frame changed 0x%x; visible %u %u %u %u, staged %u %u %u %u\n",
+           latches + 1, (unsigned long)halMillis(), channelMask, changedMask, (unsigned)halSimPwmDuty(0),
+           (unsigned)halSimPwmDuty(1), (unsigned)halSimPwmDuty(2), (unsigned)halSimPwmDuty(3),
+           (unsigned)staged.duty[0], (unsigned)staged.duty[1], (unsigned)staged.duty[2],
+           (unsigned)staged.duty[3]);
+    printf("FAILED\n");
+    failed = true;
+    exit(1);
+  }
+  latches++;
+  for (uint8_t mask = channelMask; mask != 0; mask &= mask - 1) {
+    channelsLatched++;
+  }
+}
+
+// Runs when the sim returns from main(). The sim itself always exits 0,
+// so a run with no latches at all fails from here.
+static void report() {
+  if (failed) {
+    return;
+  }
+  printf("Frames: %lu latches of %lu channels, each a whole committed frame\n", latches, channelsLatched);
+  if (latches == 0) {
+    printf("FAILED: no latches seen\n");
+    fflush(stdout);
+    _Exit(1);
+  }
+  printf("ALL PASSED\n");
+}
+
+// Hooked in before setup() runs, so the first frame is watched too
+static struct FrameCheck {
+  FrameCheck() {
+    halSimSetLatchHook(onLatch);
+    atexit(report);
+  }
+} frameCheck;
@@ -0,0 +1,230 @@
+// Host check for the v7 latency histogram (src/latency_histogram.h).
+//
+// Walks every value up to 2^22 and a random sample of the rest of the
+// 32-bit range through latencyBucket() and checks that each lands in a
+// bucket whose bounds contain it, that the buckets tile the range with no
+// gaps, and that no bucket below the overflow is wider than 1/8 of its
+// lowest value - the 12.5% error bound the firmware reports against.
+// Then records random distributions and checks every percentile against
+// the exact one from a sorted copy: never below it, at most one bucket
+// above. Last, it times record() for small and large values to show the
+// cost stays flat however large the value.
+//
+//   g++ -std=gnu++17 -O2 -Isrc -o latencycheck tools/latencycheck.cpp src/latency_histogram.cpp
+//   ./latencycheck [--samples N] [--records N] [--seed N]
+//
+// Exits non-zero if any check fails.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "latency_histogram.h"
+
+static uint32_t randomState = 1;
+
+// xorshift32: fast, and the same sequence everywhere for a given seed
+static uint32_t nextRandom() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+static unsigned long failures = 0;
+
+static void fail(const char* what, uint32_t value, int bucket) {
+  if (failures++ < 10) {
+    printf("FAIL %s: value %lu bucket %d (%lu..%lu)\n", what, (unsigned long)value, bucket,
+           (unsigned long)latencyBucketLowest(bucket), (unsigned long)latencyBucketHighest(bucket));
+  }
+}
+
+static void checkValue(uint32_t value) {
+  int bucket = latencyBucket(value);
+  if (bucket < 0 || bucket >= LATENCY_BUCKETS) {
+    fail("bucket out of range", value, 0);
+    return;
+  }
+  if (value < latencyBucketLowest(bucket) || value > latencyBucketHighest(bucket)) {
+    fail("value outside its bucket", value, bucket);
+  }
+  if ((bucket == LATENCY_OVERFLOW_BUCKET) != (value >= (1UL << LATENCY_MAX_BITS))) {
+    fail("overflow bucket", value, bucket);
+  }
+}
+
+static void checkBuckets(unsigned long samples) {
+  // The bounds: contiguous, increasing, and narrow enough
+  for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+    uint32_t lowest = latencyBucketLowest(bucket);
+    uint32_t highest = latencyBucketHighest(bucket);
+    if (highest < lowest) {
+      fail("empty bucket", lowest, bucket);
+    }
+    if (bucket > 0 && lowest != latencyBucketHighest(bucket - 1) + 1) {
+      fail("gap or overlap before bucket", lowest, bucket);
+    }
+    uint32_t width = highest - lowest + 1;
+    uint32_t allowed = lowest / LATENCY_SUB_BUCKETS > 1 ? lowest / LATENCY_SUB_BUCKETS : 1;
+    if (bucket < LATENCY_OVERFLOW_BUCKET && width > allowed) {
+      fail("bucket wider than 1/8", lowest, bucket);
+    }
+  }
+  if (latencyBucketLowest(0) != 0 || latencyBucketHighest(LATENCY_OVERFLOW_BUCKET) != UINT32_MAX ||
+      latencyBucketLowest(LATENCY_OVERFLOW_BUCKET) != (1UL << LATENCY_MAX_BITS)) {
+    fail("range ends", 0, 0);
+  }
+
+  // Every value through 2^22, then each power of two and its neighbours,
+  // then random values spread evenly over the bit lengths
+  for (uint32_t value = 0; value <= (1UL << 22); value++) {
+    checkValue(value);
+  }
+  for (int bit = 0; bit < 32; bit++) {
+    uint32_t power = 1UL << bit;
+    checkValue(power - 1);
+    checkValue(power);
+    checkValue(power + 1);
+  }
+  checkValue(UINT32_MAX);
+  for (unsigned long i = 0; i < samples; i++) {
+    int bits = 1 + nextRandom() % 32;
+    checkValue(bits == 32 ? nextRandom() : nextRandom() & ((1UL << bits) - 1));
+  }
+  printf("Buckets: %d (%d overflow from %lu), %lu sampled values\n", LATENCY_BUCKETS,
+         LATENCY_OVERFLOW_BUCKET, 1UL << LATENCY_MAX_BITS, samples + (1UL << 22) + 1);
+}
+
+// Exact percentile of a sorted copy, using the same rank as percentile()
+static uint32_t exactPercentile(const std::vector<uint32_t>& sorted, uint32_t perMille) {
+  uint64_t rank = ((uint64_t)sorted.size() * perMille + 999) / 1000;
+  if (rank == 0) {
+    rank = 1;
+  }
+  return sorted[rank - 1];
+}
+
+static uint32_t drawSample(int distribution) {
+  switch (distribution) {
+    case 0:                                   // Uniform over a control-loop-sized range
+      return 2000 + nextRandom() % 4000;
+    case 1: {                                 // Exponential with a 10k-cycle mean
+      double u = (nextRandom() + 1.0) / 4294967297.0;
+      return (uint32_t)(-10000.0 * log(u));
+    }
+    case 2:                                   // Mostly fast, with a rare slow path
+      return nextRandom() % 100 == 0 ? 500000 + nextRandom() % 100000 : 3000 + nextRandom() % 200;
+    default:                                  // Log-uniform over the whole range
+      return nextRandom() >> (nextRandom() % 32);
+  }
+}
+
+static void checkPercentiles() {
+  static const char* names[] = {"uniform", "exponential", "bimodal", "log-uniform"};
+  static const uint32_t perMilles[] = {0, 1, 100, 500, 900, 990, 999, 1000};
+  for (int distribution = 0; distribution < 4; distribution++) {
+    for (int size : {1, 7, 1000, 100000}) {
+      LatencyHistogram histogram;
+      std::vector<uint32_t> values;
+      for (int i = 0; i < size; i++) {
+        uint32_t value = drawSample(distribution);
+        histogram.record(value);
+        values.push_back(value);
+      }
+      std::sort(values.begin(), values.end());
+      if (histogram.maximum() != values.back() || histogram.count() != (uint32_t)size) {
+        fail("count or maximum", values.back(), 0);
+      }
+      for (uint32_t perMille : perMilles) {
+        uint32_t exact = exactPercentile(values, perMille);
+        uint32_t reported = histogram.percentile(perMille);
+        int bucket = latencyBucket(exact);
+        if (reported < exact || reported > latencyBucketHighest(bucket)) {
+          printf("FAIL %s n=%d p%lu: exact %lu, reported %lu\n", names[distribution], size,
+                 (unsigned long)perMille, (unsigned long)exact, (unsigned long)reported);
+          failures++;
+        }
+      }
+    }
+  }
+
+  // Budgets count values strictly above them, and 0 turns the count off
+  LatencyHistogram histogram;
+  histogram.setBudget(100);
+  for (uint32_t value : {99, 100, 101, 1000}) {
+    histogram.record(value);
+  }
+  if (histogram.overruns() != 2) {
+    fail("overrun count", histogram.overruns(), 0);
+  }
+  histogram.reset();
+  if (histogram.count() != 0 || histogram.percentile(500) != 0 || histogram.budget() != 100) {
+    fail("reset", histogram.count(), 0);
+  }
+  histogram.setBudget(0);
+  histogram.record(UINT32_MAX);
+  if (histogram.overruns() != 0 || histogram.bucketCount(LATENCY_OVERFLOW_BUCKET) != 1) {
+    fail("overflow or disabled budget", histogram.overruns(), 0);
+  }
+  printf("Percentiles: 4 distributions x 4 sizes x %zu ranks checked\n", sizeof(perMilles) / sizeof(perMilles[0]));
+}
+
+// Outside any function so the optimiser has to keep the timed stores
+LatencyHistogram timedHistogram;
+
+// ns per record() for values spread over a range, after a warm-up pass
+static double timeRecords(uint32_t mask, uint32_t floor, unsigned long records) {
+  std::vector<uint32_t> values(4096);
+  for (uint32_t& value : values) {
+    value = floor + (nextRandom() & mask);
+  }
+  LatencyHistogram& histogram = timedHistogram;
+  histogram.reset();
+  for (uint32_t value : values) {
+    histogram.record(value);
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < records; i++) {
+    histogram.record(values[i & 4095]);
+  }
+  auto stop = std::chrono::steady_clock::now();
+  if (histogram.count() != records + values.size()) {
+    fail("timing count", histogram.count(), 0);
+  }
+  return std::chrono::duration<double, std::nano>(stop - start).count() / records;
+}
+
+int main(int argc, char** argv) {
+  unsigned long samples = 10000000;
+  unsigned long records = 50000000;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--samples") && i + 1 < argc) {
+      samples = strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--records") && i + 1 < argc) {
+      records = strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      randomState = strtoul(argv[++i], nullptr, 0) | 1;
+    } else {
+      fprintf(stderr, "usage: %s [--samples N] [--records N] [--seed N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  checkBuckets(samples);
+  checkPercentiles();
+  printf("record(): %.2f ns below 8, %.2f ns around 2^12, %.2f ns around 2^27, %.2f ns overflow\n",
+         timeRecords(7, 0, records), timeRecords(1023, 4096, records),
+         timeRecords((1UL << 26) - 1, 1UL << 27, records), timeRecords(0xffff, 1UL << 30, records));
+
+  if (failures != 0) {
+    printf("FAILED: %lu checks\n", failures);
+    return 1;
+  }
+  printf("ALL PASSED\n");
+  return 0;
+}
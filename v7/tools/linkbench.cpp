@@ -0,0 +1,362 @@
+// End-to-end test and benchmark for the v7 binary serial link.
+//
+// Runs the native build with --pty (or talks to a robot on its USB port)
+// through tools/robot_link.h and:
+//
+//   1. pings it to measure the round-trip latency,
+//   2. streams setpoints and takes telemetry at 1 kHz for a few seconds,
+//      checking every telemetry frame against the setpoint it reports and
+//      measuring the telemetry rate, throughput and setpoint-to-telemetry
+//      latency,
+//   3. sends corrupted and malformed frames, and checks the robot counts
+//      them and keeps answering,
+//   4. stops streaming, and checks the robot hands control back to its
+//      movement modes after HOST_SETPOINT_TIMEOUT_MS.
+//
+// Each check prints PASS or FAIL and the exit status is non-zero if any
+// failed. From the v7 directory:
+//
+//   g++ -std=gnu++17 -O1 -DHAL_NATIVE -DENABLE_PROTOCOL -Isrc -o program src/*.cpp
+//   g++ -std=gnu++17 -O2 -pthread -Isrc -o linkbench tools/linkbench.cpp tools/robot_link.cpp src/frame.cpp src/crc.cpp
+//   ./linkbench --firmware ./program [--seconds N] [--verbose]
+//   ./linkbench --device /dev/ttyACM0 [--seconds N]
+//
+// A robot must be built with -DENABLE_PROTOCOL, and will drive its wheels
+// during step 2 - lift them off the ground.
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "robot_link.h"
+
+// Must match HOST_SETPOINT_TIMEOUT_MS in src/control.h
+#define HOST_SETPOINT_TIMEOUT_MS 250
+
+#define PING_COUNT 1000
+#define PING_TIMEOUT_MS 100
+#define STREAM_RATE_HZ 1000
+#define MIN_TELEMETRY_HZ 950          // Pass mark for a 1 kHz request
+#define LAPSE_MARGIN_MS 100           // Allowed beyond HOST_SETPOINT_TIMEOUT_MS
+
+typedef std::chrono::steady_clock Clock;
+
+static RobotLink robot;
+static bool verbose = false;
+static int failures = 0;
+
+static RobotTelemetry lastTelemetry = {};
+static uint64_t telemetryFrames = 0;
+static uint64_t telemetryGaps = 0;
+static bool haveTelemetry = false;
+
+static void check(bool ok, const char* what) {
+  printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok) {
+    failures++;
+  }
+}
+
+static double microsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+static double percentile(std::vector<double> values, double fraction) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  size_t index = std::min(values.size() - 1, (size_t)(values.size() * fraction));
+  return values[index];
+}
+
+static void printLatency(const char* name, const std::vector<double>& us) {
+  printf("%s: n=%zu min=%.0f median=%.0f p99=%.0f max=%.0f us\n", name, us.size(),
+         percentile(us, 0), percentile(us, 0.5), percentile(us, 0.99), percentile(us, 1));
+}
+
+// The setpoint streamed with each sequence number, so every telemetry
+// frame can be checked against the one it says is in effect
+static int leftFor(uint16_t seq) {
+  return (int)(seq % 401) - 200;
+}
+
+static int rightFor(uint16_t seq) {
+  return 200 - (int)(seq % 401);
+}
+
+static void onTelemetry(const RobotTelemetry& t) {
+  if (haveTelemetry) {
+    telemetryGaps += (uint16_t)(t.seq - lastTelemetry.seq - 1);
+  }
+  lastTelemetry = t;
+  haveTelemetry = true;
+  telemetryFrames++;
+}
+
+static void onLog(const char* text, size_t length) {
+  if (verbose) {
+    fprintf(stderr, "[robot] %.*s", (int)length, text);
+  }
+}
+
+// Polls until done() or the timeout; false on timeout or a port error
+template <typename Done>
+static bool pollUntil(Done done, int timeoutMs) {
+  Clock::time_point start = Clock::now();
+  while (!done()) {
+    int remainingMs = timeoutMs - (int)(microsSince(start) / 1000);
+    if (remainingMs <= 0 || robot.poll(std::min(remainingMs, 10)) < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool ping(uint32_t token, double* rttUs) {
+  bool answered = false;
+  robot.onPong = [&](uint32_t got, uint32_t robotUs) { answered = answered || got == token; };
+  Clock::time_point start = Clock::now();
+  if (!robot.sendPing(token) || !pollUntil([&] { return answered; }, PING_TIMEOUT_MS)) {
+    return false;
+  }
+  if (rttUs != nullptr) {
+    *rttUs = microsSince(start);
+  }
+  return true;
+}
+
+static void testPing() {
+  std::vector<double> rtt;
+  for (uint32_t token = 1; token <= PING_COUNT; token++) {
+    double us;
+    if (ping(token, &us)) {
+      rtt.push_back(us);
+    }
+  }
+  printLatency("ping round trip", rtt);
+  check(rtt.size() == PING_COUNT, "every ping answered");
+}
+
+static void testStreaming(int seconds) {
+  std::vector<Clock::time_point> sentAt(65536);
+  std::vector<double> latency;
+  uint64_t mismatches = 0;
+  uint64_t hostFrames = 0;
+  uint16_t seq = 0;
+  uint16_t latestSeen = 0;
+  bool seenAny = false;
+
+  robot.onTelemetry = [&](const RobotTelemetry& t) {
+    onTelemetry(t);
+    if ((t.flags & TELEMETRY_FLAG_HOST) == 0) {
+      return;
+    }
+    hostFrames++;
+    if (t.setpoint[0] != leftFor(t.hostSeq) || t.setpoint[1] != rightFor(t.hostSeq)) {
+      mismatches++;
+    }
+    if (!seenAny || (int16_t)(t.hostSeq - latestSeen) > 0) {
+      latency.push_back(std::chrono::duration<double, std::micro>(Clock::now() - sentAt[t.hostSeq]).count());
+      latestSeen = t.hostSeq;
+      seenAny = true;
+    }
+  };
+
+  // Start the stream, then let it settle before counting
+  robot.setTelemetryRate(STREAM_RATE_HZ);
+  uint64_t framesBefore = 0;
+  uint64_t gapsBefore = 0;
+  uint64_t bytesBefore = 0;
+  uint32_t errorsBefore = robot.rxErrors();
+  Clock::time_point start = Clock::now();
+  Clock::time_point countFrom = start + std::chrono::milliseconds(200);
+  Clock::time_point end = countFrom + std::chrono::seconds(seconds);
+  Clock::time_point nextSend = start;
+  bool counting = false;
+
+  while (Clock::now() < end) {
+    if (!counting && Clock::now() >= countFrom) {
+      counting = true;
+      framesBefore = telemetryFrames;
+      gapsBefore = telemetryGaps;
+      bytesBefore = robot.rxBytes();
+      latency.clear();
+    }
+    if (Clock::now() >= nextSend) {
+      seq++;
+      sentAt[seq] = Clock::now();
+      robot.sendSetpoint(seq, leftFor(seq), rightFor(seq));
+      nextSend += std::chrono::microseconds(1000000 / STREAM_RATE_HZ);
+    }
+    int waitMs = (int)std::chrono::duration_cast<std::chrono::milliseconds>(nextSend - Clock::now()).count();
+    if (robot.poll(std::max(waitMs, 0)) < 0) {
+      break;
+    }
+  }
+
+  double frames = (double)(telemetryFrames - framesBefore);
+  printf("telemetry: %.0f frames/s, %llu lost, %.1f kB/s received\n", frames / seconds,
+         (unsigned long long)(telemetryGaps - gapsBefore), (robot.rxBytes() - bytesBefore) / 1000.0 / seconds);
+  printLatency("setpoint to telemetry", latency);
+  check(frames / seconds >= MIN_TELEMETRY_HZ, "telemetry at 1 kHz");
+  check(hostFrames != 0 && mismatches == 0, "telemetry reports the setpoints sent");
+  check(robot.rxErrors() == errorsBefore, "no corrupt frames from the robot");
+}
+
+static void testCorruption() {
+  robot.onTelemetry = onTelemetry;
+  robot.setTelemetryRate(100);
+  pollUntil([] { return false; }, 50);
+  uint16_t rejectedBefore = lastTelemetry.robotRejected;
+
+  // Text, a frame with a bad CRC and a setpoint too short to use
+  const char* text = "not a frame\r\n";
+  robot.sendRaw((const uint8_t*)text, strlen(text));
+  uint8_t zero = 0;
+  robot.sendRaw(&zero, 1);
+
+  FrameWriter writer;
+  writer.begin(MSG_PING);
+  writer.putU32(0xDEADBEEF);
+  size_t length = writer.finish();
+  std::vector<uint8_t> corrupt(writer.data(), writer.data() + length);
+  corrupt[length - 2] ^= 0x55;
+  robot.sendRaw(corrupt.data(), corrupt.size());
+
+  writer.begin(MSG_SETPOINT);
+  writer.putU16(1);
+  length = writer.finish();
+  robot.sendRaw(writer.data(), length);
+
+  check(ping(0xC0FFEE, nullptr), "link survives corrupt frames");
+  pollUntil([] { return false; }, 50);
+  printf("robot rejected %u frames\n", (unsigned)(uint16_t)(lastTelemetry.robotRejected - rejectedBefore));
+  check((uint16_t)(lastTelemetry.robotRejected - rejectedBefore) >= 3, "robot counts corrupt frames");
+}
+
+static void testLapse() {
+  // Still fed: take one more setpoint, then go quiet
+  robot.onTelemetry = onTelemetry;
+  robot.setTelemetryRate(1000);
+  robot.sendSetpoint(1, leftFor(1), rightFor(1));
+  Clock::time_point stoppedAt = Clock::now();
+  bool took = pollUntil([] { return (lastTelemetry.flags & TELEMETRY_FLAG_HOST) != 0 && lastTelemetry.hostSeq == 1; },
+                        HOST_SETPOINT_TIMEOUT_MS);
+  bool lapsed = took && pollUntil([] { return (lastTelemetry.flags & TELEMETRY_FLAG_HOST) == 0; },
+                                  HOST_SETPOINT_TIMEOUT_MS + LAPSE_MARGIN_MS);
+  double lapseMs = microsSince(stoppedAt) / 1000;
+  printf("host control lapsed %.0f ms after the last setpoint\n", lapseMs);
+  check(lapsed && lapseMs >= HOST_SETPOINT_TIMEOUT_MS, "control returns to the modes after the timeout");
+
+  robot.setTelemetryRate(0);
+}
+
+// Starts the native build on a pty and returns the pty path
+static std::string startFirmware(const char* program, int seconds, pid_t* child) {
+  int output[2];
+  if (pipe(output) != 0) {
+    return "";
+  }
+  *child = fork();
+  if (*child == 0) {
+    dup2(output[1], STDOUT_FILENO);
+    close(output[0]);
+    std::string runSeconds = std::to_string(seconds);
+    execl(program, program, "--pty", "--seconds", runSeconds.c_str(), "--seed", "42", (char*)nullptr);
+    _exit(127);
+  }
+  close(output[1]);
+
+  FILE* lines = fdopen(output[0], "r");
+  const char* marker = "[native] serial link on ";
+  char line[256];
+  std::string path;
+  while (path.empty() && fgets(line, sizeof(line), lines) != nullptr) {
+    if (strncmp(line, marker, strlen(marker)) == 0) {
+      path = line + strlen(marker);
+      path.erase(path.find_last_not_of("\r\n") + 1);
+    }
+  }
+
+  // Keep the firmware's stdout drained so it never blocks on the pipe
+  std::thread([lines] {
+    char text[256];
+    while (fgets(text, sizeof(text), lines) != nullptr) {
+      if (verbose) {
+        fprintf(stderr, "[native] %s", text);
+      }
+    }
+  }).detach();
+  return path;
+}
+
+int main(int argc, char** argv) {
+  const char* firmware = nullptr;
+  const char* device = nullptr;
+  int seconds = 3;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--verbose") == 0) {
+      verbose = true;
+    } else if (i + 1 >= argc) {
+      break;
+    } else if (strcmp(argv[i], "--firmware") == 0) {
+      firmware = argv[++i];
+    } else if (strcmp(argv[i], "--device") == 0) {
+      device = argv[++i];
+    } else if (strcmp(argv[i], "--seconds") == 0) {
+      seconds = std::max(1, atoi(argv[++i]));
+    }
+  }
+  if ((firmware == nullptr) == (device == nullptr)) {
+    fprintf(stderr, "usage: %s --firmware PROGRAM | --device PORT [--seconds N] [--verbose]\n", argv[0]);
+    return 2;
+  }
+
+  pid_t child = -1;
+  std::string path;
+  if (firmware != nullptr) {
+    path = startFirmware(firmware, seconds + 60, &child);
+    if (path.empty()) {
+      fprintf(stderr, "%s did not open a pty\n", firmware);
+      return 1;
+    }
+    device = path.c_str();
+  }
+  if (!robot.open(device)) {
+    fprintf(stderr, "cannot open %s\n", device);
+    return 1;
+  }
+  robot.onLog = onLog;
+  robot.onTelemetry = onTelemetry;
+  printf("link: %s\n", device);
+
+  // The firmware may still be booting
+  bool up = false;
+  for (int attempt = 0; attempt < 50 && !up; attempt++) {
+    up = ping(0xFFFF0000u + attempt, nullptr);
+  }
+  check(up, "robot answers");
+  if (up) {
+    testPing();
+    testStreaming(seconds);
+    testCorruption();
+    testLapse();
+  }
+
+  robot.close();
+  if (child > 0) {
+    kill(child, SIGTERM);
+    waitpid(child, nullptr, 0);
+  }
+  printf("%s (%d failed)\n", failures == 0 ? "ALL PASSED" : "FAILED", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,201 @@
+// Compiles movement pattern choreography (CSV) into the bytecode arrays
+// used by src/pattern.cpp. See patterns/movement_patterns.csv for the
+// syntax.
+//
+//   g++ -O2 -o patternc tools/patternc.cpp
+//   ./patternc patterns/movement_patterns.csv > src/patterns.h
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct Step {
+  std::string op;
+  std::vector<std::string> args;
+  int line;
+};
+
+struct Pattern {
+  std::string name;
+  std::vector<Step> steps;
+  std::map<std::string, int> labels;
+};
+
+static std::string trim(const std::string& s) {
+  size_t start = s.find_first_not_of(" \t\r");
+  size_t end = s.find_last_not_of(" \t\r");
+  return start == std::string::npos ? "" : s.substr(start, end - start + 1);
+}
+
+static bool fail(const std::string& file, int line, const std::string& message) {
+  std::cerr << file << ":" << line << ": " << message << "\n";
+  return false;
+}
+
+static bool parseInt(const std::string& text, long low, long high, long& value) {
+  char* end = nullptr;
+  value = strtol(text.c_str(), &end, 10);
+  return !text.empty() && *end == '\0' && value >= low && value <= high;
+}
+
+static bool resolveTarget(const Pattern& pattern, const std::string& text, long& target) {
+  auto label = pattern.labels.find(text);
+  if (label != pattern.labels.end()) {
+    target = label->second;
+    return true;
+  }
+  return parseInt(text, 0, (long)pattern.steps.size() - 1, target);
+}
+
+// Appends the pattern's array to out
+static bool emit(const std::string& file, const Pattern& pattern, std::string& out) {
+  out += "static const PatternStep " + pattern.name + "[] = {\n";
+
+  // Whether the step just emitted never falls through to the next one
+  bool terminal = false;
+  // Step index of each counted loop so far; they share one repeat counter
+  std::vector<long> countedLoops;
+  for (size_t i = 0; i < pattern.steps.size(); i++) {
+    const Step& step = pattern.steps[i];
+    long a = 0, b = 0, c = 0;
+    char text[96];
+
+    if (step.op == "drive") {
+      if (step.args.size() != 3 || !parseInt(step.args[0], -100, 100, a) ||
+          !parseInt(step.args[1], -100, 100, b) || !parseInt(step.args[2], 0, 2550, c)) {
+        return fail(file, step.line, "drive needs left% and right% (-100..100) and ms (0..2550)");
+      }
+      if (c % 10 != 0) {
+        return fail(file, step.line, "drive duration must be a multiple of 10 ms");
+      }
+      snprintf(text, sizeof(text), "PATTERN_DRIVE(%ld, %ld, %ld)", a, b, c);
+      terminal = false;
+    } else if (step.op == "loop") {
+      if (step.args.size() != 2 || !resolveTarget(pattern, step.args[0], a) ||
+          !parseInt(step.args[1], 0, 127, b)) {
+        return fail(file, step.line, "loop needs a target and a count (0..127)");
+      }
+      if (b != 0) {
+        long low = a < (long)i ? a : (long)i;
+        for (long other : countedLoops) {
+          if (other >= low) {
+            return fail(file, step.line, "counted loops can't nest - the runner has one repeat counter");
+          }
+        }
+        countedLoops.push_back((long)i);
+      }
+      snprintf(text, sizeof(text), "PATTERN_LOOP(%ld, %ld)", a, b);
+      terminal = b == 0 && a <= (long)i;
+    } else if (step.op == "branch") {
+      if (step.args.size() != 2 || !resolveTarget(pattern, step.args[0], a) ||
+          !parseInt(step.args[1], 0, 100, b)) {
+        return fail(file, step.line, "branch needs a target and a percentage (0..100)");
+      }
+      snprintf(text, sizeof(text), "PATTERN_BRANCH(%ld, %ld)", a, b);
+      terminal = false;
+    } else if (step.op == "end") {
+      snprintf(text, sizeof(text), "PATTERN_END()");
+      terminal = true;
+    } else {
+      return fail(file, step.line, "unknown step '" + step.op + "'");
+    }
+
+    out += std::string("  ") + text + ",  // " + std::to_string(i) + "\n";
+  }
+
+  // patternUpdate() would run off the end of the array otherwise
+  if (!terminal) {
+    return fail(file, pattern.steps.back().line,
+                "pattern " + pattern.name + " must finish with end or a forever loop back");
+  }
+  // Second guard, should the runner ever step past the last step
+  out += "  PATTERN_END(),  // " + std::to_string(pattern.steps.size()) + ", sentinel\n";
+  out += "};\n\n";
+  return true;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    std::cerr << "usage: " << argv[0] << " <patterns.csv>\n";
+    return 1;
+  }
+
+  std::ifstream in(argv[1]);
+  if (!in) {
+    std::cerr << "cannot open " << argv[1] << "\n";
+    return 1;
+  }
+
+  std::vector<Pattern> patterns;
+  std::string raw;
+  int lineNumber = 0;
+  while (std::getline(in, raw)) {
+    lineNumber++;
+    std::string line = trim(raw.substr(0, raw.find('#')));
+    if (line.empty()) {
+      continue;
+    }
+
+    if (line.back() == ':') {
+      if (patterns.empty()) {
+        fail(argv[1], lineNumber, "label before any pattern");
+        return 1;
+      }
+      Pattern& pattern = patterns.back();
+      pattern.labels[trim(line.substr(0, line.size() - 1))] = (int)pattern.steps.size();
+      continue;
+    }
+
+    std::vector<std::string> fields;
+    std::stringstream stream(line);
+    std::string field;
+    while (std::getline(stream, field, ',')) {
+      fields.push_back(trim(field));
+    }
+
+    if (fields[0] == "pattern") {
+      if (fields.size() != 2 || fields[1].empty()) {
+        fail(argv[1], lineNumber, "pattern needs a name");
+        return 1;
+      }
+      patterns.push_back(Pattern{fields[1], {}, {}});
+      continue;
+    }
+
+    if (patterns.empty()) {
+      fail(argv[1], lineNumber, "step before any pattern");
+      return 1;
+    }
+    patterns.back().steps.push_back(
+        Step{fields[0], std::vector<std::string>(fields.begin() + 1, fields.end()), lineNumber});
+  }
+
+  // Nothing reaches stdout until every pattern compiles, so a failed run
+  // can't leave a truncated patterns.h behind
+  std::string out = "#ifndef PATTERNS_H\n#define PATTERNS_H\n\n";
+  out += "// Generated by tools/patternc.cpp from " + std::string(argv[1]) + " - do not edit.\n\n";
+  out += "#include \"pattern.h\"\n\n";
+
+  for (const Pattern& pattern : patterns) {
+    if (pattern.steps.empty()) {
+      fail(argv[1], lineNumber, "pattern " + pattern.name + " has no steps");
+      return 1;
+    }
+    if (pattern.steps.size() > 255) {      // The sentinel takes index 255
+      fail(argv[1], lineNumber, "pattern " + pattern.name + " has more than 255 steps");
+      return 1;
+    }
+    if (!emit(argv[1], pattern, out)) {
+      return 1;
+    }
+  }
+
+  out += "#endif // PATTERNS_H\n";
+  std::fwrite(out.data(), 1, out.size(), stdout);
+  return 0;
+}
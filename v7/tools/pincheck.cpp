@@ -0,0 +1,134 @@
+// Sim check of the v7 H-bridge input duties (stageMotorDuty() in
+// src/motor_control.cpp).
+//
+// For every signed duty of each motor at two PWM resolutions, in fast and
+// slow decay, and for a stopped motor set to coast or to brake, it plays
+// one PWM period of the two staged input duties through the DRV8833 truth
+// table (IN1/IN2: 10 forward, 01 reverse, 11 brake, 00 coast). The motor
+// must drive the right way for |duty| counts, clamped to the resolution,
+// and never the wrong way. For the rest of the period it must coast in
+// fast decay and brake in slow decay. A stopped motor must spend the
+// whole period in its stop mode. The frame must record the decay it was
+// staged in, and the other motor's channels must be left alone.
+//
+// Links the whole firmware but main.cpp, like rampcheck, and runs from
+// setup():
+//
+//   g++ -std=gnu++17 -DHAL_NATIVE -Isrc -o pincheck tools/pincheck.cpp $(ls src/*.cpp | grep -v src/main.cpp)
+//   ./pincheck
+//
+// Exits non-zero if any check fails.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "hal.h"
+#include "config.h"
+#include "log.h"
+#include "motor_control.h"
+
+#define CHECK_FREQ_HZ 1000
+#define CHECK_OVERRANGE 5           // Duties checked past the maximum, for the clamp
+#define CHECK_UNTOUCHED 0x5a5a      // Fill for the channels a call must not touch
+
+enum BridgeState { BRIDGE_COAST, BRIDGE_FORWARD, BRIDGE_REVERSE, BRIDGE_BRAKE, BRIDGE_STATES };
+
+static const char* const DECAY_NAMES[] = {"fast", "slow"};
+static const char* const STOP_NAMES[] = {"coast", "brake"};
+
+static unsigned long failures = 0;
+
+// Counts per PWM period spent in each bridge state: an LEDC output is high
+// for the first duty counts of the period
+static void playPeriod(uint32_t in1Duty, uint32_t in2Duty, uint32_t fullOn, uint32_t* counts) {
+  for (int state = 0; state < BRIDGE_STATES; state++) {
+    counts[state] = 0;
+  }
+  for (uint32_t count = 0; count < fullOn; count++) {
+    bool in1 = count < in1Duty;
+    bool in2 = count < in2Duty;
+    counts[in1 ? (in2 ? BRIDGE_BRAKE : BRIDGE_FORWARD) : (in2 ? BRIDGE_REVERSE : BRIDGE_COAST)]++;
+  }
+}
+
+static void checkMotor(int motor, int32_t duty, DecayMode decay, StopMode stop) {
+  int in1 = motor == MOTOR_A ? PWM_CHANNEL_A_IN1 : PWM_CHANNEL_B_IN1;
+  int in2 = motor == MOTOR_A ? PWM_CHANNEL_A_IN2 : PWM_CHANNEL_B_IN2;
+  uint32_t fullOn = getPwmMaxDuty() + 1;
+
+  MotorFrame frame;
+  for (int channel = 0; channel < NUM_MOTOR_CHANNELS; channel++) {
+    frame.duty[channel] = CHECK_UNTOUCHED;
+  }
+  frame.decay[0] = frame.decay[1] = decay == DECAY_FAST ? DECAY_SLOW : DECAY_FAST;
+  setMotorDecay(motor, decay);
+  setStopMode(stop);
+  stageMotorDuty(frame, motor, duty);
+
+  uint32_t counts[BRIDGE_STATES];
+  playPeriod(frame.duty[in1], frame.duty[in2], fullOn, counts);
+
+  uint32_t expected[BRIDGE_STATES] = {0, 0, 0, 0};
+  uint32_t magnitude = abs(duty) > (int32_t)getPwmMaxDuty() ? getPwmMaxDuty() : abs(duty);
+  if (duty == 0) {
+    expected[stop == STOP_BRAKE ? BRIDGE_BRAKE : BRIDGE_COAST] = fullOn;
+  } else {
+    expected[duty > 0 ? BRIDGE_FORWARD : BRIDGE_REVERSE] = magnitude;
+    expected[decay == DECAY_SLOW ? BRIDGE_BRAKE : BRIDGE_COAST] = fullOn - magnitude;
+  }
+
+  bool ok = frame.duty[in1] <= fullOn && frame.duty[in2] <= fullOn && frame.decay[motor] == decay &&
+            frame.decay[1 - motor] != decay;
+  for (int state = 0; state < BRIDGE_STATES; state++) {
+    ok = ok && counts[state] == expected[state];
+  }
+  for (int channel = 0; channel < NUM_MOTOR_CHANNELS; channel++) {
+    ok = ok && (channel == in1 || channel == in2 || frame.duty[channel] == CHECK_UNTOUCHED);
+  }
+  if (!ok && failures++ < 20) {
+    printf("FAIL motor %d duty %ld, %s decay, stop %s: IN1 %u IN2 %u -> coast %lu fwd %lu rev %lu brake %lu\n",
+           motor, (long)duty, DECAY_NAMES[decay], STOP_NAMES[stop], frame.duty[in1], frame.duty[in2],
+           (unsigned long)counts[BRIDGE_COAST], (unsigned long)counts[BRIDGE_FORWARD],
+           (unsigned long)counts[BRIDGE_REVERSE], (unsigned long)counts[BRIDGE_BRAKE]);
+  }
+}
+
+static unsigned long checkResolution(uint8_t resolution) {
+  if (!setPwmProfile({CHECK_FREQ_HZ, resolution})) {
+    printf("FAIL %u-bit PWM at %d Hz refused\n", resolution, CHECK_FREQ_HZ);
+    failures++;
+    return 0;
+  }
+  int32_t highest = getPwmMaxDuty() + CHECK_OVERRANGE;
+  unsigned long cases = 0;
+  for (int motor = MOTOR_A; motor <= MOTOR_B; motor++) {
+    for (int decay = DECAY_FAST; decay <= DECAY_SLOW; decay++) {
+      for (int stop = STOP_COAST; stop <= STOP_BRAKE; stop++) {
+        for (int32_t duty = -highest; duty <= highest; duty++) {
+          checkMotor(motor, duty, (DecayMode)decay, (StopMode)stop);
+          cases++;
+        }
+      }
+    }
+  }
+  return cases;
+}
+
+void setup() {
+  logInit();
+  configLoad();
+  setupMotors({CHECK_FREQ_HZ, 8});
+  unsigned long cases = checkResolution(8);
+  cases += checkResolution(10);
+  logFlush();
+  printf("Truth table: %lu motor x duty x decay x stop cases at 8 and 10 bits\n", cases);
+
+  if (failures != 0) {
+    printf("FAILED: %lu checks\n", failures);
+    exit(1);
+  }
+  printf("ALL PASSED\n");
+  exit(0);
+}
+
+void loop() {
+}
@@ -0,0 +1,87 @@
+// Sim check that a wheel ramp finishes on time in a light-sleep build.
+//
+// Runs the real motor, control and power code on the native HAL, with its
+// own setup() and loop() in place of main.cpp: one wheel is commanded from
+// 0 to 200 and the loop then idles with a long deadline, as the modes do,
+// so powerIdle() would light-sleep if it were allowed to. The S-curve
+// needs every 2 ms control period to get there in about 360 ms; if the
+// CPU sleeps through them (the control task's timer stops in light sleep)
+// the ramp stalls until the next wake.
+//
+//   g++ -std=gnu++17 -DHAL_NATIVE -DENABLE_LIGHT_SLEEP -Isrc -o rampcheck tools/rampcheck.cpp $(ls src/*.cpp | grep -v src/main.cpp)
+//   ./rampcheck
+//
+// Exits non-zero if the ramp is late or never finishes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "hal.h"
+#include "config.h"
+#include "control.h"
+#include "log.h"
+#include "motor_control.h"
+#include "motion_profile.h"
+#include "power.h"
+
+#ifdef ENABLE_SLOW_DECAY
+#error "rampcheck reads the fast-decay duty off IN1 - build it without ENABLE_SLOW_DECAY"
+#endif
+
+#define RAMP_TARGET 200
+#define RAMP_IDLE_MS 1000          // Loop deadline, like a slow mode's movement interval
+#define RAMP_SAMPLE_US 1000
+#define RAMP_TIMEOUT_MS 3000
+
+// Ideal S-curve time for the move: rise, hold at full acceleration, fall
+static const double RAMP_EXPECTED_MS =
+    (2 * PROFILE_JERK_TIME_S + (RAMP_TARGET - 2 * PROFILE_PHASE_DELTA) / PROFILE_MAX_ACCEL) * 1000;
+#define RAMP_LATE_MS 20             // Allowed over the ideal time
+#define RAMP_EARLY_PERCENT 90      // The duty rounds to the target a few ticks before the curve ends
+
+static uint32_t targetDuty = 0;
+static unsigned long startUs = 0;
+static unsigned long finishUs = 0;
+static unsigned long samples = 0;
+
+// Runs on a sim timer, so it only sees the outputs while the CPU is awake -
+// but the ramp only moves then too
+static void sampleDuty() {
+  samples++;
+  if (finishUs == 0 && halSimPwmDuty(PWM_CHANNEL_A_IN1) == targetDuty) {
+    finishUs = halMicros();
+  }
+}
+
+void setup() {
+  logInit();
+  configLoad();
+  setupMotors({robotConfig.pwmFreqHz, robotConfig.pwmResolution});
+  targetDuty = (RAMP_TARGET * getPwmMaxDuty() + 127) / 255;
+
+  halTimerStartPeriodic(sampleDuty, RAMP_SAMPLE_US);
+  startUs = halMicros();
+  driveWheels(RAMP_TARGET, 0);
+}
+
+void loop() {
+  unsigned long elapsedMs = (halMicros() - startUs) / 1000;
+  if (finishUs != 0 || elapsedMs >= RAMP_TIMEOUT_MS) {
+    logFlush();
+    if (finishUs == 0) {
+      printf("FAILED: duty %lu never reached %lu in %d ms (%lu samples)\n",
+             (unsigned long)halSimPwmDuty(PWM_CHANNEL_A_IN1), (unsigned long)targetDuty,
+             RAMP_TIMEOUT_MS, samples);
+      exit(1);
+    }
+    double rampMs = (finishUs - startUs) / 1000.0;
+    printf("0 -> %d ramp took %.1f ms (S-curve %.1f ms)\n", RAMP_TARGET, rampMs, RAMP_EXPECTED_MS);
+    if (rampMs > RAMP_EXPECTED_MS + RAMP_LATE_MS || rampMs < RAMP_EXPECTED_MS * RAMP_EARLY_PERCENT / 100) {
+      printf("FAILED: expected %.0f..%.0f ms\n", RAMP_EXPECTED_MS * RAMP_EARLY_PERCENT / 100,
+             RAMP_EXPECTED_MS + RAMP_LATE_MS);
+      exit(1);
+    }
+    printf("PASSED\n");
+    exit(0);
+  }
+  powerIdle(RAMP_IDLE_MS);
+}
@@ -0,0 +1,148 @@
+#include "robot_link.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+bool RobotLink::open(const char* path) {
+  close();
+  fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0) {
+    return false;
+  }
+  // Raw bytes both ways: no echo, no line editing, no CR/LF translation.
+  // The baud rate means nothing to USB CDC or a pty.
+  termios modes;
+  if (tcgetattr(fd, &modes) == 0) {
+    cfmakeraw(&modes);
+    tcsetattr(fd, TCSANOW, &modes);
+  }
+  tcflush(fd, TCIOFLUSH);
+  return true;
+}
+
+void RobotLink::close() {
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+// The port is non-blocking for reads; writes wait for room instead of
+// splitting a frame
+bool RobotLink::sendFrame() {
+  size_t length = writer.finish();
+  const uint8_t* data = writer.data();
+  return length != 0 && sendRaw(data, length);
+}
+
+bool RobotLink::sendRaw(const uint8_t* data, size_t length) {
+  while (length != 0) {
+    ssize_t count = ::write(fd, data, length);
+    if (count < 0) {
+      if (errno != EAGAIN && errno != EINTR) {
+        return false;
+      }
+      pollfd waitFor = {fd, POLLOUT, 0};
+      ::poll(&waitFor, 1, 100);
+      continue;
+    }
+    data += count;
+    length -= count;
+  }
+  return true;
+}
+
+bool RobotLink::sendSetpoint(uint16_t seq, int left, int right, bool brake) {
+  writer.begin(MSG_SETPOINT);
+  writer.putU16(seq);
+  writer.putI16((int16_t)left);
+  writer.putI16((int16_t)right);
+  writer.putU8(brake ? 1 : 0);    // StopMode: STOP_COAST, STOP_BRAKE
+  return sendFrame();
+}
+
+bool RobotLink::sendPing(uint32_t token) {
+  writer.begin(MSG_PING);
+  writer.putU32(token);
+  return sendFrame();
+}
+
+bool RobotLink::setTelemetryRate(uint16_t hz) {
+  writer.begin(MSG_TELEMETRY_RATE);
+  writer.putU16(hz);
+  return sendFrame();
+}
+
+void RobotLink::handleFrame() {
+  const uint8_t* p = reader.payload();
+  size_t length = reader.payloadLength();
+
+  switch (reader.type()) {
+    case MSG_TELEMETRY:
+      if (length >= MSG_TELEMETRY_LENGTH && onTelemetry) {
+        RobotTelemetry t;
+        t.seq = frameGetU16(p);
+        t.timeUs = frameGetU32(p + 2);
+        t.hostSeq = frameGetU16(p + 6);
+        t.setpoint[0] = frameGetI16(p + 8);
+        t.setpoint[1] = frameGetI16(p + 10);
+        t.output[0] = frameGetI16(p + 12);
+        t.output[1] = frameGetI16(p + 14);
+        t.encoder[0] = frameGetI32(p + 16);
+        t.encoder[1] = frameGetI32(p + 20);
+        t.currentMa = frameGetU16(p + 24);
+        t.flags = p[26];
+        t.robotRejected = frameGetU16(p + 27);
+        onTelemetry(t);
+      }
+      break;
+
+    case MSG_PONG:
+      if (length >= MSG_PONG_LENGTH && onPong) {
+        onPong(frameGetU32(p), frameGetU32(p + 4));
+      }
+      break;
+
+    case MSG_LOG:
+      if (onLog) {
+        onLog((const char*)p, length);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+int RobotLink::poll(int timeoutMs) {
+  pollfd waitFor = {fd, POLLIN, 0};
+  if (::poll(&waitFor, 1, timeoutMs) < 0) {
+    return errno == EINTR ? 0 : -1;
+  }
+
+  int frames = 0;
+  uint8_t received[4096];
+  for (;;) {
+    ssize_t count = ::read(fd, received, sizeof(received));
+    if (count < 0) {
+      if (errno == EAGAIN || errno == EINTR) {
+        break;
+      }
+      return -1;
+    }
+    if (count == 0) {
+      break;
+    }
+    receivedBytes += count;
+    for (ssize_t i = 0; i < count; i++) {
+      if (reader.feed(received[i])) {
+        handleFrame();
+        frames++;
+      }
+    }
+  }
+  return frames;
+}
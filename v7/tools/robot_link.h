@@ -0,0 +1,68 @@
+// Linux client for the v7 binary serial link (src/protocol.h).
+//
+// Opens the robot's USB serial port (or the native build's --pty link) in
+// raw mode and speaks the framed protocol through src/frame.h, so host and
+// firmware share one encoder and decoder. Build it into a tool with:
+//
+//   g++ -O2 -Isrc tools/your_tool.cpp tools/robot_link.cpp src/frame.cpp src/crc.cpp
+//
+// Received frames are handed to the callbacks from poll(), on the calling
+// thread.
+
+#ifndef ROBOT_LINK_H
+#define ROBOT_LINK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include "frame.h"
+#include "protocol.h"
+
+// A decoded MSG_TELEMETRY frame
+struct RobotTelemetry {
+  uint16_t seq;
+  uint32_t timeUs;
+  uint16_t hostSeq;
+  int16_t setpoint[2];
+  int16_t output[2];
+  int32_t encoder[2];
+  uint16_t currentMa;
+  uint8_t flags;
+  uint16_t robotRejected;     // Frames the robot has thrown away
+};
+
+class RobotLink {
+public:
+  ~RobotLink() { close(); }
+
+  bool open(const char* path);
+  void close();
+
+  // Each send writes one whole frame; false if the port failed
+  bool sendSetpoint(uint16_t seq, int left, int right, bool brake = false);
+  bool sendPing(uint32_t token);
+  bool setTelemetryRate(uint16_t hz);
+  bool sendRaw(const uint8_t* data, size_t length);
+
+  // Waits up to timeoutMs for input, then decodes everything that has
+  // arrived. Returns the number of good frames, or -1 if the port failed.
+  int poll(int timeoutMs);
+
+  std::function<void(const RobotTelemetry&)> onTelemetry;
+  std::function<void(uint32_t token, uint32_t robotUs)> onPong;
+  std::function<void(const char* text, size_t length)> onLog;
+
+  uint32_t rxErrors() const { return reader.errors(); }
+  uint64_t rxBytes() const { return receivedBytes; }
+
+private:
+  bool sendFrame();
+  void handleFrame();
+
+  int fd = -1;
+  FrameReader reader;
+  FrameWriter writer;
+  uint64_t receivedBytes = 0;
+};
+
+#endif // ROBOT_LINK_H
@@ -0,0 +1,225 @@
+// Host benchmark and check for the v7 timer wheel (src/scheduler.cpp).
+//
+// Links the real scheduler against a fake millisecond clock. Thousands of
+// one-shot timers with delays spread over all three levels are added, a
+// random share of them cancelled, and the clock then run past the last
+// one twice: a tick at a time, and jumping straight to
+// schedulerTimeUntilNext() as the loop's idle does. Every tick must fire
+// exactly the timers due on it, and the reported wait must never pass the
+// next one due. Periodic timers are then run for a simulated minute and
+// checked the same way. Along the way it times schedulerAdd(),
+// schedulerCancel() and the expiry of each timer.
+//
+//   g++ -std=gnu++17 -O2 -DHAL_NATIVE -Isrc -o schedbench tools/schedbench.cpp src/scheduler.cpp
+//   ./schedbench [--timers N] [--seed N]
+//
+// Exits non-zero if any timer fires on the wrong tick or the wait
+// oversleeps.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "scheduler.h"
+
+#define SCHED_START_MS 0xfffe0000UL     // Close enough to 2^32 that the ticks wrap during the run
+#define SCHED_CANCEL_PERCENT 10
+#define SCHED_PERIODIC_RUN_MS 60000
+#define SCHED_PERIODIC_MAX_MS 5000
+
+static uint32_t randomState = 1;
+
+// xorshift32: fast, and the same sequence everywhere for a given seed
+static uint32_t nextRandom() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+// The scheduler's only dependency on the HAL
+static unsigned long fakeMillis = 0;
+
+unsigned long halMillis() {
+  return fakeMillis;
+}
+
+static unsigned long failures = 0;
+
+// Fires per tick since the start of a run, expected and seen
+static std::vector<uint32_t> expected;
+static std::vector<uint32_t> fired;
+static unsigned long firedTotal = 0;
+static unsigned long passes = 0;     // schedulerRun() calls in the run
+
+static void onExpire() {
+  unsigned long tick = fakeMillis - SCHED_START_MS;
+  if (tick < fired.size()) {
+    fired[tick]++;
+  }
+  firedTotal++;
+}
+
+static double nsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Delays log-uniform over 1 ms .. the wheel's range, so each level and
+// every cascade boundary get their share
+static uint32_t randomDelay() {
+  int bits = 1 + nextRandom() % 20;
+  uint32_t delay = nextRandom() & ((1UL << bits) - 1);
+  if (delay == 0) {
+    delay = 1;
+  }
+  return delay > SCHEDULER_MAX_DELAY_MS ? SCHEDULER_MAX_DELAY_MS : delay;
+}
+
+// Runs the clock from the start to endTick, a tick at a time or jumping
+// to each wake-up the scheduler reports. Returns the ns spent in the
+// scheduler.
+static double runClock(uint32_t endTick, bool jump, const char* name) {
+  // The next tick anything is due on, from each tick
+  std::vector<uint32_t> nextDue(endTick + 2, UINT32_MAX);
+  for (uint32_t tick = endTick + 1; tick-- > 0;) {
+    nextDue[tick] = expected[tick] != 0 ? tick : nextDue[tick + 1];
+  }
+
+  double ns = 0;
+  unsigned long oversleeps = 0;
+  passes = 0;
+  fakeMillis = SCHED_START_MS;
+  while (fakeMillis - SCHED_START_MS <= endTick) {
+    auto start = std::chrono::steady_clock::now();
+    schedulerRun();
+    uint32_t wait = schedulerTimeUntilNext();
+    ns += nsSince(start);
+    passes++;
+
+    uint32_t tick = fakeMillis - SCHED_START_MS;
+    if (wait == 0) {
+      if (oversleeps++ < 10) {
+        printf("FAIL %s: nothing ran at tick %lu but a timer is due\n", name, (unsigned long)tick);
+      }
+    } else if (tick + 1 <= endTick && tick + wait > nextDue[tick + 1]) {
+      if (oversleeps++ < 10) {
+        printf("FAIL %s: at tick %lu waits %lu ms, but a timer is due at %lu\n", name,
+               (unsigned long)tick, (unsigned long)wait, (unsigned long)nextDue[tick + 1]);
+      }
+    }
+    fakeMillis += jump && wait != 0 ? wait : 1;
+  }
+  failures += oversleeps;
+
+  unsigned long wrong = 0;
+  for (uint32_t tick = 0; tick <= endTick; tick++) {
+    if (fired[tick] != expected[tick] && wrong++ < 10) {
+      printf("FAIL %s: tick %lu fired %lu timers, expected %lu\n", name, (unsigned long)tick,
+             (unsigned long)fired[tick], (unsigned long)expected[tick]);
+    }
+  }
+  failures += wrong;
+  return ns;
+}
+
+static void resetRun(uint32_t endTick) {
+  expected.assign(endTick + 1, 0);
+  fired.assign(endTick + 1, 0);
+  firedTotal = 0;
+  fakeMillis = SCHED_START_MS;
+  schedulerInit();
+}
+
+static void checkOneShot(unsigned long count, bool jump) {
+  const char* name = jump ? "one-shot, idle jumps" : "one-shot, every tick";
+  uint32_t endTick = SCHEDULER_MAX_DELAY_MS + 1;
+  resetRun(endTick);
+
+  std::vector<SchedulerTimer> timers(count);
+  std::vector<uint32_t> delays(count);
+  for (uint32_t& delay : delays) {
+    delay = randomDelay();
+    expected[delay]++;
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < count; i++) {
+    schedulerAdd(&timers[i], onExpire, delays[i]);
+  }
+  double addNs = nsSince(start);
+
+  std::vector<unsigned long> cancels;
+  for (unsigned long i = 0; i < count; i++) {
+    if (nextRandom() % 100 < SCHED_CANCEL_PERCENT) {
+      cancels.push_back(i);
+      expected[delays[i]]--;
+    }
+  }
+  start = std::chrono::steady_clock::now();
+  for (unsigned long i : cancels) {
+    schedulerCancel(&timers[i]);
+  }
+  double cancelNs = nsSince(start);
+
+  double runNs = runClock(endTick, jump, name);
+  unsigned long expires = count - cancels.size();
+  for (unsigned long i = 0; i < count; i++) {
+    if (schedulerIsActive(&timers[i])) {
+      printf("FAIL %s: timer %lu still active after the run\n", name, i);
+      failures++;
+      break;
+    }
+  }
+  printf("%s: %lu timers, %zu cancelled, %lu fired in %lu passes; add %.1f ns, cancel %.1f ns, "
+         "%.1f ns per expiry\n",
+         name, count, cancels.size(), firedTotal, passes, addNs / count,
+         cancels.empty() ? 0.0 : cancelNs / cancels.size(), runNs / expires);
+}
+
+static void checkPeriodic(unsigned long count) {
+  uint32_t endTick = SCHED_PERIODIC_RUN_MS;
+  resetRun(endTick);
+
+  std::vector<SchedulerTimer> timers(count);
+  for (unsigned long i = 0; i < count; i++) {
+    uint32_t period = 1 + nextRandom() % SCHED_PERIODIC_MAX_MS;
+    uint32_t delay = 1 + nextRandom() % SCHED_PERIODIC_MAX_MS;
+    schedulerAdd(&timers[i], onExpire, delay, period);
+    for (uint32_t tick = delay; tick <= endTick; tick += period) {
+      expected[tick]++;
+    }
+  }
+
+  double runNs = runClock(endTick, true, "periodic");
+  for (SchedulerTimer& timer : timers) {
+    schedulerCancel(&timer);
+  }
+  printf("periodic: %lu timers over %lu ms, %lu fired in %lu passes; %.1f ns per expiry\n", count,
+         (unsigned long)endTick, firedTotal, passes, runNs / (firedTotal != 0 ? firedTotal : 1));
+}
+
+int main(int argc, char** argv) {
+  unsigned long timers = 10000;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--timers") && i + 1 < argc) {
+      timers = strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      randomState = strtoul(argv[++i], nullptr, 0) | 1;
+    } else {
+      fprintf(stderr, "usage: %s [--timers N] [--seed N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  checkOneShot(timers, false);
+  checkOneShot(timers, true);
+  checkPeriodic(timers / 10);
+
+  if (failures != 0) {
+    printf("FAILED: %lu checks\n", failures);
+    return 1;
+  }
+  printf("ALL PASSED\n");
+  return 0;
+}
@@ -0,0 +1,233 @@
+// Host check and benchmark for the v7 current sense window fold
+// (src/current_window.h, which currentSenseProcess() runs per sample).
+//
+// Feeds whole windows of synthetic shunt samples through
+// currentWindowAdd() and checks currentWindowStats() against the same
+// figures worked out in double: DC at every ADC level (peak, mean and RMS
+// all equal the level), square waves of each duty and period (mean
+// H*d, RMS H*sqrt(d)), and a PWM-chopped motor current - a rise while the
+// bridge drives, an exponential decay while it recirculates, plus ADC
+// noise. Peak must be exact; mean and RMS round down, so each must be at
+// most one count below the exact value and never above it. A stream
+// several windows long must close a window every
+// CURRENT_SENSE_WINDOW_SAMPLES samples and no other time. Last, it times
+// the fold over 1000 chopped samples and reports ns per 1000.
+//
+//   g++ -std=gnu++17 -O2 -Isrc -o sensecheck tools/sensecheck.cpp src/current_window.cpp
+//   ./sensecheck [--runs N] [--seed N]
+//
+// Exits non-zero if any check fails.
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "current_window.h"
+
+#define SENSE_FULL_SCALE 4095          // HAL_ADC_STREAM_FULL_SCALE: 12-bit conversions
+#define SENSE_TIMED_SAMPLES 1000
+
+static uint32_t randomState = 1;
+
+// xorshift32: fast, and the same sequence everywhere for a given seed
+static uint32_t nextRandom() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+static unsigned long failures = 0;
+
+static void check(bool ok, const char* what) {
+  if (!ok && failures++ < 20) {
+    printf("FAIL %s\n", what);
+  }
+}
+
+// Runs one window through the fold and checks it against double
+static void checkWindow(const uint16_t* samples, const char* what) {
+  SenseAccumulator acc;
+  currentWindowReset(acc);
+  uint16_t peak = 0;
+  double sum = 0;
+  double sumSquares = 0;
+  bool closedWrong = false;
+  for (int i = 0; i < CURRENT_SENSE_WINDOW_SAMPLES; i++) {
+    bool full = currentWindowAdd(acc, samples[i]);
+    closedWrong |= full != (i == CURRENT_SENSE_WINDOW_SAMPLES - 1);
+    peak = samples[i] > peak ? samples[i] : peak;
+    sum += samples[i];
+    sumSquares += (double)samples[i] * samples[i];
+  }
+  SenseWindowStats stats = currentWindowStats(acc);
+  double mean = sum / CURRENT_SENSE_WINDOW_SAMPLES;
+  double rms = sqrt(sumSquares / CURRENT_SENSE_WINDOW_SAMPLES);
+
+  bool ok = !closedWrong && stats.peak == peak && stats.mean <= mean && stats.mean > mean - 1 &&
+            stats.rms <= rms + 1e-9 && stats.rms > rms - 1;
+  if (!ok && failures++ < 20) {
+    printf("FAIL %s: peak %u mean %u rms %u, expected %u %.2f %.2f\n", what, stats.peak, stats.mean, stats.rms,
+           peak, mean, rms);
+  }
+}
+
+static void checkDc() {
+  uint16_t samples[CURRENT_SENSE_WINDOW_SAMPLES];
+  for (int level = 0; level <= SENSE_FULL_SCALE; level++) {
+    for (int i = 0; i < CURRENT_SENSE_WINDOW_SAMPLES; i++) {
+      samples[i] = level;
+    }
+    checkWindow(samples, "DC");
+
+    SenseAccumulator acc;
+    currentWindowReset(acc);
+    for (int i = 0; i < CURRENT_SENSE_WINDOW_SAMPLES; i++) {
+      currentWindowAdd(acc, level);
+    }
+    SenseWindowStats stats = currentWindowStats(acc);
+    check(stats.peak == level && stats.mean == level && stats.rms == level, "DC figures not all the level");
+  }
+  printf("DC: every level 0..%d, full scale without overflow\n", SENSE_FULL_SCALE);
+}
+
+// High for onSamples of every period, low for the rest
+static void checkSquare() {
+  static const int periods[] = {2, 4, 8, 10, 20, 25, 40, 50, 100, 200};
+  static const uint16_t highs[] = {1, 100, 1000, 2047, SENSE_FULL_SCALE};
+  uint16_t samples[CURRENT_SENSE_WINDOW_SAMPLES];
+  unsigned long cases = 0;
+  for (int period : periods) {
+    for (int onSamples = 0; onSamples <= period; onSamples++) {
+      for (uint16_t high : highs) {
+        for (int i = 0; i < CURRENT_SENSE_WINDOW_SAMPLES; i++) {
+          samples[i] = i % period < onSamples ? high : 0;
+        }
+        checkWindow(samples, "square");
+
+        // Whole periods in the window: mean H*d, RMS H*sqrt(d)
+        SenseAccumulator acc;
+        currentWindowReset(acc);
+        for (int i = 0; i < CURRENT_SENSE_WINDOW_SAMPLES; i++) {
+          currentWindowAdd(acc, samples[i]);
+        }
+        SenseWindowStats stats = currentWindowStats(acc);
+        double duty = (double)onSamples / period;
+        check(stats.mean == (uint16_t)floor(high * duty + 1e-9) &&
+                  stats.rms == (uint16_t)floor(high * sqrt(duty) + 1e-9),
+              "square wave mean or RMS");
+        cases++;
+      }
+    }
+  }
+  printf("Square: %lu period x duty x level cases\n", cases);
+}
+
+// One sample of a PWM-chopped motor current, in counts: the current rises
+// towards the stall level while the bridge drives and decays while it
+// recirculates, with a few counts of ADC noise on top
+static uint16_t chopped(int i, int period, int onSamples, double stall, double& current) {
+  double target = i % period < onSamples ? stall : 0;
+  current += (target - current) * 0.3;
+  int noisy = (int)current + (int)(nextRandom() % 9) - 4;
+  return noisy < 0 ? 0 : (noisy > SENSE_FULL_SCALE ? SENSE_FULL_SCALE : noisy);
+}
+
+static void checkChopped() {
+  uint16_t samples[CURRENT_SENSE_WINDOW_SAMPLES];
+  unsigned long windows = 0;
+  for (int period = 4; period <= 40; period += 3) {
+    for (int onSamples = 1; onSamples < period; onSamples++) {
+      double stall = 200 + nextRandom() % (SENSE_FULL_SCALE - 200);
+      double current = 0;
+      for (int i = 0; i < CURRENT_SENSE_WINDOW_SAMPLES; i++) {
+        samples[i] = chopped(i, period, onSamples, stall, current);
+      }
+      checkWindow(samples, "PWM-chopped");
+      windows++;
+    }
+  }
+  printf("PWM-chopped: %lu windows of rise, decay and noise\n", windows);
+}
+
+// A stream several windows long closes one every window's worth, and the
+// figures start over each time
+static void checkStream() {
+  SenseAccumulator acc;
+  currentWindowReset(acc);
+  int closed = 0;
+  int windows = 7;
+  for (int i = 0; i < windows * CURRENT_SENSE_WINDOW_SAMPLES + CURRENT_SENSE_WINDOW_SAMPLES / 2; i++) {
+    uint16_t level = 100 * (i / CURRENT_SENSE_WINDOW_SAMPLES + 1);
+    if (currentWindowAdd(acc, level)) {
+      check((i + 1) % CURRENT_SENSE_WINDOW_SAMPLES == 0, "window closed off its boundary");
+      SenseWindowStats stats = currentWindowStats(acc);
+      check(stats.peak == level && stats.mean == level && stats.rms == level, "window carried the last one over");
+      currentWindowReset(acc);
+      closed++;
+    }
+  }
+  check(closed == windows, "windows closed in the stream");
+  currentWindowReset(acc);
+  SenseWindowStats empty = currentWindowStats(acc);
+  check(empty.peak == 0 && empty.mean == 0 && empty.rms == 0, "empty window");
+  printf("Stream: %d windows of %d samples, then a half window left open\n", closed, CURRENT_SENSE_WINDOW_SAMPLES);
+}
+
+// Best of runs, timing the fold over SENSE_TIMED_SAMPLES chopped samples
+// with the window stats taken as they close, as currentSenseProcess() does
+static void timeFold(unsigned long runs) {
+  static uint16_t samples[SENSE_TIMED_SAMPLES];
+  double current = 0;
+  for (int i = 0; i < SENSE_TIMED_SAMPLES; i++) {
+    samples[i] = chopped(i, 16, 6, 1500, current);
+  }
+
+  SenseAccumulator acc;
+  currentWindowReset(acc);
+  uint32_t sink = 0;
+  double best = 1e30;
+  for (unsigned long run = 0; run < runs; run++) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < SENSE_TIMED_SAMPLES; i++) {
+      if (currentWindowAdd(acc, samples[i])) {
+        SenseWindowStats stats = currentWindowStats(acc);
+        sink += stats.peak + stats.mean + stats.rms;
+        currentWindowReset(acc);
+      }
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    best = ns < best ? ns : best;
+  }
+  printf("Fold: %.0f ns per %d samples, best of %lu runs (checksum %lu)\n", best, SENSE_TIMED_SAMPLES, runs,
+         (unsigned long)sink);
+}
+
+int main(int argc, char** argv) {
+  unsigned long runs = 1000;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--runs") && i + 1 < argc) {
+      runs = strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      randomState = strtoul(argv[++i], nullptr, 0) | 1;
+    } else {
+      fprintf(stderr, "usage: %s [--runs N] [--seed N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  checkDc();
+  checkSquare();
+  checkChopped();
+  checkStream();
+  timeFold(runs);
+
+  if (failures != 0) {
+    printf("FAILED: %lu checks\n", failures);
+    return 1;
+  }
+  printf("ALL PASSED\n");
+  return 0;
+}
@@ -0,0 +1,564 @@
+// End-to-end test and benchmark for v7 teleoperation over UDP (src/teleop.h).
+//
+// Runs the native build with --udp-port (or talks to a robot on the
+// network) as an operator would, streaming COMMAND datagrams, and:
+//
+//   1. streams over a clean path and checks every command is acknowledged,
+//   2. streams through injected loss and jitter (which reorders datagrams)
+//      and checks the robot takes commands strictly in order, counting
+//      every one it threw away as stale,
+//   3. sends a command that was held up longer than the deadman window and
+//      checks the robot refuses it,
+//   4. checks a second operator can't take over an engaged robot,
+//   5. goes quiet and checks the deadman stops the robot no sooner than
+//      its window, then that a new operator can take over,
+//
+// and prints the round-trip histogram the robot exports, next to the one
+// measured here. The impairment applies to the operator -> robot
+// direction, as on a flaky uplink. Each check prints PASS or FAIL and the
+// exit status is non-zero if any failed. From the v7 directory:
+//
+//   g++ -std=gnu++17 -O1 -DHAL_NATIVE -DENABLE_TELEOP -Isrc -o program src/*.cpp
+//   g++ -std=gnu++17 -O2 -pthread -Isrc -o teleopbench tools/teleopbench.cpp
+//   ./teleopbench --firmware ./program [--port N] [--seconds N] [--rate HZ] [--loss PCT] [--jitter MS] [--verbose]
+//   ./teleopbench --robot 192.168.1.50 [--port N] ...
+//
+// A robot must be built with -DENABLE_TELEOP and will drive its wheels -
+// lift them off the ground.
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "frame.h"
+#include "teleop.h"
+
+#define STATS_TIMEOUT_MS 200
+#define DEADMAN_MARGIN_MS 20          // Allowed beyond the deadman window (a teleop period plus polling)
+#define SETTLE_MS 100                 // Wait for datagrams still in flight
+
+typedef std::chrono::steady_clock Clock;
+
+static int sock = -1;
+static bool verbose = false;
+static int failures = 0;
+static uint32_t randomState = 1;
+
+// Operator state
+static uint32_t session = 0;
+static uint32_t seq = 0;
+static uint32_t echoRobotUs = 0;         // Robot time on the newest ACK
+static Clock::time_point echoReceivedAt;
+static uint32_t newestAckSeq = 0;
+
+// What came back
+struct Ack {
+  uint32_t seq;
+  uint32_t robotUs;
+  uint8_t flags;
+};
+
+struct RobotStats {
+  uint32_t session;
+  uint32_t accepted;
+  uint32_t stale;
+  uint32_t foreign;
+  uint32_t malformed;
+  uint32_t deadmanStops;
+  uint32_t msSinceCommand;
+  uint16_t deadmanMs;
+  uint8_t flags;
+  uint32_t rtt[TELEOP_RTT_BUCKETS];
+};
+
+static std::vector<Ack> acks;
+static std::vector<Clock::time_point> sentAt;   // By seq
+static std::vector<double> hostRttUs;
+static bool haveStats = false;
+static RobotStats lastStats = {};
+
+// Datagrams held back by the injected jitter, soonest first
+struct Delayed {
+  Clock::time_point due;
+  std::vector<uint8_t> data;
+  bool operator<(const Delayed& other) const { return due > other.due; }
+};
+static std::priority_queue<Delayed> delayed;
+static double lossFraction = 0;
+static int jitterMs = 0;
+static uint64_t dropped = 0;
+static uint64_t delivered = 0;
+
+static uint32_t nextRandom() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+static void check(bool ok, const char* what) {
+  printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok) {
+    failures++;
+  }
+}
+
+static double microsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+static uint32_t operatorMicros() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+}
+
+static double percentile(std::vector<double> values, double fraction) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  size_t index = std::min(values.size() - 1, (size_t)(values.size() * fraction));
+  return values[index];
+}
+
+static uint8_t* putU16(uint8_t* p, uint16_t value) {
+  p[0] = value;
+  p[1] = value >> 8;
+  return p + 2;
+}
+
+static uint8_t* putU32(uint8_t* p, uint32_t value) {
+  p = putU16(p, value);
+  return putU16(p, value >> 16);
+}
+
+static uint8_t* putHeader(uint8_t* p, uint8_t type, uint32_t from) {
+  p = putU16(p, TELEOP_MAGIC);
+  *p++ = TELEOP_VERSION;
+  *p++ = type;
+  return putU32(p, from);
+}
+
+static void sendNow(const std::vector<uint8_t>& data) {
+  send(sock, data.data(), data.size(), 0);
+  delivered++;
+}
+
+// Through the impairment: dropped, delayed or sent at once
+static void sendImpaired(const std::vector<uint8_t>& data) {
+  if (lossFraction > 0 && nextRandom() % 10000 < lossFraction * 10000) {
+    dropped++;
+    return;
+  }
+  if (jitterMs > 0) {
+    delayed.push({Clock::now() + std::chrono::microseconds(nextRandom() % (jitterMs * 1000)), data});
+    return;
+  }
+  sendNow(data);
+}
+
+static void releaseDue() {
+  while (!delayed.empty() && delayed.top().due <= Clock::now()) {
+    sendNow(delayed.top().data);
+    delayed.pop();
+  }
+}
+
+static std::vector<uint8_t> makeCommand(uint32_t from, uint32_t number, int left, int right, uint32_t operatorUs) {
+  std::vector<uint8_t> data(TELEOP_COMMAND_LENGTH);
+  uint8_t* p = putHeader(data.data(), TELEOP_COMMAND, from);
+  p = putU32(p, number);
+  p = putU16(p, (uint16_t)left);
+  p = putU16(p, (uint16_t)right);
+  *p++ = 0;
+  *p++ = 0;
+  p = putU32(p, operatorUs);
+  p = putU32(p, echoRobotUs);
+  putU32(p, echoRobotUs != 0 ? (uint32_t)microsSince(echoReceivedAt) : 0);
+  return data;
+}
+
+// The wheel speeds streamed with each sequence number
+static int leftFor(uint32_t number) {
+  return (int)(number % 401) - 200;
+}
+
+static int rightFor(uint32_t number) {
+  return 200 - (int)(number % 401);
+}
+
+static void sendCommand() {
+  seq++;
+  if (sentAt.size() <= seq) {
+    sentAt.resize(seq + 1024);
+  }
+  sentAt[seq] = Clock::now();
+  sendImpaired(makeCommand(session, seq, leftFor(seq), rightFor(seq), operatorMicros()));
+}
+
+static void handleDatagram(const uint8_t* data, size_t length) {
+  if (length < TELEOP_HEADER_LENGTH || frameGetU16(data) != TELEOP_MAGIC) {
+    return;
+  }
+  if (data[3] == TELEOP_ACK && length == TELEOP_ACK_LENGTH) {
+    Ack ack = {frameGetU32(data + 8), frameGetU32(data + 16), data[20]};
+    acks.push_back(ack);
+    if (ack.seq < sentAt.size()) {
+      hostRttUs.push_back(microsSince(sentAt[ack.seq]));
+    }
+    if (ack.seq > newestAckSeq) {
+      newestAckSeq = ack.seq;
+      echoRobotUs = ack.robotUs;
+      echoReceivedAt = Clock::now();
+    }
+  } else if (data[3] == TELEOP_STATS && length == TELEOP_STATS_LENGTH) {
+    RobotStats& s = lastStats;
+    s.session = frameGetU32(data + 4);
+    s.accepted = frameGetU32(data + 8);
+    s.stale = frameGetU32(data + 12);
+    s.foreign = frameGetU32(data + 16);
+    s.malformed = frameGetU32(data + 20);
+    s.deadmanStops = frameGetU32(data + 24);
+    s.msSinceCommand = frameGetU32(data + 28);
+    s.deadmanMs = frameGetU16(data + 32);
+    s.flags = data[34];
+    for (int bucket = 0; bucket < TELEOP_RTT_BUCKETS; bucket++) {
+      s.rtt[bucket] = frameGetU32(data + 36 + 4 * bucket);
+    }
+    haveStats = true;
+  }
+}
+
+// Waits up to timeoutMs for datagrams (releasing delayed ones meanwhile)
+static void pollFor(int timeoutMs) {
+  Clock::time_point end = Clock::now() + std::chrono::milliseconds(timeoutMs);
+  do {
+    releaseDue();
+    int waitMs = (int)std::chrono::duration_cast<std::chrono::milliseconds>(end - Clock::now()).count();
+    if (!delayed.empty()) {
+      int dueMs = (int)std::chrono::duration_cast<std::chrono::milliseconds>(delayed.top().due - Clock::now()).count();
+      waitMs = std::min(waitMs, dueMs);
+    }
+    pollfd entry = {sock, POLLIN, 0};
+    if (poll(&entry, 1, std::max(waitMs, 0)) > 0) {
+      uint8_t data[256];
+      ssize_t length;
+      while ((length = recv(sock, data, sizeof(data), MSG_DONTWAIT)) > 0) {
+        handleDatagram(data, (size_t)length);
+      }
+    }
+  } while (Clock::now() < end);
+}
+
+static bool requestStats() {
+  uint8_t request[TELEOP_STATS_REQUEST_LENGTH];
+  putHeader(request, TELEOP_STATS_REQUEST, session);
+  haveStats = false;
+  send(sock, request, sizeof(request), 0);
+  Clock::time_point start = Clock::now();
+  while (!haveStats && microsSince(start) < STATS_TIMEOUT_MS * 1000.0) {
+    pollFor(1);
+  }
+  return haveStats;
+}
+
+// Streams commands at rateHz for the given time
+static void stream(int rateHz, double seconds) {
+  Clock::time_point end = Clock::now() + std::chrono::microseconds((long long)(seconds * 1e6));
+  Clock::time_point nextSend = Clock::now();
+  while (Clock::now() < end) {
+    if (Clock::now() >= nextSend) {
+      sendCommand();
+      nextSend += std::chrono::microseconds(1000000 / rateHz);
+    }
+    int waitMs = (int)std::chrono::duration_cast<std::chrono::milliseconds>(nextSend - Clock::now()).count();
+    pollFor(std::max(waitMs, 0));
+  }
+  // Let delayed datagrams and their ACKs arrive
+  while (!delayed.empty()) {
+    pollFor(1);
+  }
+  pollFor(SETTLE_MS);
+}
+
+// True if the ACKs, in the order the robot sent them, are for ever newer
+// commands and carry the right session
+static bool acksInOrder(size_t from) {
+  for (size_t i = from + 1; i < acks.size(); i++) {
+    if ((int32_t)(acks[i].robotUs - acks[i - 1].robotUs) < 0 || acks[i].seq <= acks[i - 1].seq) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void printRobotHistogram() {
+  uint32_t total = 0;
+  for (int bucket = 0; bucket < TELEOP_RTT_BUCKETS; bucket++) {
+    total += lastStats.rtt[bucket];
+  }
+  printf("robot round-trip histogram (%u samples):\n", total);
+  uint32_t low = 0;
+  for (int bucket = 0; bucket < TELEOP_RTT_BUCKETS; bucket++) {
+    uint32_t high = teleopRttBucketLimit(bucket);
+    if (lastStats.rtt[bucket] != 0) {
+      if (high == UINT32_MAX) {
+        printf("  >= %7u us: %u\n", low, lastStats.rtt[bucket]);
+      } else {
+        printf("  %7u..%7u us: %u\n", low, high, lastStats.rtt[bucket]);
+      }
+    }
+    low = high;
+  }
+}
+
+static void printHostLatency(const char* name) {
+  printf("%s: n=%zu min=%.0f median=%.0f p99=%.0f max=%.0f us\n", name, hostRttUs.size(),
+         percentile(hostRttUs, 0), percentile(hostRttUs, 0.5), percentile(hostRttUs, 0.99), percentile(hostRttUs, 1));
+}
+
+static void testClean(int rateHz, int seconds) {
+  requestStats();
+  RobotStats before = lastStats;
+  size_t acksBefore = acks.size();
+  uint32_t seqBefore = seq;
+  hostRttUs.clear();
+
+  stream(rateHz, seconds);
+  requestStats();
+  uint32_t sent = seq - seqBefore;
+  printf("clean: %u commands sent, %zu acknowledged\n", sent, acks.size() - acksBefore);
+  printHostLatency("command to ACK");
+  check(acks.size() - acksBefore == sent, "every command acknowledged");
+  check(lastStats.stale == before.stale && lastStats.malformed == before.malformed, "nothing thrown away");
+  check((lastStats.flags & TELEOP_FLAG_ENGAGED) != 0 && (lastStats.flags & TELEOP_FLAG_DEADMAN) == 0,
+        "robot engaged");
+}
+
+static void testImpaired(int rateHz, int seconds, double loss, int jitter) {
+  requestStats();
+  RobotStats before = lastStats;
+  size_t acksBefore = acks.size();
+  uint64_t deliveredBefore = delivered;
+  uint64_t droppedBefore = dropped;
+  hostRttUs.clear();
+
+  lossFraction = loss;
+  jitterMs = jitter;
+  stream(rateHz, seconds);
+  lossFraction = 0;
+  jitterMs = 0;
+  requestStats();
+
+  uint64_t arrived = delivered - deliveredBefore;
+  uint32_t taken = lastStats.accepted - before.accepted;
+  uint32_t stale = lastStats.stale - before.stale;
+  printf("impaired (%.0f%% loss, 0..%d ms jitter): %llu dropped, %llu delivered, %u taken, %u stale\n",
+         loss * 100, jitter, (unsigned long long)(dropped - droppedBefore), (unsigned long long)arrived, taken, stale);
+  printHostLatency("command to ACK");
+  check(acksInOrder(acksBefore), "commands taken strictly in order");
+  check(acks.size() - acksBefore == taken, "every command taken is acknowledged");
+  check(taken + stale == arrived, "every other command counted stale");
+  // Jitter longer than the command interval reorders some
+  check(jitter * rateHz < 1000 || stale != 0, "reordered commands seen");
+}
+
+// Both send a command first so the deadman doesn't fire meanwhile
+static void testLate() {
+  sendCommand();
+  pollFor(SETTLE_MS / 10);
+  requestStats();
+  RobotStats before = lastStats;
+  size_t acksBefore = acks.size();
+
+  // A fresh sequence number, but stamped long before the last command
+  seq++;
+  sendNow(makeCommand(session, seq, 0, 0, operatorMicros() - 3 * before.deadmanMs * 1000u));
+  pollFor(SETTLE_MS);
+  requestStats();
+  check(lastStats.stale == before.stale + 1 && acks.size() == acksBefore, "late command refused");
+}
+
+static void testForeign() {
+  sendCommand();
+  pollFor(SETTLE_MS / 10);
+  requestStats();
+  RobotStats before = lastStats;
+  size_t acksBefore = acks.size();
+  sendNow(makeCommand(session + 1, 1, 255, 255, operatorMicros()));
+  pollFor(SETTLE_MS / 2);
+  requestStats();
+  check(lastStats.foreign == before.foreign + 1 && acks.size() == acksBefore, "second operator refused while engaged");
+}
+
+static void testDeadman(int rateHz) {
+  // Keep the robot fed, then go quiet
+  stream(rateHz, 0.2);
+  requestStats();
+  RobotStats before = lastStats;
+  uint32_t deadmanMs = before.deadmanMs;
+  sendCommand();
+  Clock::time_point lastSent = Clock::now();
+
+  double stoppedAfterMs = -1;
+  while (microsSince(lastSent) < (deadmanMs + DEADMAN_MARGIN_MS + 100) * 1000.0) {
+    if (!requestStats()) {
+      continue;
+    }
+    double sinceMs = microsSince(lastSent) / 1000;
+    if ((lastStats.flags & TELEOP_FLAG_DEADMAN) != 0) {
+      stoppedAfterMs = sinceMs;
+      break;
+    }
+    pollFor(2);
+  }
+  printf("deadman (%u ms): stopped %.0f ms after the last command\n", deadmanMs, stoppedAfterMs);
+  check(stoppedAfterMs >= deadmanMs && stoppedAfterMs <= deadmanMs + DEADMAN_MARGIN_MS,
+        "deadman stops the robot on time");
+  check(lastStats.deadmanStops == before.deadmanStops + 1, "deadman stop counted");
+
+  // Now a new operator may take over, with its own numbering
+  session++;
+  seq = 0;
+  newestAckSeq = 0;
+  echoRobotUs = 0;
+  size_t acksBefore = acks.size();
+  sendCommand();
+  pollFor(SETTLE_MS);
+  requestStats();
+  check(acks.size() == acksBefore + 1 && lastStats.session == session &&
+        (lastStats.flags & TELEOP_FLAG_DEADMAN) == 0, "new operator takes over after the deadman");
+}
+
+// Starts the native build listening on a loopback UDP port
+static bool startFirmware(const char* program, int port, int seconds, pid_t* child) {
+  int output[2];
+  if (pipe(output) != 0) {
+    return false;
+  }
+  *child = fork();
+  if (*child == 0) {
+    dup2(output[1], STDOUT_FILENO);
+    close(output[0]);
+    std::string udpPort = std::to_string(port);
+    std::string runSeconds = std::to_string(seconds);
+    execl(program, program, "--udp-port", udpPort.c_str(), "--seconds", runSeconds.c_str(), "--seed", "42",
+          (char*)nullptr);
+    _exit(127);
+  }
+  close(output[1]);
+
+  FILE* lines = fdopen(output[0], "r");
+  const char* marker = "[native] UDP on ";
+  char line[256];
+  bool listening = false;
+  while (!listening && fgets(line, sizeof(line), lines) != nullptr) {
+    listening = strncmp(line, marker, strlen(marker)) == 0;
+  }
+
+  // Keep the firmware's stdout drained so it never blocks on the pipe
+  std::thread([lines] {
+    char text[256];
+    while (fgets(text, sizeof(text), lines) != nullptr) {
+      if (verbose) {
+        fprintf(stderr, "[native] %s", text);
+      }
+    }
+  }).detach();
+  return listening;
+}
+
+int main(int argc, char** argv) {
+  const char* firmware = nullptr;
+  const char* robotAddress = nullptr;
+  int port = TELEOP_PORT;
+  int seconds = 3;
+  int rateHz = 100;
+  double loss = 0.2;
+  int jitter = 30;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--verbose") == 0) {
+      verbose = true;
+    } else if (i + 1 >= argc) {
+      break;
+    } else if (strcmp(argv[i], "--firmware") == 0) {
+      firmware = argv[++i];
+    } else if (strcmp(argv[i], "--robot") == 0) {
+      robotAddress = argv[++i];
+    } else if (strcmp(argv[i], "--port") == 0) {
+      port = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--seconds") == 0) {
+      seconds = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--rate") == 0) {
+      rateHz = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--loss") == 0) {
+      loss = std::min(std::max(atof(argv[++i]) / 100, 0.0), 0.99);
+    } else if (strcmp(argv[i], "--jitter") == 0) {
+      jitter = std::max(0, atoi(argv[++i]));
+    }
+  }
+  if ((firmware == nullptr) == (robotAddress == nullptr)) {
+    fprintf(stderr, "usage: %s --firmware PROGRAM | --robot ADDRESS [--port N] [--seconds N] [--rate HZ] "
+            "[--loss PCT] [--jitter MS] [--verbose]\n", argv[0]);
+    return 2;
+  }
+
+  pid_t child = -1;
+  if (firmware != nullptr) {
+    robotAddress = "127.0.0.1";
+    if (!startFirmware(firmware, port, seconds * 2 + 60, &child)) {
+      fprintf(stderr, "%s did not open UDP port %d\n", firmware, port);
+      return 1;
+    }
+  }
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sock < 0 || inet_pton(AF_INET, robotAddress, &address.sin_addr) != 1 ||
+      connect(sock, (sockaddr*)&address, sizeof(address)) != 0) {
+    fprintf(stderr, "cannot reach %s:%d\n", robotAddress, port);
+    return 1;
+  }
+  printf("robot: %s:%d\n", robotAddress, port);
+
+  randomState = operatorMicros() | 1;
+  session = nextRandom();
+
+  // The firmware may still be booting
+  bool up = false;
+  for (int attempt = 0; attempt < 50 && !up; attempt++) {
+    up = requestStats();
+  }
+  check(up, "robot answers");
+  if (up) {
+    testClean(rateHz, seconds);
+    testImpaired(rateHz, seconds, loss, jitter);
+    testLate();
+    testForeign();
+    requestStats();
+    printRobotHistogram();
+    testDeadman(rateHz);
+  }
+
+  close(sock);
+  if (child > 0) {
+    kill(child, SIGTERM);
+    waitpid(child, nullptr, 0);
+  }
+  printf("%s (%d failed)\n", failures == 0 ? "ALL PASSED" : "FAILED", failures);
+  return failures == 0 ? 0 : 1;
+}
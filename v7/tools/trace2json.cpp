@@ -0,0 +1,180 @@
+// Converts a v7 event trace into Chrome/Perfetto trace JSON.
+//
+// Capture the serial output of a build with -DENABLE_TRACE into a file,
+// then run:
+//
+//   g++ -O2 -o trace2json tools/trace2json.cpp
+//   ./trace2json serial.log > trace.json
+//
+// and open trace.json in https://ui.perfetto.dev or chrome://tracing.
+// Only the lines between "TRACE BEGIN" and "TRACE END" are used, so the
+// normal log output around the dump is ignored.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Must match TraceEventType in src/trace.h
+enum TraceEventType {
+  TRACE_PWM_WRITE = 1,
+  TRACE_SET_DIRECTION,
+  TRACE_MODE_SELECT,
+  TRACE_MOVEMENT_BEGIN,
+  TRACE_MOVEMENT_END,
+  TRACE_AUX_BEGIN,
+  TRACE_AUX_END,
+  TRACE_AUX_WRITE,
+  TRACE_FAULT_CHECK
+};
+
+struct Event {
+  uint32_t cycles;
+  uint8_t type;
+  uint8_t arg8;
+  uint16_t arg16;
+};
+
+// Must match MotorDirection and ModeID in src/
+static const char* DIRECTION_NAMES[] = {"FORWARD", "BACKWARD", "TURN_LEFT", "TURN_RIGHT", "STOP"};
+static const char* MODE_NAMES[] = {"Spin", "Wander", "Pulse", "Circle", "Zigzag", "Stop", "Rest"};
+
+static const char* lookup(const char* const* names, size_t count, unsigned index) {
+  return index < count ? names[index] : "?";
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static bool parseLine(const std::string& line, std::vector<Event>& events) {
+  std::vector<uint8_t> bytes;
+  for (size_t i = 0; i + 1 < line.size(); i += 2) {
+    int hi = hexValue(line[i]);
+    int lo = hexValue(line[i + 1]);
+    if (hi < 0 || lo < 0) {
+      break;
+    }
+    bytes.push_back((uint8_t)(hi << 4 | lo));
+  }
+  if (bytes.empty() || bytes.size() % 8 != 0) {
+    return false;
+  }
+  for (size_t i = 0; i < bytes.size(); i += 8) {
+    Event e;
+    e.cycles = bytes[i] | bytes[i + 1] << 8 | bytes[i + 2] << 16 | (uint32_t)bytes[i + 3] << 24;
+    e.type = bytes[i + 4];
+    e.arg8 = bytes[i + 5];
+    e.arg16 = bytes[i + 6] | bytes[i + 7] << 8;
+    events.push_back(e);
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    std::cerr << "usage: " << argv[0] << " <serial-log>\n";
+    return 1;
+  }
+
+  std::ifstream in(argv[1]);
+  if (!in) {
+    std::cerr << "cannot open " << argv[1] << "\n";
+    return 1;
+  }
+
+  std::vector<Event> events;
+  unsigned cpuMhz = 240;
+  bool inTrace = false;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (line.compare(0, 11, "TRACE BEGIN") == 0) {
+      unsigned mhz = 0, count = 0;
+      if (sscanf(line.c_str(), "TRACE BEGIN cpu_mhz=%u events=%u", &mhz, &count) == 2 && mhz > 0) {
+        cpuMhz = mhz;
+      }
+      events.clear();
+      inTrace = true;
+    } else if (line == "TRACE END") {
+      inTrace = false;
+    } else if (inTrace && !parseLine(line, events)) {
+      std::cerr << "skipping malformed line: " << line << "\n";
+    }
+  }
+
+  if (events.empty()) {
+    std::cerr << "no trace found in " << argv[1] << "\n";
+    return 1;
+  }
+
+  // Unwrap the 32-bit cycle counter (wraps every ~18 s at 240 MHz)
+  std::printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  uint64_t base = events[0].cycles;
+  uint64_t cycles = base;
+  uint32_t last = events[0].cycles;
+  bool first = true;
+
+  for (const Event& e : events) {
+    cycles += (uint32_t)(e.cycles - last);
+    last = e.cycles;
+    double ts = (double)(cycles - base) / cpuMhz;  // microseconds
+
+    char buf[256];
+    switch (e.type) {
+      case TRACE_PWM_WRITE:
+        snprintf(buf, sizeof(buf),
+                 "{\"name\":\"pwm ch%u\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":1,\"args\":{\"duty\":%u}}",
+                 e.arg8, ts, e.arg16);
+        break;
+      case TRACE_SET_DIRECTION:
+        snprintf(buf, sizeof(buf),
+                 "{\"name\":\"setDirection %s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":1}",
+                 lookup(DIRECTION_NAMES, 5, e.arg8), ts);
+        break;
+      case TRACE_MODE_SELECT:
+        snprintf(buf, sizeof(buf),
+                 "{\"name\":\"mode %s\",\"ph\":\"i\",\"s\":\"p\",\"ts\":%.3f,\"pid\":1,\"tid\":1,\"args\":{\"duration_s\":%u}}",
+                 lookup(MODE_NAMES, 7, e.arg8), ts, e.arg16);
+        break;
+      case TRACE_MOVEMENT_BEGIN:
+      case TRACE_MOVEMENT_END:
+        snprintf(buf, sizeof(buf),
+                 "{\"name\":\"movement %s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":1}",
+                 lookup(MODE_NAMES, 7, e.arg8), e.type == TRACE_MOVEMENT_BEGIN ? "B" : "E", ts);
+        break;
+      case TRACE_AUX_BEGIN:
+      case TRACE_AUX_END:
+        snprintf(buf, sizeof(buf),
+                 "{\"name\":\"aux %s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":2}",
+                 lookup(MODE_NAMES, 7, e.arg8), e.type == TRACE_AUX_BEGIN ? "B" : "E", ts);
+        break;
+      case TRACE_AUX_WRITE:
+        snprintf(buf, sizeof(buf),
+                 "{\"name\":\"aux pin\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":2,\"args\":{\"state\":%u}}",
+                 ts, e.arg8);
+        break;
+      case TRACE_FAULT_CHECK:
+        snprintf(buf, sizeof(buf),
+                 "{\"name\":\"checkFault\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":1,\"args\":{\"fault\":%u}}",
+                 ts, e.arg8);
+        break;
+      default:
+        continue;
+    }
+
+    std::printf("%s%s", first ? "" : ",\n", buf);
+    first = false;
+  }
+
+  std::printf("\n]}\n");
+  return 0;
+}